@@ -0,0 +1,77 @@
+// Serial versus scheduler-parallel accessibility analysis on wide, balanced
+// and deep trees, for both the Node tree and FlatDocument inputs, at a few
+// parallel thresholds.
+//
+// usage: openperf_a11y_bench [workers]
+#include "openperf/accessibility.hpp"
+#include "openperf/flat_document.hpp"
+#include "openperf/task_scheduler.hpp"
+
+#include "bench_common.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+struct Shape {
+    const char* name;
+    std::shared_ptr<Node> (*make)(std::size_t);
+};
+
+std::shared_ptr<Node> wide(std::size_t n) { return makeTree(n, n); }
+std::shared_ptr<Node> balanced(std::size_t n) { return makeTree(n, 4); }
+// Node's destructor recurses, so chains stay short enough to free safely.
+std::shared_ptr<Node> deep(std::size_t n) { return makeDeepTree(std::min<std::size_t>(n, 20000)); }
+
+}
+
+int main(int argc, char** argv) {
+    std::size_t workers = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                   : std::max(1u, std::thread::hardware_concurrency());
+
+    TaskScheduler scheduler(workers);
+    scheduler.start();
+
+    const std::size_t thresholds[] = {1024, 16384, 65536};
+    const Shape shapes[] = {{"wide", wide}, {"balanced", balanced}, {"deep", deep}};
+    const std::size_t sizes[] = {1000, 10000, 100000, 500000};
+
+    AccessibilityAnalyzer serial;
+    std::printf("%zu workers; times in microseconds per analysis\n", workers);
+    std::printf("%-9s %8s %6s %12s", "shape", "nodes", "input", "serial");
+    for (auto t : thresholds) std::printf("   par@%-6zu", t);
+    std::printf("\n");
+
+    for (const auto& shape : shapes) {
+        for (auto size : sizes) {
+            Page page;
+            page.root = shape.make(size);
+            auto doc = FlatDocument::fromTree(*page.root);
+            if (shape.make == deep && size > doc.size()) continue; // capped above
+            std::size_t iters = std::max<std::size_t>(1, 2000000 / doc.size() / 10);
+
+            for (int flat = 0; flat < 2; ++flat) {
+                auto analyze = [&](const AccessibilityAnalyzer& a) {
+                    return nsPerOp([&] { doNotOptimize(flat ? a.analyze(doc) : a.analyze(page)); }, iters) / 1e3;
+                };
+                std::printf("%-9s %8zu %6s %12.1f", shape.name, doc.size(), flat ? "flat" : "tree", analyze(serial));
+                for (auto t : thresholds) {
+                    AccessibilityAnalyzer::Options options;
+                    options.parallelThreshold = t;
+                    AccessibilityAnalyzer parallel(&scheduler, options);
+                    std::printf(" %12.1f", analyze(parallel));
+                }
+                std::printf("\n");
+            }
+        }
+    }
+
+    scheduler.stop();
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Cost per node of the accessibility rule engine as the rule count grows:
+// rules dispatched by tag atom versus the same rules each run on every node
+// and filtering by tag themselves (the old hard-coded chain).
+//
+// usage: openperf_a11y_rules_bench [nodes]
+#include "openperf/accessibility.hpp"
+#include "openperf/flat_document.hpp"
+
+#include "bench_common.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+const char* kRuleTags[] = {"div", "span", "p", "img", "button", "a", "h2", "li", "section",
+                           "input", "label", "nav", "table", "video", "form", "select"};
+
+// Defaults plus `extra` synthetic rules spread over kRuleTags. Each reports
+// a rarely-true condition so the cost is dispatch and checking, not issues.
+std::shared_ptr<const RuleRegistry> makeRegistry(std::size_t extra, bool dispatch) {
+    auto registry = std::make_shared<RuleRegistry>();
+    registry->addDefaultRules();
+    for (std::size_t r = 0; r < extra; ++r) {
+        Atom tag = AtomTable::global().intern(kRuleTags[r % std::size(kRuleTags)]);
+        std::string code = "SYNTHETIC_" + std::to_string(r);
+        auto check = [code, r](const RuleNode& node, std::vector<AccessibilityIssue>& out) {
+            if (node.text.size() == 3 + r % 5 && node.ariaLabel.empty()) {
+                out.emplace_back(code, "synthetic rule", Severity::Info, std::string(node.id));
+            }
+        };
+        if (dispatch) {
+            registry->add(std::make_unique<FunctionRule>(RuleSelector::tags({tag}), check));
+        } else {
+            registry->add(std::make_unique<FunctionRule>(RuleSelector::everyNode(),
+                [tag, check](const RuleNode& node, std::vector<AccessibilityIssue>& out) {
+                    if (node.tag == tag) check(node, out);
+                }));
+        }
+    }
+    return registry;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::size_t nodes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+    Page page;
+    page.root = makeTree(nodes, 8);
+    auto doc = FlatDocument::fromTree(*page.root);
+
+    std::printf("%zu nodes; ns per node\n", doc.size());
+    std::printf("%6s %6s %14s %14s %14s %14s\n", "rules", "input", "dispatched", "every-node", "speedup", "issues");
+    for (std::size_t extra : {0, 10, 25, 50, 100}) {
+        AccessibilityAnalyzer::Options dispatched, everyNode;
+        dispatched.rules = makeRegistry(extra, true);
+        everyNode.rules = makeRegistry(extra, false);
+        AccessibilityAnalyzer fast(nullptr, dispatched), slow(nullptr, everyNode);
+
+        for (int flat = 0; flat < 2; ++flat) {
+            std::size_t issues = 0;
+            auto perNode = [&](const AccessibilityAnalyzer& analyzer) {
+                return nsPerOp([&] {
+                    auto result = flat ? analyzer.analyze(doc) : analyzer.analyze(page);
+                    issues = result.size();
+                    doNotOptimize(result.data());
+                }, 5) / static_cast<double>(doc.size());
+            };
+            double a = perNode(fast);
+            double b = perNode(slow);
+            std::printf("%6zu %6s %14.1f %14.1f %13.2fx %14zu\n",
+                        dispatched.rules->size(), flat ? "flat" : "tree", a, b, b / a, issues);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+namespace openperf::bench {
+
+// Global heap counters, maintained by the operator new/delete replacements
+// in alloc_counter.cpp. Link that file into a benchmark to use them.
+struct AllocStats {
+    std::size_t allocations = 0;
+    std::size_t liveBytes = 0;
+};
+
+AllocStats allocStats();
+
+}
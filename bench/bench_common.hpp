@@ -0,0 +1,166 @@
+#pragma once
+
+#include "openperf/page.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace openperf::bench {
+
+// Small deterministic PRNG so runs are comparable across machines.
+struct Rng {
+    std::uint64_t state;
+    explicit Rng(std::uint64_t seed = 42) : state(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+    std::uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+    std::size_t below(std::size_t n) { return static_cast<std::size_t>(next() % n); }
+};
+
+// Synthetic page tree: `nodes` nodes, each with up to `fanout` children,
+// filled breadth-first with a mix of tags. Roughly a third of img/button/a
+// elements are missing labels so the analyzer has issues to report.
+inline std::shared_ptr<Node> makeTree(std::size_t nodes, std::size_t fanout, std::uint64_t seed = 42) {
+    static const char* kTags[] = {"div", "div", "span", "p", "img", "button", "a", "h2", "li", "section"};
+    Rng rng(seed);
+
+    auto makeNode = [&](std::size_t i) {
+        auto n = std::make_shared<Node>();
+        n->tag = kTags[rng.below(std::size(kTags))];
+        n->id = "n" + std::to_string(i);
+        if (rng.below(3) != 0) n->text = "Lorem ipsum dolor sit amet " + std::to_string(i);
+        if (n->tag == "button" || n->tag == "a") n->isInteractive = true;
+        if (rng.below(5) == 0) n->ariaLabel = "label " + std::to_string(i);
+        return n;
+    };
+
+    auto root = makeNode(0);
+    root->tag = "body";
+    std::vector<Node*> frontier{root.get()};
+    std::size_t made = 1;
+    for (std::size_t head = 0; made < nodes && head < frontier.size(); ++head) {
+        for (std::size_t c = 0; c < fanout && made < nodes; ++c) {
+            auto child = makeNode(made++);
+            frontier.push_back(child.get());
+            frontier[head]->children.push_back(std::move(child));
+        }
+    }
+    return root;
+}
+
+// Size and make-up of a generated page for makeTree(const TreeShape&).
+struct TreeShape {
+    std::size_t nodes = 2000;
+    std::size_t depth = 12;  // longest root-to-leaf path, in nodes
+    std::size_t fanout = 8;  // children per node in the breadth-first fill
+    // tags drawn by weight; empty for makeTree's default mix
+    std::vector<std::pair<std::string, unsigned>> tags;
+};
+
+// Like makeTree(nodes, fanout), but a chain from the root first reaches
+// `depth` levels, the rest is filled breadth-first no deeper than that, and
+// tags are drawn from `shape.tags`.
+inline std::shared_ptr<Node> makeTree(const TreeShape& shape, std::uint64_t seed = 42) {
+    static const std::vector<std::pair<std::string, unsigned>> kDefaultTags = {
+        {"div", 2}, {"span", 1}, {"p", 1}, {"img", 1}, {"button", 1}, {"a", 1}, {"h2", 1}, {"li", 1}, {"section", 1}};
+    const auto& tags = shape.tags.empty() ? kDefaultTags : shape.tags;
+    unsigned totalWeight = 0;
+    for (const auto& [tag, weight] : tags) totalWeight += weight;
+    Rng rng(seed);
+
+    auto makeNode = [&](std::size_t i) {
+        auto n = std::make_shared<Node>();
+        std::size_t pick = rng.below(std::max(1u, totalWeight));
+        for (const auto& [tag, weight] : tags) {
+            if (pick < weight) {
+                n->tag = tag;
+                break;
+            }
+            pick -= weight;
+        }
+        n->id = "n" + std::to_string(i);
+        if (rng.below(3) != 0) n->text = "Lorem ipsum dolor sit amet " + std::to_string(i);
+        if (n->tag == "button" || n->tag == "a") n->isInteractive = true;
+        if (rng.below(5) == 0) n->ariaLabel = "label " + std::to_string(i);
+        return n;
+    };
+
+    auto root = makeNode(0);
+    root->tag = "body";
+    std::vector<std::pair<Node*, std::size_t>> frontier{{root.get(), 1}}; // node, its depth
+    std::size_t made = 1;
+    for (std::size_t level = 1; level < shape.depth && made < shape.nodes; ++level) {
+        auto child = makeNode(made++);
+        frontier.emplace_back(child.get(), level + 1);
+        frontier[level - 1].first->children.push_back(std::move(child));
+    }
+    for (std::size_t head = 0; made < shape.nodes && head < frontier.size(); ++head) {
+        auto [parent, depth] = frontier[head];
+        if (depth >= shape.depth) continue;
+        while (parent->children.size() < shape.fanout && made < shape.nodes) {
+            auto child = makeNode(made++);
+            frontier.emplace_back(child.get(), depth + 1);
+            parent->children.push_back(std::move(child));
+        }
+    }
+    return root;
+}
+
+// A single chain `depth` nodes deep.
+inline std::shared_ptr<Node> makeDeepTree(std::size_t depth) {
+    auto root = std::make_shared<Node>();
+    root->tag = "div";
+    root->id = "d0";
+    Node* cur = root.get();
+    for (std::size_t i = 1; i < depth; ++i) {
+        auto child = std::make_shared<Node>();
+        child->tag = (i % 7 == 0) ? "img" : "div";
+        child->id = "d" + std::to_string(i);
+        Node* next = child.get();
+        cur->children.push_back(std::move(child));
+        cur = next;
+    }
+    return root;
+}
+
+// Best-of-`reps` average nanoseconds per call of fn() over `iters` calls.
+template <typename F>
+double nsPerOp(F&& fn, std::size_t iters, int reps = 3) {
+    double best = 1e300;
+    for (int r = 0; r < reps; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < iters; ++i) fn();
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / static_cast<double>(iters);
+        if (ns < best) best = ns;
+    }
+    return best;
+}
+
+// Command-line numbers: true only if all of `text` is one plain number
+// (no sign, no trailing characters) and it fits `out`.
+template <typename T>
+inline bool parseNumber(std::string_view text, T* out) {
+    if (text.empty() || text.front() == '-' || text.front() == '+') return false;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), *out);
+    return ec == std::errc{} && end == text.data() + text.size();
+}
+
+// Keeps the optimiser from discarding a computed value.
+template <typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+}
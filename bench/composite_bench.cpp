@@ -0,0 +1,112 @@
+// Compositor cost against the fraction of the viewport that changed. The
+// page is a column of 20px rows under two translucent absolute overlays;
+// each run recolors a share of the rows, either as one block (a widget
+// updating) or spread evenly (touching every tile row), then times damage
+// tracking plus compositing over the previous frame, next to compositing
+// the whole frame from scratch.
+//
+// usage: openperf_composite_bench [width] [height]
+#include "openperf/compositor.hpp"
+#include "openperf/flat_document.hpp"
+#include "openperf/layout.hpp"
+#include "openperf/paint.hpp"
+
+#include "bench_common.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+constexpr float kRowHeight = 20;
+
+// `changed` of the rows are recolored: the first ones, or every 1/changed-th.
+std::shared_ptr<Node> makePage(std::int32_t height, double changed, bool spread) {
+    auto root = std::make_shared<Node>();
+    root->tag = "body";
+    root->style.background = 0xffffffff;
+    const int rows = static_cast<int>(static_cast<float>(height) / kRowHeight) + 1;
+    for (int i = 0; i < rows; ++i) {
+        auto row = std::make_shared<Node>();
+        row->tag = "div";
+        row->style.height = kRowHeight;
+        row->text = "row " + std::to_string(i);
+        const bool recolor = spread ? static_cast<int>((i + 1) * changed) > static_cast<int>(i * changed)
+                                    : i < static_cast<int>(rows * changed);
+        row->style.background = recolor ? 0xffe0e0ff : (i % 2 ? 0xf4f4f4ff : 0xeaeaeaff);
+        root->children.push_back(std::move(row));
+    }
+    for (int i = 0; i < 2; ++i) {
+        auto overlay = std::make_shared<Node>();
+        overlay->tag = "div";
+        overlay->style.position = Style::Position::Absolute;
+        overlay->style.left = 100 + 300 * static_cast<float>(i);
+        overlay->style.top = 80;
+        overlay->style.width = 360;
+        overlay->style.height = 240;
+        overlay->style.background = 0x3366cc60;
+        overlay->style.borderWidth = 2;
+        overlay->style.borderColor = 0x3366ccff;
+        root->children.push_back(std::move(overlay));
+    }
+    return root;
+}
+
+std::vector<Layer> paintPage(const Node& root, const Painter& painter, const LayoutEngine& layout) {
+    auto doc = FlatDocument::fromTree(root);
+    return painter.paintLayers(doc, layout.layout(doc));
+}
+
+}
+
+int main(int argc, char** argv) {
+    const std::int32_t width = argc > 1 ? std::atoi(argv[1]) : 1280;
+    const std::int32_t height = argc > 2 ? std::atoi(argv[2]) : 720;
+
+    LayoutEngine::Options layoutOptions;
+    layoutOptions.viewportWidth = static_cast<float>(width);
+    LayoutEngine layout(layoutOptions);
+    Painter::Options paintOptions;
+    paintOptions.viewportWidth = width;
+    paintOptions.viewportHeight = height;
+    Painter painter(nullptr, paintOptions);
+    Compositor compositor;
+
+    auto baseLayers = paintPage(*makePage(height, 0, false), painter, layout);
+    const Frame base = compositor.composite(baseLayers, nullptr, Compositor::damage(nullptr, baseLayers));
+    const double viewport = static_cast<double>(width) * height;
+
+    std::printf("%dx%d, %zu layers, kernel %s\n", width, height, baseLayers.size(),
+                paintKernelName(compositor.kernel()));
+    std::printf("%-7s %8s %8s %10s %12s %10s %9s\n", "pattern", "changed", "damage", "damage ms", "composite ms",
+                "full ms", "speedup");
+    for (bool spread : {false, true}) {
+        for (double changed : {0.0, 0.05, 0.1, 0.25, 0.5, 1.0}) {
+            auto layers = paintPage(*makePage(height, changed, spread), painter, layout);
+
+            std::vector<DamageRect> damage;
+            double damageNs = nsPerOp([&] {
+                damage = Compositor::damage(&base, layers);
+                doNotOptimize(damage.data());
+            }, 50);
+            Frame frame;
+            double incrementalNs = nsPerOp([&] {
+                frame = compositor.composite(layers, &base, damage);
+                doNotOptimize(frame.tiles.data());
+            }, 50);
+            double fullNs = nsPerOp([&] {
+                Frame full = compositor.composite(layers, nullptr, {});
+                doNotOptimize(full.tiles.data());
+            }, 50);
+
+            const double total = damageNs + incrementalNs;
+            std::printf("%-7s %7.0f%% %7.1f%% %10.3f %12.3f %10.3f %8.1fx\n", spread ? "spread" : "block",
+                        changed * 100, 100.0 * static_cast<double>(frame.damagedPixels) / viewport,
+                        damageNs / 1e6, incrementalNs / 1e6, fullNs / 1e6, fullNs / total);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+// Compares the shared_ptr<Node> tree with FlatDocument: heap footprint,
+// plain traversal and full accessibility analysis.
+#include "openperf/accessibility.hpp"
+#include "openperf/flat_document.hpp"
+
+#include "alloc_counter.hpp"
+#include "bench_common.hpp"
+
+#include <cstdio>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+std::size_t countImagesTree(const Node& root) {
+    std::size_t count = 0;
+    std::vector<const Node*> stack{&root};
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+        if (n->tag == "img") ++count;
+        for (const auto& c : n->children) stack.push_back(c.get());
+    }
+    return count;
+}
+
+std::size_t countImagesFlat(const FlatDocument& doc) {
+    std::size_t count = 0;
+    for (NodeIndex i = 0; i < doc.size(); ++i)
+        if (doc.tag(i) == atoms::Img) ++count;
+    return count;
+}
+
+}
+
+int main() {
+    AccessibilityAnalyzer analyzer;
+
+    std::printf("%8s %12s %12s %8s %12s %12s %12s %12s\n",
+                "nodes", "tree_bytes", "flat_bytes", "ratio",
+                "tree_walk_ns", "flat_walk_ns", "tree_a11y_ns", "flat_a11y_ns");
+
+    for (std::size_t nodes : {1000u, 10000u, 50000u, 100000u, 250000u}) {
+        auto before = allocStats().liveBytes;
+        auto tree = makeTree(nodes, 8);
+        auto treeBytes = allocStats().liveBytes - before;
+
+        before = allocStats().liveBytes;
+        auto doc = std::make_shared<const FlatDocument>(FlatDocument::fromTree(*tree));
+        auto flatBytes = allocStats().liveBytes - before;
+
+        std::size_t iters = std::max<std::size_t>(1, 2'000'000 / nodes);
+
+        double treeWalk = nsPerOp([&] { doNotOptimize(countImagesTree(*tree)); }, iters);
+        double flatWalk = nsPerOp([&] { doNotOptimize(countImagesFlat(*doc)); }, iters);
+
+        Page treePage;
+        treePage.root = tree;
+        double treeA11y = nsPerOp([&] { doNotOptimize(analyzer.analyze(treePage).size()); }, iters);
+        double flatA11y = nsPerOp([&] { doNotOptimize(analyzer.analyze(*doc).size()); }, iters);
+
+        std::printf("%8zu %12zu %12zu %7.2fx %12.0f %12.0f %12.0f %12.0f\n",
+                    nodes, treeBytes, flatBytes,
+                    static_cast<double>(treeBytes) / static_cast<double>(flatBytes),
+                    treeWalk, flatWalk, treeA11y, flatA11y);
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Cost of the layout stage on synthetic page shapes: wide (one parent, many
+// children), deep (a single chain), the usual mixed tree, and flex-heavy
+// (nested flex rows and columns with growing items).
+//
+// usage: openperf_layout_bench [nodes]
+#include "openperf/flat_document.hpp"
+#include "openperf/layout.hpp"
+
+#include "bench_common.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+std::shared_ptr<Node> makeWideTree(std::size_t nodes) {
+    auto root = std::make_shared<Node>();
+    root->tag = "body";
+    Rng rng(3);
+    for (std::size_t i = 1; i < nodes; ++i) {
+        auto child = std::make_shared<Node>();
+        child->tag = rng.below(3) ? "span" : "div";
+        child->text = "item " + std::to_string(i);
+        root->children.push_back(std::move(child));
+    }
+    return root;
+}
+
+// Flex containers nested breadth-first, alternating direction per level;
+// leaves carry text and a third of the items grow.
+std::shared_ptr<Node> makeFlexTree(std::size_t nodes, std::size_t fanout) {
+    Rng rng(5);
+    auto root = std::make_shared<Node>();
+    root->tag = "body";
+    root->style.display = Style::Display::Flex;
+    std::vector<std::pair<Node*, std::size_t>> frontier{{root.get(), 0}};
+    std::size_t made = 1;
+    for (std::size_t head = 0; made < nodes && head < frontier.size(); ++head) {
+        auto [parent, level] = frontier[head];
+        for (std::size_t c = 0; c < fanout && made < nodes; ++c, ++made) {
+            auto child = std::make_shared<Node>();
+            child->tag = "div";
+            child->style.display = Style::Display::Flex;
+            child->style.flexDirection = level % 2 ? Style::FlexDirection::Row : Style::FlexDirection::Column;
+            child->style.margin = 2;
+            child->style.padding = 4;
+            if (rng.below(3) == 0) child->style.flexGrow = 1;
+            if (rng.below(2) == 0) child->text = "flex item";
+            frontier.emplace_back(child.get(), level + 1);
+            parent->children.push_back(std::move(child));
+        }
+    }
+    return root;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::size_t nodes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+    struct Shape {
+        const char* name;
+        std::shared_ptr<Node> root;
+    };
+    // the deep chain stays short enough for the recursive Node destructor
+    Shape shapes[] = {
+        {"wide", makeWideTree(nodes)},
+        {"deep", makeDeepTree(std::min<std::size_t>(nodes, 20000))},
+        {"mixed", makeTree(nodes, 8)},
+        {"flex", makeFlexTree(nodes, 6)},
+    };
+
+    LayoutEngine engine;
+    std::printf("%-8s %10s %12s %12s %14s\n", "shape", "nodes", "ms/layout", "ns/node", "page height");
+    for (const auto& shape : shapes) {
+        auto doc = FlatDocument::fromTree(*shape.root);
+        BoxArray boxes;
+        double ns = nsPerOp([&] {
+            boxes = engine.layout(doc);
+            doNotOptimize(boxes.x.data());
+        }, 10);
+        std::printf("%-8s %10zu %12.3f %12.1f %14.0f\n", shape.name, doc.size(), ns / 1e6,
+                    ns / static_cast<double>(doc.size()), boxes.height[0]);
+    }
+    return 0;
+}
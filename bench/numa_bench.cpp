@@ -0,0 +1,138 @@
+// Worker placement: render throughput and latency with the scheduler's
+// workers unpinned, pinned per NUMA node and pinned per CPU.
+//
+// Each mode builds an engine, submits distinct pages (more than the render
+// cache holds, so every render does the work) and renders all of them in
+// batches. With an affinity set, each page is handed to the next node in
+// turn and its renders stay on that node, so its boxes and tiles are read
+// from local memory.
+//
+// On a single-node machine Node and Cpu affinity differ from None only by
+// the pinning itself. Pass a node count to split the usable CPUs into that
+// many pretend nodes and exercise the per-node queues anyway.
+//
+// usage: openperf_numa_bench [rounds] [pretend nodes]
+#include "openperf/cpu_topology.hpp"
+#include "openperf/engine.hpp"
+
+#include "bench_common.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// More distinct pages than the render cache holds at the default viewport.
+constexpr std::size_t kPages = 64;
+constexpr std::size_t kTreeNodes = 2000;
+
+struct Percentiles {
+    double p50 = 0, p99 = 0;
+};
+
+Percentiles percentiles(std::vector<double> ms) {
+    if (ms.empty()) return {};
+    std::sort(ms.begin(), ms.end());
+    return {ms[ms.size() / 2], ms[ms.size() * 99 / 100]};
+}
+
+struct ModeResult {
+    double rendersPerSec = 0;
+    Percentiles runMs;    // first stage start to last stage end
+    Percentiles totalMs;  // submission to completion
+    std::size_t nodes = 0;
+    std::size_t pinned = 0;
+};
+
+ModeResult runMode(WorkerAffinity affinity, const CpuTopology& topology, std::size_t rounds) {
+    Engine::Options options;
+    options.scheduler.affinity = affinity;
+    options.scheduler.topology = topology;
+    Engine engine(options);
+    engine.start();
+
+    std::vector<std::string> ids;
+    for (std::size_t i = 0; i < kPages; ++i) {
+        Page page;
+        page.root = makeTree(kTreeNodes, 4, i + 1);
+        ids.push_back(engine.submitPage(std::move(page)));
+    }
+    waitAll(engine.renderBatch(ids)); // warm-up
+
+    using ms = std::chrono::duration<double, std::milli>;
+    std::vector<double> run, total;
+    const auto start = Clock::now();
+    for (std::size_t round = 0; round < rounds; ++round) {
+        for (const auto& handle : engine.renderBatch(ids)) {
+            const auto& result = handle.wait();
+            run.push_back(ms(result.runTime()).count());
+            total.push_back(ms(result.completed - result.submitted).count());
+        }
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    ModeResult result;
+    result.rendersPerSec = static_cast<double>(run.size()) / seconds;
+    result.runMs = percentiles(std::move(run));
+    result.totalMs = percentiles(std::move(total));
+    result.nodes = engine.scheduler().nodeCount();
+    result.pinned = engine.scheduler().pinnedWorkers();
+    engine.stop();
+    return result;
+}
+
+// The usable CPUs dealt round-robin into `nodes` pretend nodes.
+CpuTopology pretendNodes(const CpuTopology& real, std::size_t nodes) {
+    const auto cpus = real.cpuIds();
+    std::vector<std::vector<int>> split(std::min(nodes, cpus.size()));
+    for (std::size_t i = 0; i < cpus.size(); ++i) split[i % split.size()].push_back(cpus[i]);
+    return CpuTopology::fromNodes(split);
+}
+
+int usage(int status = 1) {
+    std::fprintf(status == 0 ? stdout : stderr, "usage: openperf_numa_bench [rounds] [pretend nodes]\n");
+    return status;
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && (std::string_view(argv[1]) == "--help" || std::string_view(argv[1]) == "-h")) return usage(0);
+    std::size_t rounds = 20;
+    std::size_t pretend = 0;
+    if (argc > 3 || (argc > 1 && (!parseNumber(argv[1], &rounds) || rounds == 0)) ||
+        (argc > 2 && !parseNumber(argv[2], &pretend))) {
+        return usage();
+    }
+
+    // Engine::submitPage logs every page; keep that out of the measurements.
+    std::cout.rdbuf(nullptr);
+
+    const auto detected = CpuTopology::detect();
+    const auto topology = pretend > 1 ? pretendNodes(detected, pretend) : detected;
+    std::printf("detected: %s\n", detected.describe().c_str());
+    if (pretend > 1) std::printf("pretend:  %s\n", topology.describe().c_str());
+    if (topology.nodeCount() == 1) {
+        std::printf("one node: pinned modes differ from unpinned only by pinning\n");
+    }
+
+    std::printf("\n%zu pages x %zu nodes, %zu rounds\n", kPages, kTreeNodes, rounds);
+    std::printf("%-8s %6s %7s %11s %9s %9s %11s %11s\n", "affinity", "nodes", "pinned", "renders/s", "run p50",
+                "run p99", "total p50", "total p99");
+    for (auto affinity : {WorkerAffinity::None, WorkerAffinity::Node, WorkerAffinity::Cpu}) {
+        const auto r = runMode(affinity, topology, rounds);
+        std::printf("%-8s %6zu %7zu %11.0f %9.3f %9.3f %11.3f %11.3f\n", toString(affinity), r.nodes, r.pinned,
+                    r.rendersPerSec, r.runMs.p50, r.runMs.p99, r.totalMs.p50, r.totalMs.p99);
+    }
+    return 0;
+}
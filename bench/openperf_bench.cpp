@@ -0,0 +1,481 @@
+// Repeatable suite over the engine's core paths, at a controlled number of
+// client threads:
+//
+//   submit_page         Engine::submitPage (hash, flatten, store)
+//   render_pipeline     Engine::runRenderPipeline, waiting for completion, over
+//                       more distinct pages than the render cache holds
+//   render_cached       the same for one page, served from the render cache
+//   a11y_analyze        AccessibilityAnalyzer over a page's flat DOM, uncached
+//   a11y_engine         Engine::analyzeAccessibility, served from its cache
+//   metrics_record      Metrics::record on one histogram
+//   scheduler_roundtrip TaskScheduler::enqueue of empty tasks until they ran
+//
+// Pages are generated from --nodes/--depth/--fanout/--tags. Each case runs
+// --repetitions times for --min-ms per thread count; the median repetition is
+// reported. Results go to stdout (or --out) as JSON and to stderr as a table.
+// With --baseline, ns_per_op is compared against an earlier run's JSON and
+// cases slower by more than --threshold percent are flagged; the exit status
+// is then 2.
+//
+// usage: openperf_bench [--filter S] [--threads 1,4] [--nodes N] [--depth D]
+//                       [--fanout F] [--tags div=4,img=1,...] [--min-ms M]
+//                       [--repetitions R] [--out FILE] [--baseline FILE]
+//                       [--threshold PCT]
+#include "openperf/accessibility.hpp"
+#include "openperf/engine.hpp"
+#include "openperf/flat_document.hpp"
+#include "openperf/metrics.hpp"
+#include "openperf/task_scheduler.hpp"
+
+#include "bench_common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// More distinct pages than the render cache holds at the default viewport.
+constexpr std::size_t kDistinctPages = 64;
+
+struct Config {
+    std::string filter;
+    std::vector<std::size_t> threads;
+    TreeShape shape;
+    std::string tags = "default";
+    int minMs = 200;
+    int repetitions = 3;
+    std::string out;
+    std::string baseline;
+    double threshold = 10;
+};
+
+// One benchmark: run(thread, first, count) performs `count` operations on
+// behalf of client `thread`; `batch` operations are timed together, so cheap
+// operations are not dominated by reading the clock.
+struct Case {
+    std::string name;
+    std::size_t batch;
+    std::function<void(std::size_t thread, std::size_t first, std::size_t count)> run;
+};
+
+struct Result {
+    std::string name;
+    std::size_t threads = 0;
+    std::uint64_t ops = 0;
+    double seconds = 0;
+    double opsPerSec = 0;
+    double nsPerOp = 0; // per thread, i.e. latency of one operation
+    double p50Ns = 0;
+    double p99Ns = 0;
+    double spreadPct = 0; // range of nsPerOp across repetitions, relative to the median
+};
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(p * static_cast<double>(sorted.size())))];
+}
+
+// One repetition of `c` with `threads` clients for at least `minMs`.
+Result measure(const Case& c, std::size_t threads, int minMs) {
+    std::atomic<std::size_t> ready{0};
+    std::atomic<bool> go{false}, done{false};
+    std::vector<std::vector<double>> samples(threads); // ns per op, one per batch
+    std::vector<std::uint64_t> ops(threads, 0);
+    std::vector<std::thread> clients;
+
+    for (std::size_t t = 0; t < threads; ++t) {
+        clients.emplace_back([&, t] {
+            c.run(t, 0, c.batch); // warm up
+            std::size_t next = c.batch;
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            while (!done.load(std::memory_order_relaxed)) {
+                auto t0 = Clock::now();
+                c.run(t, next, c.batch);
+                auto t1 = Clock::now();
+                samples[t].push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() /
+                                     static_cast<double>(c.batch));
+                next += c.batch;
+                ops[t] += c.batch;
+            }
+        });
+    }
+
+    while (ready.load() < threads) std::this_thread::yield();
+    auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::milliseconds(minMs));
+    done.store(true);
+    for (auto& client : clients) client.join();
+
+    Result r;
+    r.name = c.name + "/threads:" + std::to_string(threads);
+    r.threads = threads;
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::vector<double> all;
+    double busyNs = 0;
+    for (std::size_t t = 0; t < threads; ++t) {
+        r.ops += ops[t];
+        for (double ns : samples[t]) busyNs += ns * static_cast<double>(c.batch);
+        all.insert(all.end(), samples[t].begin(), samples[t].end());
+    }
+    std::sort(all.begin(), all.end());
+    r.opsPerSec = static_cast<double>(r.ops) / r.seconds;
+    r.nsPerOp = r.ops ? busyNs / static_cast<double>(r.ops) : 0;
+    r.p50Ns = percentile(all, 0.50);
+    r.p99Ns = percentile(all, 0.99);
+    return r;
+}
+
+// Median repetition by nsPerOp, with the spread of all of them.
+Result measureRepeated(const Case& c, std::size_t threads, int minMs, int repetitions) {
+    std::vector<Result> reps;
+    for (int i = 0; i < repetitions; ++i) reps.push_back(measure(c, threads, minMs));
+    std::sort(reps.begin(), reps.end(), [](const Result& a, const Result& b) { return a.nsPerOp < b.nsPerOp; });
+    Result r = reps[reps.size() / 2];
+    if (r.nsPerOp > 0) r.spreadPct = 100 * (reps.back().nsPerOp - reps.front().nsPerOp) / r.nsPerOp;
+    return r;
+}
+
+std::string jsonEscape(std::string_view s) {
+    std::string out;
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') out += '\\';
+        out += ch;
+    }
+    return out;
+}
+
+std::string shapeString(const Config& config) {
+    return "nodes=" + std::to_string(config.shape.nodes) + " depth=" + std::to_string(config.shape.depth) +
+           " fanout=" + std::to_string(config.shape.fanout) + " tags=" + config.tags;
+}
+
+std::string toJson(const Config& config, const std::vector<Result>& results) {
+    std::ostringstream os;
+    os.precision(6);
+    os << "{\n  \"context\": {\n"
+       << "    \"shape\": \"" << jsonEscape(shapeString(config)) << "\",\n"
+       << "    \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+       << "    \"min_ms\": " << config.minMs << ",\n"
+       << "    \"repetitions\": " << config.repetitions << ",\n"
+#ifdef NDEBUG
+       << "    \"assertions\": false\n"
+#else
+       << "    \"assertions\": true\n"
+#endif
+       << "  },\n  \"benchmarks\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        os << (i ? ",\n" : "\n") << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"threads\": " << r.threads
+           << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds << ", \"ops_per_sec\": " << r.opsPerSec
+           << ", \"ns_per_op\": " << r.nsPerOp << ", \"p50_ns\": " << r.p50Ns << ", \"p99_ns\": " << r.p99Ns
+           << ", \"spread_pct\": " << r.spreadPct << "}";
+    }
+    os << "\n  ]\n}\n";
+    return os.str();
+}
+
+// Field lookups in JSON this tool wrote: flat objects, no escaped quotes in
+// the values we read.
+std::optional<std::string> stringField(std::string_view object, std::string_view key) {
+    auto at = object.find("\"" + std::string(key) + "\"");
+    if (at == std::string_view::npos) return std::nullopt;
+    auto open = object.find('"', object.find(':', at) + 1);
+    auto close = object.find('"', open + 1);
+    if (open == std::string_view::npos || close == std::string_view::npos) return std::nullopt;
+    return std::string(object.substr(open + 1, close - open - 1));
+}
+
+std::optional<double> numberField(std::string_view object, std::string_view key) {
+    auto at = object.find("\"" + std::string(key) + "\"");
+    if (at == std::string_view::npos) return std::nullopt;
+    auto colon = object.find(':', at);
+    if (colon == std::string_view::npos) return std::nullopt;
+    std::string rest(object.substr(colon + 1, 32));
+    char* end = nullptr;
+    double value = std::strtod(rest.c_str(), &end);
+    if (end == rest.c_str()) return std::nullopt;
+    return value;
+}
+
+struct Baseline {
+    std::string shape;
+    std::map<std::string, double> nsPerOp;
+};
+
+std::optional<Baseline> readBaseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) return std::nullopt;
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const std::string text = buffer.str();
+
+    Baseline baseline;
+    baseline.shape = stringField(text, "shape").value_or("");
+    auto at = text.find("\"benchmarks\"");
+    while (at != std::string::npos && (at = text.find('{', at)) != std::string::npos) {
+        auto end = text.find('}', at);
+        if (end == std::string::npos) break;
+        std::string_view object(text.data() + at, end - at);
+        auto name = stringField(object, "name");
+        auto ns = numberField(object, "ns_per_op");
+        if (name && ns) baseline.nsPerOp[*name] = *ns;
+        at = end;
+    }
+    return baseline;
+}
+
+// Prints the comparison to stderr; returns the number of regressions.
+std::size_t compare(const Baseline& baseline, const std::vector<Result>& results, const Config& config) {
+    if (baseline.shape != shapeString(config)) {
+        std::fprintf(stderr, "warning: baseline page shape '%s' differs from '%s'\n", baseline.shape.c_str(),
+                     shapeString(config).c_str());
+    }
+    std::fprintf(stderr, "\n%-34s %12s %12s %8s  %s\n", "vs baseline", "base ns/op", "ns/op", "change", "");
+    std::size_t regressions = 0;
+    for (const auto& r : results) {
+        auto it = baseline.nsPerOp.find(r.name);
+        if (it == baseline.nsPerOp.end() || it->second <= 0) {
+            std::fprintf(stderr, "%-34s %12s %12.0f %8s  new\n", r.name.c_str(), "-", r.nsPerOp, "-");
+            continue;
+        }
+        const double change = 100 * (r.nsPerOp - it->second) / it->second;
+        const char* verdict = "";
+        if (change > config.threshold) {
+            verdict = "REGRESSION";
+            ++regressions;
+        } else if (change < -config.threshold) {
+            verdict = "improved";
+        }
+        std::fprintf(stderr, "%-34s %12.0f %12.0f %+7.1f%%  %s\n", r.name.c_str(), it->second, r.nsPerOp, change,
+                     verdict);
+    }
+    return regressions;
+}
+
+// "1,4" -> {1, 4}; false unless every item is a positive number.
+bool parseList(const std::string& text, std::vector<std::size_t>* values) {
+    values->clear();
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        std::size_t value = 0;
+        if (!parseNumber(item, &value) || value == 0) return false;
+        values->push_back(value);
+    }
+    return !values->empty();
+}
+
+// "div=4,img=1" -> weighted tags; a bare tag weighs 1. False on an empty
+// tag or a weight that isn't a positive number.
+bool parseTags(const std::string& text, std::vector<std::pair<std::string, unsigned>>* tags) {
+    tags->clear();
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        auto eq = item.find('=');
+        unsigned weight = 1;
+        if (eq == 0 || item.empty()) return false;
+        if (eq != std::string::npos && (!parseNumber(std::string_view(item).substr(eq + 1), &weight) || weight == 0)) {
+            return false;
+        }
+        tags->emplace_back(item.substr(0, eq), weight);
+    }
+    return !tags->empty();
+}
+
+int usage(int status = 1) {
+    std::fprintf(status == 0 ? stdout : stderr,
+                 "usage: openperf_bench [--filter S] [--threads 1,4] [--nodes N] [--depth D] [--fanout F]\n"
+                 "                      [--tags div=4,img=1,...] [--min-ms M] [--repetitions R]\n"
+                 "                      [--out FILE] [--baseline FILE] [--threshold PCT]\n");
+    return status;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") return usage(0);
+        if (i + 1 >= argc) return usage();
+        std::string value = argv[++i];
+        bool valid = true;
+        if (arg == "--filter") {
+            config.filter = value;
+        } else if (arg == "--threads") {
+            valid = parseList(value, &config.threads);
+        } else if (arg == "--nodes") {
+            valid = parseNumber(value, &config.shape.nodes);
+        } else if (arg == "--depth") {
+            valid = parseNumber(value, &config.shape.depth);
+        } else if (arg == "--fanout") {
+            valid = parseNumber(value, &config.shape.fanout);
+        } else if (arg == "--tags") {
+            config.tags = value;
+            valid = parseTags(value, &config.shape.tags);
+        } else if (arg == "--min-ms") {
+            valid = parseNumber(value, &config.minMs);
+        } else if (arg == "--repetitions") {
+            valid = parseNumber(value, &config.repetitions);
+        } else if (arg == "--out") {
+            config.out = value;
+        } else if (arg == "--baseline") {
+            config.baseline = value;
+        } else if (arg == "--threshold") {
+            valid = parseNumber(value, &config.threshold);
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return usage();
+        }
+        if (!valid) {
+            std::fprintf(stderr, "invalid value for %s: %s\n", arg.c_str(), value.c_str());
+            return usage();
+        }
+    }
+    if (config.threads.empty()) {
+        config.threads = {1};
+        if (auto hw = std::thread::hardware_concurrency(); hw > 1) config.threads.push_back(hw);
+    }
+    if (config.shape.nodes < 1 || config.shape.depth < 1 || config.shape.fanout < 1 || config.minMs < 1 ||
+        config.repetitions < 1) {
+        return usage();
+    }
+
+    std::optional<Baseline> baseline;
+    if (!config.baseline.empty() && !(baseline = readBaseline(config.baseline))) {
+        std::fprintf(stderr, "cannot read baseline %s\n", config.baseline.c_str());
+        return 1;
+    }
+
+    // Engine::submitPage logs every page; keep that out of the measurements.
+    std::cout.rdbuf(nullptr);
+
+    Engine engine;
+    engine.start();
+
+    std::vector<Page> pages;
+    std::vector<std::string> ids;
+    std::vector<FlatDocument> docs;
+    for (std::size_t i = 0; i < kDistinctPages; ++i) {
+        Page page;
+        page.id = "bench-" + std::to_string(i);
+        page.url = "https://example.com/bench/" + std::to_string(i);
+        page.root = makeTree(config.shape, i + 1);
+        docs.push_back(FlatDocument::fromTree(*page.root));
+        pages.push_back(page);
+        ids.push_back(engine.submitPage(std::move(page)));
+    }
+    if (docs[0].size() < config.shape.nodes) {
+        std::fprintf(stderr, "warning: depth %zu and fanout %zu fit only %zu nodes\n", config.shape.depth,
+                     config.shape.fanout, docs[0].size());
+    }
+
+    AccessibilityAnalyzer analyzer(&engine.scheduler());
+    Metrics metrics;
+    const MetricId metric = metrics.registerMetric("bench");
+    TaskScheduler scheduler;
+    scheduler.start();
+
+    auto renderAndWait = [&](const std::string& id) {
+        std::promise<void> rendered;
+        engine.runRenderPipeline(id, [&](RenderResult) { rendered.set_value(); });
+        rendered.get_future().wait();
+    };
+
+    const std::vector<Case> cases = {
+        {"submit_page", 1,
+         [&](std::size_t thread, std::size_t first, std::size_t count) {
+             for (std::size_t i = first; i < first + count; ++i) {
+                 doNotOptimize(engine.submitPage(pages[(thread + i) % pages.size()]));
+             }
+         }},
+        {"render_pipeline", 1,
+         [&](std::size_t thread, std::size_t first, std::size_t count) {
+             for (std::size_t i = first; i < first + count; ++i) renderAndWait(ids[(thread * 7 + i) % ids.size()]);
+         }},
+        {"render_cached", 1,
+         [&](std::size_t, std::size_t, std::size_t count) {
+             for (std::size_t i = 0; i < count; ++i) renderAndWait(ids[0]);
+         }},
+        {"a11y_analyze", 1,
+         [&](std::size_t thread, std::size_t first, std::size_t count) {
+             for (std::size_t i = first; i < first + count; ++i) {
+                 doNotOptimize(analyzer.analyze(docs[(thread + i) % docs.size()]).size());
+             }
+         }},
+        {"a11y_engine", 1,
+         [&](std::size_t thread, std::size_t first, std::size_t count) {
+             for (std::size_t i = first; i < first + count; ++i) {
+                 doNotOptimize(engine.analyzeAccessibility(ids[(thread + i) % ids.size()]).size());
+             }
+         }},
+        {"metrics_record", 1024,
+         [&](std::size_t, std::size_t first, std::size_t count) {
+             for (std::size_t i = first; i < first + count; ++i) metrics.record(metric, static_cast<double>(i & 1023));
+         }},
+        {"scheduler_roundtrip", 256,
+         [&](std::size_t, std::size_t, std::size_t count) {
+             std::atomic<std::size_t> ran{0};
+             for (std::size_t i = 0; i < count; ++i) {
+                 scheduler.enqueue([&ran] { ran.fetch_add(1, std::memory_order_release); });
+             }
+             while (ran.load(std::memory_order_acquire) < count) std::this_thread::yield();
+         }},
+    };
+
+    if (std::none_of(cases.begin(), cases.end(),
+                     [&](const Case& c) { return c.name.find(config.filter) != std::string::npos; })) {
+        std::fprintf(stderr, "no case matches --filter %s\n", config.filter.c_str());
+        return usage();
+    }
+
+    std::vector<Result> results;
+    std::fprintf(stderr, "pages: %s, %d x %d ms per point\n", shapeString(config).c_str(), config.repetitions,
+                 config.minMs);
+    std::fprintf(stderr, "%-34s %12s %12s %12s %12s %8s\n", "case", "ops/s", "ns/op", "p50 ns", "p99 ns", "spread");
+    for (const auto& c : cases) {
+        if (c.name.find(config.filter) == std::string::npos) continue;
+        for (std::size_t threads : config.threads) {
+            results.push_back(measureRepeated(c, threads, config.minMs, config.repetitions));
+            const auto& r = results.back();
+            std::fprintf(stderr, "%-34s %12.0f %12.0f %12.0f %12.0f %7.1f%%\n", r.name.c_str(), r.opsPerSec,
+                         r.nsPerOp, r.p50Ns, r.p99Ns, r.spreadPct);
+        }
+    }
+
+    scheduler.stop();
+    engine.stop();
+
+    const std::string json = toJson(config, results);
+    if (config.out.empty()) {
+        std::fwrite(json.data(), 1, json.size(), stdout);
+    } else if (!(std::ofstream(config.out) << json)) {
+        std::fprintf(stderr, "cannot write %s\n", config.out.c_str());
+        return 1;
+    }
+
+    if (baseline && compare(*baseline, results, config) > 0) return 2;
+    return 0;
+}
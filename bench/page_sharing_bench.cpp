@@ -0,0 +1,113 @@
+// Cost of handing a stored page to a render task: the old copy-by-value path
+// (optional<Page> lookup plus a by-value lambda capture) versus capturing the
+// shared PagePtr snapshot, plus the full Engine::runRenderPipeline call
+// (snapshot lookup and pipeline admission) for reference.
+#include "openperf/engine.hpp"
+
+#include "alloc_counter.hpp"
+#include "bench_common.hpp"
+
+#include <cstdio>
+#include <optional>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+// The pre-snapshot Engine storage, kept here only as a baseline.
+class CopyingStore {
+public:
+    void put(Page page) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto id = page.id;
+        pages_.insert_or_assign(id, std::move(page));
+    }
+
+    std::optional<Page> get(const std::string& id) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pages_.find(id);
+        if (it == pages_.end()) return std::nullopt;
+        return it->second;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Page> pages_;
+};
+
+Page makePage(std::size_t nodes) {
+    Page page;
+    page.id = "bench-page-with-a-realistic-identifier";
+    page.url = "https://www.example.com/some/fairly/long/path/index.html?utm_source=bench";
+    page.root = makeTree(nodes, 8);
+    return page;
+}
+
+struct Result {
+    double ns;
+    double allocsPerCall;
+};
+
+template <typename F>
+Result measure(F&& fn, std::size_t iters) {
+    auto before = allocStats().allocations;
+    double ns = nsPerOp(fn, iters, 1);
+    auto after = allocStats().allocations;
+    return {ns, static_cast<double>(after - before) / static_cast<double>(iters)};
+}
+
+}
+
+int main() {
+    constexpr std::size_t kIters = 200000;
+
+    std::printf("%8s %12s %12s %12s %12s %12s %12s\n",
+                "nodes", "copy_ns", "copy_allocs", "shared_ns", "shared_allocs",
+                "engine_ns", "engine_allocs");
+
+    for (std::size_t nodes : {100u, 10000u}) {
+        // workers are never started: tasks are queued, not run, so only the
+        // synchronous hand-off is measured
+        Engine engine;
+        engine.submitPage(makePage(nodes));
+
+        TaskScheduler scheduler(1);
+        CopyingStore store;
+        store.put(makePage(nodes));
+
+        std::mutex sharedMutex;
+        std::unordered_map<std::string, PagePtr> sharedStore;
+        {
+            auto page = std::make_shared<const Page>(makePage(nodes));
+            sharedStore.emplace(page->id, page);
+        }
+
+        auto copying = measure([&] {
+            auto maybePage = store.get("bench-page-with-a-realistic-identifier");
+            if (!maybePage) return;
+            Page pageCopy = *maybePage;
+            scheduler.enqueue([pageCopy]() { doNotOptimize(pageCopy.id.size()); });
+        }, kIters);
+
+        auto shared = measure([&] {
+            PagePtr page;
+            {
+                std::lock_guard<std::mutex> lock(sharedMutex);
+                auto it = sharedStore.find("bench-page-with-a-realistic-identifier");
+                if (it == sharedStore.end()) return;
+                page = it->second;
+            }
+            scheduler.enqueue([page = std::move(page)]() { doNotOptimize(page->id.size()); });
+        }, kIters);
+
+        auto full = measure([&] {
+            engine.runRenderPipeline("bench-page-with-a-realistic-identifier");
+        }, kIters);
+
+        std::printf("%8zu %12.1f %12.2f %12.1f %12.2f %12.1f %12.2f\n",
+                    nodes, copying.ns, copying.allocsPerCall, shared.ns, shared.allocsPerCall,
+                    full.ns, full.allocsPerCall);
+    }
+    return 0;
+}
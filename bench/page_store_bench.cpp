@@ -0,0 +1,107 @@
+// Multi-threaded lookup/submit throughput: a single mutex-guarded map (the
+// old Engine storage) versus the sharded PageStore.
+//
+// usage: openperf_page_store_bench [max_threads] [millis_per_point]
+#include "openperf/page_store.hpp"
+
+#include "bench_common.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+constexpr std::size_t kKeys = 10000;
+
+class MutexMapStore {
+public:
+    PagePtr find(const std::string& id) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pages_.find(id);
+        return it == pages_.end() ? nullptr : it->second;
+    }
+    void insert(PagePtr page) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pages_.insert_or_assign(page->id, std::move(page));
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, PagePtr> pages_;
+};
+
+// Returns million operations per second across all threads.
+template <typename Store>
+double run(Store& store, const std::vector<PagePtr>& pool, std::size_t threads,
+           unsigned lookupPercent, int millis) {
+    std::atomic<bool> go{false}, done{false};
+    std::atomic<std::size_t> ops{0};
+    std::vector<std::thread> workers;
+
+    for (std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            Rng rng(t + 1);
+            std::size_t local = 0;
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            while (!done.load(std::memory_order_relaxed)) {
+                const PagePtr& page = pool[rng.below(pool.size())];
+                if (rng.below(100) < lookupPercent) {
+                    doNotOptimize(store.find(page->id).get());
+                } else {
+                    store.insert(page);
+                }
+                ++local;
+            }
+            ops.fetch_add(local);
+        });
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+    done.store(true);
+    for (auto& w : workers) w.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return static_cast<double>(ops.load()) / secs / 1e6;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::size_t maxThreads = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                      : 2 * std::max(1u, std::thread::hardware_concurrency());
+    int millis = argc > 2 ? std::atoi(argv[2]) : 300;
+
+    std::vector<PagePtr> pool;
+    for (std::size_t i = 0; i < kKeys; ++i) {
+        Page page;
+        page.id = "page-" + std::to_string(i);
+        page.url = "https://example.com/" + std::to_string(i);
+        pool.push_back(std::make_shared<const Page>(std::move(page)));
+    }
+
+    std::printf("%8s %8s %14s %14s %8s\n", "threads", "lookup%", "mutex_Mops", "sharded_Mops", "speedup");
+
+    for (unsigned lookupPercent : {100u, 95u, 50u}) {
+        for (std::size_t threads = 1; threads <= maxThreads; threads *= 2) {
+            MutexMapStore mutexStore;
+            PageStore sharded;
+            for (const auto& p : pool) {
+                mutexStore.insert(p);
+                sharded.insert(p);
+            }
+
+            double base = run(mutexStore, pool, threads, lookupPercent, millis);
+            double fast = run(sharded, pool, threads, lookupPercent, millis);
+            std::printf("%8zu %8u %14.2f %14.2f %7.2fx\n", threads, lookupPercent, base, fast, fast / base);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Paint stage cost per span kernel at common viewport sizes. The page is a
+// styled mixed tree: opaque and translucent backgrounds, bordered boxes and
+// text. Each kernel rasterizes the same display list on one thread and is
+// checked pixel-for-pixel against the scalar output; the last row per
+// viewport is the default kernel with tiles spread over a scheduler.
+//
+// usage: openperf_paint_bench [nodes] [threads]
+#include "openperf/flat_document.hpp"
+#include "openperf/layout.hpp"
+#include "openperf/paint.hpp"
+#include "openperf/task_scheduler.hpp"
+
+#include "bench_common.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+void styleTree(Node& root) {
+    static const std::uint32_t kColors[] = {0xf4f4f4ff, 0x3366ccff, 0xffcc0080, 0x00000020, 0xe0f0e0c0};
+    Rng rng(11);
+    std::vector<Node*> stack{&root};
+    while (!stack.empty()) {
+        Node* n = stack.back();
+        stack.pop_back();
+        if (rng.below(2) == 0) n->style.background = kColors[rng.below(std::size(kColors))];
+        if (rng.below(4) == 0) {
+            n->style.borderWidth = 1 + static_cast<float>(rng.below(3));
+            n->style.borderColor = 0x202020ff;
+        }
+        n->style.padding = 4;
+        for (auto& child : n->children) stack.push_back(child.get());
+    }
+}
+
+std::size_t mismatches(const Raster& a, const Raster& b) {
+    std::size_t count = 0;
+    for (std::int32_t y = 0; y < a.height; ++y)
+        for (std::int32_t x = 0; x < a.width; ++x) count += a.pixel(x, y) != b.pixel(x, y);
+    return count;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::size_t nodes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+    std::size_t threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+
+    auto root = makeTree(nodes, 4);
+    styleTree(*root);
+    auto doc = FlatDocument::fromTree(*root);
+
+    TaskScheduler scheduler(threads);
+    scheduler.start();
+
+    struct Viewport {
+        const char* name;
+        std::int32_t width, height;
+    };
+    const Viewport viewports[] = {{"phone", 390, 844}, {"laptop", 1280, 720}, {"desktop", 1920, 1080}};
+
+    std::printf("%-8s %-10s %-7s %8s %10s %10s %10s\n", "viewport", "size", "kernel", "items", "ms/paint",
+                "Mpix/s", "mismatch");
+    for (const auto& vp : viewports) {
+        LayoutEngine::Options layoutOptions;
+        layoutOptions.viewportWidth = static_cast<float>(vp.width);
+        BoxArray boxes = LayoutEngine(layoutOptions).layout(doc);
+
+        Painter::Options options;
+        options.viewportWidth = vp.width;
+        options.viewportHeight = vp.height;
+        DisplayList list = Painter(nullptr, options).record(doc, boxes);
+
+        char size[32];
+        std::snprintf(size, sizeof(size), "%dx%d", vp.width, vp.height);
+        const double pixels = static_cast<double>(vp.width) * vp.height;
+
+        auto run = [&](const char* label, const Painter& painter, const Raster* reference) {
+            Raster raster;
+            double ns = nsPerOp([&] {
+                raster = painter.rasterize(list);
+                doNotOptimize(raster.pixels.data());
+            }, 20);
+            std::printf("%-8s %-10s %-7s %8zu %10.3f %10.1f %10zu\n", vp.name, size, label, list.items.size(),
+                        ns / 1e6, pixels / (ns / 1e3), reference ? mismatches(raster, *reference) : 0);
+            return raster;
+        };
+
+        options.kernel = PaintKernel::Scalar;
+        Raster reference = run("scalar", Painter(nullptr, options), nullptr);
+        for (auto kernel : {PaintKernel::Sse2, PaintKernel::Avx2}) {
+            if (!paintKernelSupported(kernel)) continue;
+            options.kernel = kernel;
+            run(paintKernelName(kernel), Painter(nullptr, options), &reference);
+        }
+        options.kernel = PaintKernel::Auto;
+        run("tiled", Painter(&scheduler, options), &reference);
+    }
+
+    scheduler.stop();
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Cost of keeping a large page current as it changes: resubmitting the
+// whole page (rebuild the flat DOM, analyze it) versus patching it (path-
+// copying edit, flat DOM that copies the unchanged subtrees of the previous
+// one, same analysis). Each round changes `percent` of the nodes with a mix
+// of updates, inserts and removes.
+//
+// usage: openperf_patch_bench [nodes] [percent] [rounds]
+#include "openperf/accessibility.hpp"
+#include "openperf/flat_document.hpp"
+#include "openperf/page_editor.hpp"
+
+#include "bench_common.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+struct Totals {
+    double apply = 0, analyze = 0;
+};
+
+}
+
+int main(int argc, char** argv) {
+    std::size_t nodes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    double percent = argc > 2 ? std::atof(argv[2]) : 1.0;
+    int rounds = argc > 3 ? std::atoi(argv[3]) : 20;
+
+    static const char* kTags[] = {"div", "span", "p", "img", "button", "a", "h2", "li"};
+    const auto perRound = std::max<std::size_t>(1, static_cast<std::size_t>(nodes * percent / 100));
+
+    AccessibilityAnalyzer analyzer;
+    PageEditor editor(makeTree(nodes, 8));
+    auto dom = FlatDocument::fromTree(*editor.root());
+
+    Rng rng(1);
+    std::vector<std::string> inserted; // leaves added by earlier rounds, safe to remove
+    std::size_t nextId = nodes;
+    Totals full, incremental;
+    std::size_t changed = 0;
+
+    for (int round = 0; round < rounds; ++round) {
+        std::vector<NodeMutation> mutations;
+        for (std::size_t i = 0; i < perRound; ++i) {
+            NodeMutation m;
+            auto dice = rng.below(10);
+            if (dice < 2 && !inserted.empty()) {
+                m.kind = NodeMutation::Kind::Remove;
+                std::swap(inserted[rng.below(inserted.size())], inserted.back());
+                m.nodeId = std::move(inserted.back());
+                inserted.pop_back();
+            } else if (dice < 4) {
+                m.kind = NodeMutation::Kind::Insert;
+                m.nodeId = "n" + std::to_string(rng.below(nodes));
+                m.node = std::make_shared<Node>();
+                m.node->tag = kTags[rng.below(std::size(kTags))];
+                m.node->id = "n" + std::to_string(nextId++);
+                inserted.push_back(m.node->id);
+            } else {
+                m.kind = NodeMutation::Kind::Update;
+                m.nodeId = "n" + std::to_string(rng.below(nodes));
+                m.node = std::make_shared<Node>();
+                m.node->tag = kTags[rng.below(std::size(kTags))];
+                if (rng.below(2)) m.node->text = "edited";
+            }
+            mutations.push_back(std::move(m));
+        }
+
+        // what Engine::patchPage does
+        auto t0 = Clock::now();
+        const auto previous = editor.root();
+        auto result = editor.apply(mutations);
+        if (result.status != PatchStatus::Applied) {
+            std::fprintf(stderr, "patch failed: %s\n", result.error.c_str());
+            return 1;
+        }
+        dom = FlatDocument::fromTree(*editor.root(), dom, editor.sharedSubtrees(*previous, dom));
+        incremental.apply += msSince(t0);
+        changed += result.changedNodes;
+
+        t0 = Clock::now();
+        auto issues = analyzer.analyze(dom);
+        incremental.analyze += msSince(t0);
+        doNotOptimize(issues.data());
+
+        // what a resubmission of the same tree costs
+        t0 = Clock::now();
+        auto fullDom = FlatDocument::fromTree(*editor.root());
+        full.apply += msSince(t0);
+        t0 = Clock::now();
+        auto fullIssues = analyzer.analyze(fullDom);
+        full.analyze += msSince(t0);
+
+        if (fullIssues.size() != issues.size()) {
+            std::fprintf(stderr, "issue count mismatch: %zu vs %zu\n", fullIssues.size(), issues.size());
+            return 1;
+        }
+    }
+
+    std::printf("%zu nodes, %zu mutations per round (%.2f%%), %d rounds\n", editor.nodeCount(), perRound, percent, rounds);
+    std::printf("changed nodes per round: %.0f (%.2f%% of the page)\n", static_cast<double>(changed) / rounds,
+                100.0 * static_cast<double>(changed) / rounds / static_cast<double>(editor.nodeCount()));
+    std::printf("%-12s %14s %14s %14s\n", "ms/round", "update", "a11y", "total");
+    std::printf("%-12s %14.2f %14.2f %14.2f\n", "resubmit", full.apply / rounds, full.analyze / rounds,
+                (full.apply + full.analyze) / rounds);
+    std::printf("%-12s %14.2f %14.2f %14.2f\n", "patch", incremental.apply / rounds, incremental.analyze / rounds,
+                (incremental.apply + incremental.analyze) / rounds);
+    return 0;
+}
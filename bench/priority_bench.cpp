@@ -0,0 +1,186 @@
+// TaskScheduler priority lanes and deadlines.
+//
+// latency     queue wait of probe tasks submitted every 100 us while the
+//             pool works through a backlog of 20 us tasks: probes in the
+//             Interactive lane behind a Batch backlog, against probes and
+//             backlog sharing one lane (how every task used to queue)
+// starvation  share of tasks taken from the Batch lane while the Interactive
+//             lane is never empty either; firstLaneForTurn() promises 1/16
+// deadlines   tasks queued behind the backlog with a 1 ms deadline that
+//             were dropped rather than run
+// overhead    enqueue-to-run round trip of empty tasks, with and without
+//             per-lane metrics attached (sampled queue wait)
+//
+// usage: openperf_priority_bench [backlog tasks]
+#include "openperf/metrics.hpp"
+#include "openperf/task_scheduler.hpp"
+
+#include "bench_common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto kWork = std::chrono::microseconds(20);
+constexpr auto kProbeInterval = std::chrono::microseconds(100);
+
+void spin(Clock::duration d) {
+    const auto until = Clock::now() + d;
+    while (Clock::now() < until) {
+    }
+}
+
+void waitFor(const std::atomic<std::size_t>& counter, std::size_t target) {
+    while (counter.load(std::memory_order_acquire) < target) std::this_thread::yield();
+}
+
+struct Percentiles {
+    double p50 = 0, p99 = 0, max = 0;
+};
+
+Percentiles percentiles(std::vector<double> us) {
+    if (us.empty()) return {};
+    std::sort(us.begin(), us.end());
+    return {us[us.size() / 2], us[us.size() * 99 / 100], us.back()};
+}
+
+// Queue wait of probes in `probeLane` while `backlog` tasks of `backlogLane` drain.
+Percentiles probeWait(std::size_t backlog, TaskPriority backlogLane, TaskPriority probeLane) {
+    TaskScheduler scheduler;
+    scheduler.start();
+
+    std::atomic<std::size_t> done{0};
+    for (std::size_t i = 0; i < backlog; ++i) {
+        scheduler.enqueue([&done] {
+            spin(kWork);
+            done.fetch_add(1, std::memory_order_release);
+        }, {backlogLane});
+    }
+
+    // probes stop once the backlog is gone; past that there is nothing to wait behind
+    const std::size_t probes = backlog * kWork / kProbeInterval / scheduler.workerCount() / 2;
+    std::vector<double> waits(probes);
+    std::atomic<std::size_t> probed{0};
+    for (std::size_t i = 0; i < probes; ++i) {
+        const auto queued = Clock::now();
+        scheduler.enqueue([&waits, &probed, i, queued] {
+            waits[i] = std::chrono::duration<double, std::micro>(Clock::now() - queued).count();
+            probed.fetch_add(1, std::memory_order_release);
+        }, {probeLane});
+        std::this_thread::sleep_for(kProbeInterval);
+    }
+    waitFor(probed, probes);
+    waitFor(done, backlog);
+    scheduler.stop();
+    return percentiles(std::move(waits));
+}
+
+// Fraction of tasks taken from the Batch lane while both lanes always have work.
+double batchShare() {
+    TaskScheduler scheduler;
+    std::atomic<std::size_t> interactive{0}, batch{0};
+    std::atomic<bool> stop{false};
+
+    // every task queues its successor, so neither lane ever empties
+    std::function<void()> feedInteractive = [&] {
+        interactive.fetch_add(1, std::memory_order_relaxed);
+        if (!stop.load(std::memory_order_relaxed)) scheduler.enqueue(feedInteractive, {TaskPriority::Interactive});
+    };
+    std::function<void()> feedBatch = [&] {
+        batch.fetch_add(1, std::memory_order_relaxed);
+        if (!stop.load(std::memory_order_relaxed)) scheduler.enqueue(feedBatch, {TaskPriority::Batch});
+    };
+    for (std::size_t i = 0; i < 2 * scheduler.workerCount(); ++i) {
+        scheduler.enqueue(feedInteractive, {TaskPriority::Interactive});
+        scheduler.enqueue(feedBatch, {TaskPriority::Batch});
+    }
+
+    scheduler.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    stop.store(true, std::memory_order_relaxed);
+    scheduler.stop();
+
+    const double total = static_cast<double>(interactive.load() + batch.load());
+    return total == 0 ? 0 : static_cast<double>(batch.load()) / total;
+}
+
+// Tasks with a 1 ms deadline queued behind `backlog` Normal tasks: how many ran.
+std::pair<std::size_t, std::size_t> deadlineDrops(std::size_t backlog) {
+    TaskScheduler scheduler;
+    Metrics metrics;
+    scheduler.attachMetrics(metrics);
+
+    std::atomic<std::size_t> done{0}, ran{0}, expired{0};
+    for (std::size_t i = 0; i < backlog; ++i) {
+        scheduler.enqueue([&done] {
+            spin(kWork);
+            done.fetch_add(1, std::memory_order_release);
+        }, {TaskPriority::Normal});
+    }
+    const std::size_t late = backlog / 4;
+    TaskOptions options;
+    options.deadline = Clock::now() + std::chrono::milliseconds(1);
+    for (std::size_t i = 0; i < late; ++i) {
+        scheduler.enqueue([&ran] { ran.fetch_add(1, std::memory_order_release); }, options,
+                          [&expired] { expired.fetch_add(1, std::memory_order_release); });
+    }
+    scheduler.start();
+    waitFor(done, backlog);
+    while (ran.load() + expired.load() < late) std::this_thread::yield();
+    scheduler.stop();
+    return {ran.load(), expired.load()};
+}
+
+double roundTripNs(bool withMetrics) {
+    constexpr std::size_t kTasks = 256;
+    TaskScheduler scheduler;
+    Metrics metrics;
+    if (withMetrics) scheduler.attachMetrics(metrics);
+    scheduler.start();
+    std::atomic<std::size_t> ran{0};
+    std::size_t target = 0;
+    const double ns = nsPerOp([&] {
+        target += kTasks;
+        for (std::size_t i = 0; i < kTasks; ++i) {
+            scheduler.enqueue([&ran] { ran.fetch_add(1, std::memory_order_release); });
+        }
+        waitFor(ran, target);
+    }, 200);
+    scheduler.stop();
+    return ns / kTasks;
+}
+
+}
+
+int main(int argc, char** argv) {
+    const std::size_t backlog = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4000;
+
+    std::printf("probe queue wait behind %zu x 20 us tasks      p50 us    p99 us    max us\n", backlog);
+    auto shared = probeWait(backlog, TaskPriority::Normal, TaskPriority::Normal);
+    std::printf("%-44s %9.0f %9.0f %9.0f\n", "one lane (backlog and probes Normal)", shared.p50, shared.p99, shared.max);
+    auto lanes = probeWait(backlog, TaskPriority::Batch, TaskPriority::Interactive);
+    std::printf("%-44s %9.0f %9.0f %9.0f\n", "Interactive probes, Batch backlog", lanes.p50, lanes.p99, lanes.max);
+
+    std::printf("\nBatch share with Interactive saturated: %.3f (floor %.3f)\n", batchShare(), 1.0 / 16);
+
+    auto [ran, expired] = deadlineDrops(backlog);
+    std::printf("1 ms deadline behind the backlog: %zu ran, %zu dropped\n", ran, expired);
+
+    const double plain = roundTripNs(false);
+    const double metered = roundTripNs(true);
+    std::printf("\nround trip ns/task: %.1f, with lane metrics %.1f (%+.1f%%)\n", plain, metered,
+                100 * (metered - plain) / plain);
+    return 0;
+}
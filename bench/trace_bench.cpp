@@ -0,0 +1,82 @@
+// Cost of a trace span: compiled out (OPENPERF_TRACING=OFF), compiled in
+// while the tracer is stopped, and while it records. Also a scheduler
+// enqueue-to-run round trip with the tracer stopped and recording, where
+// each task adds an enqueue span, a flow, a dequeue and a run span, and the
+// Chrome JSON export per recorded event.
+//
+// usage: openperf_trace_bench [iterations]
+#include "openperf/task_scheduler.hpp"
+#include "openperf/trace.hpp"
+
+#include "bench_common.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+
+using namespace openperf;
+using namespace openperf::bench;
+
+void spanLoopCompiledOut(std::size_t iters); // trace_bench_off.cpp
+
+namespace {
+
+void spanLoop(std::size_t iters) {
+    for (std::size_t i = 0; i < iters; ++i) {
+        OPENPERF_TRACE_SPAN("bench", "span");
+        doNotOptimize(i);
+    }
+}
+
+// Runs `tasks` empty tasks through the scheduler, submitted from outside it.
+void roundTrip(TaskScheduler& scheduler, std::size_t tasks) {
+    std::atomic<std::size_t> ran{0};
+    for (std::size_t i = 0; i < tasks; ++i) {
+        scheduler.enqueue([&ran] { ran.fetch_add(1, std::memory_order_release); });
+    }
+    while (ran.load(std::memory_order_acquire) < tasks) std::this_thread::yield();
+}
+
+}
+
+int main(int argc, char** argv) {
+    const std::size_t iters = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1'000'000;
+    auto& tracer = Tracer::global();
+
+    std::printf("%-34s %10s\n", "span", "ns/span");
+    const double out = nsPerOp([&] { spanLoopCompiledOut(iters); }, 1) / static_cast<double>(iters);
+    const double stopped = nsPerOp([&] { spanLoop(iters); }, 1) / static_cast<double>(iters);
+    tracer.start();
+    const double recording = nsPerOp([&] { spanLoop(iters); }, 1) / static_cast<double>(iters);
+    tracer.stop();
+    std::printf("%-34s %10.2f\n", "compiled out", out);
+    std::printf("%-34s %10.2f\n", "compiled in, tracer stopped", stopped);
+    std::printf("%-34s %10.2f\n", "recording", recording);
+
+    constexpr std::size_t kTasks = 256;
+    TaskScheduler scheduler;
+    scheduler.start();
+    const std::size_t batches = std::max<std::size_t>(1, iters / 100 / kTasks);
+    std::printf("\n%-34s %10s\n", "scheduler round trip", "ns/task");
+    const double plain = nsPerOp([&] { roundTrip(scheduler, kTasks); }, batches) / kTasks;
+    tracer.clear();
+    tracer.start();
+    const double traced = nsPerOp([&] { roundTrip(scheduler, kTasks); }, batches) / kTasks;
+    tracer.stop();
+    std::printf("%-34s %10.1f\n", "tracer stopped", plain);
+    std::printf("%-34s %10.1f %+9.1f%%\n", "recording", traced, 100 * (traced - plain) / plain);
+    scheduler.stop();
+
+    // rings hold the last kEventsPerThread events of each thread
+    tracer.clear();
+    tracer.start();
+    spanLoop(Tracer::kEventsPerThread);
+    tracer.stop();
+    std::string json;
+    const double exportNs = nsPerOp([&] { json = tracer.chromeJson(); }, 1);
+    std::printf("\n%-34s %10.1f  (%zu events, %zu KiB)\n", "export ns/event",
+                exportNs / static_cast<double>(Tracer::kEventsPerThread), Tracer::kEventsPerThread, json.size() / 1024);
+    return 0;
+}
@@ -0,0 +1,15 @@
+// The span loop of trace_bench.cpp, built as if the whole tree had
+// OPENPERF_TRACING=OFF: the macro expands to nothing.
+#define OPENPERF_DISABLE_TRACING
+#include "openperf/trace.hpp"
+
+#include "bench_common.hpp"
+
+#include <cstddef>
+
+void spanLoopCompiledOut(std::size_t iters) {
+    for (std::size_t i = 0; i < iters; ++i) {
+        OPENPERF_TRACE_SPAN("bench", "span");
+        openperf::bench::doNotOptimize(i);
+    }
+}
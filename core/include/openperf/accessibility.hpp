@@ -1,28 +1,59 @@
 #pragma once
 
 #include "openperf/page.hpp"
+#include "openperf/flat_document.hpp"
+#include "openperf/accessibility_rules.hpp"
+#include "openperf/task_scheduler.hpp"
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace openperf {
 
-enum class Severity {
-    Info, Warning, Error
-};
-
-struct AccessibilityIssue {
-    std::string code;
-    std::string message;
-    Severity severity;
-    std::string nodeId;
+// One page's result in a batch analysis.
+struct AccessibilityReport {
+    bool found = false; // false: unknown page id
+    std::vector<AccessibilityIssue> issues;
 };
 
+/**
+ * Runs the rules of a RuleRegistry over every node of a page.
+ *
+ * With a scheduler, documents of at least parallelThreshold nodes are split
+ * into contiguous document-order ranges that run as parallel tasks, each
+ * into its own issue buffer. Ordered rules first take one serial pass of
+ * their own. Buffers are concatenated in range order, so the result is
+ * identical to the serial walk.
+ */
 class AccessibilityAnalyzer {
 public:
+    struct Options {
+        std::size_t parallelThreshold = 16384; // nodes; smaller pages stay serial
+        std::size_t grainSize = 4096;          // nodes per task
+        std::shared_ptr<const RuleRegistry> rules; // null for RuleRegistry::defaults()
+    };
+
+    AccessibilityAnalyzer();
+    explicit AccessibilityAnalyzer(TaskScheduler* scheduler);
+    AccessibilityAnalyzer(TaskScheduler* scheduler, Options options);
+
+    // Uses page.dom when present, otherwise walks the Node tree.
     std::vector<AccessibilityIssue> analyze(const Page& page) const;
+    std::vector<AccessibilityIssue> analyze(const FlatDocument& doc) const;
+
+    const RuleRegistry& rules() const { return *options_.rules; }
 
 private:
-    void checkNode(const std::shared_ptr<Node>& node, std::vector<AccessibilityIssue>& out) const;
+    static RuleNode ruleNode(const Node& node);
+
+    // `visit(i)` returns the RuleNode for the i-th node in document order.
+    template <typename Visit>
+    std::vector<AccessibilityIssue> run(std::size_t count, const Visit& visit) const;
+
+    TaskScheduler* scheduler_ = nullptr;
+    Options options_;
 };
 
 }
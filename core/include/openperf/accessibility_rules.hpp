@@ -0,0 +1,164 @@
+#pragma once
+
+#include "openperf/flat_document.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace openperf {
+
+enum class Severity {
+    Info, Warning, Error
+};
+
+struct AccessibilityIssue {
+    std::string code;
+    std::string message;
+    Severity severity;
+    std::string nodeId;
+};
+
+// One node as seen by a rule, whichever DOM representation it came from.
+struct RuleNode {
+    Atom tag = atoms::Empty;
+    Atom role = atoms::Empty;
+    std::string_view id;
+    std::string_view text;
+    std::string_view ariaLabel;
+    bool isInteractive = false;
+
+    bool hasAccessibleText() const { return !ariaLabel.empty() || !text.empty(); }
+};
+
+// Which nodes a rule is run on. A selector matches on exactly one axis.
+struct RuleSelector {
+    enum class Kind { Tags, Roles, Interactive, EveryNode };
+
+    Kind kind = Kind::EveryNode;
+    std::vector<Atom> atoms; // tags or roles, for those kinds
+
+    static RuleSelector tags(std::vector<Atom> tags) { return {Kind::Tags, std::move(tags)}; }
+    static RuleSelector roles(std::vector<Atom> roles) { return {Kind::Roles, std::move(roles)}; }
+    static RuleSelector interactive() { return {Kind::Interactive, {}}; }
+    static RuleSelector everyNode() { return {Kind::EveryNode, {}}; }
+};
+
+// Per-analysis state of an ordered rule.
+struct RuleState {
+    virtual ~RuleState() = default;
+};
+
+/**
+ * A single accessibility check.
+ *
+ * Plain rules look at one node at a time and may run on any thread, in any
+ * order. Ordered rules (newState() returns non-null) get a fresh state per
+ * analysis and see their matching nodes strictly in document order, which
+ * is what rules needing tree context, such as heading order, rely on.
+ */
+class AccessibilityRule {
+public:
+    virtual ~AccessibilityRule() = default;
+
+    virtual RuleSelector selector() const = 0;
+    virtual std::unique_ptr<RuleState> newState() const { return nullptr; }
+
+    // `state` is null for plain rules.
+    virtual void check(const RuleNode& node, RuleState* state,
+                       std::vector<AccessibilityIssue>& out) const = 0;
+};
+
+// A plain rule from a function.
+class FunctionRule : public AccessibilityRule {
+public:
+    using Check = std::function<void(const RuleNode&, std::vector<AccessibilityIssue>&)>;
+
+    FunctionRule(RuleSelector selector, Check check)
+        : selector_(std::move(selector)), check_(std::move(check)) {}
+
+    RuleSelector selector() const override { return selector_; }
+    void check(const RuleNode& node, RuleState*, std::vector<AccessibilityIssue>& out) const override {
+        check_(node, out);
+    }
+
+private:
+    RuleSelector selector_;
+    Check check_;
+};
+
+/**
+ * Owns a set of rules and a dispatch table from tag and role atoms to the
+ * rules that apply, so each node only runs its own rules.
+ *
+ * For one node, plain rules run before ordered ones; within each group
+ * tag, every-node and interactive rules run in registration order, then
+ * role rules. Not thread-safe while rules are being added; share a
+ * finished registry as shared_ptr<const RuleRegistry>.
+ */
+class RuleRegistry {
+public:
+    RuleRegistry() = default;
+    RuleRegistry(const RuleRegistry&) = delete;
+    RuleRegistry& operator=(const RuleRegistry&) = delete;
+
+    // IMG_ALT_MISSING, INTERACTIVE_MISSING_LABEL, BUTTON_LINK_NO_TEXT,
+    // HEADING_NO_TEXT and HEADING_LEVEL_SKIPPED.
+    static std::shared_ptr<const RuleRegistry> defaults();
+    void addDefaultRules();
+
+    RuleRegistry& add(std::unique_ptr<AccessibilityRule> rule);
+
+    std::size_t size() const { return rules_.size(); }
+    bool hasOrderedRules() const { return !orderedRules_.empty(); }
+
+    // One state per ordered rule, for a single analysis.
+    std::vector<std::unique_ptr<RuleState>> newStates() const;
+
+    // Runs the plain rules for `node`.
+    void checkPlain(const RuleNode& node, std::vector<AccessibilityIssue>& out) const {
+        plain_.run(node, nullptr, out);
+    }
+    // Runs the ordered rules for `node`; call in document order.
+    void checkOrdered(const RuleNode& node, std::vector<std::unique_ptr<RuleState>>& states,
+                      std::vector<AccessibilityIssue>& out) const {
+        ordered_.run(node, states.data(), out);
+    }
+
+private:
+    struct Entry {
+        const AccessibilityRule* rule;
+        std::size_t slot; // index of the rule's state, for ordered rules
+    };
+
+    class Dispatch {
+    public:
+        void add(const RuleSelector& selector, Entry entry);
+        void run(const RuleNode& node, std::unique_ptr<RuleState>* states,
+                 std::vector<AccessibilityIssue>& out) const;
+
+    private:
+        using List = std::vector<Entry>;
+
+        // [0] for all nodes, [1] for interactive nodes
+        const List& tagList(Atom tag, bool interactive) const {
+            const auto& table = byTag_[interactive];
+            return tag < table.size() ? table[tag] : fallback_[interactive];
+        }
+        void growTags(Atom tag);
+
+        List fallback_[2];              // every-node and interactive rules
+        std::vector<List> byTag_[2];    // fallback_ plus the tag's rules
+        std::vector<List> byRole_;
+    };
+
+    std::vector<std::unique_ptr<AccessibilityRule>> rules_;
+    std::vector<const AccessibilityRule*> orderedRules_;
+    Dispatch plain_;
+    Dispatch ordered_;
+};
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "openperf/paint.hpp"
+#include "openperf/task_scheduler.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace openperf {
+
+// Part of the viewport that must be recomposited. Pixels, half-open.
+struct DamageRect {
+    std::int32_t x0, y0, x1, y1;
+
+    std::int64_t area() const { return std::int64_t{x1 - x0} * (y1 - y0); }
+};
+
+/**
+ * A composited viewport and the layers it was built from.
+ *
+ * The image is tiled like the root layer. Tiles are immutable and shared
+ * with the previous frame wherever nothing was damaged, so unchanged
+ * regions cost neither copies nor memory. Layers keep their display lists,
+ * which is all damage tracking needs from a previous frame; their rasters
+ * are dropped once composited.
+ */
+struct Frame {
+    std::int32_t width = 0, height = 0, tileSize = 0;
+    std::int32_t tilesX = 0, tilesY = 0;
+    std::vector<std::shared_ptr<const std::uint32_t[]>> tiles; // tileSize * tileSize pixels each
+    std::vector<Layer> layers;
+    std::int64_t damagedPixels = 0; // recomposited for this frame
+
+    std::uint32_t pixel(std::int32_t x, std::int32_t y) const;
+    std::size_t memoryBytes() const; // shared tiles included
+};
+
+/**
+ * CPU compositor: blends painted layers (premultiplied source-over, in
+ * order) into a frame.
+ *
+ * Given the previous frame of the same page, damage() finds what changed
+ * by comparing each layer's per-tile display lists, and composite() then
+ * recomposites only the damaged part of each tile, sharing untouched
+ * tiles with the previous frame. Touching damage is merged; a mostly
+ * damaged tile, or a mostly damaged frame, is redone whole. Layers are matched by position in the
+ * list; a layer that moved, resized or appeared damages both its old and
+ * new bounds. With a scheduler, tiles are composited in parallel.
+ */
+class Compositor {
+public:
+    struct Options {
+        PaintKernel kernel = PaintKernel::Auto;
+    };
+
+    Compositor();
+    explicit Compositor(TaskScheduler* scheduler);
+    Compositor(TaskScheduler* scheduler, Options options);
+
+    // What differs between `prev` and `layers`; the whole viewport if there
+    // is no comparable previous frame. layers[0] is the root layer.
+    static std::vector<DamageRect> damage(const Frame* prev, const std::vector<Layer>& layers);
+
+    // Composites `layers` inside `damage` over `prev`'s image. Without a
+    // previous frame of the same size, everything is composited.
+    Frame composite(std::vector<Layer> layers, const Frame* prev, const std::vector<DamageRect>& damage) const;
+
+    PaintKernel kernel() const { return kernel_; }
+
+private:
+    TaskScheduler* scheduler_;
+    PaintKernel kernel_;
+};
+
+}
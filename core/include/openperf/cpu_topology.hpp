@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace openperf {
+
+// Parses a Linux CPU list such as "0-3,8,10-11" into ascending CPU ids;
+// returns false on malformed input.
+bool parseCpuList(std::string_view text, std::vector<int>* out);
+// The inverse: ascending ids back to "0-3,8,10-11".
+std::string formatCpuList(const std::vector<int>& cpus);
+
+struct CpuInfo {
+    int id = 0;           // as the kernel numbers it
+    std::size_t node = 0; // dense index, see CpuTopology
+    int core = 0;         // lowest id among its SMT siblings; equal for siblings
+};
+
+/**
+ * CPUs this process may run on, grouped by NUMA node.
+ *
+ * detect() reads the node and cpu directories under /sys/devices/system and
+ * keeps only CPUs in the process's affinity mask, so taskset and cgroup
+ * cpusets are respected. Nodes without a usable CPU are left out and the
+ * rest are numbered 0..nodeCount()-1 in system order. Where sysfs has no
+ * node information (other systems, kernels without NUMA) every CPU is put
+ * on one node, which is also what a single-socket machine reports.
+ */
+class CpuTopology {
+public:
+    CpuTopology() = default; // no CPUs
+
+    static CpuTopology detect(const std::string& sysfsRoot = "/sys/devices/system");
+    // One node of CPUs 0..count-1, each a core of its own.
+    static CpuTopology uniform(std::size_t count);
+    // Node i holds the CPUs of nodeCpus[i], each a core of its own; for
+    // laying workers out as on another machine.
+    static CpuTopology fromNodes(const std::vector<std::vector<int>>& nodeCpus);
+
+    bool empty() const { return cpus_.empty(); }
+    std::size_t nodeCount() const { return nodeIds_.size(); }
+    // Ordered by id.
+    const std::vector<CpuInfo>& cpus() const { return cpus_; }
+    std::vector<int> cpuIds() const;
+    std::vector<int> cpuIds(std::size_t node) const;
+    // System number of dense node `node`, e.g. for logs.
+    int nodeId(std::size_t node) const { return nodeIds_[node]; }
+
+    // This topology less the `reserved` CPUs; nodes left empty are dropped.
+    CpuTopology without(const std::vector<int>& reserved) const;
+
+    // The order to hand CPUs to workers in: nodes take turns, and within a
+    // node every physical core gets a worker before any SMT sibling does.
+    std::vector<CpuInfo> placementOrder() const;
+
+    // e.g. "2 nodes, 16 cpus (node 0: 0-7, node 1: 8-15)"
+    std::string describe() const;
+
+private:
+    std::vector<CpuInfo> cpus_;
+    std::vector<int> nodeIds_;
+};
+
+// Restricts the calling thread, or `thread`, to `cpus`. Returns false if the
+// system refuses or has no thread affinity; the thread then runs unpinned.
+bool pinCurrentThread(const std::vector<int>& cpus);
+bool pinThread(std::thread& thread, const std::vector<int>& cpus);
+
+}
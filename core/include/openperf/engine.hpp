@@ -1,60 +1,180 @@
 #pragma once
 
 #include "openperf/page.hpp"
+#include "openperf/flat_document.hpp"
+#include "openperf/page_editor.hpp"
+#include "openperf/page_store.hpp"
 #include "openperf/task_scheduler.hpp"
+#include "openperf/render_pipeline.hpp"
+#include "openperf/render_handle.hpp"
 #include "openperf/metrics.hpp"
 #include "openperf/accessibility.hpp"
+#include "openperf/layout.hpp"
+#include "openperf/paint.hpp"
+#include "openperf/compositor.hpp"
+#include "openperf/result_cache.hpp"
+#include "openperf/trace.hpp"
 
-#include <unordered_map>
 #include <mutex>
 #include <atomic>
-#include <optional>
 #include <iostream>
+#include <string>
+#include <vector>
 
 namespace openperf {
 
 class Engine {
 public:
+    struct Options {
+        // Renders past the in-flight limit wait for admission; unbounded by default.
+        AdmissionOptions admission;
+        // Worker count and placement; one unpinned worker per CPU by default.
+        TaskScheduler::Options scheduler;
+    };
+
     Engine();
+    explicit Engine(Options options);
     ~Engine();
 
     void start();
     void stop();
 
     std::string submitPage(Page page) {
-        static std::atomic<std::uint64_t> g_pageCounter{0};
-
+        OPENPERF_TRACE_SPAN("engine", "submitPage");
         std::cout << "[engine] submitPage: initial id='" << page.id << "'\n";
 
-        if (page.id.empty()) {
-            auto idNum = g_pageCounter.fetch_add(1, std::memory_order_relaxed);
-            page.id = "page-" + std::to_string(idNum);
-        }
+        auto prepared = preparePage(std::move(page));
+
+        std::cout << "[engine] submitPage: generated id='" << prepared->id << "'\n";
+
+        std::string pageId = prepared->id;
+        pages_.insert(std::move(prepared));
 
-        std::cout << "[engine] submitPage: generated id='" << page.id << "'\n";
+        return pageId;
+    }
+
+    // submitPage() for many pages: they are hashed and flattened in parallel
+    // on the scheduler and stored with one PageStore::insertBatch. Returns
+    // their ids in the order of `pages`.
+    std::vector<std::string> submitPages(std::vector<Page> pages);
 
-        {
-            std::lock_guard<std::mutex> lock(pagesMutex_);
-            pages_.emplace(page.id, std::move(page));
-        }
+    // Applies `mutations` in order to a stored page, all or nothing, and
+    // stores the result as its new snapshot. Unchanged subtrees are shared
+    // with the previous snapshot, and its flat DOM copies theirs.
+    PatchResult patchPage(const std::string& pageId, const std::vector<NodeMutation>& mutations);
 
-        return page.id;
+    bool removePage(const std::string& pageId) {
+        frames_.erase(pageId);
+        return pages_.erase(pageId);
     }
+    std::size_t pageCount() const { return pages_.size(); }
+    std::size_t pageBytes() const { return pages_.bytes(); }
 
     void runRenderPipeline(const std::string& pageId); // async via scheduler
 
+    // Same, but `done` is called once the render finishes, normally on a
+    // scheduler worker. It is called inline if the page is unknown or the
+    // pipeline rejects the job, and from a later submitter's thread if the
+    // job is shed from the admission queue.
+    //
+    // `options` picks the lane the render waits in, for admission and for
+    // workers. A render whose first stage would start past the deadline
+    // does no work and reports RenderStatus::Expired.
+    void runRenderPipeline(const std::string& pageId, RenderCallback done, TaskOptions options = {});
+
+    // Renders many pages, looked up together. `done`, if set, is called once
+    // the last of them has finished, with one result per id in the order of
+    // `pageIds`; unknown and rejected pages have their status set.
+    void runRenderBatch(const std::vector<std::string>& pageIds, RenderBatchCallback done,
+                        TaskOptions options = {});
+
+    // runRenderPipeline() returning a handle to wait on or cancel. The
+    // result carries per-stage timings and the queue wait; a render
+    // cancelled before its first stage reports RenderStatus::Cancelled.
+    RenderHandle render(const std::string& pageId, TaskOptions options = {});
+
+    // runRenderBatch() with one handle per id, in the order of `pageIds`;
+    // waitAll() awaits them without polling.
+    std::vector<RenderHandle> renderBatch(const std::vector<std::string>& pageIds, TaskOptions options = {});
+
+    // Pool shared by the render pipeline, e.g. for transports that hand
+    // request handling off to it.
+    TaskScheduler& scheduler() { return scheduler_; }
+
     std::vector<AccessibilityIssue> analyzeAccessibility(const std::string& pageId);
+    // Analyzes many pages, looked up together and checked in parallel on the
+    // scheduler. One report per id, in the order of `pageIds`.
+    std::vector<AccessibilityReport> analyzeAccessibilityBatch(const std::vector<std::string>& pageIds);
     std::vector<Metric> getMetrics() const;
+    MetricsDelta getMetricsSince(std::uint64_t cursor) const;
+    std::vector<MetricSummary> getMetricSummaries() const;
 
 private:
-    std::optional<Page> getPage(const std::string& pageId) const;
-
-    mutable std::mutex pagesMutex_;
-    std::unordered_map<std::string, Page> pages_;
+    struct CacheMetrics {
+        MetricId hits, misses, evictions;
+    };
+
+    PagePtr getPage(const std::string& pageId) const;
+
+    // Assigns an id if there is none, hashes the content and builds the
+    // flat DOM; everything submitPage does short of storing the page. The
+    // page's renders run on the caller's node, or off the workers on the
+    // next node in turn.
+    PagePtr preparePage(Page page);
+    // Returns the submitted job, or null if the page was unknown or the
+    // pipeline rejected it; `done` has been called in both cases.
+    std::shared_ptr<RenderJob> startRender(const std::string& pageId, PagePtr page, RenderCallback done,
+                                           const TaskOptions& options);
+    RenderHandle startRender(const std::string& pageId, PagePtr page, const TaskOptions& options);
+    std::vector<AccessibilityIssue> analyze(const Page& page);
+
+    CacheMetrics registerCacheMetrics(const std::string& prefix);
+    std::shared_ptr<const RenderOutput> findRender(const ContentHash& content);
+
+    // render pipeline stages, run as separate scheduler tasks
+    void parseStage(RenderJob& job);
+    void layoutStage(RenderJob& job);
+    void paintStage(RenderJob& job);
+    void compositeStage(RenderJob& job);
+    void onRenderComplete(RenderJob& job);
+    // Reports a render that ended without running, e.g. rejected, shed,
+    // cancelled or expired.
+    void renderDropped(RenderJob& job, RenderStatus status);
+
+    PageStore pages_;
 
     TaskScheduler scheduler_;
     Metrics metrics_;
     AccessibilityAnalyzer accessibility_;
+    LayoutEngine layout_;
+    Painter painter_;
+    Compositor compositor_;
+    RenderPipeline pipeline_;
+
+    // results by page content, shared across page ids
+    ResultCache<std::vector<AccessibilityIssue>> a11yCache_;
+    ResultCache<RenderOutput> renderCache_;
+    // last frame per page, the base for damage tracking
+    ResultCache<Frame, std::string> frames_;
+
+    // metric handles, registered once in the constructor
+    std::vector<MetricId> stageMetrics_;
+    MetricId renderLatencyMetric_;
+    MetricId queueDepthMetric_;
+    MetricId renderQueueMetric_;
+    MetricId queueWaitMetric_;
+    MetricId rejectedMetric_;
+    MetricId shedMetric_;
+    MetricId cancelledMetric_;
+    MetricId expiredMetric_;
+    MetricId patchChangedMetric_;
+    MetricId layoutReusedMetric_;
+    MetricId paintTileMetric_;
+    MetricId compositeDamageMetric_;
+    CacheMetrics a11yCacheMetrics_;
+    CacheMetrics renderCacheMetrics_;
+
+    std::atomic<std::size_t> nextNode_{0}; // round-robin home node of submitted pages
 };
 
 }
\ No newline at end of file
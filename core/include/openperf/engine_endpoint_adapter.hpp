@@ -19,18 +19,55 @@ public:
         return engine_.submitPage(std::move(page));
     }
 
+    std::vector<std::string> submitPages(std::vector<Page> pages) override {
+        return engine_.submitPages(std::move(pages));
+    }
+
     void runRenderPipeline(const std::string& pageId) override {
         engine_.runRenderPipeline(pageId);
     }
 
+    void runRenderPipeline(const std::string& pageId, RenderCallback done) override {
+        engine_.runRenderPipeline(pageId, std::move(done));
+    }
+
+    void runRenderBatch(const std::vector<std::string>& pageIds, RenderBatchCallback done) override {
+        engine_.runRenderBatch(pageIds, std::move(done));
+    }
+
+    // the engine's own handles, which can cancel a render still queued
+    RenderHandle render(const std::string& pageId) override {
+        return engine_.render(pageId);
+    }
+
+    std::vector<RenderHandle> renderBatch(const std::vector<std::string>& pageIds) override {
+        return engine_.renderBatch(pageIds);
+    }
+
     std::vector<AccessibilityIssue> analyzeAccessibility(const std::string& pageId) override {
         return engine_.analyzeAccessibility(pageId);
     }
 
+    std::vector<AccessibilityReport> analyzeAccessibilityBatch(const std::vector<std::string>& pageIds) override {
+        return engine_.analyzeAccessibilityBatch(pageIds);
+    }
+
+    PatchResult patchPage(const std::string& pageId, const std::vector<NodeMutation>& mutations) override {
+        return engine_.patchPage(pageId, mutations);
+    }
+
     std::vector<Metric> getMetrics() const override {
         return engine_.getMetrics();
     }
 
+    MetricsDelta getMetricsSince(std::uint64_t cursor) const override {
+        return engine_.getMetricsSince(cursor);
+    }
+
+    std::vector<MetricSummary> getMetricSummaries() const override {
+        return engine_.getMetricSummaries();
+    }
+
 private:
     Engine& engine_;
 };
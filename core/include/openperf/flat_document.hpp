@@ -0,0 +1,222 @@
+#pragma once
+
+#include "openperf/page.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace openperf {
+
+using NodeIndex = std::uint32_t;
+using Atom = std::uint32_t;
+
+inline constexpr NodeIndex kInvalidNode = ~NodeIndex{0};
+// Set on atoms a FlatDocument assigned itself, for names outside the
+// global vocabulary; they never equal an AtomTable atom.
+inline constexpr Atom kLocalAtom = Atom{1} << 31;
+
+// Well-known atoms, pre-seeded in this order by AtomTable::global().
+namespace atoms {
+inline constexpr Atom Empty = 0;
+inline constexpr Atom Img = 1;
+inline constexpr Atom Button = 2;
+inline constexpr Atom A = 3;
+inline constexpr Atom H1 = 4; // H1..H6 are consecutive
+inline constexpr Atom H6 = 9;
+inline constexpr Atom Div = 10;
+inline constexpr Atom Span = 11;
+inline constexpr Atom P = 12;
+inline constexpr Atom Input = 13;
+inline constexpr Atom Label = 14;
+inline constexpr Atom Ul = 15;
+inline constexpr Atom Li = 16;
+inline constexpr Atom Nav = 17;
+inline constexpr Atom Main = 18;
+inline constexpr Atom Section = 19;
+inline constexpr Atom Header = 20;
+inline constexpr Atom Footer = 21;
+inline constexpr Atom Body = 22;
+inline constexpr Atom Html = 23;
+
+inline constexpr bool isHeading(Atom a) { return a >= H1 && a <= H6; }
+inline constexpr int headingLevel(Atom a) { return isHeading(a) ? static_cast<int>(a - H1) + 1 : 0; }
+}
+
+/**
+ * Process-wide string interning for tag and role names.
+ *
+ * Atoms are dense small integers, so analyzers can dispatch on them with a
+ * table lookup instead of string compares. The table is seeded with the
+ * HTML tags and ARIA roles the engine knows; interned names are never
+ * freed, so only trusted code (rule authors) may add to it. Names taken
+ * from pages go through find(), and FlatDocument keeps the ones it does
+ * not know itself.
+ */
+class AtomTable {
+public:
+    static AtomTable& global();
+
+    // Adds `name` if new. Never call with client input: the table only grows.
+    Atom intern(std::string_view name);
+    // Returns atoms::Empty for names that were never interned.
+    Atom find(std::string_view name) const;
+    std::string_view name(Atom atom) const;
+    std::size_t size() const;
+
+private:
+    AtomTable();
+
+    mutable std::shared_mutex mutex_;
+    std::deque<std::string> names_; // deque keeps views into it stable
+    std::unordered_map<std::string_view, Atom> index_;
+};
+
+/**
+ * Compact struct-of-arrays DOM.
+ *
+ * Nodes are stored in document (pre-)order and addressed by NodeIndex, so a
+ * subtree is the contiguous range [i, subtreeEnd(i)). Tags and roles are
+ * atoms; id, text and aria-label live in one per-document string arena.
+ * Styles are deduplicated into a per-document table, since most nodes share
+ * a handful of them. A document is immutable once built.
+ */
+class FlatDocument {
+public:
+    static FlatDocument fromTree(const Node& root);
+    // Same, but each subtree of root listed in `unchanged` is copied from
+    // `previous` at the given index instead of walked; see
+    // PageEditor::sharedSubtrees(). The copies are listed in `copied`, if
+    // given, in document order.
+    static FlatDocument fromTree(const Node& root, const FlatDocument& previous,
+                                 const std::unordered_map<const Node*, NodeIndex>& unchanged,
+                                 std::vector<CopiedSubtree>* copied = nullptr);
+
+    std::size_t size() const { return tags_.size(); }
+    bool empty() const { return tags_.empty(); }
+    NodeIndex root() const { return empty() ? kInvalidNode : 0; }
+
+    // Either a global atom or, for names outside the vocabulary, one with
+    // kLocalAtom set that only this document can name.
+    Atom tag(NodeIndex i) const { return tags_[i]; }
+    Atom role(NodeIndex i) const { return roles_[i]; }
+    std::string_view tagName(NodeIndex i) const { return atomName(tags_[i]); }
+    std::string_view roleName(NodeIndex i) const { return atomName(roles_[i]); }
+    std::string_view id(NodeIndex i) const { return view(ids_[i]); }
+    std::string_view text(NodeIndex i) const { return view(texts_[i]); }
+    std::string_view ariaLabel(NodeIndex i) const { return view(ariaLabels_[i]); }
+    bool isInteractive(NodeIndex i) const { return (flags_[i] & kInteractive) != 0; }
+    const Style& style(NodeIndex i) const { return styles_[styleIds_[i]]; }
+    // The deduplicated style table style(i) indexes with styleId(i).
+    std::uint32_t styleId(NodeIndex i) const { return styleIds_[i]; }
+    const std::vector<Style>& styles() const { return styles_; }
+
+    NodeIndex parent(NodeIndex i) const { return parents_[i]; }
+    NodeIndex firstChild(NodeIndex i) const { return i + 1 < subtreeEnds_[i] ? i + 1 : kInvalidNode; }
+    NodeIndex nextSibling(NodeIndex i) const { return nextSiblings_[i]; }
+    NodeIndex subtreeEnd(NodeIndex i) const { return subtreeEnds_[i]; }
+    std::uint32_t depth(NodeIndex i) const { return depths_[i]; }
+
+    // Rebuilds an equivalent shared_ptr<Node> tree.
+    std::shared_ptr<Node> toTree() const;
+
+    // Heap bytes owned by this document.
+    std::size_t memoryBytes() const;
+    std::size_t textBytes() const { return arena_.size(); }
+
+private:
+    friend class FlatDocumentBuilder;
+
+    struct TextRef {
+        std::uint32_t offset = 0;
+        std::uint32_t length = 0;
+    };
+
+    static constexpr std::uint8_t kInteractive = 1;
+
+    std::string_view view(TextRef ref) const { return {arena_.data() + ref.offset, ref.length}; }
+    std::string_view atomName(Atom atom) const;
+
+    std::vector<Atom> tags_;
+    std::vector<Atom> roles_;
+    std::vector<TextRef> ids_;
+    std::vector<TextRef> texts_;
+    std::vector<TextRef> ariaLabels_;
+    std::vector<std::uint8_t> flags_;
+    std::vector<std::uint32_t> styleIds_; // into styles_
+    std::vector<Style> styles_;
+    std::vector<NodeIndex> parents_;
+    std::vector<NodeIndex> nextSiblings_;
+    std::vector<NodeIndex> subtreeEnds_;
+    std::vector<std::uint32_t> depths_;
+    std::vector<TextRef> localNames_; // indexed by local atom & ~kLocalAtom
+    std::string arena_;
+};
+
+/**
+ * Builds a FlatDocument in document order: beginNode() opens an element as
+ * the next child of the currently open one, endNode() closes it.
+ */
+class FlatDocumentBuilder {
+public:
+    explicit FlatDocumentBuilder(std::size_t expectedNodes = 0, std::size_t expectedTextBytes = 0);
+
+    NodeIndex beginNode(std::string_view tag,
+                        std::string_view id = {},
+                        std::string_view text = {},
+                        std::string_view role = {},
+                        std::string_view ariaLabel = {},
+                        bool isInteractive = false,
+                        const Style& style = {});
+    // Same, with the tag already interned.
+    NodeIndex beginNode(Atom tag,
+                        std::string_view id = {},
+                        std::string_view text = {},
+                        std::string_view role = {},
+                        std::string_view ariaLabel = {},
+                        bool isInteractive = false,
+                        const Style& style = {});
+    void endNode();
+
+    // Appends a copy of `from`'s subtree at `root` as the next child of the
+    // currently open node, already closed.
+    void appendSubtree(const FlatDocument& from, NodeIndex root);
+
+    // Appends to the text of the currently open node.
+    void appendText(std::string_view text);
+
+    std::size_t openDepth() const { return open_.size(); }
+    // Nodes begun so far.
+    std::size_t nodeCount() const { return doc_.size(); }
+
+    // Closes any nodes still open.
+    FlatDocument finish();
+
+private:
+    struct StyleHash {
+        std::size_t operator()(const Style& s) const;
+    };
+
+    FlatDocument::TextRef store(std::string_view s);
+    std::uint32_t styleId(const Style& style);
+    // Global atom of `name`, or a document-local one if it has none.
+    Atom atom(std::string_view name);
+    Atom atom(const FlatDocument& from, Atom a);
+
+    FlatDocument doc_;
+    std::unordered_map<Style, std::uint32_t, StyleHash> styleIds_;
+    std::uint32_t lastStyleId_ = 0;
+    // appendSubtree(): style ids of the last source document, as ours
+    const FlatDocument* styleSource_ = nullptr;
+    std::vector<std::uint32_t> sourceStyleIds_;
+    std::unordered_map<std::string, Atom> localAtoms_;
+    std::vector<NodeIndex> open_;
+    std::vector<NodeIndex> lastChild_; // per open node, parallel to open_
+    NodeIndex lastRoot_ = kInvalidNode;
+};
+
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "openperf/flat_document.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace openperf {
+
+/**
+ * Incremental HTML parser that builds a FlatDocument directly, without an
+ * intermediate Node tree.
+ *
+ * feed() accepts the input in chunks of any size and consumes every
+ * complete token right away; only a tag or character reference cut off at
+ * the end of a chunk is carried over. The end of a cut-off tag is looked
+ * for from where the last chunk left off, so a tag split into many chunks
+ * is still scanned once. The result does not depend on how the input was
+ * split.
+ *
+ * This is a tolerant tokenizer with a small tree builder, not an HTML5
+ * parser. Everything ends up under a single root (an implicit <html> if
+ * the input starts with something else). Void and self-closed elements
+ * get no children, an end tag closes the nearest open element of that
+ * name and is ignored if there is none, and the usual optional end tags
+ * (</p>, </li>, </td>, ...) are implied by the next sibling. Comments,
+ * doctypes and processing instructions are skipped, and script and style
+ * contents are dropped. Text is decoded, whitespace-collapsed and kept as
+ * the text of the element it appears in. Of the attributes, id, role,
+ * aria-label, hidden and an inline style (px lengths and hex colors) are
+ * kept; a, button, input, select, textarea and anything with tabindex or
+ * onclick counts as interactive. Tag names the global AtomTable does not
+ * know are stored by the document, never interned.
+ *
+ * Scans for tag, character reference and quote delimiters, and for
+ * whitespace to collapse, run 16 bytes at a time on x86-64.
+ */
+class HtmlParser {
+public:
+    struct Options {
+        // Elements nested deeper become siblings at this depth.
+        std::size_t maxDepth = 512;
+        // Elements past this many are dropped; see truncated().
+        std::size_t maxNodes = std::numeric_limits<std::size_t>::max();
+    };
+
+    HtmlParser();
+    explicit HtmlParser(Options options);
+
+    void feed(std::string_view chunk);
+
+    // Parses what is left, closes open elements and returns the document.
+    // The parser is then ready for the next one.
+    FlatDocument finish();
+
+    // Input fed since the last finish().
+    std::size_t bytesFed() const { return bytesFed_; }
+    // Whether elements were dropped for Options::maxNodes since the last
+    // finish().
+    bool truncated() const { return truncated_; }
+
+private:
+    enum class Mode : std::uint8_t { Data, Comment, Bogus, RawText };
+
+    // What the tree builder needs to know about a tag name; see
+    // html_parser.cpp for the flags and groups.
+    struct TagInfo {
+        // the global atom, or for a name it lacks one numbered by this
+        // parser (with kLocalAtom set) that only tells open elements apart
+        Atom atom = atoms::Empty;
+        std::string_view name; // the key in tags_
+        std::uint8_t flags = 0;
+        std::uint8_t group = 0; // optional-end-tag group the element is in
+        std::uint8_t ends = 0;  // groups whose open element this tag closes
+    };
+
+    struct OpenElement {
+        Atom tag = atoms::Empty;
+        std::uint8_t group = 0;
+        std::string text; // collapsed, added to the node when it closes
+        bool pendingSpace = false;
+    };
+
+    struct NameHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+
+    // Parses [begin, end) and returns how much of it was consumed.
+    std::size_t parse(const char* begin, const char* end, bool final);
+    const char* parseMarkup(const char* p, const char* end, bool final);
+    const char* parseRawText(const char* p, const char* end, bool final, bool& incomplete);
+    void startScan();
+    bool tagArrived();
+    void attribute(std::string_view name, std::string_view value);
+    const TagInfo& tagInfo(std::string_view name);
+    void startTag(bool selfClosing);
+    void endTag(std::string_view name);
+    void push(const TagInfo& tag);
+    void closeTop();
+    void addText(const char* p, const char* end);
+
+    Options options_;
+    FlatDocumentBuilder builder_;
+    // tag names seen by this parser, so each is classified once; names
+    // without a global atom are forgotten at finish()
+    std::unordered_map<std::string, TagInfo, NameHash, std::equal_to<>> tags_;
+    Atom unknownTags_ = 0;
+    std::vector<OpenElement> open_; // entries past depth_ are kept for reuse
+    std::size_t depth_ = 0;
+    Mode mode_ = Mode::Data;
+    std::string pending_; // unconsumed tail of the input
+    // pending_ starts with a cut-off tag whose closing '>' has been looked
+    // for up to here (0 if it doesn't), in the quoting state it ended in
+    std::size_t scanned_ = 0;
+    char scanState_ = 0;
+    std::size_t bytesFed_ = 0;
+    bool truncated_ = false;
+
+    // current tag, reused across tags
+    std::string name_, id_, role_, ariaLabel_, value_;
+    Style style_;
+    bool interactive_ = false;
+    bool hidden_ = false;
+};
+
+// Parses a complete document.
+FlatDocument parseHtml(std::string_view html);
+
+}
@@ -3,6 +3,9 @@
 #include "openperf/page.hpp"
 #include "openperf/accessibility.hpp"
 #include "openperf/metrics.hpp"
+#include "openperf/page_editor.hpp"
+#include "openperf/render_pipeline.hpp"
+#include "openperf/render_handle.hpp"
 
 #include <string>
 #include <vector>
@@ -14,9 +17,9 @@ namespace openperf {
  * Abstract interface for IPC endpoints that expose Engine functionality.
  * 
  * This abstraction allows plugging in different transport mechanisms:
- * - gRPC (current implementation in daemon/)
- * - Unix domain sockets
- * - Shared memory transport
+ * - gRPC (daemon/)
+ * - Unix domain sockets (uds_endpoint.hpp)
+ * - Shared memory rings (shm_endpoint.hpp)
  * - Named pipes
  * 
  * The core Engine remains transport-agnostic, making it easy to:
@@ -34,22 +37,99 @@ public:
      */
     virtual std::string submitPage(Page page) = 0;
 
+    /**
+     * Submit many pages in one call.
+     * Returns their IDs, in the order of `pages`.
+     */
+    virtual std::vector<std::string> submitPages(std::vector<Page> pages) = 0;
+
     /**
      * Trigger the render pipeline for a given page.
      * This is asynchronous - the pipeline runs in a background task.
      */
     virtual void runRenderPipeline(const std::string& pageId) = 0;
 
+    /**
+     * Trigger the render pipeline and get notified when it finishes.
+     * `done` receives the per-stage timings; it may run on an engine
+     * worker thread, so it must not block.
+     */
+    virtual void runRenderPipeline(const std::string& pageId, RenderCallback done) = 0;
+
+    /**
+     * Trigger the render pipeline for many pages. With `done`, it receives
+     * one result per ID, in order, once the last render has finished;
+     * unknown and rejected pages carry that status.
+     */
+    virtual void runRenderBatch(const std::vector<std::string>& pageIds, RenderBatchCallback done) = 0;
+
+    /**
+     * Trigger the render pipeline and get a handle to wait on. The result
+     * carries the page ID, per-stage timings and the queue wait.
+     * By default the handle is completed through runRenderPipeline(pageId,
+     * done) and cannot cancel; endpoints that can stop a queued render
+     * override this.
+     */
+    virtual RenderHandle render(const std::string& pageId) {
+        RenderPromise promise{pageId};
+        runRenderPipeline(pageId, promise.callback());
+        return promise.handle();
+    }
+
+    /**
+     * render() for many pages, issued as one runRenderBatch(). Returns one
+     * handle per ID, in order; waitAll() blocks until all have reported.
+     */
+    virtual std::vector<RenderHandle> renderBatch(const std::vector<std::string>& pageIds) {
+        std::vector<RenderPromise> promises;
+        std::vector<RenderHandle> handles;
+        promises.reserve(pageIds.size());
+        handles.reserve(pageIds.size());
+        for (const auto& id : pageIds) {
+            promises.emplace_back(id);
+            handles.push_back(promises.back().handle());
+        }
+        runRenderBatch(pageIds, [promises = std::move(promises)](std::vector<RenderResult> results) {
+            for (std::size_t i = 0; i < promises.size() && i < results.size(); ++i) {
+                promises[i].complete(std::move(results[i]));
+            }
+        });
+        return handles;
+    }
+
     /**
      * Analyze accessibility issues for a given page.
      * Returns a list of discovered issues.
      */
     virtual std::vector<AccessibilityIssue> analyzeAccessibility(const std::string& pageId) = 0;
 
+    /**
+     * Analyze many pages. Returns one report per ID, in order; a report
+     * is marked not found for an unknown ID.
+     */
+    virtual std::vector<AccessibilityReport> analyzeAccessibilityBatch(const std::vector<std::string>& pageIds) = 0;
+
+    /**
+     * Apply insert, remove and update mutations to a stored page, all or
+     * nothing. Later analysis and layout only revisit what changed.
+     */
+    virtual PatchResult patchPage(const std::string& pageId, const std::vector<NodeMutation>& mutations) = 0;
+
     /**
      * Get current metrics from the engine.
      */
     virtual std::vector<Metric> getMetrics() const = 0;
+
+    /**
+     * Get only the samples recorded after `cursor` (0 = all retained ones).
+     * The returned cursor is passed back on the next call.
+     */
+    virtual MetricsDelta getMetricsSince(std::uint64_t cursor) const = 0;
+
+    /**
+     * Get aggregated per-metric stats (count, p50/p90/p99, max).
+     */
+    virtual std::vector<MetricSummary> getMetricSummaries() const = 0;
 };
 
 } // namespace openperf
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "openperf/flat_document.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace openperf {
+
+/**
+ * Layout output: the border box of every node, indexed by NodeIndex.
+ *
+ * Stored as struct-of-arrays in document order, so a pass over one
+ * coordinate (e.g. culling boxes against a tile) reads contiguous floats.
+ * Coordinates are page-absolute px; nodes that are not displayed get an
+ * empty box at their parent's origin.
+ */
+struct BoxArray {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> width;
+    std::vector<float> height;
+
+    std::size_t size() const { return x.size(); }
+    std::size_t memoryBytes() const;
+};
+
+/**
+ * What a layout knows about each node beyond its box, kept so that the
+ * layout of an edited copy of the document can take over the subtrees the
+ * edit left alone (see LayoutEngine::layout).
+ */
+struct LayoutState {
+    std::vector<float> preferred;      // max-content width
+    std::vector<float> ownHeight;      // before the parent stretched or grew it
+    std::vector<float> relX, relY;     // offset from the parent's border box
+    std::vector<std::uint8_t> hidden;  // not displayed, itself or by an ancestor
+    std::size_t reusedNodes = 0;       // boxes taken over from the previous layout
+
+    std::size_t memoryBytes() const;
+};
+
+// An earlier layout and the subtrees a document copied from its document.
+struct PreviousLayout {
+    const BoxArray& boxes;
+    const LayoutState& state;
+    const std::vector<CopiedSubtree>& copied; // in document order
+};
+
+/**
+ * Computes a BoxArray from a FlatDocument's styles.
+ *
+ * Supports block flow, inline boxes, absolute positioning and single-line
+ * flexbox (row or column, flex-grow, proportional shrink, stretch). Inline
+ * elements are approximated as atomic boxes that wrap as a whole; text is
+ * measured as characters times charWidth and flows in lines of lineHeight.
+ * Margins don't collapse.
+ *
+ * Runs as four linear passes over the document: preferred widths bottom-up,
+ * used widths top-down, heights and offsets bottom-up, absolute coordinates
+ * top-down. No recursion, so deep documents are safe.
+ *
+ * Styles come from clients, so each is first passed through clampStyle():
+ * boxes are always finite, whatever the page asks for.
+ *
+ * Given a previous layout, a copied subtree keeps its preferred widths,
+ * and if its root is given the width it had before, every box below the
+ * root is copied as well: a subtree's layout depends on nothing outside
+ * it but that width. Only the changed regions and their ancestors are
+ * laid out again; the result equals a full layout.
+ */
+class LayoutEngine {
+public:
+    struct Options {
+        float viewportWidth = 1280;
+        float charWidth = 8;
+        float lineHeight = 20;
+    };
+
+    LayoutEngine() : LayoutEngine(Options{}) {}
+    explicit LayoutEngine(Options options) : options_(options) {}
+
+    // Lengths and offsets beyond this are clamped to it.
+    static constexpr float kMaxLength = 1 << 20;
+
+    // Fills in `state` if given.
+    BoxArray layout(const FlatDocument& doc, LayoutState* state = nullptr,
+                    const PreviousLayout* previous = nullptr) const;
+
+    // `style` with NaN lengths reset (widths and heights to auto, others to
+    // 0), infinities and other lengths clamped to +-kMaxLength, and
+    // padding, border width and flex-grow kept non-negative.
+    static Style clampStyle(const Style& style);
+
+    // Style::Display::Auto resolved by tag.
+    static Style::Display displayOf(const FlatDocument& doc, NodeIndex i);
+
+private:
+    Options options_;
+};
+
+}
@@ -1,9 +1,16 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
-#include <mutex>
 
 namespace openperf {
 
@@ -11,15 +18,182 @@ struct Metric {
     std::string name;
     double value;
     std::chrono::steady_clock::time_point timestamp;
+    // Recording order: nanoseconds since the Metrics was created, bumped to
+    // stay strictly increasing per thread. Starts at 1.
+    std::uint64_t sequence = 0;
+};
+
+// Samples recorded after a cursor, see Metrics::getMetricsSince.
+struct MetricsDelta {
+    std::vector<Metric> samples;
+    std::uint64_t cursor = 0; // pass back to get only newer samples
+    std::uint64_t missed = 0; // samples overwritten before they could be read
+};
+
+using MetricId = std::uint32_t;
+inline constexpr MetricId kInvalidMetric = ~MetricId{0};
+
+enum class MetricKind {
+    Histogram, // latency-like samples: percentiles are tracked
+    Counter    // monotonically added values: only count/sum are tracked
+};
+
+struct HistogramStats {
+    std::uint64_t count = 0;
+    double sum = 0;
+    double min = 0;
+    double max = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
 };
 
+struct MetricSummary {
+    std::string name;
+    MetricKind kind;
+    HistogramStats total;  // since startup
+    HistogramStats window; // last completed window (current one until the first completes)
+};
+
+/**
+ * Bounded-memory metrics store.
+ *
+ * Metrics are registered once and recorded through their MetricId. Each
+ * recording thread gets its own buffers: fixed-size log-linear histograms
+ * (about 6% relative precision) per metric and a ring of its most recent
+ * raw samples. The owning thread is the only writer of its buffers, so
+ * record() takes no locks and makes no shared writes: a sample's sequence
+ * comes from its timestamp and its thread's previous sequence, and is only
+ * raised past a watermark that readers publish, so a polled cursor never
+ * skips a sample. Readers sum across threads and merge the rings. A
+ * thread's buffers are handed to the next new thread once it exits, so
+ * memory depends on the number of threads alive at once and metrics, never
+ * on uptime or thread churn.
+ */
 class Metrics {
 public:
+    static constexpr std::size_t kMaxMetrics = 256;
+    static constexpr std::size_t kRawSamplesPerThread = 512;
+    static constexpr std::size_t kCursorMarks = 64;
+
+    explicit Metrics(std::chrono::steady_clock::duration window = std::chrono::seconds(10));
+    ~Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    // Idempotent; returns kInvalidMetric once kMaxMetrics names are taken.
+    MetricId registerMetric(std::string_view name, MetricKind kind = MetricKind::Histogram);
+
+    // Hot path: wait-free once the calling thread has touched this metric.
+    void record(MetricId id, double value);
+
+    // Convenience for cold paths; resolves (and registers) the name first.
     void record(const std::string& name, double value);
+
+    // Most recent raw samples across all threads, oldest first.
     std::vector<Metric> getMetrics() const; // by value, avoid potential UB
+
+    // Retained samples with sequence > cursor, oldest first. Samples still
+    // being written are held back, so polling with the returned cursor never
+    // skips one. `missed` is exact for the last kCursorMarks cursors handed
+    // out; older cursors only count evictions the rings can still show.
+    MetricsDelta getMetricsSince(std::uint64_t cursor) const;
+
+    // Aggregated stats for every registered metric.
+    std::vector<MetricSummary> summarize() const;
+
 private:
-    mutable std::mutex mutex_;
-    std::vector<Metric> samples_;
+    static constexpr int kSubBucketBits = 4;
+    static constexpr std::size_t kSubBuckets = std::size_t{1} << kSubBucketBits;
+    static constexpr std::size_t kBuckets = 38 * kSubBuckets; // values up to 2^40 units
+    static constexpr double kUnitsPerValue = 1000.0;           // e.g. microsecond resolution for ms
+
+    struct Histogram {
+        std::array<std::atomic<std::uint64_t>, kBuckets> buckets{};
+        std::atomic<std::uint64_t> count{0};
+        std::atomic<double> sum{0};
+        std::atomic<double> min{0};
+        std::atomic<double> max{0};
+    };
+
+    struct RawSlot {
+        std::atomic<std::uint64_t> seq{0}; // 0 = empty or being written
+        std::atomic<std::uint64_t> sequence{0};
+        std::atomic<MetricId> id{0};
+        std::atomic<double> value{0};
+        std::atomic<std::int64_t> timestampNs{0};
+    };
+
+    struct ThreadBuffer {
+        std::array<std::atomic<Histogram*>, kMaxMetrics> histograms{};
+        std::array<RawSlot, kRawSamplesPerThread> raw;
+        std::atomic<std::uint64_t> rawHead{0};
+        std::atomic<std::uint64_t> pendingSequence{0}; // lower bound of an in-flight record, 0 = idle
+        std::uint64_t lastSequence = 0;                // writer-only
+        std::vector<std::unique_ptr<Histogram>> owned; // writer-only, freed with the buffer
+    };
+
+    // Aggregated bucket counts, used for window deltas.
+    struct Totals {
+        std::vector<std::uint64_t> buckets;
+        std::uint64_t count = 0;
+        double sum = 0;
+        double min = 0;
+        double max = 0;
+    };
+
+    static std::size_t bucketFor(double value);
+    static double bucketValue(std::size_t bucket);
+    static HistogramStats statsFrom(const Totals& totals, MetricKind kind, bool exactMinMax);
+
+    // Buffers of live and exited threads; shared with the threads' exit
+    // hooks, which may outlive the Metrics.
+    struct BufferPool {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers; // appended once per buffer
+        std::vector<ThreadBuffer*> free;                    // of exited threads, reused first
+    };
+
+    // Per buffer, how many samples it had recorded up to a cursor handed
+    // out by getMetricsSince; lets the next call count evictions exactly.
+    struct CursorMark {
+        std::uint64_t cursor = 0;
+        std::vector<std::uint64_t> recorded;
+    };
+
+    ThreadBuffer& localBuffer();
+    static void releaseBuffer(void* pool, void* buffer);
+    Totals collect(MetricId id) const;
+
+    const std::uint64_t instanceId_;
+
+    // registry
+    mutable std::shared_mutex registryMutex_;
+    std::unordered_map<std::string, MetricId> ids_;
+    std::array<std::string, kMaxMetrics> names_;
+    std::array<MetricKind, kMaxMetrics> kinds_{};
+    std::atomic<std::uint32_t> registered_{0};
+
+    const std::int64_t epochNs_;
+    // Highest cursor a reader is about to hand out; only read by record().
+    alignas(64) mutable std::atomic<std::uint64_t> watermark_{0};
+
+    std::shared_ptr<BufferPool> pool_ = std::make_shared<BufferPool>();
+    // guarded by pool_->mutex
+    mutable std::vector<CursorMark> cursorMarks_;
+    mutable std::size_t nextCursorMark_ = 0;
+
+    // windowing state, only touched by readers
+    mutable std::mutex windowMutex_;
+    std::chrono::steady_clock::duration windowLength_;
+    mutable std::chrono::steady_clock::time_point windowStart_;
+    mutable std::vector<Totals> windowBase_;
+    mutable std::vector<HistogramStats> lastWindow_;
+    mutable bool haveCompletedWindow_ = false;
 };
 
+// Exact per-name stats over a batch of samples (total and window are equal).
+std::vector<MetricSummary> summarizeSamples(const std::vector<Metric>& samples);
+
 }
@@ -1,11 +1,41 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
 
 namespace openperf {
 
+class FlatDocument;
+class PageEditor;
+
+// Minimal CSS-like style read by the layout and paint stages. Lengths are
+// in px, colors are 0xRRGGBBAA.
+struct Style {
+    enum class Display : std::uint8_t { Auto, Block, Inline, Flex, None }; // Auto: the tag's default
+    enum class Position : std::uint8_t { Static, Absolute };
+    enum class FlexDirection : std::uint8_t { Row, Column };
+    static constexpr float kAuto = -1;
+
+    Display display = Display::Auto;
+    Position position = Position::Static;
+    FlexDirection flexDirection = FlexDirection::Row;
+    float width = kAuto;  // border box; negative is auto
+    float height = kAuto;
+    float left = 0;       // Absolute: offset from the parent's border box
+    float top = 0;
+    float margin = 0;     // same on all four sides
+    float padding = 0;
+    float flexGrow = 0;
+    std::uint32_t background = 0;  // 0 = transparent
+    std::uint32_t borderColor = 0;
+    float borderWidth = 0;         // drawn inside the border box
+
+    bool operator==(const Style&) const = default;
+};
+
 struct Node {
     std::string tag;
     std::string id;
@@ -13,13 +43,68 @@ struct Node {
     std::string role;
     std::string ariaLabel;
     bool isInteractive = false;
+    Style style;
     std::vector<std::shared_ptr<Node>> children;
 };
 
+// Bounds on trees taken from clients, shared by every transport: maxNodes
+// covers all of a request's trees together, and HTML streams are held to
+// maxHtmlBytes of markup in all. Node teardown recurses through its
+// children, so unbounded depth would also overflow the stack on free.
+struct TreeLimits {
+    std::size_t maxDepth = 96;
+    std::size_t maxNodes = 1'000'000;
+    std::size_t maxHtmlBytes = 64 << 20;
+};
+
+// Identifies a page's content independently of its id, see hashTree().
+struct ContentHash {
+    std::uint64_t value = 0;
+    std::size_t nodes = 0; // 0 = not hashed
+
+    bool empty() const { return nodes == 0; }
+    bool operator==(const ContentHash&) const = default;
+};
+
+// A subtree a patched snapshot's flat DOM copied from the previous
+// snapshot's: `size` nodes at index `to` here, at `from` there.
+struct CopiedSubtree {
+    std::uint32_t to = 0;
+    std::uint32_t from = 0;
+    std::uint32_t size = 0;
+};
+
 struct Page {
     std::string id;
     std::string url;
     std::shared_ptr<Node> root;
+
+    // Compact flat form of root, filled in by Engine::submitPage and
+    // Engine::patchPage. Pages parsed from HTML (see HtmlParser) have only
+    // this and no root.
+    std::shared_ptr<const FlatDocument> dom;
+
+    // Hash of root (or dom), filled in by Engine::submitPage and
+    // Engine::patchPage.
+    ContentHash content;
+
+    // Set by Engine::patchPage and shared by all later snapshots of the page.
+    std::shared_ptr<PageEditor> editor;
+    // Nodes the patch that produced this snapshot created (0 when submitted).
+    std::size_t changedNodes = 0;
+    // Set by Engine::patchPage: the content of the snapshot this one was
+    // patched from, and the subtrees dom copied from that snapshot's flat
+    // DOM, in document order. Layout reuses the earlier boxes of those.
+    ContentHash patchedFrom;
+    std::vector<CopiedSubtree> copiedSubtrees;
+
+    // Scheduler node (see TaskScheduler::nodeCount) whose workers run the
+    // page's renders; -1 = none in particular. Kept by patches.
+    int node = -1;
 };
 
+// Immutable snapshot handed out by the engine. Resubmitting a page swaps in a
+// new snapshot; holders of the old one keep it alive until they finish.
+using PagePtr = std::shared_ptr<const Page>;
+
 }
\ No newline at end of file
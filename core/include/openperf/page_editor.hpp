@@ -0,0 +1,101 @@
+#pragma once
+
+#include "openperf/flat_document.hpp"
+#include "openperf/page.hpp"
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace openperf {
+
+// One edit of a stored page's tree.
+struct NodeMutation {
+    enum class Kind { Insert, Remove, Update };
+    static constexpr std::size_t kAppend = std::numeric_limits<std::size_t>::max();
+
+    Kind kind = Kind::Update;
+    std::string nodeId;             // the parent for Insert, otherwise the node itself
+    std::size_t position = kAppend; // Insert: child index, clamped to the child count
+    // Insert: the subtree, copied into the page; the caller's nodes are never
+    // modified. Update: the new attributes; children are ignored and an
+    // empty id keeps the node's id.
+    std::shared_ptr<Node> node;
+};
+
+enum class PatchStatus {
+    Applied, PageNotFound, NodeNotFound, InvalidMutation
+};
+
+struct PatchResult {
+    PatchStatus status = PatchStatus::Applied;
+    std::size_t changedNodes = 0; // nodes created: edited, inserted and copied ancestors
+    std::string error;            // what failed, when not Applied
+};
+
+/**
+ * Applies NodeMutations to a page tree by path copying.
+ *
+ * An edited node and its ancestors are copied; every other subtree is
+ * shared with the previous tree, which stays valid for whoever still holds
+ * it. Unchanged subtrees keep their identity, so copied nodes double as
+ * dirty bits (see sharedSubtrees()).
+ *
+ * Keeps an id and parent index of the current tree, so a mutation costs
+ * O(depth + fanout along its path) instead of a walk of the page. Ids are
+ * expected to be unique; with duplicates, which node is targeted is
+ * unspecified. Not thread-safe: callers serialize on mutex().
+ */
+class PageEditor {
+public:
+    explicit PageEditor(std::shared_ptr<Node> root);
+
+    PageEditor(const PageEditor&) = delete;
+    PageEditor& operator=(const PageEditor&) = delete;
+
+    // All or nothing: on failure the tree and index are left as they were.
+    PatchResult apply(const std::vector<NodeMutation>& mutations);
+
+    const std::shared_ptr<Node>& root() const { return root_; }
+
+    // After apply(): the subtrees of `previous`, the root before it, that
+    // the current tree still shares, each with its index in `previousDom`,
+    // the flat form of `previous`. For FlatDocument::fromTree(). Empty if
+    // previousDom does not have previous's shape.
+    std::unordered_map<const Node*, NodeIndex> sharedSubtrees(const Node& previous,
+                                                              const FlatDocument& previousDom) const;
+    std::size_t nodeCount() const { return parent_.size(); }
+    std::size_t textBytes() const { return textBytes_; }
+
+    std::mutex& mutex() { return mutex_; }
+
+private:
+    PatchResult applyOne(const NodeMutation& mutation);
+
+    // Returns a writable copy of `node`, copying its ancestors up to the
+    // first node already copied by this apply() (or the root).
+    Node* own(const Node* node);
+    void replaceChild(Node& parent, const Node* from, std::shared_ptr<Node> to);
+
+    void reset(std::shared_ptr<Node> root);
+    void index(const std::shared_ptr<Node>& subtree, const Node* parent, bool fresh);
+    void unindex(const Node* subtree);
+    void indexId(const Node* node);
+    void unindexId(const Node* node);
+    static std::size_t textOf(const Node& node);
+
+    std::mutex mutex_;
+    std::shared_ptr<Node> root_;
+    std::unordered_map<std::string_view, const Node*> byId_; // views into the nodes' ids
+    std::unordered_map<const Node*, const Node*> parent_;    // every node; the root maps to null
+    std::unordered_set<const Node*> fresh_;                  // created by the current apply()
+    std::size_t textBytes_ = 0;
+};
+
+}
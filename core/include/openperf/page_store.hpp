@@ -0,0 +1,99 @@
+#pragma once
+
+#include "openperf/page.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace openperf {
+
+/**
+ * Concurrent id -> PagePtr map, lock-striped across shards.
+ *
+ * Each shard has its own reader/writer lock, so lookups of different pages
+ * never touch the same lock and lookups of the same page only share one.
+ * Tracks an approximate byte footprint and can evict the oldest pages once
+ * a byte budget is exceeded.
+ */
+class PageStore {
+public:
+    struct Options {
+        std::size_t shardCount = 64; // rounded up to a power of two
+        std::size_t maxBytes = 0;    // 0 = no eviction
+    };
+
+    PageStore();
+    explicit PageStore(Options options);
+
+    PagePtr find(const std::string& id) const;
+    bool contains(const std::string& id) const;
+
+    // find() for many ids, taking each shard's lock once. Results are in
+    // the order of `ids`, null where a page is missing.
+    std::vector<PagePtr> findBatch(const std::vector<std::string>& ids) const;
+
+    // Inserts or replaces; returns the previous snapshot (null if none).
+    PagePtr insert(PagePtr page);
+
+    // insert() for many pages, taking each shard's lock once. Pages with
+    // the same id are stored in order, so the last one wins. Eviction
+    // spares every page of the batch.
+    void insertBatch(std::vector<PagePtr> pages);
+
+    // Replaces the page only if `expected` is still its current snapshot.
+    bool replace(const PagePtr& expected, PagePtr page);
+
+    bool erase(const std::string& id);
+    void clear();
+
+    // Evicts pages until bytes() <= maxBytes, oldest-inserted first when the
+    // store was configured with a byte budget. Returns the number evicted.
+    std::size_t evictTo(std::size_t maxBytes);
+
+    std::size_t size() const { return count_.load(std::memory_order_relaxed); }
+    std::size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+    std::size_t evictions() const { return evictions_.load(std::memory_order_relaxed); }
+
+    // Approximate heap footprint of a page (snapshot, strings, DOM).
+    static std::size_t estimateBytes(const Page& page);
+
+private:
+    struct Entry {
+        PagePtr page;
+        std::size_t bytes = 0;
+        std::uint64_t generation = 0;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Entry> pages;
+        std::deque<std::pair<std::string, std::uint64_t>> fifo; // insertion order, lazily pruned
+    };
+
+    Shard& shardFor(const std::string& id) const;
+    std::size_t shardIndex(const std::string& id) const;
+    // Indices of `count` items grouped by shard, given each item's shard.
+    std::vector<std::uint32_t> groupByShard(const std::vector<std::uint32_t>& shardOf) const;
+    void pruneFifo(Shard& shard);
+    // Pages inserted at generation keepFrom or later are spared; 0 spares none.
+    std::size_t evictUntil(std::size_t maxBytes, std::uint64_t keepFrom);
+    bool evictOldest(Shard& shard, std::uint64_t keepFrom);
+    void account(std::ptrdiff_t countDelta, std::ptrdiff_t bytesDelta);
+
+    Options options_;
+    std::size_t shardMask_;
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<std::uint64_t> generation_{0};
+    std::atomic<std::size_t> count_{0};
+    std::atomic<std::size_t> bytes_{0};
+    std::atomic<std::size_t> evictions_{0};
+    std::atomic<std::size_t> evictCursor_{0};
+};
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "openperf/flat_document.hpp"
+#include "openperf/layout.hpp"
+#include "openperf/task_scheduler.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace openperf {
+
+// A solid rectangle, in painter's order. Pixel coordinates, half-open.
+struct DisplayItem {
+    std::int32_t x0, y0, x1, y1;
+    std::uint32_t color; // 0xRRGGBBAA
+
+    bool operator==(const DisplayItem&) const = default;
+};
+
+/**
+ * Paint commands for one viewport, binned by tile.
+ *
+ * items are in painter's order. The items touching tile t are
+ * tileItems[tileOffsets[t] .. tileOffsets[t + 1]), still in painter's
+ * order, so each tile can be rasterized on its own.
+ */
+struct DisplayList {
+    std::int32_t width = 0, height = 0, tileSize = 0;
+    std::int32_t tilesX = 0, tilesY = 0;
+    std::uint32_t clearColor = 0; // 0xRRGGBBAA, what tiles start as
+    std::vector<DisplayItem> items;
+    std::vector<std::uint32_t> tileOffsets; // tilesX * tilesY + 1 entries
+    std::vector<std::uint32_t> tileItems;
+
+    std::size_t tileCount() const { return static_cast<std::size_t>(tilesX) * static_cast<std::size_t>(tilesY); }
+};
+
+/**
+ * Rasterized viewport or layer. Pixels are premultiplied RGBA bytes in
+ * memory order (opaque pixels read the same either way) and stored tile by
+ * tile: tile t occupies tileSize * tileSize pixels from
+ * t * tileSize * tileSize, row-major, with edge tiles padded.
+ */
+struct Raster {
+    std::int32_t width = 0, height = 0, tileSize = 0;
+    std::int32_t tilesX = 0, tilesY = 0;
+    std::vector<std::uint32_t> pixels;
+    std::vector<double> tileMs; // rasterization time per tile
+
+    std::uint32_t pixel(std::int32_t x, std::int32_t y) const;
+    std::size_t memoryBytes() const { return pixels.capacity() * sizeof(std::uint32_t); }
+};
+
+// Span kernels the rasterizer can use. Auto picks the widest one the CPU
+// supports; SSE2 and AVX2 exist on x86-64 builds only.
+enum class PaintKernel { Auto, Scalar, Sse2, Avx2 };
+
+bool paintKernelSupported(PaintKernel kernel);
+const char* paintKernelName(PaintKernel kernel);
+
+// The kernel actually used for a request: Auto and unsupported kernels
+// resolve to a supported one.
+PaintKernel resolvePaintKernel(PaintKernel kernel);
+
+// A separately painted part of the viewport, placed at (x, y). The list is
+// in layer space; its width and height are the layer's size.
+struct Layer {
+    std::int32_t x = 0, y = 0;
+    std::shared_ptr<const DisplayList> list;
+    std::shared_ptr<const Raster> raster; // list, rasterized
+};
+
+/**
+ * Software painter: turns layout output into a display list and rasterizes
+ * it into tiled RGBA buffers.
+ *
+ * Each displayed node contributes its background, its border as four
+ * rects, and one translucent bar per line of text standing in for glyphs.
+ * Only the viewport (from the page origin) is painted. Opaque spans are
+ * plain stores; translucent ones are source-over blends. With a scheduler,
+ * tiles are rasterized in parallel.
+ *
+ * paintLayers() splits the page for the compositor: the root layer covers
+ * the viewport, and every displayed position: absolute node in it gets a
+ * layer of its own, clipped to its box, up to maxLayers in all. Layers
+ * stack in document order, so absolute content sits above the flow content
+ * of its ancestors' layers. Absolute nodes past the limit are painted into
+ * their parent's layer, in document order with its other content.
+ */
+class Painter {
+public:
+    struct Options {
+        std::int32_t viewportWidth = 1280;
+        std::int32_t viewportHeight = 720;
+        std::int32_t tileSize = 256;
+        PaintKernel kernel = PaintKernel::Auto;
+        // text metrics; keep in step with LayoutEngine::Options
+        float charWidth = 8;
+        float lineHeight = 20;
+        std::uint32_t textColor = 0x20202080;
+        std::uint32_t clearColor = 0xffffffff;
+        // paintLayers(): layers per page, the root layer included
+        std::size_t maxLayers = 16;
+    };
+
+    Painter();
+    explicit Painter(TaskScheduler* scheduler);
+    Painter(TaskScheduler* scheduler, Options options);
+
+    DisplayList record(const FlatDocument& doc, const BoxArray& boxes) const;
+    Raster rasterize(const DisplayList& list) const;
+
+    Raster paint(const FlatDocument& doc, const BoxArray& boxes) const { return rasterize(record(doc, boxes)); }
+
+    std::vector<Layer> paintLayers(const FlatDocument& doc, const BoxArray& boxes) const;
+
+    PaintKernel kernel() const { return kernel_; }
+
+private:
+    TaskScheduler* scheduler_;
+    Options options_;
+    PaintKernel kernel_; // resolved from options_.kernel
+};
+
+}
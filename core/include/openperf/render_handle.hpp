@@ -0,0 +1,75 @@
+#pragma once
+
+#include "openperf/render_pipeline.hpp"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace openperf {
+
+/**
+ * Waitable result of one render.
+ *
+ * Handles are cheap to copy and all copies see the same result. wait()
+ * blocks on a condition variable until the render reports, so callers
+ * awaiting many renders neither sleep nor poll. cancel() stops a render
+ * that has not started its first stage; it then completes with
+ * RenderStatus::Cancelled. Handles from remote endpoints cannot cancel.
+ */
+class RenderHandle {
+public:
+    RenderHandle() = default; // not attached to a render
+
+    bool valid() const { return state_ != nullptr; }
+    const std::string& pageId() const;
+
+    bool ready() const;
+    // Blocks until the render has reported; the result lives as long as
+    // any handle to it. Without a render, returns a Cancelled result at once.
+    const RenderResult& wait() const;
+    // Returns false if the render has not reported within `timeout`, and at
+    // once without a render, which never reports.
+    bool waitFor(std::chrono::steady_clock::duration timeout) const;
+
+    // Stops the render if no stage has started yet. Returns whether it did;
+    // the handle then completes, possibly from another thread, as Cancelled.
+    bool cancel();
+
+private:
+    friend class RenderPromise;
+    struct State;
+
+    explicit RenderHandle(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+    std::shared_ptr<State> state_;
+};
+
+/**
+ * Producer side of a RenderHandle: whoever runs the render completes it.
+ */
+class RenderPromise {
+public:
+    explicit RenderPromise(std::string pageId);
+
+    RenderHandle handle() const { return RenderHandle(state_); }
+
+    // What handle().cancel() calls; returns whether the render was stopped.
+    void setCanceller(std::function<bool()> cancel);
+
+    // Publishes the result and wakes every waiter. Only the first call counts.
+    void complete(RenderResult result) const;
+
+    // A callback that completes this promise, for APIs that report through one.
+    RenderCallback callback() const;
+
+private:
+    std::shared_ptr<RenderHandle::State> state_;
+};
+
+// Blocks until every handle has reported.
+void waitAll(const std::vector<RenderHandle>& handles);
+
+}
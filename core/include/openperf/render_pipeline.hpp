@@ -0,0 +1,229 @@
+#pragma once
+
+#include "openperf/page.hpp"
+#include "openperf/task_scheduler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace openperf {
+
+struct BoxArray;
+struct Frame;
+struct LayoutState;
+
+struct StageTiming {
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+};
+
+enum class RenderStatus {
+    Completed,
+    PageNotFound,
+    Rejected,  // admission queue full
+    Shed,      // dropped from the admission queue for a newer render
+    Cancelled, // cancelled before its first stage started
+    Expired    // its deadline passed before its first stage started
+};
+
+// Outcome of one render, reported once its last stage has finished.
+struct RenderResult {
+    std::string pageId;
+    RenderStatus status = RenderStatus::Completed;
+    std::chrono::steady_clock::time_point submitted;
+    std::chrono::steady_clock::time_point completed;
+    std::vector<std::string> stageNames; // parallel to stages
+    std::vector<StageTiming> stages;
+
+    // First stage's start; `submitted` when no stage ran.
+    std::chrono::steady_clock::time_point started() const {
+        auto first = stages.empty() ? submitted : stages.front().start;
+        for (const auto& t : stages) first = std::min(first, t.start);
+        return first;
+    }
+    // Submission to the first stage's start: admission and scheduler queueing.
+    std::chrono::steady_clock::duration queueWait() const { return started() - submitted; }
+    // First stage's start to the last stage's end.
+    std::chrono::steady_clock::duration runTime() const {
+        auto last = started();
+        for (const auto& t : stages) last = std::max(last, t.end);
+        return last - started();
+    }
+};
+
+using RenderCallback = std::function<void(RenderResult)>;
+using RenderBatchCallback = std::function<void(std::vector<RenderResult>)>;
+
+// What rendering some content produced; pages with the same content reuse it.
+struct RenderOutput {
+    std::shared_ptr<const FlatDocument> dom;
+    std::shared_ptr<const BoxArray> boxes;
+    std::shared_ptr<const LayoutState> layout; // lets layouts of patched snapshots reuse boxes
+    std::shared_ptr<const Frame> frame;
+};
+
+// Per-render state handed from stage to stage.
+struct RenderJob {
+    std::string pageId;
+    PagePtr page;                              // shared snapshot, never copied
+    std::shared_ptr<const FlatDocument> dom;   // set by the parse stage
+    std::shared_ptr<const BoxArray> boxes;     // set by the layout stage
+    std::shared_ptr<const LayoutState> layout; // likewise
+    std::shared_ptr<const Frame> frame;        // layers from paint, composited by composite
+    std::shared_ptr<const RenderOutput> cached; // set when the content was rendered before
+    std::chrono::steady_clock::time_point submitted;
+    TaskOptions options;             // lane and node of its stage tasks, and its deadline
+    std::vector<StageTiming> stages; // indexed by StageId
+    RenderCallback onDone;           // optional, called by the engine on completion
+
+    // Pending until a stage starts; RenderPipeline::cancel() moves a pending
+    // job to Cancelled, and a first stage starting past the deadline to
+    // Expired. The stages of either run without doing anything.
+    enum class Phase : std::uint8_t { Pending, Running, Cancelled, Expired };
+    std::atomic<Phase> phase{Phase::Pending};
+};
+
+// What submit() does with a job once maxInFlight jobs are running and
+// queueCapacity more are waiting to be admitted.
+enum class AdmissionPolicy {
+    // Wait for room. A submitter on a scheduler worker can't wait (it may be
+    // the worker the queue needs) and is turned away as under Reject, so
+    // the queue stays bounded; the async server's handlers all run there.
+    Block,
+    Reject,    // turn the new job away
+    ShedOldest // drop the job that has waited longest to make room
+};
+
+struct AdmissionOptions {
+    std::size_t maxInFlight = 0;   // jobs admitted but not completed, 0 = unlimited
+    std::size_t queueCapacity = 0; // jobs waiting for admission
+    AdmissionPolicy policy = AdmissionPolicy::Reject;
+};
+
+struct StageOptions {
+    std::size_t maxConcurrency = 0; // 0 = unlimited
+    std::size_t queueCapacity = 0;  // jobs waiting for a slot, 0 = unbounded
+};
+
+/**
+ * Render pipeline expressed as a DAG of stages run on a TaskScheduler.
+ *
+ * Every stage of every job is its own scheduler task; when a stage finishes
+ * it schedules the successors whose dependencies are now all satisfied, so
+ * Parse of one page overlaps Layout/Paint/Composite of others.
+ *
+ * A stage with maxConcurrency runs at most that many jobs at once; extra
+ * jobs wait in the stage's queue. When that queue is also full the upstream
+ * stage keeps its own slot until the job is admitted, which throttles the
+ * upstream stage instead of blocking a worker thread.
+ *
+ * Jobs past the in-flight limit wait in an admission queue, so the
+ * scheduler only ever holds stage tasks of admitted jobs. The queue has a
+ * FIFO lane per TaskPriority, served in firstLaneForTurn() order like the
+ * scheduler's. What happens when it is full is up to the AdmissionPolicy;
+ * ShedOldest only ever sheds a job of the new one's priority or lower.
+ *
+ * The graph and admission options must be set before the first submit().
+ */
+class RenderPipeline {
+public:
+    using StageId = std::size_t;
+    using StageFn = std::function<void(RenderJob&)>;
+    using CompletionFn = std::function<void(RenderJob&)>;
+
+    explicit RenderPipeline(TaskScheduler& scheduler);
+    ~RenderPipeline();
+
+    StageId addStage(std::string name, StageFn fn,
+                     StageOptions options = {},
+                     std::vector<StageId> dependsOn = {});
+
+    void onComplete(CompletionFn fn) { onComplete_ = std::move(fn); }
+
+    // Called with each job ShedOldest drops, on the thread whose submit()
+    // displaced it. The job never ran.
+    void onShed(CompletionFn fn) { onShed_ = std::move(fn); }
+
+    void setAdmission(AdmissionOptions options) { admission_ = options; }
+    const AdmissionOptions& admission() const { return admission_; }
+
+    // Returns false if the job was rejected; it is left untouched then.
+    bool submit(std::shared_ptr<RenderJob> job);
+
+    enum class CancelResult {
+        Started,  // too late: a stage has started, or the job is done
+        Dequeued, // taken out of the admission queue; the caller reports it
+        Skipped   // admitted: its stages do nothing and onComplete reports it
+    };
+
+    // Stops `job` before its first stage starts. Either way it ends up in
+    // RenderJob::Phase::Cancelled.
+    CancelResult cancel(const std::shared_ptr<RenderJob>& job);
+
+    std::size_t stageCount() const { return stages_.size(); }
+    const std::string& stageName(StageId id) const { return stages_[id]->name; }
+    std::size_t inFlight() const { return inFlightJobs_.load(std::memory_order_relaxed); }
+    std::size_t queued() const { return queuedJobs_.load(std::memory_order_relaxed); }
+
+private:
+    struct JobState;
+    struct SlotHold;
+
+    struct Blocked {
+        std::shared_ptr<JobState> job;
+        std::shared_ptr<SlotHold> hold; // upstream slot released once admitted
+    };
+
+    struct Stage {
+        std::string name;
+        const char* traceName = nullptr; // interned copy of name
+        StageFn fn;
+        StageOptions options;
+        std::vector<StageId> successors;
+        std::uint32_t predecessorCount = 0;
+        bool successorMayBlock = false; // some successor has both limits set
+
+        std::mutex mutex;
+        std::size_t running = 0;
+        std::deque<std::shared_ptr<JobState>> queue;
+        std::deque<Blocked> blocked;
+    };
+
+    void start(std::shared_ptr<RenderJob> job);
+    void finished();
+    void deliver(StageId id, std::shared_ptr<JobState> job, const std::shared_ptr<SlotHold>& hold);
+    void schedule(StageId id, std::shared_ptr<JobState> job);
+    // `dropped`: the scheduler dropped the stage task; the job is cancelled
+    // and its remaining stages only pass it along.
+    void run(StageId id, const std::shared_ptr<JobState>& job, bool dropped = false);
+    void releaseSlot(StageId id);
+
+    TaskScheduler& scheduler_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::vector<StageId> roots_;
+    CompletionFn onComplete_;
+    CompletionFn onShed_;
+    AdmissionOptions admission_;
+    std::atomic<std::size_t> inFlightJobs_{0};
+
+    // admission queue, one lane per priority; only used with a maxInFlight
+    std::mutex admissionMutex_;
+    std::condition_variable roomCv_; // Block submitters wait here
+    std::array<std::deque<std::shared_ptr<RenderJob>>, kTaskPriorities> waiting_;
+    std::size_t waitingCount_ = 0;   // across lanes
+    std::uint64_t admissionTurn_ = 0;
+    std::atomic<std::size_t> queuedJobs_{0};
+    std::atomic<bool> destroying_{false};
+};
+
+}
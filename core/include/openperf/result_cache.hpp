@@ -0,0 +1,172 @@
+#pragma once
+
+#include "openperf/page.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace openperf {
+
+// Structural hash of a page tree: tags, ids, text, roles, labels, styles
+// and shape. Page ids and urls are not part of it, so pages built from the
+// same template with the same content hash equally. Keyed with a random
+// per-process key, so values mean nothing outside the process and clients
+// cannot craft collisions with other clients' pages.
+ContentHash hashTree(const Node& root);
+
+// The same hash for a flat DOM, equal to hashTree(*doc.toTree()). Only the
+// first root's subtree is hashed.
+ContentHash hashDocument(const FlatDocument& doc);
+
+template <typename Key>
+struct CacheKeyHash : std::hash<Key> {};
+
+template <>
+struct CacheKeyHash<ContentHash> {
+    std::size_t operator()(const ContentHash& k) const { return static_cast<std::size_t>(k.value); }
+};
+
+/**
+ * Bounded map from page content to a computed result, shared by every page
+ * with that content.
+ *
+ * Keys are content hashes, so a resubmitted page that changed simply stops
+ * matching its old entries; those age out. Other keys (e.g. page ids) work
+ * too, given a CacheKeyHash; empty keys are never stored. Eviction is segmented LRU: new
+ * entries start in a probation segment and move to the protected segment
+ * on their second hit, so a burst of one-off pages evicts other one-off
+ * pages before it evicts the templates that keep getting hit. The protected
+ * segment may use protectedShare of maxBytes.
+ *
+ * Values are immutable and handed out as shared pointers, so the lock is
+ * only held for the list and map updates.
+ */
+template <typename Value, typename Key = ContentHash>
+class ResultCache {
+public:
+    struct Options {
+        std::size_t maxBytes = 32u << 20;
+        double protectedShare = 0.8;
+    };
+
+    ResultCache() : ResultCache(Options{}) {}
+    explicit ResultCache(Options options) : options_(options) {}
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Null on a miss, and for pages without a content hash.
+    std::shared_ptr<const Value> find(const Key& key) {
+        if (key.empty()) return nullptr;
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = index_.find(key);
+        if (it == index_.end()) return nullptr;
+
+        auto entry = it->second;
+        if (entry->isProtected) {
+            protected_.splice(protected_.begin(), protected_, entry);
+        } else {
+            // second hit: promote
+            protected_.splice(protected_.begin(), probation_, entry);
+            entry->isProtected = true;
+            probationBytes_ -= entry->bytes;
+            protectedBytes_ += entry->bytes;
+            // demote the coldest protected entries back to probation
+            while (protectedBytes_ > protectedLimit() && protected_.size() > 1) {
+                auto cold = std::prev(protected_.end());
+                cold->isProtected = false;
+                protectedBytes_ -= cold->bytes;
+                probationBytes_ += cold->bytes;
+                probation_.splice(probation_.begin(), protected_, cold);
+            }
+        }
+        return entry->value;
+    }
+
+    // Stores `value` under `key`, replacing any previous value, and evicts
+    // until the cache fits. Returns the number of entries evicted. Values
+    // larger than maxBytes are not stored.
+    std::size_t insert(const Key& key, std::shared_ptr<const Value> value, std::size_t bytes) {
+        if (key.empty() || !value) return 0;
+        std::size_t evicted = 0;
+        std::list<Entry> dropped; // released outside the lock
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (auto it = index_.find(key); it != index_.end()) unlink(it->second, dropped);
+            if (bytes > options_.maxBytes) return 0;
+
+            probation_.push_front(Entry{key, std::move(value), bytes, false});
+            index_.emplace(key, probation_.begin());
+            probationBytes_ += bytes;
+
+            while (probationBytes_ + protectedBytes_ > options_.maxBytes) {
+                auto& from = probation_.empty() ? protected_ : probation_;
+                unlink(std::prev(from.end()), dropped);
+                ++evicted;
+            }
+        }
+        return evicted;
+    }
+
+    bool erase(const Key& key) {
+        List dropped;
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = index_.find(key);
+        if (it == index_.end()) return false;
+        unlink(it->second, dropped);
+        return true;
+    }
+
+    void clear() {
+        std::list<Entry> dropped;
+        std::lock_guard<std::mutex> lock{mutex_};
+        dropped.splice(dropped.end(), probation_);
+        dropped.splice(dropped.end(), protected_);
+        index_.clear();
+        probationBytes_ = protectedBytes_ = 0;
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return index_.size();
+    }
+
+    std::size_t bytes() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return probationBytes_ + protectedBytes_;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        std::shared_ptr<const Value> value;
+        std::size_t bytes = 0;
+        bool isProtected = false;
+    };
+    using List = std::list<Entry>;
+
+    std::size_t protectedLimit() const {
+        return static_cast<std::size_t>(static_cast<double>(options_.maxBytes) * options_.protectedShare);
+    }
+
+    void unlink(typename List::iterator entry, List& dropped) {
+        index_.erase(entry->key);
+        auto& from = entry->isProtected ? protected_ : probation_;
+        (entry->isProtected ? protectedBytes_ : probationBytes_) -= entry->bytes;
+        dropped.splice(dropped.end(), from, entry);
+    }
+
+    Options options_;
+    mutable std::mutex mutex_;
+    List probation_, protected_; // most recently used first
+    std::unordered_map<Key, typename List::iterator, CacheKeyHash<Key>> index_;
+    std::size_t probationBytes_ = 0, protectedBytes_ = 0;
+};
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "openperf/ipc_endpoint.hpp"
+#include "openperf/wire_format.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+
+namespace openperf {
+
+namespace detail {
+struct ShmRegion;
+}
+
+/**
+ * Serves an IEngineEndpoint over a POSIX shared-memory region holding two
+ * single-producer/single-consumer byte rings (requests and replies) that
+ * carry wire-format frames.
+ *
+ * Each side spins briefly on the ring indices and then sleeps on a
+ * process-shared futex, so an idle link costs no CPU. A region serves one
+ * client process at a time; create one server per client. If that client
+ * dies, the server drops its frames and takes the next one. Trees in
+ * requests are held to `limits`.
+ */
+class ShmEndpointServer {
+public:
+    static constexpr std::size_t kDefaultRingBytes = std::size_t{1} << 20;
+
+    // `name` is a shm_open name such as "/openperf-gateway". Each ring must
+    // be able to hold the largest frame exchanged.
+    ShmEndpointServer(IEngineEndpoint& endpoint, std::string name,
+                      std::size_t ringBytes = kDefaultRingBytes, TreeLimits limits = {});
+    ~ShmEndpointServer();
+
+    ShmEndpointServer(const ShmEndpointServer&) = delete;
+    ShmEndpointServer& operator=(const ShmEndpointServer&) = delete;
+
+    // Creates (or replaces) the region and starts serving. Throws std::system_error.
+    void start();
+    // Wakes any waiting client with an error and unlinks the region.
+    void stop();
+
+    const std::string& name() const { return name_; }
+
+private:
+    void serveLoop();
+
+    IEngineEndpoint& endpoint_;
+    std::string name_;
+    std::size_t ringBytes_;
+    TreeLimits limits_;
+    detail::ShmRegion* region_ = nullptr;
+    std::size_t mappedBytes_ = 0;
+    int fd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+};
+
+/**
+ * IEngineEndpoint that talks to a ShmEndpointServer through its region.
+ * Calls from several threads are serialized; only one client may attach.
+ * If the server process dies, pending and later calls throw WireError.
+ */
+class ShmEndpointClient : public wire::ClientEndpoint {
+public:
+    // Maps an existing region; throws std::system_error, or WireError if the
+    // region is not an OpenPerf endpoint, has no server or already has a
+    // client.
+    explicit ShmEndpointClient(const std::string& name);
+    ~ShmEndpointClient() override;
+
+    ShmEndpointClient(const ShmEndpointClient&) = delete;
+    ShmEndpointClient& operator=(const ShmEndpointClient&) = delete;
+
+protected:
+    wire::FrameHeader roundTrip(const std::string& frame, std::string& replyPayload) const override;
+
+private:
+    detail::ShmRegion* region_ = nullptr;
+    std::size_t mappedBytes_ = 0;
+    std::size_t ringBytes_ = 0;
+    int fd_ = -1;
+};
+
+}
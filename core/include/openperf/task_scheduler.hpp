@@ -1,38 +1,213 @@
 #pragma once
 
+#include "openperf/cpu_topology.hpp"
+#include "openperf/metrics.hpp"
+#include "openperf/work_stealing_deque.hpp"
+
+#include <array>
+#include <chrono>
 #include <functional>
+#include <string_view>
 #include <thread>
 #include <vector>
-#include <queue>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <cstdint>
 
 namespace openperf {
 
 using Task = std::function<void()>;
 
+// Lanes work can queue in, most urgent first.
+enum class TaskPriority : std::uint8_t {
+    Interactive, // a user is waiting, e.g. the dashboard
+    Normal,
+    Batch        // bulk work such as crawls; runs when nothing else is queued
+};
+inline constexpr std::size_t kTaskPriorities = 3;
+
+const char* toString(TaskPriority priority);
+// Parses "interactive", "normal" or "batch"; returns false for anything else.
+bool parsePriority(std::string_view name, TaskPriority* out);
+
+// Starvation protection shared by every prioritised queue: turn `turn`
+// looks at this lane first, then the lanes below it, then the ones above.
+// Most turns start at Interactive, every 4th at Normal and every 16th at
+// Batch, so under sustained load Normal still gets 3/16 of the turns and
+// Batch 1/16.
+TaskPriority firstLaneForTurn(std::uint64_t turn);
+
+struct TaskOptions {
+    TaskPriority priority = TaskPriority::Normal;
+    // dropped instead of run if still queued at this point
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // NUMA node (see TaskScheduler::nodeCount) whose workers should run the
+    // task, e.g. the one holding its data; -1 = wherever it is enqueued
+    int node = -1;
+};
+
+// Where workers may run.
+enum class WorkerAffinity : std::uint8_t {
+    None, // wherever the kernel puts them
+    Node, // any CPU of the worker's NUMA node
+    Cpu   // one CPU each
+};
+
+const char* toString(WorkerAffinity affinity);
+// Parses "none", "node" or "cpu"; returns false for anything else.
+bool parseAffinity(std::string_view name, WorkerAffinity* out);
+
+/**
+ * Work-stealing thread pool with priority lanes.
+ *
+ * Each worker owns one Chase-Lev deque per TaskPriority. Tasks enqueued
+ * from a worker thread go onto that worker's deque (LIFO for the owner, so
+ * continuations stay cache-hot); tasks enqueued from outside the pool go
+ * through a shared injection queue, also one per lane. An idle worker looks
+ * for work lane by lane in firstLaneForTurn() order: its own deque, then
+ * the injection queue, then randomly chosen victims. With nothing anywhere
+ * it spins briefly and finally parks on a condition variable until new
+ * work is published.
+ *
+ * A task whose deadline has passed by the time a worker takes it is
+ * dropped; its onExpired callback, if any, runs instead. So does a task
+ * still queued once stop() has let the workers go.
+ *
+ * With a WorkerAffinity other than None, workers are spread over the NUMA
+ * nodes of the detected CpuTopology and pin themselves when they start.
+ * Each node then has an injection queue of its own for tasks aimed at it
+ * (TaskOptions::node), next to the shared one, and idle workers steal
+ * from their own node first; they only take another node's work once they
+ * have been idle for a few rounds, so a wake-up that lands on the wrong
+ * node does not drag the task's data across the interconnect. With one
+ * node, or with affinity None, all of this collapses to the plain pool.
+ */
 class TaskScheduler {
 public:
-    explicit TaskScheduler(std::size_t workerCount = std::thread::hardware_concurrency());
+    struct Options {
+        std::size_t workers = 0; // 0 = one per usable CPU
+        WorkerAffinity affinity = WorkerAffinity::None;
+        // CPUs no worker runs on, e.g. left to network threads; also lowers
+        // the default worker count. Ignored if it would leave no CPU.
+        std::vector<int> reservedCpus;
+        // CPUs to place workers on; empty = CpuTopology::detect()
+        CpuTopology topology;
+    };
+
+    TaskScheduler();
+    explicit TaskScheduler(std::size_t workerCount);
+    explicit TaskScheduler(Options options);
     ~TaskScheduler();
 
+    // Records each lane's queue wait (task_wait_<lane>_ms, sampled) and
+    // dropped tasks (task_dropped_<lane>) in `metrics`. Call before start().
+    void attachMetrics(Metrics& metrics);
+
     void start();
+    // Runs what is queued, then joins the workers. Tasks queued after they
+    // are gone are dropped, their onExpired callbacks run on this thread.
     void stop();
+
+    // On a worker, the task inherits the priority of the one running there,
+    // so a request's follow-up work stays in its lane; elsewhere it is Normal.
     void enqueue(Task task);
-    
-    // Get current queue depth (thread-safe)
+    // `onExpired` runs in place of `task` if the deadline passes first, e.g.
+    // to fail the request the task was for.
+    void enqueue(Task task, TaskOptions options, Task onExpired = nullptr);
+
+    // enqueue() unless maxDepth tasks are already queued; returns whether it
+    // did. The bound is approximate when several threads submit at once.
+    bool tryEnqueue(Task task, std::size_t maxDepth);
+    bool tryEnqueue(Task task, std::size_t maxDepth, TaskOptions options, Task onExpired = nullptr);
+
+    // Get current queue depth (thread-safe), summed across all lanes and deques
     std::size_t getQueueDepth() const;
 
+    std::size_t workerCount() const { return workerCount_; }
+    bool running() const { return running_.load(std::memory_order_acquire); }
+
+    // Index of the calling worker in this pool, or -1 when called from outside it.
+    int currentWorkerIndex() const;
+
+    // Node groups the workers form: the topology's nodes with an affinity
+    // set, otherwise 1.
+    std::size_t nodeCount() const { return nodeWorkers_.size(); }
+    // Node of the calling worker, or -1 when called from outside the pool.
+    int currentNode() const;
+    // CPUs the workers were placed on, reserved CPUs excluded.
+    const CpuTopology& topology() const { return topology_; }
+    // Workers that managed to pin themselves; less than workerCount() if
+    // the system refused.
+    std::size_t pinnedWorkers() const { return pinnedWorkers_.load(std::memory_order_relaxed); }
+
+    /**
+     * Runs fn(lo, hi) over [begin, end) split into chunks of `grain` items
+     * and returns once every chunk is done. The calling thread takes chunks
+     * too, so this is safe from inside a task and never waits on a chunk
+     * that has not started. Chunks may run in any order; fn must not throw.
+     */
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+                     const std::function<void(std::size_t, std::size_t)>& fn);
+
 private:
-    void workerLoop();
+    struct Entry {
+        Task task;
+        Task onExpired;
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::steady_clock::time_point enqueued; // set on tasks sampled for the wait metric
+        TaskPriority priority;
+    };
+
+    struct Worker {
+        std::array<WorkStealingDeque<Entry*>, kTaskPriorities> deques;
+        std::thread thread;
+        std::uint64_t rngState = 0;
+        std::uint64_t turn = 0; // tasks taken, for firstLaneForTurn()
+        std::size_t node = 0;
+        std::vector<int> cpus;  // to pin to; empty = unpinned
+    };
+
+    // Submission path for threads outside the pool, and for tasks aimed at
+    // another node.
+    struct InjectionQueue {
+        std::mutex mutex;
+        std::array<std::deque<Entry*>, kTaskPriorities> lanes;
+        std::array<std::atomic<std::size_t>, kTaskPriorities> count{};
+    };
+
+    void workerLoop(std::size_t index);
+    void run(Entry& entry);
+    Entry* findTask(std::size_t index, bool remote);
+    Entry* findInLane(std::size_t index, std::size_t lane, bool remote, int& source);
+    Entry* popInjected(InjectionQueue& queue, std::size_t lane);
+    Entry* stealFrom(std::size_t thief, std::size_t lane, bool remote);
+    InjectionQueue& injectionQueue(int node);
+    void park();
+    void wakeOne();
+
+    CpuTopology topology_;
+    std::size_t workerCount_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::vector<std::size_t>> nodeWorkers_; // worker indices per node
+    std::atomic<std::size_t> pinnedWorkers_{0};
+
+    // one per node when there are several, then the shared one
+    std::vector<std::unique_ptr<InjectionQueue>> injected_;
+
+    Metrics* metrics_ = nullptr;
+    std::array<MetricId, kTaskPriorities> waitMetrics_{};
+    std::array<MetricId, kTaskPriorities> droppedMetrics_{};
+
+    // idle parking
+    std::mutex parkMutex_;
+    std::condition_variable parkCv_;
+    std::atomic<std::size_t> sleepers_{0};
 
-    std::vector<std::thread> workers_;
-    std::queue<Task> queue_;
-    mutable std::mutex mutex_;
-    std::condition_variable cv_;
     std::atomic<bool> running_{false};
     std::atomic<std::size_t> queueDepth_{0};
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace openperf {
+
+/**
+ * Process-wide trace recorder, exported as Chrome trace-event JSON (opens in
+ * Perfetto and chrome://tracing).
+ *
+ * Each thread that records gets its own ring of kEventsPerThread events,
+ * written only by that thread with a per-slot sequence so a concurrent
+ * export skips slots caught mid-write; when a ring wraps, the oldest events
+ * are overwritten. Recording takes no locks and allocates nothing after the
+ * thread's first event. While stopped, a span costs one relaxed load.
+ *
+ * A thread's ring outlives the thread so its events can still be exported;
+ * clear() frees the rings of threads that have exited. Past
+ * kMaxRetiredBuffers of those, a thread recording its first event takes
+ * over the oldest instead of allocating, dropping its events as a full
+ * ring would, so threads coming and going cannot pile up rings.
+ *
+ * Event names and categories are stored as pointers and must outlive the
+ * tracer: string literals, or strings passed through intern().
+ *
+ * Building with OPENPERF_DISABLE_TRACING turns the OPENPERF_TRACE_* macros
+ * into nothing, so instrumented code pays no cost at all.
+ */
+class Tracer {
+public:
+    static constexpr std::size_t kEventsPerThread = 1 << 14;
+    static constexpr std::size_t kMaxRetiredBuffers = 8;
+
+    static Tracer& global();
+
+    void start() { enabled_.store(true, std::memory_order_release); }
+    void stop() { enabled_.store(false, std::memory_order_release); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Drops recorded events and frees the buffers of exited threads; call
+    // while stopped, e.g. once the trace has been written.
+    void clear();
+
+    // Stable copy of `name` for use as an event name.
+    const char* intern(std::string_view name);
+
+    // Names the calling thread in exported traces. Cheap; the thread gets a
+    // buffer only once it records.
+    void setThreadName(std::string name);
+
+    // Steady-clock nanoseconds, the timebase of every event.
+    static std::int64_t now();
+    static std::int64_t toNs(std::chrono::steady_clock::time_point t);
+
+    // Event recorders; each is a no-op while stopped. `argName`, if set,
+    // labels one integer argument shown with the event.
+    void complete(const char* category, const char* name, std::int64_t startNs, std::int64_t endNs,
+                  const char* argName = nullptr, std::int64_t arg = 0);
+    void instant(const char* category, const char* name, const char* argName = nullptr, std::int64_t arg = 0);
+    // Arrow from the current thread's enclosing span to the span enclosing
+    // the matching flowEnd(), e.g. from an enqueue to the task's run.
+    void flowStart(const char* category, const char* name, std::uint64_t id);
+    void flowEnd(const char* category, const char* name, std::uint64_t id);
+    // Span not tied to one thread, e.g. a render from submission to completion.
+    void async(const char* category, const char* name, std::uint64_t id, std::int64_t startNs, std::int64_t endNs);
+
+    // Fresh id for flow and async events.
+    std::uint64_t nextId() { return nextId_.fetch_add(1, std::memory_order_relaxed); }
+
+    void writeChromeJson(std::ostream& out) const;
+    std::string chromeJson() const;
+
+private:
+    // Async spans are stored once and exported as a begin/end pair.
+    enum class Phase : char { Complete = 'X', Instant = 'i', FlowStart = 's', FlowEnd = 'f', Async = 'b' };
+
+    struct Slot {
+        std::atomic<std::uint64_t> seq{0}; // 0 = empty or being written
+        std::atomic<const char*> category{nullptr};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<const char*> argName{nullptr};
+        std::atomic<std::int64_t> startNs{0};
+        std::atomic<std::int64_t> durationNs{0};
+        std::atomic<std::int64_t> arg{0};
+        std::atomic<std::uint64_t> id{0};
+        std::atomic<Phase> phase{Phase::Complete};
+    };
+
+    struct ThreadBuffer {
+        std::unique_ptr<Slot[]> slots = std::make_unique<Slot[]>(kEventsPerThread);
+        std::atomic<std::uint64_t> head{0};
+        std::uint32_t tid = 0;
+        std::string name;     // guarded by buffersMutex_
+        bool retired = false; // its thread has exited; guarded by buffersMutex_
+    };
+
+    Tracer() = default;
+
+    ThreadBuffer& localBuffer();
+    static void retireBuffer(void* buffer);
+    void record(Phase phase, const char* category, const char* name, std::int64_t startNs, std::int64_t durationNs,
+                const char* argName, std::int64_t arg, std::uint64_t id);
+
+    std::atomic<bool> enabled_{false};
+    std::atomic<std::uint64_t> nextId_{1};
+
+    mutable std::mutex buffersMutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    std::vector<ThreadBuffer*> retired_; // oldest first
+    std::uint32_t nextTid_ = 1;
+
+    std::mutex internMutex_;
+    std::unordered_set<std::string> interned_;
+};
+
+/**
+ * Records the enclosing scope as a complete event when tracing was on at
+ * its start. Use through OPENPERF_TRACE_SPAN.
+ */
+class TraceSpan {
+public:
+    TraceSpan(const char* category, const char* name)
+        : category_(category), name_(name), startNs_(Tracer::global().enabled() ? Tracer::now() : -1) {}
+    ~TraceSpan() {
+        if (startNs_ >= 0) Tracer::global().complete(category_, name_, startNs_, Tracer::now(), argName_, arg_);
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    bool active() const { return startNs_ >= 0; }
+    void setArg(const char* name, std::int64_t value) {
+        argName_ = name;
+        arg_ = value;
+    }
+
+private:
+    const char* category_;
+    const char* name_;
+    std::int64_t startNs_;
+    const char* argName_ = nullptr;
+    std::int64_t arg_ = 0;
+};
+
+}
+
+#define OPENPERF_TRACE_CONCAT_(a, b) a##b
+#define OPENPERF_TRACE_CONCAT(a, b) OPENPERF_TRACE_CONCAT_(a, b)
+
+#ifdef OPENPERF_DISABLE_TRACING
+#define OPENPERF_TRACING_ON() false
+#define OPENPERF_TRACE_SPAN(category, name)
+// arguments stay unevaluated but count as used
+#define OPENPERF_TRACE_SPAN_ARG(category, name, argName, arg) static_cast<void>(sizeof(arg))
+#define OPENPERF_TRACE_INSTANT(category, name, argName, arg) static_cast<void>(sizeof(arg))
+#else
+// Whether events are being recorded; guards work done only for a trace.
+#define OPENPERF_TRACING_ON() (::openperf::Tracer::global().enabled())
+// Traces the rest of the enclosing scope.
+#define OPENPERF_TRACE_SPAN(category, name) \
+    ::openperf::TraceSpan OPENPERF_TRACE_CONCAT(openperfTraceSpan_, __LINE__)(category, name)
+// Same, with an integer argument evaluated only while tracing.
+#define OPENPERF_TRACE_SPAN_ARG(category, name, argName, arg)                                    \
+    ::openperf::TraceSpan OPENPERF_TRACE_CONCAT(openperfTraceSpan_, __LINE__)(category, name);   \
+    if (OPENPERF_TRACE_CONCAT(openperfTraceSpan_, __LINE__).active())                            \
+    OPENPERF_TRACE_CONCAT(openperfTraceSpan_, __LINE__).setArg(argName, static_cast<std::int64_t>(arg))
+#define OPENPERF_TRACE_INSTANT(category, name, argName, arg)                                              \
+    do {                                                                                                  \
+        if (OPENPERF_TRACING_ON())                                                                        \
+            ::openperf::Tracer::global().instant(category, name, argName, static_cast<std::int64_t>(arg)); \
+    } while (0)
+#endif
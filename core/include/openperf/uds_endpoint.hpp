@@ -0,0 +1,81 @@
+#pragma once
+
+#include "openperf/ipc_endpoint.hpp"
+#include "openperf/wire_format.hpp"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace openperf {
+
+/**
+ * Serves an IEngineEndpoint (typically an EngineEndpointAdapter) over a Unix
+ * domain stream socket using the wire framing.
+ *
+ * One thread accepts connections; each connection gets its own thread and
+ * handles one request at a time, so a client sees replies in order. Trees in
+ * requests are held to `limits`.
+ */
+class UdsEndpointServer {
+public:
+    UdsEndpointServer(IEngineEndpoint& endpoint, std::string path, TreeLimits limits = {});
+    ~UdsEndpointServer();
+
+    UdsEndpointServer(const UdsEndpointServer&) = delete;
+    UdsEndpointServer& operator=(const UdsEndpointServer&) = delete;
+
+    // Binds and listens, replacing a stale socket file. Throws std::system_error.
+    void start();
+    void stop();
+
+    const std::string& path() const { return path_; }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    void acceptLoop();
+    void serve(Connection& connection);
+    void reapFinished();
+
+    IEngineEndpoint& endpoint_;
+    std::string path_;
+    TreeLimits limits_;
+    int listenFd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread acceptThread_;
+
+    // fds stay open until their thread is joined so a number is never reused
+    // while stop() might still shut it down
+    std::mutex connectionsMutex_;
+    std::list<std::unique_ptr<Connection>> connections_;
+};
+
+/**
+ * IEngineEndpoint backed by a connection to a UdsEndpointServer.
+ * Calls from several threads are serialized over the one socket.
+ */
+class UdsEndpointClient : public wire::ClientEndpoint {
+public:
+    // Connects immediately; throws std::system_error.
+    explicit UdsEndpointClient(const std::string& path);
+    ~UdsEndpointClient() override;
+
+    UdsEndpointClient(const UdsEndpointClient&) = delete;
+    UdsEndpointClient& operator=(const UdsEndpointClient&) = delete;
+
+protected:
+    wire::FrameHeader roundTrip(const std::string& frame, std::string& replyPayload) const override;
+
+private:
+    int fd_ = -1;
+};
+
+}
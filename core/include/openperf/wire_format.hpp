@@ -0,0 +1,209 @@
+#pragma once
+
+#include "openperf/ipc_endpoint.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace openperf::wire {
+
+/**
+ * Compact binary framing shared by the same-host transports (UDS, shm).
+ *
+ * A frame is a fixed header followed by `length` payload bytes. Integers and
+ * doubles are written in host byte order, since both ends always run on the
+ * same machine; strings are a u32 length followed by the bytes. Node trees
+ * are written in pre-order, each node followed by its child count. A node's
+ * flag byte says whether a style follows its strings.
+ */
+
+enum class MessageType : std::uint16_t {
+    SubmitPage = 1,
+    RunRender = 2,
+    AnalyzeAccessibility = 3,
+    GetMetrics = 4,
+    GetMetricsSince = 5,
+    GetMetricSummaries = 6,
+    PatchPage = 7,
+    SubmitPages = 8,
+    RunRenderBatch = 9,
+    AnalyzeAccessibilityBatch = 10,
+    Error = 0xffff // reply payload is a message string
+};
+
+struct FrameHeader {
+    std::uint32_t length = 0; // payload bytes
+    MessageType type = MessageType::Error;
+    std::uint16_t flags = 0;
+    std::uint32_t requestId = 0; // echoed in the reply
+};
+
+inline constexpr std::size_t kHeaderSize = 12;
+inline constexpr std::uint32_t kMaxPayloadBytes = 64u << 20;
+
+// Raised for malformed or oversized frames and for error replies.
+class WireError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+void encodeHeader(const FrameHeader& header, char* out);
+FrameHeader decodeHeader(const char* in);
+
+class Writer {
+public:
+    // Leaves room for the header so finish() needs no copy.
+    Writer() { buffer_.resize(kHeaderSize); }
+
+    void u8(std::uint8_t v) { buffer_.push_back(static_cast<char>(v)); }
+    void u32(std::uint32_t v) { raw(&v, sizeof(v)); }
+    void u64(std::uint64_t v) { raw(&v, sizeof(v)); }
+    void i64(std::int64_t v) { raw(&v, sizeof(v)); }
+    void f32(float v) { raw(&v, sizeof(v)); }
+    void f64(double v) { raw(&v, sizeof(v)); }
+    void str(std::string_view s) {
+        u32(static_cast<std::uint32_t>(s.size()));
+        buffer_.append(s);
+    }
+
+    std::size_t payloadSize() const { return buffer_.size() - kHeaderSize; }
+
+    // Fills in the header and returns the whole frame.
+    const std::string& finish(MessageType type, std::uint32_t requestId);
+
+    void reset() { buffer_.resize(kHeaderSize); }
+
+private:
+    void raw(const void* p, std::size_t n) { buffer_.append(static_cast<const char*>(p), n); }
+
+    std::string buffer_;
+};
+
+// Bounds-checked reader over one payload; throws WireError on truncation.
+class Reader {
+public:
+    Reader(const char* data, std::size_t size) : p_(data), end_(data + size) {}
+
+    std::uint8_t u8() { return static_cast<std::uint8_t>(*take(1)); }
+    std::uint32_t u32() { return pod<std::uint32_t>(); }
+    std::uint64_t u64() { return pod<std::uint64_t>(); }
+    std::int64_t i64() { return pod<std::int64_t>(); }
+    float f32() { return pod<float>(); }
+    double f64() { return pod<double>(); }
+    std::string str() {
+        auto n = u32();
+        const char* s = take(n);
+        return std::string(s, n);
+    }
+
+    bool atEnd() const { return p_ == end_; }
+    std::size_t remaining() const { return static_cast<std::size_t>(end_ - p_); }
+
+private:
+    template <class T>
+    T pod() {
+        T v;
+        std::memcpy(&v, take(sizeof(T)), sizeof(T));
+        return v;
+    }
+
+    const char* take(std::size_t n) {
+        if (static_cast<std::size_t>(end_ - p_) < n) throw WireError("truncated frame");
+        const char* at = p_;
+        p_ += n;
+        return at;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+// Trees are decoded without recursion and held to `limits`; a tree beyond
+// them throws WireError. maxNodes covers all of a request's trees together.
+void encode(Writer& w, const Page& page);
+Page decodePage(Reader& r, const TreeLimits& limits = {});
+
+void encode(Writer& w, const std::vector<Page>& pages);
+std::vector<Page> decodePages(Reader& r, const TreeLimits& limits = {});
+
+// page ids of a batch request, or of a SubmitPages reply
+void encode(Writer& w, const std::vector<std::string>& ids);
+std::vector<std::string> decodeIds(Reader& r);
+
+void encode(Writer& w, const std::vector<NodeMutation>& mutations);
+std::vector<NodeMutation> decodeMutations(Reader& r, const TreeLimits& limits = {});
+
+void encode(Writer& w, const PatchResult& result);
+PatchResult decodePatchResult(Reader& r);
+
+void encode(Writer& w, const RenderResult& result);
+RenderResult decodeRenderResult(Reader& r);
+
+void encode(Writer& w, const std::vector<RenderResult>& results);
+std::vector<RenderResult> decodeRenderResults(Reader& r);
+
+void encode(Writer& w, const std::vector<AccessibilityIssue>& issues);
+std::vector<AccessibilityIssue> decodeIssues(Reader& r);
+
+void encode(Writer& w, const std::vector<AccessibilityReport>& reports);
+std::vector<AccessibilityReport> decodeReports(Reader& r);
+
+void encode(Writer& w, const std::vector<Metric>& samples);
+std::vector<Metric> decodeMetrics(Reader& r);
+
+void encode(Writer& w, const MetricsDelta& delta);
+MetricsDelta decodeMetricsDelta(Reader& r);
+
+void encode(Writer& w, const std::vector<MetricSummary>& summaries);
+std::vector<MetricSummary> decodeSummaries(Reader& r);
+
+/**
+ * Server side of the protocol: decodes one request payload, runs it against
+ * `endpoint` and writes the reply payload to `out`. Returns the reply type,
+ * which is MessageType::Error (with the message as payload) if the request
+ * was malformed, held a tree beyond `limits` or the endpoint threw.
+ */
+MessageType handleRequest(IEngineEndpoint& endpoint, MessageType type, Reader& in, Writer& out,
+                          const TreeLimits& limits = {});
+
+/**
+ * Client side: an IEngineEndpoint whose calls become request/reply frames.
+ * Transports implement roundTrip(); calls are serialized per client.
+ *
+ * runRenderPipeline(pageId, done) and runRenderBatch(pageIds, done) wait
+ * for the remote renders and call `done` on the calling thread.
+ */
+class ClientEndpoint : public IEngineEndpoint {
+public:
+    std::string submitPage(Page page) override;
+    std::vector<std::string> submitPages(std::vector<Page> pages) override;
+    void runRenderPipeline(const std::string& pageId) override;
+    void runRenderPipeline(const std::string& pageId, RenderCallback done) override;
+    void runRenderBatch(const std::vector<std::string>& pageIds, RenderBatchCallback done) override;
+    std::vector<AccessibilityIssue> analyzeAccessibility(const std::string& pageId) override;
+    std::vector<AccessibilityReport> analyzeAccessibilityBatch(const std::vector<std::string>& pageIds) override;
+    PatchResult patchPage(const std::string& pageId, const std::vector<NodeMutation>& mutations) override;
+    std::vector<Metric> getMetrics() const override;
+    MetricsDelta getMetricsSince(std::uint64_t cursor) const override;
+    std::vector<MetricSummary> getMetricSummaries() const override;
+
+protected:
+    // Sends the request and returns the reply payload. Throws on transport
+    // errors and turns Error replies into WireError.
+    std::string call(Writer& request, MessageType type) const;
+
+    // Transport hook: send one complete frame and receive the reply frame.
+    // Returns the reply header and stores its payload in `replyPayload`.
+    // Never called concurrently for the same client.
+    virtual FrameHeader roundTrip(const std::string& frame, std::string& replyPayload) const = 0;
+
+private:
+    mutable std::mutex mutex_;
+    mutable std::uint32_t nextRequestId_ = 1;
+};
+
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace openperf {
+
+/**
+ * Chase-Lev work-stealing deque (Lê et al., "Correct and Efficient
+ * Work-Stealing for Weak Memory Models", PPoPP 2013).
+ *
+ * The owning worker pushes and pops at the bottom; any other thread may
+ * steal from the top. T must be trivially copyable (the scheduler stores
+ * raw task pointers). The ring grows on demand; retired rings are kept
+ * until the deque is destroyed because a concurrent thief may still be
+ * reading from them.
+ */
+template <typename T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque stores T in atomics");
+
+public:
+    explicit WorkStealingDeque(std::size_t initialCapacity = 256) {
+        std::size_t cap = 1;
+        while (cap < initialCapacity) cap <<= 1;
+        auto ring = std::make_unique<Ring>(cap);
+        ring_.store(ring.get(), std::memory_order_relaxed);
+        rings_.push_back(std::move(ring));
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only.
+    void push(T item) {
+        std::int64_t b = bottom_.load(std::memory_order_relaxed);
+        std::int64_t t = top_.load(std::memory_order_acquire);
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        if (b - t > static_cast<std::int64_t>(ring->capacity) - 1) {
+            ring = grow(ring, t, b);
+        }
+        ring->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only. LIFO end, keeps the most recently spawned work cache-hot.
+    std::optional<T> pop() {
+        std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        T item = ring->get(b);
+        if (t == b) {
+            // last element: race against thieves for it
+            bool won = top_.compare_exchange_strong(t, t + 1,
+                                                    std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            if (!won) return std::nullopt;
+        }
+        return item;
+    }
+
+    // Any thread. FIFO end.
+    std::optional<T> steal() {
+        std::int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return std::nullopt;
+
+        Ring* ring = ring_.load(std::memory_order_acquire);
+        T item = ring->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        return item;
+    }
+
+    // Approximate; exact only when no push/pop/steal is in flight.
+    std::size_t size() const {
+        std::int64_t b = bottom_.load(std::memory_order_relaxed);
+        std::int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<std::size_t>(b - t) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    struct Ring {
+        explicit Ring(std::size_t cap) : capacity(cap), mask(cap - 1), slots(cap) {}
+
+        T get(std::int64_t i) const {
+            return slots[static_cast<std::size_t>(i) & mask].load(std::memory_order_relaxed);
+        }
+        void put(std::int64_t i, T item) {
+            slots[static_cast<std::size_t>(i) & mask].store(item, std::memory_order_relaxed);
+        }
+
+        std::size_t capacity;
+        std::size_t mask;
+        std::vector<std::atomic<T>> slots;
+    };
+
+    Ring* grow(Ring* old, std::int64_t t, std::int64_t b) {
+        auto bigger = std::make_unique<Ring>(old->capacity * 2);
+        for (std::int64_t i = t; i < b; ++i) bigger->put(i, old->get(i));
+        Ring* raw = bigger.get();
+        rings_.push_back(std::move(bigger));
+        ring_.store(raw, std::memory_order_release);
+        return raw;
+    }
+
+    alignas(64) std::atomic<std::int64_t> top_{0};
+    alignas(64) std::atomic<std::int64_t> bottom_{0};
+    alignas(64) std::atomic<Ring*> ring_{nullptr};
+    std::vector<std::unique_ptr<Ring>> rings_; // owner-only; retired rings stay alive
+};
+
+}
@@ -1,67 +1,113 @@
 #include "openperf/accessibility.hpp"
+#include "openperf/trace.hpp"
+
+#include <algorithm>
+#include <iterator>
 
 namespace openperf {
 
-std::vector<AccessibilityIssue> AccessibilityAnalyzer::analyze(const Page& page) const {
-    std::vector<AccessibilityIssue> issues;
-    if (page.root) checkNode(page.root, issues);
-    return issues;
+AccessibilityAnalyzer::AccessibilityAnalyzer()
+    : AccessibilityAnalyzer(nullptr, Options{}) {}
+
+AccessibilityAnalyzer::AccessibilityAnalyzer(TaskScheduler* scheduler)
+    : AccessibilityAnalyzer(scheduler, Options{}) {}
+
+AccessibilityAnalyzer::AccessibilityAnalyzer(TaskScheduler* scheduler, Options options)
+    : scheduler_(scheduler), options_(std::move(options)) {
+    if (!options_.rules) options_.rules = RuleRegistry::defaults();
 }
 
-void AccessibilityAnalyzer::checkNode(const std::shared_ptr<Node>& node, std::vector<AccessibilityIssue>& out) const {
-    if (!node) return;
-
-    // Rule: Images must have alt text or aria-label
-    if (node->tag == "img") {
-        bool hasAlt = !node->ariaLabel.empty() || !node->text.empty();
-        if (!hasAlt) {
-            out.emplace_back("IMG_ALT_MISSING", 
-                "Image element is missing descriptive text or aria-label.",
-                Severity::Warning, 
-                node->id);
-        }
+std::vector<AccessibilityIssue> AccessibilityAnalyzer::analyze(const Page& page) const {
+    if (page.dom) return analyze(*page.dom);
+    if (!page.root) return {};
+
+    // iterative pre-order, so deep trees can't overflow the stack
+    std::vector<const Node*> nodes;
+    std::vector<const Node*> stack{page.root.get()};
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+        nodes.push_back(n);
+        for (auto it = n->children.rbegin(); it != n->children.rend(); ++it)
+            if (*it) stack.push_back(it->get());
     }
 
-    // Rule: Interactive elements must have labels
-    if (node->isInteractive) {
-        bool hasLabel = !node->ariaLabel.empty() || !node->text.empty();
-        if (!hasLabel) {
-            out.emplace_back("INTERACTIVE_MISSING_LABEL",
-                "Interactive element lacks a visible label or aria-label.",
-                Severity::Error,
-                node->id);
+    return run(nodes.size(), [&](std::size_t i) { return ruleNode(*nodes[i]); });
+}
+
+std::vector<AccessibilityIssue> AccessibilityAnalyzer::analyze(const FlatDocument& doc) const {
+    // nodes are stored in document order, so a linear scan visits them in
+    // the same order as the tree walk
+    return run(doc.size(), [&](std::size_t i) {
+        const auto n = static_cast<NodeIndex>(i);
+        RuleNode node;
+        node.tag = doc.tag(n);
+        node.role = doc.role(n);
+        node.id = doc.id(n);
+        node.text = doc.text(n);
+        node.ariaLabel = doc.ariaLabel(n);
+        node.isInteractive = doc.isInteractive(n);
+        return node;
+    });
+}
+
+RuleNode AccessibilityAnalyzer::ruleNode(const Node& n) {
+    const AtomTable& atomTable = AtomTable::global();
+    RuleNode node;
+    node.tag = atomTable.find(n.tag);
+    if (!n.role.empty()) node.role = atomTable.find(n.role);
+    node.id = n.id;
+    node.text = n.text;
+    node.ariaLabel = n.ariaLabel;
+    node.isInteractive = n.isInteractive;
+    return node;
+}
+
+template <typename Visit>
+std::vector<AccessibilityIssue> AccessibilityAnalyzer::run(std::size_t count, const Visit& visit) const {
+    OPENPERF_TRACE_SPAN_ARG("a11y", "analyze", "nodes", count);
+    const RuleRegistry& rules = *options_.rules;
+    auto states = rules.newStates();
+
+    std::vector<AccessibilityIssue> issues;
+    if (!scheduler_ || count < options_.parallelThreshold) {
+        for (std::size_t i = 0; i < count; ++i) {
+            RuleNode node = visit(i);
+            rules.checkPlain(node, issues);
+            if (rules.hasOrderedRules()) rules.checkOrdered(node, states, issues);
         }
+        return issues;
     }
 
-    // Rule: Buttons and links must have accessible text
-    if (node->tag == "button" || node->tag == "a") {
-        bool hasAccessibleText = !node->ariaLabel.empty() || !node->text.empty();
-        if (!hasAccessibleText) {
-            out.emplace_back("BUTTON_LINK_NO_TEXT",
-                node->tag == "button" 
-                    ? "Button element has no accessible text or aria-label."
-                    : "Link element has no accessible text or aria-label.",
-                Severity::Error,
-                node->id);
+    // Ordered rules can't be split, so they take one serial pass first and
+    // their issues are spliced in after each node's plain-rule issues.
+    std::vector<AccessibilityIssue> orderedIssues;
+    std::vector<std::size_t> orderedAt; // node index of each ordered issue
+    if (rules.hasOrderedRules()) {
+        for (std::size_t i = 0; i < count; ++i) {
+            rules.checkOrdered(visit(i), states, orderedIssues);
+            orderedAt.resize(orderedIssues.size(), i);
         }
     }
 
-    // Rule: Heading hierarchy (simplified - check for h1-h6 tags)
-    if (node->tag.length() == 2 && node->tag[0] == 'h' && node->tag[1] >= '1' && node->tag[1] <= '6') {
-        // In a full implementation, we'd track heading levels across the tree
-        // For now, we just check that headings have text
-        if (node->text.empty() && node->ariaLabel.empty()) {
-            out.emplace_back("HEADING_NO_TEXT",
-                "Heading element has no text content.",
-                Severity::Warning,
-                node->id);
+    const std::size_t grain = std::max<std::size_t>(1, options_.grainSize);
+    std::vector<std::vector<AccessibilityIssue>> parts((count + grain - 1) / grain);
+    scheduler_->parallelFor(0, count, grain, [&](std::size_t lo, std::size_t hi) {
+        auto& out = parts[lo / grain];
+        auto k = static_cast<std::size_t>(std::lower_bound(orderedAt.begin(), orderedAt.end(), lo) - orderedAt.begin());
+        for (std::size_t i = lo; i < hi; ++i) {
+            rules.checkPlain(visit(i), out);
+            for (; k < orderedAt.size() && orderedAt[k] == i; ++k) out.push_back(orderedIssues[k]);
         }
-    }
+    });
 
-    // Recursively check children
-    for (auto& child : node->children) {
-        checkNode(child, out);
+    std::size_t total = 0;
+    for (const auto& part : parts) total += part.size();
+    issues.reserve(total);
+    for (auto& part : parts) {
+        std::move(part.begin(), part.end(), std::back_inserter(issues));
     }
+    return issues;
 }
 
-}
\ No newline at end of file
+}
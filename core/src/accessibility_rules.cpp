@@ -0,0 +1,171 @@
+#include "openperf/accessibility_rules.hpp"
+
+#include <algorithm>
+
+namespace openperf {
+
+namespace {
+
+// Reports headings that skip a level going down, e.g. an h4 straight after
+// an h2. Going back up any number of levels is fine.
+class HeadingOrderRule : public AccessibilityRule {
+public:
+    RuleSelector selector() const override {
+        std::vector<Atom> headings;
+        for (Atom a = atoms::H1; a <= atoms::H6; ++a) headings.push_back(a);
+        return RuleSelector::tags(std::move(headings));
+    }
+
+    std::unique_ptr<RuleState> newState() const override { return std::make_unique<State>(); }
+
+    void check(const RuleNode& node, RuleState* state, std::vector<AccessibilityIssue>& out) const override {
+        auto& last = static_cast<State*>(state)->level;
+        int level = atoms::headingLevel(node.tag);
+        if (last != 0 && level > last + 1) {
+            out.emplace_back("HEADING_LEVEL_SKIPPED",
+                "Heading level jumps from h" + std::to_string(last) + " to h" + std::to_string(level) + ".",
+                Severity::Warning,
+                std::string(node.id));
+        }
+        last = level;
+    }
+
+private:
+    struct State : RuleState {
+        int level = 0;
+    };
+};
+
+}
+
+std::shared_ptr<const RuleRegistry> RuleRegistry::defaults() {
+    static const std::shared_ptr<const RuleRegistry> registry = [] {
+        auto r = std::make_shared<RuleRegistry>();
+        r->addDefaultRules();
+        return r;
+    }();
+    return registry;
+}
+
+void RuleRegistry::addDefaultRules() {
+    // Rule: Images must have alt text or aria-label
+    add(std::make_unique<FunctionRule>(RuleSelector::tags({atoms::Img}),
+        [](const RuleNode& node, std::vector<AccessibilityIssue>& out) {
+            if (!node.hasAccessibleText()) {
+                out.emplace_back("IMG_ALT_MISSING",
+                    "Image element is missing descriptive text or aria-label.",
+                    Severity::Warning,
+                    std::string(node.id));
+            }
+        }));
+
+    // Rule: Interactive elements must have labels
+    add(std::make_unique<FunctionRule>(RuleSelector::interactive(),
+        [](const RuleNode& node, std::vector<AccessibilityIssue>& out) {
+            if (!node.hasAccessibleText()) {
+                out.emplace_back("INTERACTIVE_MISSING_LABEL",
+                    "Interactive element lacks a visible label or aria-label.",
+                    Severity::Error,
+                    std::string(node.id));
+            }
+        }));
+
+    // Rule: Buttons and links must have accessible text
+    add(std::make_unique<FunctionRule>(RuleSelector::tags({atoms::Button, atoms::A}),
+        [](const RuleNode& node, std::vector<AccessibilityIssue>& out) {
+            if (!node.hasAccessibleText()) {
+                out.emplace_back("BUTTON_LINK_NO_TEXT",
+                    node.tag == atoms::Button
+                        ? "Button element has no accessible text or aria-label."
+                        : "Link element has no accessible text or aria-label.",
+                    Severity::Error,
+                    std::string(node.id));
+            }
+        }));
+
+    // Rule: Headings must have text
+    std::vector<Atom> headings;
+    for (Atom a = atoms::H1; a <= atoms::H6; ++a) headings.push_back(a);
+    add(std::make_unique<FunctionRule>(RuleSelector::tags(std::move(headings)),
+        [](const RuleNode& node, std::vector<AccessibilityIssue>& out) {
+            if (!node.hasAccessibleText()) {
+                out.emplace_back("HEADING_NO_TEXT",
+                    "Heading element has no text content.",
+                    Severity::Warning,
+                    std::string(node.id));
+            }
+        }));
+
+    // Rule: Heading levels must not be skipped
+    add(std::make_unique<HeadingOrderRule>());
+}
+
+RuleRegistry& RuleRegistry::add(std::unique_ptr<AccessibilityRule> rule) {
+    RuleSelector selector = rule->selector();
+    if (rule->newState()) {
+        ordered_.add(selector, {rule.get(), orderedRules_.size()});
+        orderedRules_.push_back(rule.get());
+    } else {
+        plain_.add(selector, {rule.get(), 0});
+    }
+    rules_.push_back(std::move(rule));
+    return *this;
+}
+
+std::vector<std::unique_ptr<RuleState>> RuleRegistry::newStates() const {
+    std::vector<std::unique_ptr<RuleState>> states;
+    states.reserve(orderedRules_.size());
+    for (const auto* rule : orderedRules_) states.push_back(rule->newState());
+    return states;
+}
+
+void RuleRegistry::Dispatch::add(const RuleSelector& selector, Entry entry) {
+    std::vector<Atom> keys = selector.atoms;
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    switch (selector.kind) {
+        case RuleSelector::Kind::Tags:
+            if (!keys.empty()) growTags(keys.back());
+            for (Atom tag : keys) {
+                byTag_[0][tag].push_back(entry);
+                byTag_[1][tag].push_back(entry);
+            }
+            break;
+        case RuleSelector::Kind::Roles:
+            if (!keys.empty() && keys.back() >= byRole_.size()) byRole_.resize(keys.back() + 1);
+            for (Atom role : keys) byRole_[role].push_back(entry);
+            break;
+        case RuleSelector::Kind::Interactive:
+            fallback_[1].push_back(entry);
+            for (auto& list : byTag_[1]) list.push_back(entry);
+            break;
+        case RuleSelector::Kind::EveryNode:
+            for (int i = 0; i < 2; ++i) {
+                fallback_[i].push_back(entry);
+                for (auto& list : byTag_[i]) list.push_back(entry);
+            }
+            break;
+    }
+}
+
+void RuleRegistry::Dispatch::growTags(Atom tag) {
+    for (int i = 0; i < 2; ++i) {
+        // new tags start with the rules that apply to every tag
+        if (tag >= byTag_[i].size()) byTag_[i].resize(tag + 1, fallback_[i]);
+    }
+}
+
+void RuleRegistry::Dispatch::run(const RuleNode& node, std::unique_ptr<RuleState>* states,
+                                 std::vector<AccessibilityIssue>& out) const {
+    for (const Entry& e : tagList(node.tag, node.isInteractive)) {
+        e.rule->check(node, states ? states[e.slot].get() : nullptr, out);
+    }
+    if (node.role != atoms::Empty && node.role < byRole_.size()) {
+        for (const Entry& e : byRole_[node.role]) {
+            e.rule->check(node, states ? states[e.slot].get() : nullptr, out);
+        }
+    }
+}
+
+}
@@ -0,0 +1,400 @@
+#include "openperf/compositor.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define OPENPERF_COMPOSITE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace openperf {
+
+namespace {
+
+// Premultiplied source-over: out = src + dst * (255 - srcAlpha) / 255 per
+// channel, rounded as in the paint kernels.
+using OverFn = void (*)(std::uint32_t* dst, const std::uint32_t* src, std::size_t n);
+
+constexpr int kAlphaShift = std::endian::native == std::endian::little ? 24 : 0;
+
+inline std::uint32_t overPixel(std::uint32_t d, std::uint32_t s) {
+    const std::uint32_t inv = 255 - ((s >> kAlphaShift) & 0xff);
+    std::uint32_t out = 0;
+    for (int c = 0; c < 4; ++c) {
+        std::uint32_t t = ((d >> (8 * c)) & 0xff) * inv + 128;
+        std::uint32_t v = ((t + (t >> 8)) >> 8) + ((s >> (8 * c)) & 0xff);
+        out |= std::min(v, 255u) << (8 * c);
+    }
+    return out;
+}
+
+void overScalar(std::uint32_t* dst, const std::uint32_t* src, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        const std::uint32_t alpha = (src[i] >> kAlphaShift) & 0xff;
+        if (alpha == 255) {
+            dst[i] = src[i];
+        } else if (src[i] != 0) {
+            dst[i] = overPixel(dst[i], src[i]);
+        }
+    }
+}
+
+#ifdef OPENPERF_COMPOSITE_X86
+
+// dst * (255 - alpha) / 255 for two pixels widened to 16 bits
+__m128i scaleHalfSse2(__m128i d, __m128i s) {
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), alpha)), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+void overSse2(std::uint32_t* dst, const std::uint32_t* src, std::size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff) continue; // transparent
+        auto* p = reinterpret_cast<__m128i*>(dst + i);
+        __m128i d = _mm_loadu_si128(p);
+        __m128i lo = scaleHalfSse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+        __m128i hi = scaleHalfSse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+        _mm_storeu_si128(p, _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+    }
+    for (; i < n; ++i) dst[i] = overPixel(dst[i], src[i]);
+}
+
+__attribute__((target("avx2"))) __m256i scaleHalfAvx2(__m256i d, __m256i s) {
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha)),
+                                 _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// tail kept in this function to avoid AVX/SSE transitions, as in paint.cpp
+__attribute__((target("avx2"))) void overAvx2(std::uint32_t* dst, const std::uint32_t* src, std::size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) == -1) continue; // transparent
+        auto* p = reinterpret_cast<__m256i*>(dst + i);
+        __m256i d = _mm256_loadu_si256(p);
+        __m256i lo = scaleHalfAvx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+        __m256i hi = scaleHalfAvx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+        _mm256_storeu_si256(p, _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+    }
+    for (; i < n; ++i) dst[i] = overPixel(dst[i], src[i]);
+}
+
+#endif
+
+OverFn overFor(PaintKernel kernel) {
+    switch (kernel) {
+#ifdef OPENPERF_COMPOSITE_X86
+        case PaintKernel::Avx2:
+            return overAvx2;
+        case PaintKernel::Sse2:
+            return overSse2;
+#endif
+        default:
+            return overScalar;
+    }
+}
+
+DamageRect intersect(const DamageRect& a, const DamageRect& b) {
+    return {std::max(a.x0, b.x0), std::max(a.y0, b.y0), std::min(a.x1, b.x1), std::min(a.y1, b.y1)};
+}
+
+bool isEmpty(const DamageRect& r) {
+    return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+DamageRect bounds(const Layer& layer) {
+    return {layer.x, layer.y, layer.x + layer.list->width, layer.y + layer.list->height};
+}
+
+constexpr std::size_t kMaxRectsPerTile = 16;
+
+// Copying the previous tile costs about as much as compositing a tile from
+// the root raster, so past this share of damage a tile is redone whole
+// rather than copied and patched.
+constexpr double kWholeTileShare = 0.25;
+
+// Past this share of the viewport nearly every tile is redone whole anyway,
+// so the frame is composited from scratch without binning the damage.
+constexpr double kFullCompositeShare = 0.75;
+
+// True if the rects overlap or share part of an edge.
+bool touches(const DamageRect& a, const DamageRect& b) {
+    return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1 &&
+           ((a.x0 < b.x1 && b.x0 < a.x1) || (a.y0 < b.y1 && b.y0 < a.y1));
+}
+
+// Replaces overlapping or touching rects with their bounding box until none
+// do, so no pixel is composited twice and adjacent rows become one rect.
+void mergeTouching(std::vector<DamageRect>& rects) {
+    for (bool merged = true; merged;) {
+        merged = false;
+        for (std::size_t i = 0; i < rects.size() && !merged; ++i) {
+            for (std::size_t j = i + 1; j < rects.size(); ++j) {
+                const DamageRect& a = rects[i];
+                const DamageRect& b = rects[j];
+                if (!touches(a, b)) continue;
+                rects[i] = {std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1)};
+                rects.erase(rects.begin() + static_cast<std::ptrdiff_t>(j));
+                merged = true;
+                break;
+            }
+        }
+    }
+}
+
+bool sameGeometry(const Frame& frame, const Raster& root) {
+    return frame.width == root.width && frame.height == root.height && frame.tileSize == root.tileSize &&
+           frame.tiles.size() == static_cast<std::size_t>(root.tilesX) * static_cast<std::size_t>(root.tilesY);
+}
+
+std::size_t listBytes(const DisplayList& list) {
+    return sizeof(DisplayList) + list.items.capacity() * sizeof(DisplayItem) +
+           (list.tileOffsets.capacity() + list.tileItems.capacity()) * sizeof(std::uint32_t);
+}
+
+}
+
+std::uint32_t Frame::pixel(std::int32_t x, std::int32_t y) const {
+    const auto tile = static_cast<std::size_t>((y / tileSize) * tilesX + x / tileSize);
+    return tiles[tile][static_cast<std::size_t>((y % tileSize) * tileSize + x % tileSize)];
+}
+
+std::size_t Frame::memoryBytes() const {
+    std::size_t bytes = tiles.capacity() * sizeof(tiles[0]) +
+                        tiles.size() * static_cast<std::size_t>(tileSize) * static_cast<std::size_t>(tileSize) *
+                            sizeof(std::uint32_t);
+    for (const auto& layer : layers) {
+        if (layer.list) bytes += listBytes(*layer.list);
+        if (layer.raster) bytes += sizeof(Raster) + layer.raster->memoryBytes();
+    }
+    return bytes;
+}
+
+Compositor::Compositor() : Compositor(nullptr, Options{}) {}
+
+Compositor::Compositor(TaskScheduler* scheduler) : Compositor(scheduler, Options{}) {}
+
+Compositor::Compositor(TaskScheduler* scheduler, Options options)
+    : scheduler_(scheduler), kernel_(resolvePaintKernel(options.kernel)) {}
+
+std::vector<DamageRect> Compositor::damage(const Frame* prev, const std::vector<Layer>& layers) {
+    std::vector<DamageRect> out;
+    if (layers.empty() || !layers[0].list) return out;
+    const DisplayList& root = *layers[0].list;
+    const DamageRect view{0, 0, root.width, root.height};
+    auto add = [&](const DamageRect& r) {
+        DamageRect clipped = intersect(r, view);
+        if (!isEmpty(clipped)) out.push_back(clipped);
+    };
+
+    const DisplayList* prevRoot = prev && !prev->layers.empty() ? prev->layers[0].list.get() : nullptr;
+    if (!prevRoot || prevRoot->width != root.width || prevRoot->height != root.height ||
+        prevRoot->tileSize != root.tileSize) {
+        add(view);
+        return out;
+    }
+
+    for (std::size_t l = 0; l < std::max(prev->layers.size(), layers.size()); ++l) {
+        const Layer* a = l < prev->layers.size() ? &prev->layers[l] : nullptr;
+        const Layer* b = l < layers.size() ? &layers[l] : nullptr;
+        if (a && !a->list) a = nullptr;
+        if (b && !b->list) b = nullptr;
+        if (!a || !b || a->x != b->x || a->y != b->y || a->list->width != b->list->width ||
+            a->list->height != b->list->height || a->list->tileSize != b->list->tileSize ||
+            a->list->clearColor != b->list->clearColor) {
+            if (a) add(bounds(*a));
+            if (b) add(bounds(*b));
+            continue;
+        }
+        if (a->list == b->list) continue;
+
+        // Items are compared position by position within each tile. With
+        // the same number of items, pixels outside the differing ones are
+        // painted by identical items in the same order, so only those change;
+        // otherwise everything from the first difference on may.
+        const DisplayList& before = *a->list;
+        const DisplayList& after = *b->list;
+        const std::int32_t t = after.tileSize;
+        for (std::size_t tile = 0; tile < after.tileCount(); ++tile) {
+            const std::uint32_t* itemsA = before.tileItems.data() + before.tileOffsets[tile];
+            const std::uint32_t* itemsB = after.tileItems.data() + after.tileOffsets[tile];
+            const std::size_t countA = before.tileOffsets[tile + 1] - before.tileOffsets[tile];
+            const std::size_t countB = after.tileOffsets[tile + 1] - after.tileOffsets[tile];
+
+            const auto ox = static_cast<std::int32_t>(tile % static_cast<std::size_t>(after.tilesX)) * t;
+            const auto oy = static_cast<std::int32_t>(tile / static_cast<std::size_t>(after.tilesX)) * t;
+            const DamageRect tileRect{ox, oy, ox + t, oy + t};
+            const std::size_t first = out.size();
+            DamageRect box{tileRect.x1, tileRect.y1, tileRect.x0, tileRect.y0};
+            auto mark = [&](const DisplayItem& item) {
+                DamageRect r = intersect({item.x0, item.y0, item.x1, item.y1}, tileRect);
+                box = {std::min(box.x0, r.x0), std::min(box.y0, r.y0), std::max(box.x1, r.x1), std::max(box.y1, r.y1)};
+                add({r.x0 + b->x, r.y0 + b->y, r.x1 + b->x, r.y1 + b->y});
+            };
+
+            std::size_t k = 0;
+            while (k < countA && k < countB && before.items[itemsA[k]] == after.items[itemsB[k]]) ++k;
+            if (k == countA && k == countB) continue;
+            if (countA == countB) {
+                for (std::size_t i = k; i < countA; ++i) {
+                    const DisplayItem& x = before.items[itemsA[i]];
+                    const DisplayItem& y = after.items[itemsB[i]];
+                    if (x == y) continue;
+                    mark(x);
+                    if (x.x0 != y.x0 || x.y0 != y.y0 || x.x1 != y.x1 || x.y1 != y.y1) mark(y);
+                }
+            } else {
+                for (std::size_t i = k; i < countA; ++i) mark(before.items[itemsA[i]]);
+                for (std::size_t i = k; i < countB; ++i) mark(after.items[itemsB[i]]);
+            }
+
+            // many small rects in one tile are cheaper as their bounding box
+            if (out.size() - first > kMaxRectsPerTile) {
+                out.resize(first);
+                add({box.x0 + b->x, box.y0 + b->y, box.x1 + b->x, box.y1 + b->y});
+            }
+        }
+    }
+    return out;
+}
+
+Frame Compositor::composite(std::vector<Layer> layers, const Frame* prev,
+                            const std::vector<DamageRect>& damage) const {
+    Frame frame;
+    if (layers.empty() || !layers[0].raster) {
+        frame.layers = std::move(layers);
+        return frame;
+    }
+
+    const Raster& root = *layers[0].raster;
+    const Frame* base = prev && sameGeometry(*prev, root) ? prev : nullptr;
+
+    frame.width = root.width;
+    frame.height = root.height;
+    frame.tileSize = root.tileSize;
+    frame.tilesX = root.tilesX;
+    frame.tilesY = root.tilesY;
+    const std::size_t tiles = static_cast<std::size_t>(root.tilesX) * static_cast<std::size_t>(root.tilesY);
+    frame.tiles.resize(tiles);
+
+    const std::int32_t t = root.tileSize;
+    const std::size_t tilePixels = static_cast<std::size_t>(t) * static_cast<std::size_t>(t);
+    const OverFn over = overFor(kernel_);
+    std::vector<std::int64_t> tileDamage(tiles, 0);
+    const DamageRect view{0, 0, root.width, root.height};
+    auto tileBounds = [&](std::size_t tile) {
+        const auto ox = static_cast<std::int32_t>(tile % static_cast<std::size_t>(root.tilesX)) * t;
+        const auto oy = static_cast<std::int32_t>(tile / static_cast<std::size_t>(root.tilesX)) * t;
+        return intersect({ox, oy, ox + t, oy + t}, view);
+    };
+
+    // Damage clipped to each tile it hits and merged there; a tile left
+    // without any keeps the previous frame's pixels.
+    std::vector<std::vector<DamageRect>> tileRects;
+    if (base) {
+        tileRects.resize(tiles);
+        for (const auto& d : damage) {
+            const DamageRect clipped = intersect(d, view);
+            if (isEmpty(clipped)) continue;
+            for (std::int32_t ty = clipped.y0 / t; ty <= (clipped.y1 - 1) / t; ++ty) {
+                for (std::int32_t tx = clipped.x0 / t; tx <= (clipped.x1 - 1) / t; ++tx) {
+                    const auto tile = static_cast<std::size_t>(ty * root.tilesX + tx);
+                    tileRects[tile].push_back(intersect(clipped, tileBounds(tile)));
+                }
+            }
+        }
+        std::int64_t total = 0;
+        for (auto& rects : tileRects) {
+            mergeTouching(rects);
+            for (const auto& r : rects) total += r.area();
+        }
+        if (static_cast<double>(total) >= kFullCompositeShare * static_cast<double>(view.area())) {
+            base = nullptr;
+            tileRects.clear();
+        }
+    }
+
+    auto compositeTile = [&](std::size_t tile) {
+        const DamageRect tileRect = tileBounds(tile);
+        const std::int32_t ox = tileRect.x0;
+        const std::int32_t oy = tileRect.y0;
+
+        std::vector<DamageRect> whole{tileRect};
+        const std::vector<DamageRect>* rects = &whole;
+        if (base) {
+            if (tileRects[tile].empty()) {
+                frame.tiles[tile] = base->tiles[tile];
+                return;
+            }
+            std::int64_t area = 0;
+            for (const auto& r : tileRects[tile]) area += r.area();
+            if (static_cast<double>(area) < kWholeTileShare * static_cast<double>(tileRect.area())) {
+                rects = &tileRects[tile];
+            }
+        }
+
+        // copy on write: start from the previous tile unless all of it is redone
+        auto pixels = std::make_shared_for_overwrite<std::uint32_t[]>(tilePixels);
+        std::uint32_t* out = pixels.get();
+        if (rects != &whole) std::memcpy(out, base->tiles[tile].get(), tilePixels * sizeof(std::uint32_t));
+
+        const std::uint32_t* rootTile = root.pixels.data() + tile * tilePixels; // tiled like the frame
+        for (const DamageRect& r : *rects) {
+            for (std::int32_t y = r.y0; y < r.y1; ++y) {
+                const std::size_t offset = static_cast<std::size_t>((y - oy) * t + (r.x0 - ox));
+                std::memcpy(out + offset, rootTile + offset,
+                            static_cast<std::size_t>(r.x1 - r.x0) * sizeof(std::uint32_t));
+            }
+
+            for (std::size_t l = 1; l < layers.size(); ++l) {
+                const Layer& layer = layers[l];
+                if (!layer.raster || layer.raster->tileSize <= 0) continue;
+                const Raster& src = *layer.raster;
+                const DamageRect part = intersect(r, {layer.x, layer.y, layer.x + src.width, layer.y + src.height});
+                if (isEmpty(part)) continue;
+
+                const std::int32_t lt = src.tileSize;
+                for (std::int32_t y = part.y0; y < part.y1; ++y) {
+                    const std::int32_t ly = y - layer.y;
+                    std::uint32_t* row = out + (y - oy) * t;
+                    // spans break where the layer's own tiles do
+                    for (std::int32_t x = part.x0; x < part.x1;) {
+                        const std::int32_t lx = x - layer.x;
+                        const std::int32_t n = std::min(part.x1 - x, lt - lx % lt);
+                        const std::size_t srcTile = static_cast<std::size_t>((ly / lt) * src.tilesX + lx / lt);
+                        const std::uint32_t* s = src.pixels.data() + srcTile * static_cast<std::size_t>(lt * lt) +
+                                                 static_cast<std::size_t>((ly % lt) * lt + lx % lt);
+                        over(row + (x - ox), s, static_cast<std::size_t>(n));
+                        x += n;
+                    }
+                }
+            }
+            tileDamage[tile] += r.area();
+        }
+        frame.tiles[tile] = std::move(pixels);
+    };
+
+    if (scheduler_ && tiles > 1) {
+        scheduler_->parallelFor(0, tiles, 1, [&](std::size_t lo, std::size_t hi) {
+            for (std::size_t tile = lo; tile < hi; ++tile) compositeTile(tile);
+        });
+    } else {
+        for (std::size_t tile = 0; tile < tiles; ++tile) compositeTile(tile);
+    }
+    for (auto px : tileDamage) frame.damagedPixels += px;
+
+    for (auto& layer : layers) layer.raster.reset();
+    frame.layers = std::move(layers);
+    return frame;
+}
+
+}
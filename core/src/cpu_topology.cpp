@@ -0,0 +1,255 @@
+#include "openperf/cpu_topology.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace openperf {
+
+namespace {
+
+std::string readLine(const std::filesystem::path& path) {
+    std::ifstream in{path};
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+bool parseInt(std::string_view text, int* out) {
+    const char* end = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(text.data(), end, *out);
+    return ec == std::errc{} && ptr == end && *out >= 0;
+}
+
+// CPUs the process may run on; empty if that cannot be asked.
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+#endif
+    return cpus;
+}
+
+#ifdef __linux__
+bool toCpuSet(const std::vector<int>& cpus, cpu_set_t* set) {
+    CPU_ZERO(set);
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+        CPU_SET(cpu, set);
+    }
+    return !cpus.empty();
+}
+#endif
+
+} // namespace
+
+bool parseCpuList(std::string_view text, std::vector<int>* out) {
+    std::vector<int> cpus;
+    while (!text.empty()) {
+        const auto comma = text.find(',');
+        std::string_view item = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+
+        while (!item.empty() && std::isspace(static_cast<unsigned char>(item.front()))) item.remove_prefix(1);
+        while (!item.empty() && std::isspace(static_cast<unsigned char>(item.back()))) item.remove_suffix(1);
+        if (item.empty()) {
+            if (comma == std::string_view::npos && cpus.empty()) break; // "" lists no CPUs
+            return false;
+        }
+
+        int lo = 0, hi = 0;
+        const auto dash = item.find('-');
+        if (dash == std::string_view::npos) {
+            if (!parseInt(item, &lo)) return false;
+            hi = lo;
+        } else if (!parseInt(item.substr(0, dash), &lo) || !parseInt(item.substr(dash + 1), &hi) || hi < lo) {
+            return false;
+        }
+        for (int cpu = lo; cpu <= hi; ++cpu) cpus.push_back(cpu);
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    *out = std::move(cpus);
+    return true;
+}
+
+std::string formatCpuList(const std::vector<int>& cpus) {
+    std::string text;
+    for (std::size_t i = 0; i < cpus.size();) {
+        std::size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+        if (!text.empty()) text += ',';
+        text += std::to_string(cpus[i]);
+        if (j > i) text += '-' + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return text;
+}
+
+CpuTopology CpuTopology::detect(const std::string& sysfsRoot) {
+    const std::vector<int> usable = allowedCpus();
+    if (usable.empty()) return uniform(std::max(1u, std::thread::hardware_concurrency()));
+
+    // system node id of every CPU sysfs lists under a node
+    std::map<int, int> nodeOf;
+    int lowestNode = -1;
+    std::error_code ec;
+    const std::filesystem::path nodeDir = std::filesystem::path(sysfsRoot) / "node";
+    for (auto it = std::filesystem::directory_iterator(nodeDir, ec); !ec && it != std::filesystem::directory_iterator();
+         it.increment(ec)) {
+        const std::string name = it->path().filename().string();
+        int node = 0;
+        if (name.rfind("node", 0) != 0 || !parseInt(std::string_view(name).substr(4), &node)) continue;
+        std::vector<int> cpus;
+        if (!parseCpuList(readLine(it->path() / "cpulist"), &cpus)) continue;
+        for (int cpu : cpus) nodeOf.emplace(cpu, node);
+        if (lowestNode < 0 || node < lowestNode) lowestNode = node;
+    }
+
+    CpuTopology topology;
+    std::set<int> nodes;
+    for (int cpu : usable) {
+        auto found = nodeOf.find(cpu);
+        // CPUs missing from every node list join the lowest node
+        const int node = found != nodeOf.end() ? found->second : std::max(lowestNode, 0);
+        nodes.insert(node);
+
+        std::vector<int> siblings;
+        const auto siblingsPath =
+            std::filesystem::path(sysfsRoot) / "cpu" / ("cpu" + std::to_string(cpu)) / "topology" / "thread_siblings_list";
+        const bool known = parseCpuList(readLine(siblingsPath), &siblings) && !siblings.empty();
+        // node holds the system id until the nodes are numbered below
+        topology.cpus_.push_back({cpu, static_cast<std::size_t>(node), known ? siblings.front() : cpu});
+    }
+
+    topology.nodeIds_.assign(nodes.begin(), nodes.end());
+    for (auto& cpu : topology.cpus_) {
+        const int node = static_cast<int>(cpu.node);
+        cpu.node = static_cast<std::size_t>(
+            std::lower_bound(topology.nodeIds_.begin(), topology.nodeIds_.end(), node) - topology.nodeIds_.begin());
+    }
+    return topology;
+}
+
+CpuTopology CpuTopology::uniform(std::size_t count) {
+    std::vector<int> cpus(count);
+    for (std::size_t i = 0; i < count; ++i) cpus[i] = static_cast<int>(i);
+    return fromNodes({cpus});
+}
+
+CpuTopology CpuTopology::fromNodes(const std::vector<std::vector<int>>& nodeCpus) {
+    CpuTopology topology;
+    for (const auto& cpus : nodeCpus) {
+        if (cpus.empty()) continue;
+        for (int cpu : cpus) topology.cpus_.push_back({cpu, topology.nodeIds_.size(), cpu});
+        topology.nodeIds_.push_back(static_cast<int>(topology.nodeIds_.size()));
+    }
+    std::sort(topology.cpus_.begin(), topology.cpus_.end(),
+              [](const CpuInfo& a, const CpuInfo& b) { return a.id < b.id; });
+    return topology;
+}
+
+std::vector<int> CpuTopology::cpuIds() const {
+    std::vector<int> ids;
+    for (const auto& cpu : cpus_) ids.push_back(cpu.id);
+    return ids;
+}
+
+std::vector<int> CpuTopology::cpuIds(std::size_t node) const {
+    std::vector<int> ids;
+    for (const auto& cpu : cpus_) {
+        if (cpu.node == node) ids.push_back(cpu.id);
+    }
+    return ids;
+}
+
+CpuTopology CpuTopology::without(const std::vector<int>& reserved) const {
+    CpuTopology rest;
+    std::vector<bool> kept(nodeIds_.size(), false);
+    for (const auto& cpu : cpus_) {
+        if (std::find(reserved.begin(), reserved.end(), cpu.id) != reserved.end()) continue;
+        rest.cpus_.push_back(cpu);
+        kept[cpu.node] = true;
+    }
+
+    // renumber the nodes that still have CPUs
+    std::vector<std::size_t> index(nodeIds_.size(), 0);
+    for (std::size_t node = 0; node < nodeIds_.size(); ++node) {
+        if (!kept[node]) continue;
+        index[node] = rest.nodeIds_.size();
+        rest.nodeIds_.push_back(nodeIds_[node]);
+    }
+    for (auto& cpu : rest.cpus_) cpu.node = index[cpu.node];
+    return rest;
+}
+
+std::vector<CpuInfo> CpuTopology::placementOrder() const {
+    // per node: one CPU of each core first, then the remaining siblings
+    std::vector<std::vector<CpuInfo>> perNode(nodeIds_.size());
+    for (std::size_t node = 0; node < nodeIds_.size(); ++node) {
+        std::set<int> seenCores;
+        std::vector<CpuInfo> siblings;
+        for (const auto& cpu : cpus_) {
+            if (cpu.node != node) continue;
+            if (seenCores.insert(cpu.core).second) perNode[node].push_back(cpu);
+            else siblings.push_back(cpu);
+        }
+        perNode[node].insert(perNode[node].end(), siblings.begin(), siblings.end());
+    }
+
+    std::vector<CpuInfo> order;
+    order.reserve(cpus_.size());
+    for (std::size_t i = 0; order.size() < cpus_.size(); ++i) {
+        for (const auto& cpus : perNode) {
+            if (i < cpus.size()) order.push_back(cpus[i]);
+        }
+    }
+    return order;
+}
+
+std::string CpuTopology::describe() const {
+    std::string text = std::to_string(nodeCount()) + (nodeCount() == 1 ? " node, " : " nodes, ") +
+                       std::to_string(cpus_.size()) + " cpus (";
+    for (std::size_t node = 0; node < nodeCount(); ++node) {
+        if (node > 0) text += ", ";
+        text += "node " + std::to_string(nodeIds_[node]) + ": " + formatCpuList(cpuIds(node));
+    }
+    return text + ")";
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    return toCpuSet(cpus, &set) && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+bool pinThread(std::thread& thread, const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    return toCpuSet(cpus, &set) && pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+    (void)thread;
+    (void)cpus;
+    return false;
+#endif
+}
+
+}
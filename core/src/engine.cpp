@@ -1,9 +1,64 @@
 #include "openperf/engine.hpp"
+#include "openperf/trace.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 
 namespace openperf {
 
-Engine::Engine() : scheduler_(std::thread::hardware_concurrency()) {}
+namespace {
+
+std::size_t stringBytes(const std::string& s) {
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+std::atomic<std::uint64_t> g_pageCounter{0};
+
+std::size_t issueBytes(const std::vector<AccessibilityIssue>& issues) {
+    std::size_t bytes = sizeof(issues) + issues.capacity() * sizeof(AccessibilityIssue);
+    for (const auto& issue : issues) {
+        bytes += stringBytes(issue.code) + stringBytes(issue.message) + stringBytes(issue.nodeId);
+    }
+    return bytes;
+}
+
+}
+
+Engine::Engine() : Engine(Options{}) {}
+
+Engine::Engine(Options options)
+    : scheduler_(options.scheduler),
+      accessibility_(&scheduler_),
+      painter_(&scheduler_),
+      compositor_(&scheduler_),
+      pipeline_(scheduler_) {
+    auto parse = pipeline_.addStage("parse", [this](RenderJob& job) { parseStage(job); });
+    auto layout = pipeline_.addStage("layout", [this](RenderJob& job) { layoutStage(job); }, {}, {parse});
+    auto paint = pipeline_.addStage("paint", [this](RenderJob& job) { paintStage(job); }, {}, {layout});
+    pipeline_.addStage("composite", [this](RenderJob& job) { compositeStage(job); }, {}, {paint});
+    pipeline_.onComplete([this](RenderJob& job) { onRenderComplete(job); });
+    pipeline_.onShed([this](RenderJob& job) { renderDropped(job, RenderStatus::Shed); });
+    pipeline_.setAdmission(options.admission);
+
+    for (std::size_t i = 0; i < pipeline_.stageCount(); ++i) {
+        stageMetrics_.push_back(metrics_.registerMetric(pipeline_.stageName(i) + "_ms"));
+    }
+    renderLatencyMetric_ = metrics_.registerMetric("render_pipeline_latency_ms");
+    queueDepthMetric_ = metrics_.registerMetric("task_queue_depth");
+    renderQueueMetric_ = metrics_.registerMetric("render_queue_depth");
+    queueWaitMetric_ = metrics_.registerMetric("render_queue_wait_ms");
+    rejectedMetric_ = metrics_.registerMetric("render_rejected", MetricKind::Counter);
+    shedMetric_ = metrics_.registerMetric("render_shed", MetricKind::Counter);
+    cancelledMetric_ = metrics_.registerMetric("render_cancelled", MetricKind::Counter);
+    expiredMetric_ = metrics_.registerMetric("render_expired", MetricKind::Counter);
+    patchChangedMetric_ = metrics_.registerMetric("patch_changed_nodes");
+    layoutReusedMetric_ = metrics_.registerMetric("layout_reused_nodes");
+    paintTileMetric_ = metrics_.registerMetric("paint_tile_ms");
+    compositeDamageMetric_ = metrics_.registerMetric("composite_damage_px");
+    a11yCacheMetrics_ = registerCacheMetrics("a11y_cache");
+    renderCacheMetrics_ = registerCacheMetrics("render_cache");
+    scheduler_.attachMetrics(metrics_);
+}
 
 Engine::~Engine() {
     stop();
@@ -17,68 +72,434 @@ void Engine::stop() {
     scheduler_.stop();
 }
 
-std::optional<Page> Engine::getPage(const std::string& pageId) const {
-    std::lock_guard<std::mutex> lock(pagesMutex_);
-    auto it = pages_.find(pageId);
-    if (it == pages_.end()) return std::nullopt;
-    return it->second;
+PagePtr Engine::getPage(const std::string& pageId) const {
+    return pages_.find(pageId);
 }
 
-void Engine::runRenderPipeline(const std::string& pageId) {
-    auto maybePage = getPage(pageId);
-    if (!maybePage) return;
-
-    Page pageCopy = *maybePage;
-
-    scheduler_.enqueue([this, pageCopy]() {
-        auto t0 = std::chrono::steady_clock::now();
-
-        // Stage 1: Parse
-        auto t_parse_start = t0;
-        // Simulate parsing DOM structure
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        auto t_parse_end = std::chrono::steady_clock::now();
-
-        // Stage 2: Layout
-        auto t_layout_start = t_parse_end;
-        // Simulate layout calculations (box model, positioning)
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        auto t_layout_end = std::chrono::steady_clock::now();
-
-        // Stage 3: Paint
-        auto t_paint_start = t_layout_end;
-        // Simulate paint operations (drawing to layers)
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        auto t_paint_end = std::chrono::steady_clock::now();
-
-        // Stage 4: Composite
-        auto t_comp_start = t_paint_end;
-        // Simulate compositing layers into final image
-        std::this_thread::sleep_for(std::chrono::milliseconds(2));
-        auto t_comp_end = std::chrono::steady_clock::now();
-
-        using ms = std::chrono::duration<double, std::milli>;
-        metrics_.record("parse_ms", ms(t_parse_end - t_parse_start).count());
-        metrics_.record("layout_ms", ms(t_layout_end - t_layout_start).count());
-        metrics_.record("paint_ms", ms(t_paint_end - t_paint_start).count());
-        metrics_.record("composite_ms", ms(t_comp_end - t_comp_start).count());
-        metrics_.record("render_pipeline_latency_ms", ms(t_comp_end - t0).count());
-        
-        // Record queue depth after task completion
-        auto queueDepth = scheduler_.getQueueDepth();
-        metrics_.record("task_queue_depth", static_cast<double>(queueDepth));
+PagePtr Engine::preparePage(Page page) {
+    // a page built off the workers is handed to the next node in turn
+    page.node = scheduler_.currentNode();
+    if (const std::size_t nodes = scheduler_.nodeCount(); page.node < 0 && nodes > 1) {
+        page.node = static_cast<int>(nextNode_.fetch_add(1, std::memory_order_relaxed) % nodes);
+    }
+    if (page.id.empty()) {
+        auto idNum = g_pageCounter.fetch_add(1, std::memory_order_relaxed);
+        page.id = "page-" + std::to_string(idNum);
+    }
+
+    if (page.content.empty()) {
+        if (page.root) page.content = hashTree(*page.root);
+        else if (page.dom) page.content = hashDocument(*page.dom); // parsed from HTML
+    }
+    if (page.root && !page.dom) {
+        // content rendered before shares its flat DOM; not a counted lookup,
+        // the page's renders count their own
+        if (auto cached = renderCache_.find(page.content)) {
+            page.dom = cached->dom;
+        } else {
+            page.dom = std::make_shared<const FlatDocument>(FlatDocument::fromTree(*page.root));
+        }
+    }
+    return std::make_shared<const Page>(std::move(page));
+}
+
+std::vector<std::string> Engine::submitPages(std::vector<Page> pages) {
+    OPENPERF_TRACE_SPAN_ARG("engine", "submitPages", "pages", pages.size());
+    std::vector<PagePtr> prepared(pages.size());
+    scheduler_.parallelFor(0, pages.size(), 1, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i) prepared[i] = preparePage(std::move(pages[i]));
     });
+
+    std::vector<std::string> ids;
+    ids.reserve(prepared.size());
+    for (const auto& page : prepared) ids.push_back(page->id);
+    pages_.insertBatch(std::move(prepared));
+    return ids;
+}
+
+Engine::CacheMetrics Engine::registerCacheMetrics(const std::string& prefix) {
+    return {metrics_.registerMetric(prefix + "_hits", MetricKind::Counter),
+            metrics_.registerMetric(prefix + "_misses", MetricKind::Counter),
+            metrics_.registerMetric(prefix + "_evictions", MetricKind::Counter)};
+}
+
+std::shared_ptr<const RenderOutput> Engine::findRender(const ContentHash& content) {
+    if (content.empty()) return nullptr;
+    auto cached = renderCache_.find(content);
+    metrics_.record(cached ? renderCacheMetrics_.hits : renderCacheMetrics_.misses, 1);
+    return cached;
+}
+
+PatchResult Engine::patchPage(const std::string& pageId, const std::vector<NodeMutation>& mutations) {
+    for (;;) {
+        auto page = getPage(pageId);
+        if (!page) {
+            PatchResult result;
+            result.status = PatchStatus::PageNotFound;
+            result.error = "unknown page_id " + pageId;
+            return result;
+        }
+        if (!page->root && !page->dom) {
+            PatchResult result;
+            result.status = PatchStatus::InvalidMutation;
+            result.error = "page has no tree";
+            return result;
+        }
+
+        // the first patch of a page indexes its tree once; pages parsed from
+        // HTML only have a flat DOM to build one from
+        auto editor = page->editor ? page->editor
+                                   : std::make_shared<PageEditor>(page->root ? page->root : page->dom->toTree());
+        std::lock_guard<std::mutex> lock{editor->mutex()};
+
+        // another patch may have landed between the lookup and the lock
+        if (page->editor && getPage(pageId) != page) continue;
+
+        const auto previous = editor->root();
+        auto result = editor->apply(mutations);
+        if (result.status != PatchStatus::Applied) return result;
+
+        auto next = std::make_shared<Page>();
+        next->id = page->id;
+        next->url = page->url;
+        next->root = editor->root();
+        next->editor = editor;
+        // the flat DOM copies the subtrees the patch left alone, and renders
+        // of the snapshot share it and, through its hash, their results
+        if (next->root) {
+            next->dom = std::make_shared<const FlatDocument>(
+                page->dom && previous ? FlatDocument::fromTree(*next->root, *page->dom,
+                                                               editor->sharedSubtrees(*previous, *page->dom),
+                                                               &next->copiedSubtrees)
+                                      : FlatDocument::fromTree(*next->root));
+            next->content = hashDocument(*next->dom);
+            if (!next->copiedSubtrees.empty()) next->patchedFrom = page->content;
+        }
+        next->changedNodes = result.changedNodes;
+        next->node = page->node;
+
+        // fails only if the page was resubmitted, removed or first patched
+        // concurrently; start over from whatever is stored now
+        if (!pages_.replace(page, std::move(next))) continue;
+
+        metrics_.record(patchChangedMetric_, static_cast<double>(result.changedNodes));
+        return result;
+    }
+}
+
+void Engine::runRenderPipeline(const std::string& pageId) {
+    runRenderPipeline(pageId, nullptr);
+}
+
+void Engine::runRenderPipeline(const std::string& pageId, RenderCallback done, TaskOptions options) {
+    startRender(pageId, getPage(pageId), std::move(done), options);
+}
+
+void Engine::runRenderBatch(const std::vector<std::string>& pageIds, RenderBatchCallback done,
+                            TaskOptions options) {
+    auto pages = pages_.findBatch(pageIds);
+    if (!done) {
+        for (std::size_t i = 0; i < pages.size(); ++i) {
+            if (pages[i]) startRender(pageIds[i], std::move(pages[i]), nullptr, options);
+        }
+        return;
+    }
+    if (pageIds.empty()) {
+        done({});
+        return;
+    }
+
+    // each render fills in its slot; whichever finishes last reports them all
+    struct Batch {
+        std::vector<RenderResult> results;
+        std::atomic<std::size_t> remaining;
+        RenderBatchCallback done;
+    };
+    auto batch = std::make_shared<Batch>();
+    batch->results.resize(pageIds.size());
+    batch->remaining.store(pageIds.size(), std::memory_order_relaxed);
+    batch->done = std::move(done);
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+        startRender(pageIds[i], std::move(pages[i]), [batch, i](RenderResult result) {
+            batch->results[i] = std::move(result);
+            if (batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                batch->done(std::move(batch->results));
+            }
+        }, options);
+    }
+}
+
+RenderHandle Engine::render(const std::string& pageId, TaskOptions options) {
+    return startRender(pageId, getPage(pageId), options);
+}
+
+std::vector<RenderHandle> Engine::renderBatch(const std::vector<std::string>& pageIds, TaskOptions options) {
+    auto pages = pages_.findBatch(pageIds);
+    std::vector<RenderHandle> handles;
+    handles.reserve(pageIds.size());
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+        handles.push_back(startRender(pageIds[i], std::move(pages[i]), options));
+    }
+    return handles;
+}
+
+RenderHandle Engine::startRender(const std::string& pageId, PagePtr page, const TaskOptions& options) {
+    RenderPromise promise{pageId};
+    auto job = startRender(pageId, std::move(page), promise.callback(), options);
+    if (job) {
+        // the job holds the promise; a weak reference back avoids a cycle
+        promise.setCanceller([this, weak = std::weak_ptr<RenderJob>(job)] {
+            auto job = weak.lock();
+            if (!job) return false; // already reported
+            auto outcome = pipeline_.cancel(job);
+            if (outcome == RenderPipeline::CancelResult::Dequeued) renderDropped(*job, RenderStatus::Cancelled);
+            return outcome != RenderPipeline::CancelResult::Started;
+        });
+    }
+    return promise.handle();
+}
+
+std::shared_ptr<RenderJob> Engine::startRender(const std::string& pageId, PagePtr page, RenderCallback done,
+                                               const TaskOptions& options) {
+    if (!page) {
+        if (done) {
+            RenderResult result;
+            result.pageId = pageId;
+            result.status = RenderStatus::PageNotFound;
+            done(std::move(result));
+        }
+        return nullptr;
+    }
+
+    auto job = std::make_shared<RenderJob>();
+    job->pageId = pageId;
+    job->cached = findRender(page->content);
+    job->page = std::move(page);
+    job->submitted = std::chrono::steady_clock::now();
+    job->options = options;
+    if (job->options.node < 0) job->options.node = job->page->node;
+    job->onDone = std::move(done);
+
+    // nothing would run it on a stopped engine
+    if (!scheduler_.running()) {
+        renderDropped(*job, RenderStatus::Cancelled);
+        return nullptr;
+    }
+
+    // what an arriving render finds ahead of it
+    metrics_.record(queueDepthMetric_, static_cast<double>(scheduler_.getQueueDepth()));
+    metrics_.record(renderQueueMetric_, static_cast<double>(pipeline_.queued()));
+
+    // submit() leaves the job untouched when it rejects it
+    if (!pipeline_.submit(job)) {
+        renderDropped(*job, RenderStatus::Rejected);
+        return nullptr;
+    }
+    return job;
+}
+
+void Engine::renderDropped(RenderJob& job, RenderStatus status) {
+    switch (status) {
+    case RenderStatus::Shed:
+        metrics_.record(shedMetric_, 1);
+        OPENPERF_TRACE_INSTANT("render", "shed", nullptr, 0);
+        break;
+    case RenderStatus::Cancelled:
+        metrics_.record(cancelledMetric_, 1);
+        OPENPERF_TRACE_INSTANT("render", "cancelled", nullptr, 0);
+        break;
+    case RenderStatus::Expired:
+        metrics_.record(expiredMetric_, 1);
+        OPENPERF_TRACE_INSTANT("render", "expired", nullptr, 0);
+        break;
+    default:
+        metrics_.record(rejectedMetric_, 1);
+        OPENPERF_TRACE_INSTANT("render", "rejected", nullptr, 0);
+        break;
+    }
+    if (!job.onDone) return;
+
+    RenderResult result;
+    result.pageId = job.pageId;
+    result.status = status;
+    result.submitted = job.submitted;
+    result.completed = std::chrono::steady_clock::now();
+    job.onDone(std::move(result));
+}
+
+void Engine::parseStage(RenderJob& job) {
+    // identical content was rendered before: every stage reuses its output
+    if (job.cached) {
+        job.dom = job.cached->dom;
+        job.boxes = job.cached->boxes;
+        job.layout = job.cached->layout;
+        job.frame = job.cached->frame;
+        return;
+    }
+
+    // pages that bypassed submitPage get their flat DOM built here
+    job.dom = job.page->dom;
+    if (!job.dom && job.page->root) {
+        job.dom = std::make_shared<const FlatDocument>(FlatDocument::fromTree(*job.page->root));
+    }
+}
+
+void Engine::layoutStage(RenderJob& job) {
+    if (job.cached || !job.dom) return;
+    auto state = std::make_shared<LayoutState>();
+
+    // a patched snapshot whose predecessor was rendered lays out only what
+    // the patch changed; not a counted lookup
+    std::shared_ptr<const RenderOutput> before;
+    const auto& copied = job.page->copiedSubtrees;
+    if (!copied.empty() && job.dom == job.page->dom) before = renderCache_.find(job.page->patchedFrom);
+    if (before && before->boxes && before->layout) {
+        PreviousLayout previous{*before->boxes, *before->layout, copied};
+        job.boxes = std::make_shared<const BoxArray>(layout_.layout(*job.dom, state.get(), &previous));
+        metrics_.record(layoutReusedMetric_, static_cast<double>(state->reusedNodes));
+    } else {
+        job.boxes = std::make_shared<const BoxArray>(layout_.layout(*job.dom, state.get()));
+    }
+    job.layout = std::move(state);
+}
+
+void Engine::paintStage(RenderJob& job) {
+    if (job.cached || !job.dom || !job.boxes) return;
+    auto painted = std::make_shared<Frame>();
+    painted->layers = painter_.paintLayers(*job.dom, *job.boxes);
+    for (const auto& layer : painted->layers) {
+        for (double ms : layer.raster->tileMs) metrics_.record(paintTileMetric_, ms);
+    }
+    job.frame = std::move(painted);
+}
+
+void Engine::compositeStage(RenderJob& job) {
+    if (!job.frame) return;
+    if (job.cached) {
+        frames_.insert(job.pageId, job.frame, sizeof(Frame) + job.frame->memoryBytes());
+        return;
+    }
+
+    // only what changed since this page's last frame is recomposited
+    auto prev = frames_.find(job.pageId);
+    auto damage = Compositor::damage(prev.get(), job.frame->layers);
+    auto frame = std::make_shared<const Frame>(compositor_.composite(job.frame->layers, prev.get(), damage));
+    metrics_.record(compositeDamageMetric_, static_cast<double>(frame->damagedPixels));
+    frames_.insert(job.pageId, frame, sizeof(Frame) + frame->memoryBytes());
+    job.frame = std::move(frame);
+}
+
+void Engine::onRenderComplete(RenderJob& job) {
+    using ms = std::chrono::duration<double, std::milli>;
+
+    // cancelled once admitted, or expired: its stages did nothing, so skip the metrics
+    switch (job.phase.load(std::memory_order_acquire)) {
+    case RenderJob::Phase::Cancelled:
+        renderDropped(job, RenderStatus::Cancelled);
+        return;
+    case RenderJob::Phase::Expired:
+        renderDropped(job, RenderStatus::Expired);
+        return;
+    default:
+        break;
+    }
+
+    auto first = job.stages.front().start;
+    auto last = job.stages.front().end;
+    for (std::size_t i = 0; i < job.stages.size(); ++i) {
+        const auto& t = job.stages[i];
+        metrics_.record(stageMetrics_[i], ms(t.end - t.start).count());
+        first = std::min(first, t.start);
+        last = std::max(last, t.end);
+    }
+    // time spent waiting for admission and a worker, apart from running
+    metrics_.record(queueWaitMetric_, ms(first - job.submitted).count());
+    metrics_.record(renderLatencyMetric_, ms(last - first).count());
+    if (OPENPERF_TRACING_ON()) {
+        // a render crosses threads, so it shows as its own track
+        auto& tracer = Tracer::global();
+        const auto id = tracer.nextId();
+        tracer.async("render", "render", id, Tracer::toNs(job.submitted), Tracer::toNs(last));
+        tracer.async("render", "queued", id, Tracer::toNs(job.submitted), Tracer::toNs(first));
+    }
+
+    if (!job.cached && !job.page->content.empty() && job.dom) {
+        auto output = std::make_shared<RenderOutput>();
+        output->dom = job.dom;
+        output->boxes = job.boxes;
+        output->layout = job.layout;
+        output->frame = job.frame;
+        auto bytes = sizeof(RenderOutput) + sizeof(FlatDocument) + job.dom->memoryBytes();
+        if (job.boxes) bytes += sizeof(BoxArray) + job.boxes->memoryBytes();
+        if (job.layout) bytes += sizeof(LayoutState) + job.layout->memoryBytes();
+        if (job.frame) bytes += sizeof(Frame) + job.frame->memoryBytes();
+        if (auto evicted = renderCache_.insert(job.page->content, std::move(output), bytes)) {
+            metrics_.record(renderCacheMetrics_.evictions, static_cast<double>(evicted));
+        }
+    }
+
+    if (job.onDone) {
+        RenderResult result;
+        result.pageId = job.pageId;
+        result.submitted = job.submitted;
+        result.completed = std::chrono::steady_clock::now();
+        result.stages = job.stages;
+        result.stageNames.reserve(pipeline_.stageCount());
+        for (std::size_t i = 0; i < pipeline_.stageCount(); ++i) {
+            result.stageNames.push_back(pipeline_.stageName(i));
+        }
+        job.onDone(std::move(result));
+    }
 }
 
 std::vector<AccessibilityIssue> Engine::analyzeAccessibility(const std::string& pageId) {
-    auto maybePage = getPage(pageId);
-    if (!maybePage) return {};
+    OPENPERF_TRACE_SPAN("a11y", "analyzeAccessibility");
+    auto page = getPage(pageId);
+    if (!page) return {};
+    return analyze(*page);
+}
 
-    return accessibility_.analyze(*maybePage);
+std::vector<AccessibilityReport> Engine::analyzeAccessibilityBatch(const std::vector<std::string>& pageIds) {
+    OPENPERF_TRACE_SPAN_ARG("a11y", "analyzeAccessibilityBatch", "pages", pageIds.size());
+    auto pages = pages_.findBatch(pageIds);
+    std::vector<AccessibilityReport> reports(pages.size());
+    scheduler_.parallelFor(0, pages.size(), 1, [&](std::size_t lo, std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i) {
+            if (!pages[i]) continue;
+            reports[i].found = true;
+            reports[i].issues = analyze(*pages[i]);
+        }
+    });
+    return reports;
+}
+
+std::vector<AccessibilityIssue> Engine::analyze(const Page& page) {
+    if (page.content.empty()) return accessibility_.analyze(page);
+
+    if (auto cached = a11yCache_.find(page.content)) {
+        metrics_.record(a11yCacheMetrics_.hits, 1);
+        OPENPERF_TRACE_INSTANT("a11y", "cache_hit", nullptr, 0);
+        return *cached;
+    }
+    metrics_.record(a11yCacheMetrics_.misses, 1);
+
+    auto issues = std::make_shared<const std::vector<AccessibilityIssue>>(accessibility_.analyze(page));
+    if (auto evicted = a11yCache_.insert(page.content, issues, issueBytes(*issues))) {
+        metrics_.record(a11yCacheMetrics_.evictions, static_cast<double>(evicted));
+    }
+    return *issues;
 }
 
 std::vector<Metric> Engine::getMetrics() const {
     return metrics_.getMetrics();
 }
 
+MetricsDelta Engine::getMetricsSince(std::uint64_t cursor) const {
+    return metrics_.getMetricsSince(cursor);
+}
+
+std::vector<MetricSummary> Engine::getMetricSummaries() const {
+    return metrics_.summarize();
+}
+
 }
\ No newline at end of file
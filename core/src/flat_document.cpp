@@ -0,0 +1,390 @@
+#include "openperf/flat_document.hpp"
+
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace openperf {
+
+// AtomTable
+
+AtomTable& AtomTable::global() {
+    static AtomTable table;
+    return table;
+}
+
+AtomTable::AtomTable() {
+    // order must match the constants in openperf::atoms
+    for (const char* name : {"", "img", "button", "a", "h1", "h2", "h3", "h4", "h5", "h6",
+                             "div", "span", "p", "input", "label", "ul", "li", "nav", "main",
+                             "section", "header", "footer", "body", "html"}) {
+        names_.emplace_back(name);
+        index_.emplace(names_.back(), static_cast<Atom>(names_.size() - 1));
+    }
+
+    // the rest of the vocabulary pages are expected to use
+    static const char* const kTags[] = {
+        "head", "title", "meta", "link", "script", "style", "noscript", "template", "article", "aside",
+        "em", "strong", "b", "i", "u", "s", "small", "code", "pre", "kbd", "samp", "var", "mark", "abbr",
+        "cite", "q", "sub", "sup", "time", "address", "blockquote", "br", "hr", "wbr", "ol", "dl", "dt",
+        "dd", "table", "caption", "thead", "tbody", "tfoot", "tr", "td", "th", "col", "colgroup", "form",
+        "fieldset", "legend", "select", "option", "optgroup", "textarea", "output", "progress", "meter",
+        "figure", "figcaption", "picture", "source", "iframe", "video", "audio", "track", "canvas", "svg",
+        "details", "summary", "dialog", "menu", "object", "embed", "map", "area", "frame", "frameset"};
+    static const char* const kRoles[] = {
+        "alert", "alertdialog", "application", "article", "banner", "button", "cell", "checkbox",
+        "columnheader", "combobox", "complementary", "contentinfo", "definition", "dialog", "directory",
+        "document", "feed", "figure", "form", "grid", "gridcell", "group", "heading", "img", "link", "list",
+        "listbox", "listitem", "log", "main", "marquee", "math", "menu", "menubar", "menuitem",
+        "menuitemcheckbox", "menuitemradio", "meter", "navigation", "none", "note", "option",
+        "presentation", "progressbar", "radio", "radiogroup", "region", "row", "rowgroup", "rowheader",
+        "scrollbar", "search", "searchbox", "separator", "slider", "spinbutton", "status", "switch", "tab",
+        "table", "tablist", "tabpanel", "term", "textbox", "timer", "toolbar", "tooltip", "tree",
+        "treegrid", "treeitem"};
+    for (const auto& names : {std::vector<const char*>(std::begin(kTags), std::end(kTags)),
+                              std::vector<const char*>(std::begin(kRoles), std::end(kRoles))}) {
+        for (const char* name : names) {
+            if (index_.count(name)) continue; // e.g. "img", both a tag and a role
+            names_.emplace_back(name);
+            index_.emplace(names_.back(), static_cast<Atom>(names_.size() - 1));
+        }
+    }
+}
+
+Atom AtomTable::intern(std::string_view name) {
+    {
+        std::shared_lock<std::shared_mutex> lock{mutex_};
+        auto it = index_.find(name);
+        if (it != index_.end()) return it->second;
+    }
+
+    std::unique_lock<std::shared_mutex> lock{mutex_};
+    auto it = index_.find(name);
+    if (it != index_.end()) return it->second;
+
+    names_.emplace_back(name);
+    auto atom = static_cast<Atom>(names_.size() - 1);
+    index_.emplace(names_.back(), atom);
+    return atom;
+}
+
+Atom AtomTable::find(std::string_view name) const {
+    std::shared_lock<std::shared_mutex> lock{mutex_};
+    auto it = index_.find(name);
+    return it == index_.end() ? atoms::Empty : it->second;
+}
+
+std::string_view AtomTable::name(Atom atom) const {
+    std::shared_lock<std::shared_mutex> lock{mutex_};
+    return atom < names_.size() ? std::string_view{names_[atom]} : std::string_view{};
+}
+
+std::size_t AtomTable::size() const {
+    std::shared_lock<std::shared_mutex> lock{mutex_};
+    return names_.size();
+}
+
+// FlatDocument
+
+FlatDocument FlatDocument::fromTree(const Node& root) {
+    // count first so every array is allocated exactly once
+    std::size_t nodes = 0;
+    std::size_t textBytes = 0;
+    std::vector<const Node*> stack{&root};
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+        ++nodes;
+        textBytes += n->id.size() + n->text.size() + n->ariaLabel.size();
+        for (const auto& child : n->children)
+            if (child) stack.push_back(child.get());
+    }
+
+    FlatDocumentBuilder builder(nodes, textBytes);
+
+    // pre-order walk; a null entry on the stack means "close the current node"
+    stack.push_back(&root);
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+        if (!n) {
+            builder.endNode();
+            continue;
+        }
+
+        builder.beginNode(n->tag, n->id, n->text, n->role, n->ariaLabel, n->isInteractive, n->style);
+        stack.push_back(nullptr);
+        for (auto it = n->children.rbegin(); it != n->children.rend(); ++it)
+            if (*it) stack.push_back(it->get());
+    }
+
+    return builder.finish();
+}
+
+FlatDocument FlatDocument::fromTree(const Node& root, const FlatDocument& previous,
+                                    const std::unordered_map<const Node*, NodeIndex>& unchanged,
+                                    std::vector<CopiedSubtree>* copied) {
+    if (copied) copied->clear();
+    if (unchanged.empty()) return fromTree(root);
+
+    // count first, taking copied subtrees' sizes from `previous`
+    std::size_t nodes = 0;
+    std::size_t textBytes = 0;
+    std::vector<const Node*> stack{&root};
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+        if (auto it = unchanged.find(n); it != unchanged.end()) {
+            nodes += previous.subtreeEnd(it->second) - it->second;
+            continue;
+        }
+        ++nodes;
+        textBytes += n->id.size() + n->text.size() + n->ariaLabel.size();
+        for (const auto& child : n->children)
+            if (child) stack.push_back(child.get());
+    }
+
+    FlatDocumentBuilder builder(nodes, textBytes + previous.textBytes());
+    stack.push_back(&root);
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+        if (!n) {
+            builder.endNode();
+            continue;
+        }
+        if (auto it = unchanged.find(n); it != unchanged.end()) {
+            if (copied) {
+                copied->push_back({static_cast<std::uint32_t>(builder.nodeCount()), it->second,
+                                   previous.subtreeEnd(it->second) - it->second});
+            }
+            builder.appendSubtree(previous, it->second);
+            continue;
+        }
+
+        builder.beginNode(n->tag, n->id, n->text, n->role, n->ariaLabel, n->isInteractive, n->style);
+        stack.push_back(nullptr);
+        for (auto it = n->children.rbegin(); it != n->children.rend(); ++it)
+            if (*it) stack.push_back(it->get());
+    }
+
+    return builder.finish();
+}
+
+std::shared_ptr<Node> FlatDocument::toTree() const {
+    if (empty()) return nullptr;
+
+    std::vector<std::shared_ptr<Node>> nodes(size());
+    for (NodeIndex i = 0; i < size(); ++i) {
+        auto node = std::make_shared<Node>();
+        node->tag = tagName(i);
+        node->role = roleName(i);
+        node->id = id(i);
+        node->text = text(i);
+        node->ariaLabel = ariaLabel(i);
+        node->isInteractive = isInteractive(i);
+        node->style = style(i);
+        if (parents_[i] != kInvalidNode) nodes[parents_[i]]->children.push_back(node);
+        nodes[i] = std::move(node);
+    }
+    return nodes[0];
+}
+
+std::string_view FlatDocument::atomName(Atom atom) const {
+    if ((atom & kLocalAtom) == 0) return AtomTable::global().name(atom);
+    const Atom local = atom & ~kLocalAtom;
+    return local < localNames_.size() ? view(localNames_[local]) : std::string_view{};
+}
+
+std::size_t FlatDocument::memoryBytes() const {
+    return tags_.capacity() * sizeof(Atom) +
+           roles_.capacity() * sizeof(Atom) +
+           ids_.capacity() * sizeof(TextRef) +
+           texts_.capacity() * sizeof(TextRef) +
+           ariaLabels_.capacity() * sizeof(TextRef) +
+           flags_.capacity() * sizeof(std::uint8_t) +
+           styleIds_.capacity() * sizeof(std::uint32_t) +
+           styles_.capacity() * sizeof(Style) +
+           parents_.capacity() * sizeof(NodeIndex) +
+           nextSiblings_.capacity() * sizeof(NodeIndex) +
+           subtreeEnds_.capacity() * sizeof(NodeIndex) +
+           depths_.capacity() * sizeof(std::uint32_t) +
+           localNames_.capacity() * sizeof(TextRef) +
+           arena_.capacity();
+}
+
+// FlatDocumentBuilder
+
+FlatDocumentBuilder::FlatDocumentBuilder(std::size_t expectedNodes, std::size_t expectedTextBytes) {
+    doc_.tags_.reserve(expectedNodes);
+    doc_.roles_.reserve(expectedNodes);
+    doc_.ids_.reserve(expectedNodes);
+    doc_.texts_.reserve(expectedNodes);
+    doc_.ariaLabels_.reserve(expectedNodes);
+    doc_.flags_.reserve(expectedNodes);
+    doc_.styleIds_.reserve(expectedNodes);
+    doc_.parents_.reserve(expectedNodes);
+    doc_.nextSiblings_.reserve(expectedNodes);
+    doc_.subtreeEnds_.reserve(expectedNodes);
+    doc_.depths_.reserve(expectedNodes);
+    doc_.arena_.reserve(expectedTextBytes);
+}
+
+FlatDocument::TextRef FlatDocumentBuilder::store(std::string_view s) {
+    if (s.empty()) return {};
+    FlatDocument::TextRef ref{static_cast<std::uint32_t>(doc_.arena_.size()),
+                              static_cast<std::uint32_t>(s.size())};
+    doc_.arena_.append(s);
+    return ref;
+}
+
+Atom FlatDocumentBuilder::atom(std::string_view name) {
+    if (name.empty()) return atoms::Empty;
+    if (Atom known = AtomTable::global().find(name); known != atoms::Empty) return known;
+
+    auto it = localAtoms_.find(std::string(name));
+    if (it != localAtoms_.end()) return it->second;
+    const Atom local = kLocalAtom | static_cast<Atom>(doc_.localNames_.size());
+    doc_.localNames_.push_back(store(name));
+    localAtoms_.emplace(std::string(name), local);
+    return local;
+}
+
+Atom FlatDocumentBuilder::atom(const FlatDocument& from, Atom a) {
+    return (a & kLocalAtom) ? atom(from.atomName(a)) : a;
+}
+
+std::size_t FlatDocumentBuilder::StyleHash::operator()(const Style& s) const {
+    std::size_t h = static_cast<std::size_t>(s.display) | static_cast<std::size_t>(s.position) << 8 |
+                    static_cast<std::size_t>(s.flexDirection) << 16;
+    for (float f : {s.width, s.height, s.left, s.top, s.margin, s.padding, s.flexGrow, s.borderWidth}) {
+        h = h * 31 + std::hash<float>{}(f);
+    }
+    h = h * 31 + s.background;
+    h = h * 31 + s.borderColor;
+    return h;
+}
+
+std::uint32_t FlatDocumentBuilder::styleId(const Style& style) {
+    // siblings usually share a style; skip the hash for a repeat
+    if (lastStyleId_ < doc_.styles_.size() && doc_.styles_[lastStyleId_] == style) return lastStyleId_;
+    auto [it, inserted] = styleIds_.try_emplace(style, static_cast<std::uint32_t>(doc_.styles_.size()));
+    if (inserted) doc_.styles_.push_back(style);
+    lastStyleId_ = it->second;
+    return lastStyleId_;
+}
+
+NodeIndex FlatDocumentBuilder::beginNode(std::string_view tag,
+                                         std::string_view id,
+                                         std::string_view text,
+                                         std::string_view role,
+                                         std::string_view ariaLabel,
+                                         bool isInteractive,
+                                         const Style& style) {
+    return beginNode(atom(tag), id, text, role, ariaLabel, isInteractive, style);
+}
+
+NodeIndex FlatDocumentBuilder::beginNode(Atom tag,
+                                         std::string_view id,
+                                         std::string_view text,
+                                         std::string_view role,
+                                         std::string_view ariaLabel,
+                                         bool isInteractive,
+                                         const Style& style) {
+    auto index = static_cast<NodeIndex>(doc_.tags_.size());
+    NodeIndex parent = open_.empty() ? kInvalidNode : open_.back();
+
+    doc_.tags_.push_back(tag);
+    doc_.roles_.push_back(atom(role));
+    doc_.ids_.push_back(store(id));
+    doc_.texts_.push_back(store(text));
+    doc_.ariaLabels_.push_back(store(ariaLabel));
+    doc_.flags_.push_back(isInteractive ? FlatDocument::kInteractive : 0);
+    doc_.styleIds_.push_back(styleId(style));
+    doc_.parents_.push_back(parent);
+    doc_.nextSiblings_.push_back(kInvalidNode);
+    doc_.subtreeEnds_.push_back(index + 1);
+    doc_.depths_.push_back(static_cast<std::uint32_t>(open_.size()));
+
+    NodeIndex& prevSibling = open_.empty() ? lastRoot_ : lastChild_.back();
+    if (prevSibling != kInvalidNode) doc_.nextSiblings_[prevSibling] = index;
+    prevSibling = index;
+
+    open_.push_back(index);
+    lastChild_.push_back(kInvalidNode);
+    return index;
+}
+
+void FlatDocumentBuilder::endNode() {
+    if (open_.empty()) return;
+    NodeIndex index = open_.back();
+    doc_.subtreeEnds_[index] = static_cast<NodeIndex>(doc_.tags_.size());
+    open_.pop_back();
+    lastChild_.pop_back();
+}
+
+void FlatDocumentBuilder::appendSubtree(const FlatDocument& from, NodeIndex root) {
+    const NodeIndex end = from.subtreeEnd(root);
+    const auto base = static_cast<NodeIndex>(doc_.tags_.size());
+    const NodeIndex parent = open_.empty() ? kInvalidNode : open_.back();
+    const auto depth = static_cast<std::uint32_t>(open_.size());
+    auto shift = [&](NodeIndex i) { return i - root + base; };
+
+    if (styleSource_ != &from) {
+        styleSource_ = &from;
+        sourceStyleIds_.assign(from.styles_.size(), ~std::uint32_t{0});
+    }
+
+    for (NodeIndex i = root; i < end; ++i) {
+        doc_.tags_.push_back(atom(from, from.tags_[i]));
+        doc_.roles_.push_back(atom(from, from.roles_[i]));
+        doc_.ids_.push_back(store(from.view(from.ids_[i])));
+        doc_.texts_.push_back(store(from.view(from.texts_[i])));
+        doc_.ariaLabels_.push_back(store(from.view(from.ariaLabels_[i])));
+        doc_.flags_.push_back(from.flags_[i]);
+
+        auto& style = sourceStyleIds_[from.styleIds_[i]];
+        if (style == ~std::uint32_t{0}) style = styleId(from.styles_[from.styleIds_[i]]);
+        doc_.styleIds_.push_back(style);
+
+        // links inside the subtree keep their shape; the root's are ours
+        const NodeIndex next = from.nextSiblings_[i];
+        doc_.parents_.push_back(i == root ? parent : shift(from.parents_[i]));
+        doc_.nextSiblings_.push_back(i == root || next == kInvalidNode ? kInvalidNode : shift(next));
+        doc_.subtreeEnds_.push_back(shift(from.subtreeEnds_[i]));
+        doc_.depths_.push_back(depth + from.depths_[i] - from.depths_[root]);
+    }
+
+    NodeIndex& prevSibling = open_.empty() ? lastRoot_ : lastChild_.back();
+    if (prevSibling != kInvalidNode) doc_.nextSiblings_[prevSibling] = base;
+    prevSibling = base;
+}
+
+void FlatDocumentBuilder::appendText(std::string_view text) {
+    if (open_.empty() || text.empty()) return;
+    auto& ref = doc_.texts_[open_.back()];
+
+    // text must stay contiguous in the arena; move it to the tail if needed
+    if (ref.length != 0 && ref.offset + ref.length != doc_.arena_.size()) {
+        std::string existing = doc_.arena_.substr(ref.offset, ref.length);
+        ref.offset = static_cast<std::uint32_t>(doc_.arena_.size());
+        doc_.arena_.append(existing);
+    } else if (ref.length == 0) {
+        ref.offset = static_cast<std::uint32_t>(doc_.arena_.size());
+    }
+    doc_.arena_.append(text);
+    ref.length += static_cast<std::uint32_t>(text.size());
+}
+
+FlatDocument FlatDocumentBuilder::finish() {
+    while (!open_.empty()) endNode();
+    lastRoot_ = kInvalidNode;
+    styleIds_.clear();
+    lastStyleId_ = 0;
+    styleSource_ = nullptr;
+    sourceStyleIds_.clear();
+    localAtoms_.clear();
+    return std::exchange(doc_, FlatDocument{});
+}
+
+}
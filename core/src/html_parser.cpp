@@ -0,0 +1,749 @@
+#include "openperf/html_parser.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define OPENPERF_HTML_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace openperf {
+
+namespace {
+
+bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+bool isAlpha(char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+bool isAlnum(char c) { return isAlpha(c) || (c >= '0' && c <= '9'); }
+char toLower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c; }
+
+// `s` equals `lower` ignoring ASCII case; `lower` is lowercase.
+bool equalsLower(std::string_view s, std::string_view lower) {
+    if (s.size() != lower.size()) return false;
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        if (toLower(s[i]) != lower[i]) return false;
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && isSpace(s.front())) s.remove_prefix(1);
+    while (!s.empty() && isSpace(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+#ifdef OPENPERF_HTML_SSE2
+__m128i load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+
+// bytes that are '\t'..'\r' or ' '
+__m128i spaceMask(__m128i v) {
+    __m128i control = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    control = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8('\r' - '\t')), control);
+    return _mm_or_si128(control, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+#endif
+
+// First `a` or `b` in [p, end), or end.
+const char* findEither(const char* p, const char* end, char a, char b) {
+#ifdef OPENPERF_HTML_SSE2
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = load(p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (mask != 0) return p + std::countr_zero(static_cast<unsigned>(mask));
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == a || *p == b) return p;
+    }
+    return end;
+}
+
+const char* findByte(const char* p, const char* end, char c) { return findEither(p, end, c, c); }
+
+// First whitespace in [p, end) that collapsing would change: anything but a
+// lone ' ' followed by more text. A ' ' at the end counts, as the text may
+// continue with more whitespace.
+const char* findCollapse(const char* p, const char* end) {
+#ifdef OPENPERF_HTML_SSE2
+    const __m128i space = _mm_set1_epi8(' ');
+    for (; end - p > 16; p += 16) {
+        __m128i v = load(p);
+        __m128i isSpaceChar = _mm_cmpeq_epi8(v, space);
+        __m128i anySpace = spaceMask(v);
+        __m128i other = _mm_andnot_si128(isSpaceChar, anySpace);
+        __m128i doubled = _mm_and_si128(isSpaceChar, spaceMask(load(p + 1)));
+        int mask = _mm_movemask_epi8(_mm_or_si128(other, doubled));
+        if (mask != 0) return p + std::countr_zero(static_cast<unsigned>(mask));
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == ' ') {
+            if (p + 1 == end || isSpace(p[1])) return p;
+        } else if (isSpace(*p)) {
+            return p;
+        }
+    }
+    return end;
+}
+
+std::string_view encodeUtf8(std::uint32_t cp, char* out) {
+    if (cp == 0 || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) cp = 0xfffd;
+    if (cp < 0x80) {
+        out[0] = static_cast<char>(cp);
+        return {out, 1};
+    }
+    if (cp < 0x800) {
+        out[0] = static_cast<char>(0xc0 | cp >> 6);
+        out[1] = static_cast<char>(0x80 | (cp & 0x3f));
+        return {out, 2};
+    }
+    if (cp < 0x10000) {
+        out[0] = static_cast<char>(0xe0 | cp >> 12);
+        out[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = static_cast<char>(0x80 | (cp & 0x3f));
+        return {out, 3};
+    }
+    out[0] = static_cast<char>(0xf0 | cp >> 18);
+    out[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = static_cast<char>(0x80 | (cp & 0x3f));
+    return {out, 4};
+}
+
+struct NamedReference {
+    std::string_view name, value;
+};
+
+// the references that are common in practice
+constexpr NamedReference kNamedReferences[] = {
+    {"amp", "&"},
+    {"lt", "<"},
+    {"gt", ">"},
+    {"quot", "\""},
+    {"apos", "'"},
+    {"nbsp", "\xc2\xa0"},
+    {"copy", "\xc2\xa9"},
+    {"reg", "\xc2\xae"},
+    {"middot", "\xc2\xb7"},
+    {"laquo", "\xc2\xab"},
+    {"raquo", "\xc2\xbb"},
+    {"times", "\xc3\x97"},
+    {"ndash", "\xe2\x80\x93"},
+    {"mdash", "\xe2\x80\x94"},
+    {"lsquo", "\xe2\x80\x98"},
+    {"rsquo", "\xe2\x80\x99"},
+    {"ldquo", "\xe2\x80\x9c"},
+    {"rdquo", "\xe2\x80\x9d"},
+    {"bull", "\xe2\x80\xa2"},
+    {"hellip", "\xe2\x80\xa6"},
+    {"euro", "\xe2\x82\xac"},
+    {"trade", "\xe2\x84\xa2"},
+};
+
+// Decodes the character reference at `p` (an '&') into `out`, using `buf`
+// for numeric ones, and returns where it ends. Anything that isn't a known
+// reference is a literal '&'. Returns nullptr if the input ends before
+// that can be decided and more may follow.
+const char* decodeReference(const char* p, const char* end, bool final, char* buf, std::string_view& out) {
+    constexpr std::size_t kMaxName = 8;
+    const char* q = p + 1;
+    out = "&";
+    if (q < end && *q == '#') {
+        ++q;
+        const bool hex = q < end && (*q | 0x20) == 'x';
+        if (hex) ++q;
+        const char* digits = q;
+        std::uint32_t cp = 0;
+        while (q < end && q - digits < static_cast<std::ptrdiff_t>(kMaxName)) {
+            char c = *q;
+            std::uint32_t d;
+            if (c >= '0' && c <= '9') d = static_cast<std::uint32_t>(c - '0');
+            else if (hex && (c | 0x20) >= 'a' && (c | 0x20) <= 'f') d = static_cast<std::uint32_t>((c | 0x20) - 'a' + 10);
+            else break;
+            cp = cp * (hex ? 16 : 10) + d;
+            ++q;
+        }
+        if (q == end && !final) return nullptr;
+        if (q == digits) return p + 1;
+        out = encodeUtf8(cp, buf);
+        return q < end && *q == ';' ? q + 1 : q;
+    }
+
+    while (q < end && isAlnum(*q) && q - p <= static_cast<std::ptrdiff_t>(kMaxName)) ++q;
+    if (q == end && !final) return nullptr;
+    if (q == end || *q != ';') return p + 1;
+    const std::string_view name(p + 1, static_cast<std::size_t>(q - p - 1));
+    for (const auto& ref : kNamedReferences) {
+        if (ref.name == name) {
+            out = ref.value;
+            return q + 1;
+        }
+    }
+    return p + 1;
+}
+
+// Appends `value` with its character references decoded.
+void decodeInto(std::string_view value, std::string& out) {
+    out.clear();
+    const char* p = value.data();
+    const char* end = p + value.size();
+    char buf[4];
+    while (p < end) {
+        const char* amp = findByte(p, end, '&');
+        out.append(p, amp);
+        if (amp == end) break;
+        std::string_view decoded;
+        p = decodeReference(amp, end, true, buf, decoded);
+        out.append(decoded);
+    }
+}
+
+// "12", "12px" or "12.5px"; other units are not supported.
+bool parseLength(std::string_view s, float& out) {
+    float v = 0;
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (ec != std::errc{}) return false;
+    std::string_view unit(ptr, static_cast<std::size_t>(s.data() + s.size() - ptr));
+    if (!unit.empty() && !equalsLower(unit, "px")) return false;
+    out = v;
+    return true;
+}
+
+// "#rgb", "#rgba", "#rrggbb", "#rrggbbaa" and a few keywords, as 0xRRGGBBAA.
+bool parseColor(std::string_view s, std::uint32_t& out) {
+    if (equalsLower(s, "transparent")) return out = 0, true;
+    if (equalsLower(s, "white")) return out = 0xffffffff, true;
+    if (equalsLower(s, "black")) return out = 0x000000ff, true;
+    if (s.size() < 2 || s[0] != '#') return false;
+    s.remove_prefix(1);
+    std::uint32_t v = 0;
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v, 16);
+    if (ec != std::errc{} || ptr != s.data() + s.size()) return false;
+    switch (s.size()) {
+    case 3: v = v << 4 | 0xf; [[fallthrough]];
+    case 4: // expand each nibble
+        v = (v & 0xf000) << 12 | (v & 0xf00) << 8 | (v & 0xf0) << 4 | (v & 0xf);
+        out = v | v << 4;
+        return true;
+    case 6: out = v << 8 | 0xff; return true;
+    case 8: out = v; return true;
+    default: return false;
+    }
+}
+
+// Applies the supported declarations of an inline style attribute.
+void applyInlineStyle(std::string_view css, Style& style) {
+    while (!css.empty()) {
+        std::size_t semi = css.find(';');
+        std::string_view decl = css.substr(0, semi);
+        css = semi == std::string_view::npos ? std::string_view{} : css.substr(semi + 1);
+        std::size_t colon = decl.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view name = trim(decl.substr(0, colon));
+        std::string_view value = trim(decl.substr(colon + 1));
+        std::string_view first = value.substr(0, value.find_first_of(" \t\n\r\f"));
+
+        if (equalsLower(name, "display")) {
+            if (equalsLower(value, "none")) style.display = Style::Display::None;
+            else if (equalsLower(value, "flex")) style.display = Style::Display::Flex;
+            else if (equalsLower(value, "inline") || equalsLower(value, "inline-block")) style.display = Style::Display::Inline;
+            else style.display = Style::Display::Block;
+        } else if (equalsLower(name, "position")) {
+            style.position = equalsLower(value, "absolute") || equalsLower(value, "fixed") ? Style::Position::Absolute
+                                                                                          : Style::Position::Static;
+        } else if (equalsLower(name, "flex-direction")) {
+            style.flexDirection = equalsLower(value, "column") ? Style::FlexDirection::Column : Style::FlexDirection::Row;
+        } else if (equalsLower(name, "flex-grow") || equalsLower(name, "flex")) {
+            parseLength(first, style.flexGrow);
+        } else if (equalsLower(name, "width")) {
+            parseLength(value, style.width);
+        } else if (equalsLower(name, "height")) {
+            parseLength(value, style.height);
+        } else if (equalsLower(name, "left")) {
+            parseLength(value, style.left);
+        } else if (equalsLower(name, "top")) {
+            parseLength(value, style.top);
+        } else if (equalsLower(name, "margin")) {
+            parseLength(first, style.margin);
+        } else if (equalsLower(name, "padding")) {
+            parseLength(first, style.padding);
+        } else if (equalsLower(name, "background") || equalsLower(name, "background-color")) {
+            parseColor(value, style.background);
+        } else if (equalsLower(name, "border-color")) {
+            parseColor(value, style.borderColor);
+        } else if (equalsLower(name, "border-width")) {
+            parseLength(value, style.borderWidth);
+        } else if (equalsLower(name, "border")) {
+            // "1px solid #333", in any order
+            while (!value.empty()) {
+                std::size_t n = std::min(value.find_first_of(" \t\n\r\f"), value.size());
+                std::string_view token = value.substr(0, n);
+                if (!parseLength(token, style.borderWidth)) parseColor(token, style.borderColor);
+                value = trim(value.substr(n));
+            }
+        }
+    }
+}
+
+// TagInfo::flags
+constexpr std::uint8_t kVoid = 1;        // no contents and no end tag
+constexpr std::uint8_t kRawText = 2;     // contents skipped up to the end tag
+constexpr std::uint8_t kHidden = 4;      // never rendered
+constexpr std::uint8_t kInteractive = 8;
+
+// Optional end tag groups, for TagInfo::group and TagInfo::ends. An open
+// element in a group is closed by a start tag that ends the group.
+constexpr std::uint8_t kGroupP = 1;
+constexpr std::uint8_t kGroupLi = 2;
+constexpr std::uint8_t kGroupDtDd = 4;
+constexpr std::uint8_t kGroupOption = 8;
+constexpr std::uint8_t kGroupCell = 16;
+constexpr std::uint8_t kGroupRow = 32;
+
+bool isOneOf(std::string_view tag, std::initializer_list<std::string_view> names) {
+    return std::find(names.begin(), names.end(), tag) != names.end();
+}
+
+std::uint8_t tagFlags(std::string_view tag) {
+    std::uint8_t flags = 0;
+    if (isOneOf(tag, {"area", "base", "br", "col", "embed", "hr", "img", "input", "link", "meta", "param", "source",
+                      "track", "wbr"}))
+        flags |= kVoid;
+    if (tag == "script" || tag == "style") flags |= kRawText;
+    if (isOneOf(tag, {"head", "title", "meta", "link", "base", "script", "style", "template", "noscript"}))
+        flags |= kHidden;
+    if (isOneOf(tag, {"a", "button", "input", "select", "textarea"})) flags |= kInteractive;
+    return flags;
+}
+
+std::uint8_t tagGroup(std::string_view tag) {
+    if (tag == "p") return kGroupP;
+    if (tag == "li") return kGroupLi;
+    if (tag == "dt" || tag == "dd") return kGroupDtDd;
+    if (tag == "option") return kGroupOption;
+    if (tag == "td" || tag == "th") return kGroupCell;
+    if (tag == "tr") return kGroupRow;
+    return 0;
+}
+
+std::uint8_t tagEnds(std::string_view tag) {
+    std::uint8_t ends = 0;
+    if (isOneOf(tag, {"address", "article", "aside", "blockquote", "dd", "details", "div", "dl", "dt", "fieldset",
+                      "figcaption", "figure", "footer", "form", "h1", "h2", "h3", "h4", "h5", "h6", "header", "hr",
+                      "li", "main", "menu", "nav", "ol", "p", "pre", "section", "table", "ul"}))
+        ends |= kGroupP;
+    if (tag == "li") ends |= kGroupLi;
+    if (tag == "dt" || tag == "dd") ends |= kGroupDtDd;
+    if (tag == "option" || tag == "optgroup") ends |= kGroupOption;
+    if (tag == "td" || tag == "th") ends |= kGroupCell;
+    if (tag == "tr") ends |= kGroupCell | kGroupRow;
+    return ends;
+}
+
+}
+
+HtmlParser::HtmlParser() : HtmlParser(Options{}) {}
+
+HtmlParser::HtmlParser(Options options) : options_(options) {
+    // the root stays open until finish()
+    options_.maxDepth = std::max<std::size_t>(options_.maxDepth, 2);
+    // an implicit <html> and the first element
+    options_.maxNodes = std::max<std::size_t>(options_.maxNodes, 2);
+}
+
+void HtmlParser::feed(std::string_view chunk) {
+    bytesFed_ += chunk.size();
+    if (pending_.empty()) {
+        std::size_t used = parse(chunk.data(), chunk.data() + chunk.size(), false);
+        pending_.assign(chunk.substr(used));
+    } else {
+        pending_.append(chunk);
+        // nothing to do until the cut-off tag is complete
+        if (scanned_ > 0 && !tagArrived()) return;
+        std::size_t used = parse(pending_.data(), pending_.data() + pending_.size(), false);
+        pending_.erase(0, used);
+    }
+    startScan();
+}
+
+FlatDocument HtmlParser::finish() {
+    parse(pending_.data(), pending_.data() + pending_.size(), true);
+    pending_.clear();
+    scanned_ = 0;
+    while (depth_ > 0) closeTop();
+    mode_ = Mode::Data;
+    bytesFed_ = 0;
+    truncated_ = false;
+    std::erase_if(tags_, [](const auto& entry) { return (entry.second.atom & kLocalAtom) != 0; });
+    unknownTags_ = 0;
+    return builder_.finish();
+}
+
+// Notes whether pending_ holds a start or end tag cut off before its '>'.
+// Anything else carried over is at most a few bytes.
+void HtmlParser::startScan() {
+    scanned_ = 0;
+    scanState_ = 0;
+    if (pending_.size() < 3 || pending_[0] != '<') return;
+    const bool tag = mode_ == Mode::RawText ? pending_[1] == '/'
+                                            : isAlpha(pending_[1]) || (pending_[1] == '/' && isAlpha(pending_[2]));
+    if (tag) scanned_ = 1;
+}
+
+// Whether the cut-off tag's closing '>' has arrived, resuming the search
+// where the last call stopped. Like parseMarkup(), a quote only opens a
+// value right after '='. Where the two could disagree this waits longer,
+// which only delays the tag: parse() still decides where it ends.
+bool HtmlParser::tagArrived() {
+    const char* p = pending_.data() + scanned_;
+    const char* end = pending_.data() + pending_.size();
+    while (p < end) {
+        if (scanState_ == '"' || scanState_ == '\'') {
+            p = findByte(p, end, scanState_);
+            if (p == end) break;
+            scanState_ = 0;
+            ++p;
+            continue;
+        }
+        if (scanState_ == 0) {
+            p = findEither(p, end, '>', '=');
+            if (p == end) break;
+            if (*p++ == '>') return true;
+            scanState_ = '=';
+            continue;
+        }
+        const char c = *p++;
+        if (c == '>') return true;
+        if (scanState_ == '=') {
+            if (c == '"' || c == '\'') scanState_ = c;
+            else if (!isSpace(c)) scanState_ = 'v'; // an unquoted value
+        } else if (isSpace(c)) {
+            scanState_ = 0;
+        }
+    }
+    scanned_ = pending_.size();
+    return false;
+}
+
+std::size_t HtmlParser::parse(const char* begin, const char* end, bool final) {
+    const char* p = begin;
+    char buf[4];
+    while (p < end) {
+        switch (mode_) {
+        case Mode::Data: {
+            if (*p == '<') {
+                const char* next = parseMarkup(p, end, final);
+                if (next == nullptr) return static_cast<std::size_t>(p - begin);
+                p = next;
+                break;
+            }
+            const char* q = findEither(p, end, '<', '&');
+            addText(p, q);
+            p = q;
+            if (p < end && *p == '&') {
+                std::string_view decoded;
+                const char* next = decodeReference(p, end, final, buf, decoded);
+                if (next == nullptr) return static_cast<std::size_t>(p - begin);
+                addText(decoded.data(), decoded.data() + decoded.size());
+                p = next;
+            }
+            break;
+        }
+        case Mode::Comment: {
+            std::size_t close = std::string_view(p, static_cast<std::size_t>(end - p)).find("-->");
+            if (close == std::string_view::npos) {
+                // "--" may be completed by the next chunk
+                if (final) return static_cast<std::size_t>(end - begin);
+                return static_cast<std::size_t>(std::max(p, end - 2) - begin);
+            }
+            p += close + 3;
+            mode_ = Mode::Data;
+            break;
+        }
+        case Mode::Bogus: {
+            p = findByte(p, end, '>');
+            if (p < end) {
+                ++p;
+                mode_ = Mode::Data;
+            }
+            break;
+        }
+        case Mode::RawText: {
+            bool incomplete = false;
+            p = parseRawText(p, end, final, incomplete);
+            if (incomplete) return static_cast<std::size_t>(p - begin);
+            break;
+        }
+        }
+    }
+    return static_cast<std::size_t>(p - begin);
+}
+
+// `p` is at '<'. Returns past the markup, or nullptr if it is cut off.
+const char* HtmlParser::parseMarkup(const char* p, const char* end, bool final) {
+    // an unterminated tag at the very end of the input is dropped
+    const char* cutOff = final ? end : nullptr;
+    const char* q = p + 1;
+    if (q == end) return cutOff;
+
+    if (*q == '!') {
+        if (end - q < 3) return cutOff;
+        if (q[1] == '-' && q[2] == '-') {
+            mode_ = Mode::Comment;
+            return q + 3;
+        }
+        mode_ = Mode::Bogus; // doctype, CDATA
+        return q + 1;
+    }
+    if (*q == '?') {
+        mode_ = Mode::Bogus;
+        return q + 1;
+    }
+    if (*q == '/') {
+        ++q;
+        if (q == end) return cutOff;
+        if (!isAlpha(*q)) {
+            mode_ = Mode::Bogus;
+            return q;
+        }
+        const char* gt = findByte(q, end, '>');
+        if (gt == end) return cutOff;
+        const char* nameEnd = q;
+        while (nameEnd < gt && !isSpace(*nameEnd) && *nameEnd != '/') ++nameEnd;
+        name_.assign(q, nameEnd);
+        std::transform(name_.begin(), name_.end(), name_.begin(), toLower);
+        endTag(name_);
+        return gt + 1;
+    }
+    if (!isAlpha(*q)) {
+        addText(p, q); // a literal '<'
+        return q;
+    }
+
+    const char* r = q;
+    while (r < end && !isSpace(*r) && *r != '>' && *r != '/') ++r;
+    if (r == end) return cutOff;
+    name_.assign(q, r);
+    std::transform(name_.begin(), name_.end(), name_.begin(), toLower);
+
+    id_.clear();
+    role_.clear();
+    ariaLabel_.clear();
+    style_ = Style{};
+    interactive_ = false;
+    hidden_ = false;
+
+    bool selfClosing = false;
+    for (;;) {
+        while (r < end && isSpace(*r)) ++r;
+        if (r == end) return cutOff;
+        if (*r == '>') {
+            ++r;
+            break;
+        }
+        if (*r == '/') {
+            if (r + 1 == end) return cutOff;
+            if (r[1] == '>') {
+                selfClosing = true;
+                r += 2;
+                break;
+            }
+            ++r;
+            continue;
+        }
+
+        const char* nameBegin = r;
+        while (r < end && !isSpace(*r) && *r != '=' && *r != '>' && *r != '/') ++r;
+        const char* nameEnd = r;
+        while (r < end && isSpace(*r)) ++r;
+        if (r == end) return cutOff;
+
+        std::string_view value;
+        if (*r == '=') {
+            ++r;
+            while (r < end && isSpace(*r)) ++r;
+            if (r == end) return cutOff;
+            if (*r == '"' || *r == '\'') {
+                const char* valueBegin = r + 1;
+                const char* close = findByte(valueBegin, end, *r);
+                if (close == end) return cutOff;
+                value = std::string_view(valueBegin, static_cast<std::size_t>(close - valueBegin));
+                r = close + 1;
+            } else {
+                const char* valueBegin = r;
+                while (r < end && !isSpace(*r) && *r != '>') ++r;
+                if (r == end) return cutOff;
+                value = std::string_view(valueBegin, static_cast<std::size_t>(r - valueBegin));
+            }
+        }
+        attribute(std::string_view(nameBegin, static_cast<std::size_t>(nameEnd - nameBegin)), value);
+    }
+
+    startTag(selfClosing);
+    return r;
+}
+
+// Skips raw text up to the end tag of the element it belongs to.
+const char* HtmlParser::parseRawText(const char* p, const char* end, bool final, bool& incomplete) {
+    const std::string_view tag = AtomTable::global().name(open_[depth_ - 1].tag);
+    for (;;) {
+        const char* lt = findByte(p, end, '<');
+        if (lt == end) return end;
+        // "</tag" plus the byte after it
+        if (static_cast<std::size_t>(end - lt) < tag.size() + 3) {
+            if (final) return end;
+            incomplete = true;
+            return lt;
+        }
+        const std::string_view name(lt + 2, tag.size());
+        const char after = lt[2 + tag.size()];
+        if (lt[1] == '/' && equalsLower(name, tag) && (isSpace(after) || after == '/' || after == '>')) {
+            const char* gt = findByte(lt + 2 + tag.size(), end, '>');
+            if (gt == end) {
+                if (final) return end;
+                incomplete = true;
+                return lt;
+            }
+            closeTop();
+            mode_ = Mode::Data;
+            return gt + 1;
+        }
+        p = lt + 1;
+    }
+}
+
+void HtmlParser::attribute(std::string_view name, std::string_view value) {
+    if (equalsLower(name, "id")) {
+        decodeInto(value, id_);
+    } else if (equalsLower(name, "role")) {
+        decodeInto(value, role_);
+    } else if (equalsLower(name, "aria-label")) {
+        decodeInto(value, ariaLabel_);
+    } else if (equalsLower(name, "style")) {
+        decodeInto(value, value_);
+        applyInlineStyle(value_, style_);
+    } else if (equalsLower(name, "hidden")) {
+        hidden_ = true;
+    } else if (equalsLower(name, "tabindex") || equalsLower(name, "onclick")) {
+        interactive_ = true;
+    }
+}
+
+const HtmlParser::TagInfo& HtmlParser::tagInfo(std::string_view name) {
+    auto it = tags_.find(name);
+    if (it != tags_.end()) return it->second;
+    TagInfo info;
+    // page markup must not grow the process-wide table
+    info.atom = AtomTable::global().find(name);
+    if (info.atom == atoms::Empty) info.atom = kLocalAtom | unknownTags_++;
+    info.flags = tagFlags(name);
+    info.group = tagGroup(name);
+    info.ends = tagEnds(name);
+    auto& entry = *tags_.emplace(std::string(name), info).first;
+    entry.second.name = entry.first;
+    return entry.second;
+}
+
+void HtmlParser::startTag(bool selfClosing) {
+    if (builder_.nodeCount() >= options_.maxNodes) {
+        truncated_ = true;
+        return;
+    }
+    const TagInfo& tag = tagInfo(name_);
+    if (depth_ == 0) {
+        if (tag.atom != atoms::Html) {
+            const TagInfo& html = tagInfo("html");
+            builder_.beginNode(html.atom);
+            push(html);
+        } else {
+            builder_.beginNode(tag.atom, id_, {}, role_, ariaLabel_, interactive_, style_);
+            push(tag);
+            return;
+        }
+    } else if (tag.atom == atoms::Html) {
+        return; // a second <html> is dropped
+    }
+
+    while (depth_ > 1 && (open_[depth_ - 1].group & tag.ends) != 0) closeTop();
+    if (depth_ >= options_.maxDepth) closeTop();
+
+    // the child's text isn't part of its parent's, so keep the words apart
+    OpenElement& parent = open_[depth_ - 1];
+    parent.pendingSpace = parent.pendingSpace || !parent.text.empty();
+
+    if (hidden_ || (tag.flags & kHidden) != 0) style_.display = Style::Display::None;
+    const bool interactive = interactive_ || (tag.flags & kInteractive) != 0;
+    if ((tag.atom & kLocalAtom) != 0) {
+        // the builder gives the name an atom of the document's own
+        builder_.beginNode(tag.name, id_, {}, role_, ariaLabel_, interactive, style_);
+    } else {
+        builder_.beginNode(tag.atom, id_, {}, role_, ariaLabel_, interactive, style_);
+    }
+    if (selfClosing || (tag.flags & kVoid) != 0) {
+        builder_.endNode();
+        return;
+    }
+    push(tag);
+    if ((tag.flags & kRawText) != 0) mode_ = Mode::RawText;
+}
+
+void HtmlParser::push(const TagInfo& tag) {
+    if (depth_ == open_.size()) open_.emplace_back();
+    OpenElement& element = open_[depth_++];
+    element.tag = tag.atom;
+    element.group = tag.group;
+    element.text.clear();
+    element.pendingSpace = false;
+}
+
+void HtmlParser::closeTop() {
+    OpenElement& element = open_[--depth_];
+    // appended at close, so the text is written to the arena once
+    builder_.appendText(element.text);
+    builder_.endNode();
+}
+
+void HtmlParser::endTag(std::string_view name) {
+    // a tag this parser never saw opened can't be open
+    auto it = tags_.find(name);
+    if (it == tags_.end()) return;
+    const Atom atom = it->second.atom;
+    // </html> and </body> are implied by the end of input
+    if (atom == atoms::Html || atom == atoms::Body) return;
+    for (std::size_t i = depth_; i-- > 1;) {
+        if (open_[i].tag == atom) {
+            while (depth_ > i) closeTop();
+            return;
+        }
+    }
+}
+
+void HtmlParser::addText(const char* p, const char* end) {
+    if (depth_ == 0) return;
+    OpenElement& element = open_[depth_ - 1];
+    while (p < end) {
+        if (isSpace(*p)) {
+            while (p < end && isSpace(*p)) ++p;
+            element.pendingSpace = !element.text.empty();
+            continue;
+        }
+        if (element.pendingSpace) {
+            element.text.push_back(' ');
+            element.pendingSpace = false;
+        }
+        const char* q = findCollapse(p, end);
+        element.text.append(p, q);
+        p = q;
+    }
+}
+
+FlatDocument parseHtml(std::string_view html) {
+    HtmlParser parser;
+    parser.feed(html);
+    return parser.finish();
+}
+
+}
@@ -0,0 +1,336 @@
+#include "openperf/layout.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace openperf {
+
+namespace {
+
+using Display = Style::Display;
+
+bool isInlineTag(Atom tag) {
+    static const std::array<Atom, 6> kExtra = [] {
+        auto& table = AtomTable::global();
+        return std::array<Atom, 6>{table.find("em"), table.find("strong"), table.find("b"),
+                                   table.find("i"), table.find("small"), table.find("code")};
+    }();
+    switch (tag) {
+        case atoms::Span:
+        case atoms::A:
+        case atoms::Img:
+        case atoms::Button:
+        case atoms::Label:
+        case atoms::Input:
+            return true;
+        default:
+            return std::find(kExtra.begin(), kExtra.end(), tag) != kExtra.end();
+    }
+}
+
+}
+
+std::size_t BoxArray::memoryBytes() const {
+    return (x.capacity() + y.capacity() + width.capacity() + height.capacity()) * sizeof(float);
+}
+
+std::size_t LayoutState::memoryBytes() const {
+    return (preferred.capacity() + ownHeight.capacity() + relX.capacity() + relY.capacity()) * sizeof(float) +
+           hidden.capacity();
+}
+
+Style::Display LayoutEngine::displayOf(const FlatDocument& doc, NodeIndex i) {
+    Display d = doc.style(i).display;
+    if (d != Display::Auto) return d;
+    return isInlineTag(doc.tag(i)) ? Display::Inline : Display::Block;
+}
+
+Style LayoutEngine::clampStyle(const Style& style) {
+    auto length = [](float v, float lo, float otherwise) {
+        return std::isnan(v) ? otherwise : std::clamp(v, lo, kMaxLength);
+    };
+    Style s = style;
+    s.width = s.width < 0 ? Style::kAuto : length(s.width, 0, Style::kAuto);
+    s.height = s.height < 0 ? Style::kAuto : length(s.height, 0, Style::kAuto);
+    s.left = length(s.left, -kMaxLength, 0);
+    s.top = length(s.top, -kMaxLength, 0);
+    s.margin = length(s.margin, -kMaxLength, 0);
+    s.padding = length(s.padding, 0, 0);
+    s.flexGrow = length(s.flexGrow, 0, 0);
+    s.borderWidth = length(s.borderWidth, 0, 0);
+    return s;
+}
+
+BoxArray LayoutEngine::layout(const FlatDocument& doc, LayoutState* state, const PreviousLayout* previous) const {
+    const auto n = static_cast<NodeIndex>(doc.size());
+    BoxArray boxes;
+    boxes.x.assign(n, 0);
+    boxes.y.assign(n, 0);
+    boxes.width.assign(n, 0);
+    boxes.height.assign(n, 0);
+
+    // scratch, indexed like the boxes, and kept for the next layout
+    LayoutState scratch;
+    LayoutState& st = state ? *state : scratch;
+    st.preferred.assign(n, 0);
+    st.ownHeight.assign(n, 0);
+    st.relX.assign(n, 0);
+    st.relY.assign(n, 0);
+    st.hidden.assign(n, 0);
+    st.reusedNodes = 0;
+    if (n == 0) return boxes;
+
+    // the document's style table, made safe to compute with
+    std::vector<Style> styles;
+    styles.reserve(doc.styles().size());
+    for (const Style& s : doc.styles()) styles.push_back(clampStyle(s));
+    auto style = [&](NodeIndex i) -> const Style& { return styles[doc.styleId(i)]; };
+
+    std::vector<Display> display(n);
+    auto& hidden = st.hidden;
+    auto& preferred = st.preferred;
+
+    auto inFlow = [&](NodeIndex c) { return !hidden[c] && style(c).position == Style::Position::Static; };
+    auto textWidth = [&](NodeIndex i) { return static_cast<float>(doc.text(i).size()) * options_.charWidth; };
+    auto isRow = [&](NodeIndex i) {
+        return display[i] == Display::Flex && style(i).flexDirection == Style::FlexDirection::Row;
+    };
+    auto isColumn = [&](NodeIndex i) {
+        return display[i] == Display::Flex && style(i).flexDirection == Style::FlexDirection::Column;
+    };
+
+    for (NodeIndex i = 0; i < n; ++i) {
+        display[i] = displayOf(doc, i);
+        NodeIndex parent = doc.parent(i);
+        hidden[i] = display[i] == Display::None || (parent != kInvalidNode && hidden[parent]);
+    }
+
+    // Copied subtrees displayed before and now keep their preferred widths
+    // (kPreferred); those whose root keeps its width keep every box below
+    // it as well (kGeometry, decided in pass 2).
+    constexpr std::uint8_t kPreferred = 1, kGeometry = 2;
+    std::vector<std::uint8_t> reuse;
+    auto reused = [&](NodeIndex i, std::uint8_t what) { return !reuse.empty() && (reuse[i] & what) != 0; };
+    if (previous) {
+        reuse.assign(n, 0);
+        const std::size_t before = previous->boxes.size();
+        for (const auto& c : previous->copied) {
+            if (c.size == 0 || c.to + std::size_t{c.size} > n || c.from + std::size_t{c.size} > before) continue;
+            if (hidden[c.to] || previous->state.hidden[c.from]) continue;
+            std::copy_n(previous->state.preferred.begin() + c.from, c.size, preferred.begin() + c.to);
+            std::fill_n(reuse.begin() + c.to, c.size, kPreferred);
+        }
+    }
+    auto takeGeometry = [&](const CopiedSubtree& c) {
+        const BoxArray& was = previous->boxes;
+        const LayoutState& wasState = previous->state;
+        // the root's offset is its parent's to set, and its height its
+        // parent's to adjust
+        auto below = [&](const std::vector<float>& from, std::vector<float>& to) {
+            std::copy_n(from.begin() + c.from + 1, c.size - 1, to.begin() + c.to + 1);
+        };
+        below(was.width, boxes.width);
+        below(was.height, boxes.height);
+        below(wasState.relX, boxes.x);
+        below(wasState.relY, boxes.y);
+        std::copy_n(wasState.ownHeight.begin() + c.from, c.size, st.ownHeight.begin() + c.to);
+        boxes.height[c.to] = wasState.ownHeight[c.from];
+        std::fill_n(reuse.begin() + c.to, c.size, kPreferred | kGeometry);
+        st.reusedNodes += c.size;
+    };
+
+    // 1. preferred (max-content) widths, children before parents
+    for (NodeIndex i = n; i-- > 0;) {
+        if (hidden[i] || reused(i, kPreferred)) continue;
+        const Style& s = style(i);
+        if (s.width >= 0) {
+            preferred[i] = s.width;
+            continue;
+        }
+
+        // own text sits on lines of its own, above the children
+        float content = textWidth(i);
+        float line = 0;
+        for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) {
+            if (!inFlow(c)) continue;
+            float outer = preferred[c] + 2 * style(c).margin;
+            if (isRow(i) || display[c] == Display::Inline) {
+                line += outer;
+            } else {
+                content = std::max({content, line, outer});
+                line = 0;
+            }
+        }
+        preferred[i] = std::max(content, line) + 2 * s.padding;
+    }
+
+    // 2. used widths, parents before children; each node sizes its children
+    std::size_t nextCopy = 0;
+    for (NodeIndex i = 0; i < n; ++i) {
+        if (hidden[i]) continue;
+        if (doc.parent(i) == kInvalidNode) {
+            const Style& s = style(i);
+            boxes.width[i] = s.width >= 0 ? s.width : std::max(0.0f, options_.viewportWidth - 2 * s.margin);
+        }
+        if (reused(i, kPreferred)) {
+            const auto& copied = previous->copied;
+            while (nextCopy < copied.size() && copied[nextCopy].to < i) ++nextCopy;
+            if (nextCopy < copied.size() && copied[nextCopy].to == i &&
+                boxes.width[i] == previous->boxes.width[copied[nextCopy].from]) {
+                takeGeometry(copied[nextCopy]);
+                i += copied[nextCopy].size - 1;
+                continue;
+            }
+        }
+        const float available = std::max(0.0f, boxes.width[i] - 2 * style(i).padding);
+
+        float used = 0, grow = 0, basis = 0;
+        for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) {
+            if (hidden[c]) continue;
+            const Style& s = style(c);
+            float& w = boxes.width[c];
+            if (s.position == Style::Position::Absolute) {
+                w = s.width >= 0 ? s.width : std::min(preferred[c], available);
+            } else if (isRow(i)) {
+                w = preferred[c]; // flex basis, resolved below
+                used += w + 2 * s.margin;
+                grow += s.flexGrow;
+                basis += w;
+            } else if (s.width >= 0) {
+                w = s.width;
+            } else if (display[c] == Display::Inline) {
+                w = std::min(preferred[c], std::max(0.0f, available - 2 * s.margin));
+            } else {
+                w = std::max(0.0f, available - 2 * s.margin);
+            }
+        }
+
+        if (!isRow(i)) continue;
+        const float free = available - used;
+        if ((free > 0 && grow > 0) || (free < 0 && basis > 0)) {
+            for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) {
+                if (!inFlow(c)) continue;
+                float& w = boxes.width[c];
+                w = free > 0 ? w + free * style(c).flexGrow / grow : std::max(0.0f, w + free * w / basis);
+            }
+        }
+    }
+
+    // 3. heights and offsets from the parent's border box, children before parents
+    for (NodeIndex i = n; i-- > 0;) {
+        if (hidden[i] || reused(i, kGeometry)) continue;
+        const Style& s = style(i);
+        const float p = s.padding;
+        const float available = std::max(0.0f, boxes.width[i] - 2 * p);
+
+        // own text comes first, as full lines
+        float y = p;
+        if (float text = textWidth(i); text > 0) {
+            y += std::ceil(text / std::max(available, options_.charWidth)) * options_.lineHeight;
+        }
+
+        if (isRow(i)) {
+            float x = p, lineHeight = 0;
+            for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) {
+                if (!inFlow(c)) continue;
+                const float m = style(c).margin;
+                boxes.x[c] = x + m;
+                boxes.y[c] = y + m;
+                x += boxes.width[c] + 2 * m;
+                lineHeight = std::max(lineHeight, boxes.height[c] + 2 * m);
+            }
+            // align-items: stretch
+            for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) {
+                if (!inFlow(c) || style(c).height >= 0) continue;
+                boxes.height[c] = std::max(boxes.height[c], lineHeight - 2 * style(c).margin);
+            }
+            y += lineHeight;
+        } else if (isColumn(i)) {
+            float grow = 0;
+            for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) {
+                if (!inFlow(c)) continue;
+                const float m = style(c).margin;
+                boxes.x[c] = p + m;
+                boxes.y[c] = y + m;
+                y += boxes.height[c] + 2 * m;
+                grow += style(c).flexGrow;
+            }
+            // a fixed-height column hands its free space to growing children
+            const float free = s.height - p - y;
+            if (s.height >= 0 && free > 0 && grow > 0) {
+                float shift = 0;
+                for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) {
+                    if (!inFlow(c)) continue;
+                    const float extra = free * style(c).flexGrow / grow;
+                    boxes.y[c] += shift;
+                    boxes.height[c] += extra;
+                    shift += extra;
+                }
+                y += free;
+            }
+        } else {
+            // block flow; runs of inline children break into lines
+            float lineX = 0, lineHeight = 0;
+            auto breakLine = [&] {
+                y += lineHeight;
+                lineX = lineHeight = 0;
+            };
+            for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) {
+                if (!inFlow(c)) continue;
+                const float m = style(c).margin;
+                const float outerWidth = boxes.width[c] + 2 * m;
+                if (display[c] == Display::Inline) {
+                    if (lineX > 0 && lineX + outerWidth > available) breakLine();
+                    boxes.x[c] = p + lineX + m;
+                    boxes.y[c] = y + m;
+                    lineX += outerWidth;
+                    lineHeight = std::max(lineHeight, boxes.height[c] + 2 * m);
+                } else {
+                    breakLine();
+                    boxes.x[c] = p + m;
+                    boxes.y[c] = y + m;
+                    y += boxes.height[c] + 2 * m;
+                }
+            }
+            breakLine();
+        }
+
+        for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) {
+            if (hidden[c] || style(c).position != Style::Position::Absolute) continue;
+            boxes.x[c] = style(c).left;
+            boxes.y[c] = style(c).top;
+        }
+
+        boxes.height[i] = s.height >= 0 ? s.height : y + p;
+        st.ownHeight[i] = boxes.height[i];
+    }
+
+    // 4. offsets to page coordinates, parents before children; top-level
+    // nodes stack down the page
+    float pageY = 0;
+    for (NodeIndex i = 0; i < n; ++i) {
+        const NodeIndex parent = doc.parent(i);
+        if (parent == kInvalidNode) {
+            if (hidden[i]) continue;
+            const float m = style(i).margin;
+            boxes.x[i] = m;
+            boxes.y[i] = pageY + m;
+            pageY += boxes.height[i] + 2 * m;
+            continue;
+        }
+        if (hidden[i]) {
+            boxes.x[i] = boxes.x[parent];
+            boxes.y[i] = boxes.y[parent];
+            continue;
+        }
+        st.relX[i] = boxes.x[i];
+        st.relY[i] = boxes.y[i];
+        boxes.x[i] += boxes.x[parent];
+        boxes.y[i] += boxes.y[parent];
+    }
+    return boxes;
+}
+
+}
@@ -1,15 +1,414 @@
 #include "openperf/metrics.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
 namespace openperf {
 
+namespace {
+
+std::atomic<std::uint64_t> g_nextInstanceId{1};
+
+// Per-thread cache of this thread's buffer in each live Metrics instance.
+// Instance ids are never reused, so entries for destroyed instances are
+// simply never matched again. A dropped entry, or every entry when the
+// thread exits, hands its buffer back to the instance's pool if that still
+// exists.
+struct TlsBufferRef {
+    std::uint64_t instanceId;
+    void* buffer;
+    std::weak_ptr<void> pool;
+    void (*release)(void* pool, void* buffer);
+
+    void releaseBuffer() const {
+        if (auto alive = pool.lock()) release(alive.get(), buffer);
+    }
+};
+
+struct TlsBuffers {
+    std::vector<TlsBufferRef> refs;
+    ~TlsBuffers() {
+        for (const auto& ref : refs) ref.releaseBuffer();
+    }
+};
+thread_local TlsBuffers tlsBuffers;
+constexpr std::size_t kMaxTlsBuffers = 16;
+
+std::int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+}
+
+Metrics::Metrics(std::chrono::steady_clock::duration window)
+    : instanceId_(g_nextInstanceId.fetch_add(1, std::memory_order_relaxed)),
+      epochNs_(nowNs()),
+      windowLength_(window),
+      windowStart_(std::chrono::steady_clock::now()) {}
+
+Metrics::~Metrics() = default;
+
+MetricId Metrics::registerMetric(std::string_view name, MetricKind kind) {
+    std::string key{name};
+    {
+        std::shared_lock<std::shared_mutex> lock{registryMutex_};
+        auto it = ids_.find(key);
+        if (it != ids_.end()) return it->second;
+    }
+
+    std::unique_lock<std::shared_mutex> lock{registryMutex_};
+    auto it = ids_.find(key);
+    if (it != ids_.end()) return it->second;
+
+    auto id = registered_.load(std::memory_order_relaxed);
+    if (id >= kMaxMetrics) return kInvalidMetric;
+
+    names_[id] = key;
+    kinds_[id] = kind;
+    ids_.emplace(std::move(key), id);
+    registered_.store(id + 1, std::memory_order_release); // publishes names_/kinds_
+    return id;
+}
+
+Metrics::ThreadBuffer& Metrics::localBuffer() {
+    auto& refs = tlsBuffers.refs;
+    for (auto it = refs.rbegin(); it != refs.rend(); ++it) {
+        if (it->instanceId == instanceId_) return *static_cast<ThreadBuffer*>(it->buffer);
+    }
+
+    // first record from this thread: slow path, once per thread. An exited
+    // thread's buffer carries on, so its counts stay in the totals.
+    ThreadBuffer* raw = nullptr;
+    {
+        std::lock_guard<std::mutex> lock{pool_->mutex};
+        if (!pool_->free.empty()) {
+            raw = pool_->free.back();
+            pool_->free.pop_back();
+        } else {
+            pool_->buffers.push_back(std::make_unique<ThreadBuffer>());
+            raw = pool_->buffers.back().get();
+        }
+    }
+
+    if (refs.size() >= kMaxTlsBuffers) {
+        refs.front().releaseBuffer();
+        refs.erase(refs.begin());
+    }
+    refs.push_back({instanceId_, raw, pool_, &Metrics::releaseBuffer});
+    return *raw;
+}
+
+void Metrics::releaseBuffer(void* pool, void* buffer) {
+    auto* owner = static_cast<BufferPool*>(pool);
+    std::lock_guard<std::mutex> lock{owner->mutex};
+    owner->free.push_back(static_cast<ThreadBuffer*>(buffer));
+}
+
+void Metrics::record(MetricId id, double value) {
+    if (id >= registered_.load(std::memory_order_acquire)) return;
+
+    ThreadBuffer& buffer = localBuffer();
+
+    Histogram* h = buffer.histograms[id].load(std::memory_order_relaxed);
+    if (!h) {
+        buffer.owned.push_back(std::make_unique<Histogram>());
+        h = buffer.owned.back().get();
+        buffer.histograms[id].store(h, std::memory_order_release);
+    }
+
+    // single writer: plain load/store pairs, no read-modify-write
+    auto count = h->count.load(std::memory_order_relaxed);
+    if (count == 0 || value < h->min.load(std::memory_order_relaxed))
+        h->min.store(value, std::memory_order_relaxed);
+    if (count == 0 || value > h->max.load(std::memory_order_relaxed))
+        h->max.store(value, std::memory_order_relaxed);
+    h->sum.store(h->sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    if (kinds_[id] == MetricKind::Histogram) {
+        auto& bucket = h->buckets[bucketFor(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    h->count.store(count + 1, std::memory_order_release);
+
+    // Announce our sequence before checking the readers' watermark: a reader
+    // that raised it either sees us in flight and holds back, or we see the
+    // raised watermark and land above its cursor.
+    const auto timestampNs = nowNs();
+    auto sequence = std::max(buffer.lastSequence + 1, static_cast<std::uint64_t>(timestampNs - epochNs_) + 1);
+    buffer.pendingSequence.store(sequence, std::memory_order_seq_cst);
+    sequence = std::max(sequence, watermark_.load(std::memory_order_seq_cst) + 1);
+    buffer.lastSequence = sequence;
+
+    // raw sample ring, seqlock-style so readers can detect torn slots
+    auto head = buffer.rawHead.load(std::memory_order_relaxed);
+    RawSlot& slot = buffer.raw[head % kRawSamplesPerThread];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.sequence.store(sequence, std::memory_order_relaxed);
+    slot.id.store(id, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.timestampNs.store(timestampNs, std::memory_order_relaxed);
+    slot.seq.store(head + 1, std::memory_order_release);
+    buffer.rawHead.store(head + 1, std::memory_order_release);
+    buffer.pendingSequence.store(0, std::memory_order_release);
+}
+
 void Metrics::record(const std::string& name, double value) {
-    std::lock_guard<std::mutex> lock{mutex_};
-    samples_.emplace_back(name, value, std::chrono::steady_clock::now());
+    record(registerMetric(name), value);
+}
+
+std::vector<Metric> Metrics::getMetrics() const {
+    return getMetricsSince(0).samples;
+}
+
+MetricsDelta Metrics::getMetricsSince(std::uint64_t cursor) const {
+    struct Raw {
+        std::uint64_t sequence;
+        MetricId id;
+        double value;
+        std::int64_t timestampNs;
+    };
+    std::vector<Raw> raw;
+    std::uint64_t limit = static_cast<std::uint64_t>(nowNs() - epochNs_);
+    std::uint64_t missed = 0;
+
+    {
+        std::lock_guard<std::mutex> lock{pool_->mutex};
+
+        // Records that start from here on get a sequence above `limit`...
+        auto seen = watermark_.load(std::memory_order_relaxed);
+        while (seen < limit && !watermark_.compare_exchange_weak(seen, limit, std::memory_order_seq_cst)) {
+        }
+        // ...and those already under way hold back everything from theirs.
+        for (const auto& buffer : pool_->buffers) {
+            auto pending = buffer->pendingSequence.load(std::memory_order_seq_cst);
+            if (pending != 0) limit = std::min(limit, pending - 1);
+        }
+        if (limit <= cursor) return MetricsDelta{{}, cursor, 0};
+
+        const CursorMark* from = nullptr;
+        for (const auto& mark : cursorMarks_) {
+            if (mark.cursor == cursor) from = &mark;
+        }
+
+        CursorMark to{limit, std::vector<std::uint64_t>(pool_->buffers.size(), 0)};
+        raw.reserve(pool_->buffers.size() * kRawSamplesPerThread);
+        for (std::size_t b = 0; b < pool_->buffers.size(); ++b) {
+            // a buffer's samples, numbered by slot.seq, have rising sequences
+            std::uint64_t oldest = 0, upToCursor = 0, upToLimit = 0, returned = 0;
+            for (const RawSlot& slot : pool_->buffers[b]->raw) {
+                auto before = slot.seq.load(std::memory_order_acquire);
+                if (before == 0) continue;
+                Raw r{slot.sequence.load(std::memory_order_relaxed),
+                      slot.id.load(std::memory_order_relaxed),
+                      slot.value.load(std::memory_order_relaxed),
+                      slot.timestampNs.load(std::memory_order_relaxed)};
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq.load(std::memory_order_relaxed) != before) continue; // overwritten mid-read
+                if (oldest == 0 || before < oldest) oldest = before;
+                if (r.sequence <= cursor) upToCursor = std::max(upToCursor, before);
+                if (r.sequence <= limit) upToLimit = std::max(upToLimit, before);
+                if (r.sequence > cursor && r.sequence <= limit) {
+                    raw.push_back(r);
+                    ++returned;
+                }
+            }
+            // with nothing retained on that side, all older samples were
+            if (oldest != 0) {
+                if (upToCursor == 0) upToCursor = oldest - 1;
+                if (upToLimit == 0) upToLimit = oldest - 1;
+            }
+            if (cursor == 0) upToCursor = 0;
+            else if (from) upToCursor = b < from->recorded.size() ? from->recorded[b] : 0;
+
+            to.recorded[b] = upToLimit;
+            if (upToLimit > upToCursor + returned) missed += upToLimit - upToCursor - returned;
+        }
+
+        if (cursorMarks_.size() < kCursorMarks) cursorMarks_.push_back(std::move(to));
+        else cursorMarks_[nextCursorMark_] = std::move(to);
+        nextCursorMark_ = (nextCursorMark_ + 1) % kCursorMarks;
+    }
+
+    std::sort(raw.begin(), raw.end(), [](const Raw& a, const Raw& b) { return a.sequence < b.sequence; });
+
+    MetricsDelta delta;
+    delta.cursor = limit;
+    delta.missed = missed;
+    delta.samples.reserve(raw.size());
+    for (const Raw& r : raw) {
+        delta.samples.push_back(Metric{names_[r.id], r.value,
+                                       std::chrono::steady_clock::time_point{std::chrono::nanoseconds{r.timestampNs}},
+                                       r.sequence});
+    }
+    return delta;
+}
+
+std::vector<MetricSummary> Metrics::summarize() const {
+    const auto registered = registered_.load(std::memory_order_acquire);
+    std::lock_guard<std::mutex> lock{windowMutex_};
+
+    auto now = std::chrono::steady_clock::now();
+    const bool roll = now - windowStart_ >= windowLength_;
+    windowBase_.resize(registered);
+    lastWindow_.resize(registered);
+
+    std::vector<MetricSummary> summaries;
+    summaries.reserve(registered);
+    for (MetricId id = 0; id < registered; ++id) {
+        Totals current = collect(id);
+        const Totals& base = windowBase_[id];
+
+        Totals delta;
+        delta.buckets = current.buckets;
+        for (std::size_t b = 0; b < base.buckets.size() && b < delta.buckets.size(); ++b)
+            delta.buckets[b] -= base.buckets[b];
+        delta.count = current.count - base.count;
+        delta.sum = current.sum - base.sum;
+
+        HistogramStats window = statsFrom(delta, kinds_[id], false);
+        if (roll) lastWindow_[id] = window;
+
+        MetricSummary summary;
+        summary.name = names_[id];
+        summary.kind = kinds_[id];
+        summary.total = statsFrom(current, kinds_[id], true);
+        summary.window = (roll || haveCompletedWindow_) ? lastWindow_[id] : window;
+        summaries.push_back(std::move(summary));
+
+        if (roll) windowBase_[id] = std::move(current);
+    }
+
+    if (roll) {
+        windowStart_ = now;
+        haveCompletedWindow_ = true;
+    }
+    return summaries;
+}
+
+Metrics::Totals Metrics::collect(MetricId id) const {
+    Totals totals;
+    totals.buckets.assign(kBuckets, 0);
+    bool first = true;
+
+    std::lock_guard<std::mutex> lock{pool_->mutex};
+    for (const auto& buffer : pool_->buffers) {
+        const Histogram* h = buffer->histograms[id].load(std::memory_order_acquire);
+        if (!h) continue;
+
+        auto count = h->count.load(std::memory_order_acquire);
+        if (count == 0) continue;
+        totals.count += count;
+        totals.sum += h->sum.load(std::memory_order_relaxed);
+
+        double mn = h->min.load(std::memory_order_relaxed);
+        double mx = h->max.load(std::memory_order_relaxed);
+        totals.min = first ? mn : std::min(totals.min, mn);
+        totals.max = first ? mx : std::max(totals.max, mx);
+        first = false;
+
+        for (std::size_t b = 0; b < kBuckets; ++b)
+            totals.buckets[b] += h->buckets[b].load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+std::size_t Metrics::bucketFor(double value) {
+    if (!(value > 0)) return 0;
+    constexpr double kMaxUnits = static_cast<double>((std::uint64_t{1} << 40) - 1);
+    auto units = static_cast<std::uint64_t>(std::min(value * kUnitsPerValue + 0.5, kMaxUnits));
+
+    if (units < kSubBuckets) return static_cast<std::size_t>(units);
+    int shift = (63 - std::countl_zero(units)) - kSubBucketBits;
+    std::size_t index = static_cast<std::size_t>(shift + 1) * kSubBuckets +
+                        static_cast<std::size_t>((units >> shift) & (kSubBuckets - 1));
+    return std::min(index, kBuckets - 1);
+}
+
+double Metrics::bucketValue(std::size_t bucket) {
+    if (bucket < kSubBuckets) return static_cast<double>(bucket) / kUnitsPerValue;
+    std::size_t shift = bucket / kSubBuckets - 1;
+    std::uint64_t mantissa = kSubBuckets + bucket % kSubBuckets;
+    double low = static_cast<double>(mantissa << shift);
+    double width = static_cast<double>(std::uint64_t{1} << shift);
+    return (low + (width - 1) / 2) / kUnitsPerValue;
+}
+
+HistogramStats Metrics::statsFrom(const Totals& totals, MetricKind kind, bool exactMinMax) {
+    HistogramStats stats;
+    stats.count = totals.count;
+    stats.sum = totals.sum;
+    if (totals.count == 0) return stats;
+
+    if (exactMinMax) {
+        stats.min = totals.min;
+        stats.max = totals.max;
+    }
+    if (kind != MetricKind::Histogram) return stats;
+
+    std::uint64_t inBuckets = 0;
+    for (auto c : totals.buckets) inBuckets += c;
+    if (inBuckets == 0) return stats;
+
+    const double quantiles[] = {0.5, 0.9, 0.99};
+    double* outputs[] = {&stats.p50, &stats.p90, &stats.p99};
+    std::size_t q = 0;
+    std::uint64_t seen = 0;
+    std::size_t firstBucket = kBuckets, lastBucket = 0;
+    for (std::size_t b = 0; b < totals.buckets.size(); ++b) {
+        if (totals.buckets[b] == 0) continue;
+        firstBucket = std::min(firstBucket, b);
+        lastBucket = b;
+        seen += totals.buckets[b];
+        while (q < 3 && static_cast<double>(seen) >= std::ceil(quantiles[q] * static_cast<double>(inBuckets))) {
+            *outputs[q++] = bucketValue(b);
+        }
+    }
+
+    if (!exactMinMax) {
+        // windows only have bucket deltas: min/max are bucket-precise
+        stats.min = bucketValue(firstBucket);
+        stats.max = bucketValue(lastBucket);
+    } else {
+        for (double* p : outputs) *p = std::clamp(*p, stats.min, stats.max);
+    }
+    return stats;
 }
 
-std::vector<Metric> Metrics::getMetrics() const { 
-    std::lock_guard<std::mutex> lock{mutex_};
-    return samples_;
+std::vector<MetricSummary> summarizeSamples(const std::vector<Metric>& samples) {
+    std::unordered_map<std::string_view, std::vector<double>> byName;
+    std::vector<std::string_view> order;
+    for (const auto& m : samples) {
+        auto [it, inserted] = byName.try_emplace(m.name);
+        if (inserted) order.push_back(m.name);
+        it->second.push_back(m.value);
+    }
+
+    std::vector<MetricSummary> summaries;
+    summaries.reserve(order.size());
+    for (auto name : order) {
+        auto& values = byName[name];
+        std::sort(values.begin(), values.end());
+
+        auto rank = [&](double q) {
+            auto i = static_cast<std::size_t>(std::ceil(q * static_cast<double>(values.size())));
+            return values[std::min(values.size() - 1, i == 0 ? 0 : i - 1)];
+        };
+
+        HistogramStats stats;
+        stats.count = values.size();
+        for (double v : values) stats.sum += v;
+        stats.min = values.front();
+        stats.max = values.back();
+        stats.p50 = rank(0.5);
+        stats.p90 = rank(0.9);
+        stats.p99 = rank(0.99);
+
+        summaries.push_back(MetricSummary{std::string(name), MetricKind::Histogram, stats, stats});
+    }
+    return summaries;
 }
 
 }
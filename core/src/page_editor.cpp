@@ -0,0 +1,231 @@
+#include "openperf/page_editor.hpp"
+
+#include <algorithm>
+
+namespace openperf {
+
+namespace {
+
+// Copies of every node, children included.
+std::shared_ptr<Node> cloneTree(const Node& root) {
+    auto copy = std::make_shared<Node>(root);
+    std::vector<Node*> stack{copy.get()};
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        for (auto& child : node->children) {
+            if (!child) continue;
+            child = std::make_shared<Node>(*child);
+            stack.push_back(child.get());
+        }
+    }
+    return copy;
+}
+
+}
+
+PageEditor::PageEditor(std::shared_ptr<Node> root) {
+    reset(std::move(root));
+}
+
+PatchResult PageEditor::apply(const std::vector<NodeMutation>& mutations) {
+    auto before = root_;
+    fresh_.clear();
+
+    for (std::size_t i = 0; i < mutations.size(); ++i) {
+        auto result = applyOne(mutations[i]);
+        if (result.status != PatchStatus::Applied) {
+            result.error = "mutation " + std::to_string(i) + ": " + result.error;
+            // the old tree was never modified, only the index needs rebuilding
+            reset(std::move(before));
+            return result;
+        }
+    }
+
+    PatchResult result;
+    result.changedNodes = fresh_.size();
+    fresh_.clear();
+    return result;
+}
+
+PatchResult PageEditor::applyOne(const NodeMutation& m) {
+    auto fail = [](PatchStatus status, std::string error) {
+        PatchResult r;
+        r.status = status;
+        r.error = std::move(error);
+        return r;
+    };
+
+    auto it = byId_.find(m.nodeId);
+    if (m.nodeId.empty() || it == byId_.end()) {
+        return fail(PatchStatus::NodeNotFound, "unknown node_id '" + m.nodeId + "'");
+    }
+    const Node* target = it->second;
+
+    switch (m.kind) {
+        case NodeMutation::Kind::Insert: {
+            if (!m.node) return fail(PatchStatus::InvalidMutation, "insert without a node");
+            if (parent_.contains(m.node.get())) {
+                return fail(PatchStatus::InvalidMutation, "inserted node is already in the page");
+            }
+            // later mutations edit fresh nodes in place, and a caller may
+            // apply the same mutations again, so the page gets its own copy
+            auto subtree = cloneTree(*m.node);
+            Node* parent = own(target);
+            auto at = parent->children.begin() +
+                      static_cast<std::ptrdiff_t>(std::min(m.position, parent->children.size()));
+            parent->children.insert(at, subtree);
+            index(subtree, parent, true);
+            break;
+        }
+
+        case NodeMutation::Kind::Remove: {
+            const Node* parentOf = parent_.at(target);
+            if (!parentOf) return fail(PatchStatus::InvalidMutation, "cannot remove the root");
+            Node* parent = own(parentOf);
+            unindex(target); // before the erase below drops the last reference
+            replaceChild(*parent, target, nullptr);
+            break;
+        }
+
+        case NodeMutation::Kind::Update: {
+            if (!m.node) return fail(PatchStatus::InvalidMutation, "update without attributes");
+            Node* node = own(target);
+            unindexId(node);
+            textBytes_ -= textOf(*node);
+            node->tag = m.node->tag;
+            if (!m.node->id.empty()) node->id = m.node->id;
+            node->text = m.node->text;
+            node->role = m.node->role;
+            node->ariaLabel = m.node->ariaLabel;
+            node->isInteractive = m.node->isInteractive;
+            node->style = m.node->style;
+            textBytes_ += textOf(*node);
+            indexId(node);
+            break;
+        }
+    }
+
+    return {};
+}
+
+Node* PageEditor::own(const Node* node) {
+    if (fresh_.contains(node)) return const_cast<Node*>(node);
+
+    // ancestors not yet copied, nearest first
+    std::vector<const Node*> chain;
+    for (const Node* n = node; n && !fresh_.contains(n); n = parent_.at(n)) chain.push_back(n);
+
+    // copy top-down, so each copy's parent is already writable
+    Node* copied = nullptr;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        const Node* original = *it;
+        const Node* parent = parent_.at(original);
+        auto copy = std::make_shared<Node>(*original); // children stay shared
+        copied = copy.get();
+
+        unindexId(original);
+        parent_.erase(original);
+        parent_[copied] = parent;
+        for (const auto& child : copied->children)
+            if (child) parent_[child.get()] = copied;
+        indexId(copied);
+        fresh_.insert(copied);
+
+        if (parent) {
+            replaceChild(*const_cast<Node*>(parent), original, std::move(copy));
+        } else {
+            root_ = std::move(copy);
+        }
+    }
+    return copied;
+}
+
+std::unordered_map<const Node*, NodeIndex> PageEditor::sharedSubtrees(const Node& previous,
+                                                                      const FlatDocument& previousDom) const {
+    // Walk `previous` alongside its flat form, descending only into nodes
+    // the current tree no longer holds: copied ancestors and removed nodes.
+    std::unordered_map<const Node*, NodeIndex> shared;
+    if (previousDom.empty()) return shared;
+    std::vector<std::pair<const Node*, NodeIndex>> stack{{&previous, previousDom.root()}};
+    while (!stack.empty()) {
+        auto [node, at] = stack.back();
+        stack.pop_back();
+        if (parent_.contains(node)) {
+            shared.emplace(node, at);
+            continue;
+        }
+        NodeIndex child = previousDom.firstChild(at);
+        for (const auto& c : node->children) {
+            if (!c) continue;
+            if (child == kInvalidNode) return {};
+            stack.emplace_back(c.get(), child);
+            child = previousDom.nextSibling(child);
+        }
+        if (child != kInvalidNode) return {};
+    }
+    return shared;
+}
+
+void PageEditor::replaceChild(Node& parent, const Node* from, std::shared_ptr<Node> to) {
+    auto& children = parent.children;
+    auto it = std::find_if(children.begin(), children.end(), [from](const auto& c) { return c.get() == from; });
+    if (it == children.end()) return;
+    if (to) {
+        *it = std::move(to);
+    } else {
+        children.erase(it);
+    }
+}
+
+void PageEditor::reset(std::shared_ptr<Node> root) {
+    byId_.clear();
+    parent_.clear();
+    fresh_.clear();
+    textBytes_ = 0;
+    root_ = std::move(root);
+    if (root_) index(root_, nullptr, false);
+}
+
+void PageEditor::index(const std::shared_ptr<Node>& subtree, const Node* parent, bool fresh) {
+    std::vector<std::pair<const Node*, const Node*>> stack{{subtree.get(), parent}};
+    while (!stack.empty()) {
+        auto [node, up] = stack.back();
+        stack.pop_back();
+        parent_[node] = up;
+        indexId(node);
+        textBytes_ += textOf(*node);
+        if (fresh) fresh_.insert(node);
+        for (const auto& child : node->children)
+            if (child) stack.emplace_back(child.get(), node);
+    }
+}
+
+void PageEditor::unindex(const Node* subtree) {
+    std::vector<const Node*> stack{subtree};
+    while (!stack.empty()) {
+        const Node* node = stack.back();
+        stack.pop_back();
+        parent_.erase(node);
+        unindexId(node);
+        textBytes_ -= textOf(*node);
+        fresh_.erase(node);
+        for (const auto& child : node->children)
+            if (child) stack.push_back(child.get());
+    }
+}
+
+void PageEditor::indexId(const Node* node) {
+    if (!node->id.empty()) byId_.try_emplace(node->id, node);
+}
+
+void PageEditor::unindexId(const Node* node) {
+    auto it = byId_.find(node->id);
+    if (it != byId_.end() && it->second == node) byId_.erase(it);
+}
+
+std::size_t PageEditor::textOf(const Node& node) {
+    return node.tag.size() + node.id.size() + node.text.size() + node.role.size() + node.ariaLabel.size();
+}
+
+}
@@ -0,0 +1,296 @@
+#include "openperf/page_store.hpp"
+#include "openperf/flat_document.hpp"
+#include "openperf/page_editor.hpp"
+
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace openperf {
+
+namespace {
+
+// shared_ptr control block + the shared_ptr itself, per tree node
+constexpr std::size_t kTreeNodeOverhead = sizeof(Node) + 2 * sizeof(void*) + sizeof(std::shared_ptr<Node>);
+
+std::size_t stringHeapBytes(const std::string& s) {
+    // anything within the small-string buffer lives inside the object
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+}
+
+PageStore::PageStore() : PageStore(Options{}) {}
+
+PageStore::PageStore(Options options) : options_(options) {
+    std::size_t shards = 1;
+    while (shards < std::max<std::size_t>(1, options_.shardCount)) shards <<= 1;
+    shardMask_ = shards - 1;
+    shards_ = std::make_unique<Shard[]>(shards);
+}
+
+PageStore::Shard& PageStore::shardFor(const std::string& id) const {
+    return shards_[shardIndex(id)];
+}
+
+std::size_t PageStore::shardIndex(const std::string& id) const {
+    return std::hash<std::string>{}(id) & shardMask_;
+}
+
+std::vector<std::uint32_t> PageStore::groupByShard(const std::vector<std::uint32_t>& shardOf) const {
+    // counting sort: stable, so items of one shard keep their batch order
+    std::vector<std::uint32_t> start(shardMask_ + 2, 0);
+    for (auto shard : shardOf) ++start[shard + 1];
+    for (std::size_t i = 1; i < start.size(); ++i) start[i] += start[i - 1];
+    std::vector<std::uint32_t> order(shardOf.size());
+    for (std::uint32_t i = 0; i < shardOf.size(); ++i) order[start[shardOf[i]]++] = i;
+    return order;
+}
+
+PagePtr PageStore::find(const std::string& id) const {
+    const Shard& shard = shardFor(id);
+    std::shared_lock<std::shared_mutex> lock{shard.mutex};
+    auto it = shard.pages.find(id);
+    return it == shard.pages.end() ? nullptr : it->second.page;
+}
+
+std::vector<PagePtr> PageStore::findBatch(const std::vector<std::string>& ids) const {
+    std::vector<PagePtr> found(ids.size());
+    std::vector<std::uint32_t> shardOf(ids.size());
+    for (std::size_t i = 0; i < ids.size(); ++i) shardOf[i] = static_cast<std::uint32_t>(shardIndex(ids[i]));
+
+    auto order = groupByShard(shardOf);
+    for (std::size_t at = 0; at < order.size();) {
+        const Shard& shard = shards_[shardOf[order[at]]];
+        std::shared_lock<std::shared_mutex> lock{shard.mutex};
+        for (; at < order.size() && &shards_[shardOf[order[at]]] == &shard; ++at) {
+            auto it = shard.pages.find(ids[order[at]]);
+            if (it != shard.pages.end()) found[order[at]] = it->second.page;
+        }
+    }
+    return found;
+}
+
+bool PageStore::contains(const std::string& id) const {
+    const Shard& shard = shardFor(id);
+    std::shared_lock<std::shared_mutex> lock{shard.mutex};
+    return shard.pages.contains(id);
+}
+
+PagePtr PageStore::insert(PagePtr page) {
+    if (!page) return nullptr;
+
+    // size the page before taking the lock
+    Entry entry{page, estimateBytes(*page), generation_.fetch_add(1, std::memory_order_relaxed) + 1};
+    const std::uint64_t generation = entry.generation;
+    const auto newBytes = static_cast<std::ptrdiff_t>(entry.bytes);
+
+    Shard& shard = shardFor(page->id);
+    PagePtr previous;
+    {
+        std::unique_lock<std::shared_mutex> lock{shard.mutex};
+        auto [it, inserted] = shard.pages.try_emplace(page->id);
+        if (inserted) {
+            account(1, newBytes);
+        } else {
+            previous = std::move(it->second.page);
+            account(0, newBytes - static_cast<std::ptrdiff_t>(it->second.bytes));
+        }
+        it->second = std::move(entry);
+
+        // insertion order only matters when there is a budget to enforce
+        if (options_.maxBytes != 0) shard.fifo.emplace_back(page->id, generation);
+        pruneFifo(shard);
+    }
+
+    // never evict the page we were just asked to store
+    if (options_.maxBytes != 0 && bytes() > options_.maxBytes) evictUntil(options_.maxBytes, generation);
+
+    return previous;
+}
+
+void PageStore::insertBatch(std::vector<PagePtr> pages) {
+    std::erase(pages, nullptr);
+    if (pages.empty()) return;
+
+    // size the pages and group them by shard before taking any lock
+    const std::uint64_t firstGeneration = generation_.fetch_add(pages.size(), std::memory_order_relaxed) + 1;
+    std::vector<std::size_t> bytes(pages.size());
+    std::vector<std::uint32_t> shardOf(pages.size());
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+        bytes[i] = estimateBytes(*pages[i]);
+        shardOf[i] = static_cast<std::uint32_t>(shardIndex(pages[i]->id));
+    }
+    auto order = groupByShard(shardOf);
+
+    std::vector<PagePtr> previous; // released outside the locks
+    previous.reserve(pages.size());
+    for (std::size_t at = 0; at < order.size();) {
+        Shard& shard = shards_[shardOf[order[at]]];
+        std::unique_lock<std::shared_mutex> lock{shard.mutex};
+        for (; at < order.size() && &shards_[shardOf[order[at]]] == &shard; ++at) {
+            const std::size_t i = order[at];
+            const auto newBytes = static_cast<std::ptrdiff_t>(bytes[i]);
+            auto [it, inserted] = shard.pages.try_emplace(pages[i]->id);
+            if (inserted) {
+                account(1, newBytes);
+            } else {
+                previous.push_back(std::move(it->second.page));
+                account(0, newBytes - static_cast<std::ptrdiff_t>(it->second.bytes));
+            }
+            it->second = Entry{std::move(pages[i]), bytes[i], firstGeneration + i};
+            if (options_.maxBytes != 0) shard.fifo.emplace_back(it->first, firstGeneration + i);
+        }
+        pruneFifo(shard);
+    }
+
+    if (options_.maxBytes != 0 && this->bytes() > options_.maxBytes) evictUntil(options_.maxBytes, firstGeneration);
+}
+
+void PageStore::pruneFifo(Shard& shard) {
+    // drop stale fifo entries left behind by replacements and erases
+    if (shard.fifo.size() > 2 * shard.pages.size() + 16) {
+        std::erase_if(shard.fifo, [&](const auto& f) {
+            auto p = shard.pages.find(f.first);
+            return p == shard.pages.end() || p->second.generation != f.second;
+        });
+    }
+}
+
+bool PageStore::replace(const PagePtr& expected, PagePtr page) {
+    if (!page || !expected || expected->id != page->id) return false;
+
+    const auto newBytes = estimateBytes(*page);
+    Shard& shard = shardFor(page->id);
+    PagePtr previous; // released outside the lock
+    std::unique_lock<std::shared_mutex> lock{shard.mutex};
+    auto it = shard.pages.find(page->id);
+    if (it == shard.pages.end() || it->second.page != expected) return false;
+
+    // keeps its generation, and so its place in the eviction order
+    account(0, static_cast<std::ptrdiff_t>(newBytes) - static_cast<std::ptrdiff_t>(it->second.bytes));
+    previous = std::exchange(it->second.page, std::move(page));
+    it->second.bytes = newBytes;
+    return true;
+}
+
+bool PageStore::erase(const std::string& id) {
+    Shard& shard = shardFor(id);
+    PagePtr dropped; // released outside the lock
+    std::unique_lock<std::shared_mutex> lock{shard.mutex};
+    auto it = shard.pages.find(id);
+    if (it == shard.pages.end()) return false;
+    dropped = std::move(it->second.page);
+    account(-1, -static_cast<std::ptrdiff_t>(it->second.bytes));
+    shard.pages.erase(it);
+    return true;
+}
+
+void PageStore::clear() {
+    for (std::size_t i = 0; i <= shardMask_; ++i) {
+        Shard& shard = shards_[i];
+        std::unique_lock<std::shared_mutex> lock{shard.mutex};
+        std::size_t bytes = 0;
+        for (const auto& [id, entry] : shard.pages) bytes += entry.bytes;
+        account(-static_cast<std::ptrdiff_t>(shard.pages.size()), -static_cast<std::ptrdiff_t>(bytes));
+        shard.pages.clear();
+        shard.fifo.clear();
+    }
+}
+
+std::size_t PageStore::evictTo(std::size_t maxBytes) {
+    return evictUntil(maxBytes, 0);
+}
+
+std::size_t PageStore::evictUntil(std::size_t maxBytes, std::uint64_t keepFrom) {
+    std::size_t evicted = 0;
+    const std::size_t shardCount = shardMask_ + 1;
+    // round-robin over shards; stop after a full lap with nothing to evict
+    for (std::size_t idle = 0; bytes() > maxBytes && idle < shardCount;) {
+        Shard& shard = shards_[evictCursor_.fetch_add(1, std::memory_order_relaxed) & shardMask_];
+        if (evictOldest(shard, keepFrom)) {
+            ++evicted;
+            idle = 0;
+        } else {
+            ++idle;
+        }
+    }
+    return evicted;
+}
+
+bool PageStore::evictOldest(Shard& shard, std::uint64_t keepFrom) {
+    PagePtr dropped;
+    std::unique_lock<std::shared_mutex> lock{shard.mutex};
+    auto kept = [keepFrom](std::uint64_t generation) { return keepFrom != 0 && generation >= keepFrom; };
+
+    if (options_.maxBytes == 0) {
+        // no insertion order tracked: evict any page but the protected ones
+        for (auto it = shard.pages.begin(); it != shard.pages.end(); ++it) {
+            if (kept(it->second.generation)) continue;
+            dropped = std::move(it->second.page);
+            account(-1, -static_cast<std::ptrdiff_t>(it->second.bytes));
+            shard.pages.erase(it);
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    while (!shard.fifo.empty()) {
+        auto [id, generation] = std::move(shard.fifo.front());
+        shard.fifo.pop_front();
+
+        auto it = shard.pages.find(id);
+        if (it == shard.pages.end() || it->second.generation != generation) continue; // stale
+
+        if (kept(generation)) {
+            shard.fifo.emplace_back(std::move(id), generation);
+            return false;
+        }
+
+        dropped = std::move(it->second.page);
+        account(-1, -static_cast<std::ptrdiff_t>(it->second.bytes));
+        shard.pages.erase(it);
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void PageStore::account(std::ptrdiff_t countDelta, std::ptrdiff_t bytesDelta) {
+    count_.fetch_add(static_cast<std::size_t>(countDelta), std::memory_order_relaxed);
+    bytes_.fetch_add(static_cast<std::size_t>(bytesDelta), std::memory_order_relaxed);
+}
+
+std::size_t PageStore::estimateBytes(const Page& page) {
+    std::size_t bytes = sizeof(Page) + stringHeapBytes(page.id) + stringHeapBytes(page.url);
+
+    if (page.dom) {
+        bytes += sizeof(FlatDocument) + page.dom->memoryBytes();
+        // the tree holds roughly the same text as the arena
+        if (page.root) bytes += page.dom->size() * kTreeNodeOverhead + page.dom->textBytes();
+        return bytes;
+    }
+
+    if (!page.root) return bytes;
+
+    // patched pages share most nodes with earlier snapshots; the editor
+    // keeps counts of its current tree so they need no walk
+    if (page.editor) {
+        return bytes + page.editor->nodeCount() * kTreeNodeOverhead + page.editor->textBytes();
+    }
+
+    std::vector<const Node*> stack{page.root.get()};
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+        bytes += kTreeNodeOverhead + n->children.capacity() * sizeof(std::shared_ptr<Node>) +
+                 stringHeapBytes(n->tag) + stringHeapBytes(n->id) + stringHeapBytes(n->text) +
+                 stringHeapBytes(n->role) + stringHeapBytes(n->ariaLabel);
+        for (const auto& c : n->children)
+            if (c) stack.push_back(c.get());
+    }
+    return bytes;
+}
+
+}
@@ -0,0 +1,404 @@
+#include "openperf/paint.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define OPENPERF_PAINT_X86 1
+#include <immintrin.h>
+#endif
+
+// keeps the scalar kernels scalar, so they are an honest baseline
+#if defined(__clang__)
+#define OPENPERF_NO_VECTORIZE
+#define OPENPERF_NO_VECTORIZE_LOOP _Pragma("clang loop vectorize(disable) interleave(disable)")
+#elif defined(__GNUC__)
+#define OPENPERF_NO_VECTORIZE __attribute__((optimize("no-tree-vectorize")))
+#define OPENPERF_NO_VECTORIZE_LOOP
+#else
+#define OPENPERF_NO_VECTORIZE
+#define OPENPERF_NO_VECTORIZE_LOOP
+#endif
+
+namespace openperf {
+
+namespace {
+
+// 0xRRGGBBAA -> a pixel whose bytes are R, G, B, A in memory
+std::uint32_t toPixel(std::uint32_t color) {
+    if constexpr (std::endian::native == std::endian::little) {
+        return (color >> 24) | ((color >> 8) & 0xff00) | ((color << 8) & 0xff0000) | (color << 24);
+    } else {
+        return color;
+    }
+}
+
+// Source-over with a constant color: out = (src * a + dst * (255 - a)) / 255
+// per channel, the alpha channel treating src as 255. Computed as
+// t = dst * inv + srcA; out = (t + (t >> 8)) >> 8, exact for the division.
+struct Blend {
+    std::uint16_t inv;
+    std::uint16_t srcA[4]; // src * a + 128, in memory channel order
+};
+
+Blend makeBlend(std::uint32_t color) {
+    const std::uint32_t a = color & 0xff;
+    const std::uint32_t opaque = toPixel(color | 0xff);
+    Blend b;
+    b.inv = static_cast<std::uint16_t>(255 - a);
+    for (int c = 0; c < 4; ++c) b.srcA[c] = static_cast<std::uint16_t>(((opaque >> (8 * c)) & 0xff) * a + 128);
+    return b;
+}
+
+using FillFn = void (*)(std::uint32_t* dst, std::size_t n, std::uint32_t pixel);
+using BlendFn = void (*)(std::uint32_t* dst, std::size_t n, const Blend& blend);
+
+struct Kernels {
+    FillFn fill;
+    BlendFn blend;
+};
+
+OPENPERF_NO_VECTORIZE void fillScalar(std::uint32_t* dst, std::size_t n, std::uint32_t pixel) {
+    OPENPERF_NO_VECTORIZE_LOOP
+    for (std::size_t i = 0; i < n; ++i) dst[i] = pixel;
+}
+
+inline std::uint32_t blendPixel(std::uint32_t d, const Blend& b) {
+    std::uint32_t out = 0;
+    for (int c = 0; c < 4; ++c) {
+        std::uint32_t t = ((d >> (8 * c)) & 0xff) * b.inv + b.srcA[c];
+        out |= ((t + (t >> 8)) >> 8) << (8 * c);
+    }
+    return out;
+}
+
+OPENPERF_NO_VECTORIZE void blendScalar(std::uint32_t* dst, std::size_t n, const Blend& b) {
+    OPENPERF_NO_VECTORIZE_LOOP
+    for (std::size_t i = 0; i < n; ++i) dst[i] = blendPixel(dst[i], b);
+}
+
+#ifdef OPENPERF_PAINT_X86
+
+std::int64_t srcPattern(const Blend& b) {
+    std::uint64_t p = 0;
+    for (int c = 0; c < 4; ++c) p |= std::uint64_t{b.srcA[c]} << (16 * c);
+    return static_cast<std::int64_t>(p);
+}
+
+void fillSse2(std::uint32_t* dst, std::size_t n, std::uint32_t pixel) {
+    const __m128i v = _mm_set1_epi32(static_cast<int>(pixel));
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    for (; i < n; ++i) dst[i] = pixel;
+}
+
+// two pixels per 16-bit half
+__m128i blendHalfSse2(__m128i d, __m128i inv, __m128i src) {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, inv), src);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+void blendSse2(std::uint32_t* dst, std::size_t n, const Blend& b) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inv = _mm_set1_epi16(static_cast<short>(b.inv));
+    const __m128i src = _mm_set1_epi64x(srcPattern(b));
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto* p = reinterpret_cast<__m128i*>(dst + i);
+        __m128i d = _mm_loadu_si128(p);
+        __m128i lo = blendHalfSse2(_mm_unpacklo_epi8(d, zero), inv, src);
+        __m128i hi = blendHalfSse2(_mm_unpackhi_epi8(d, zero), inv, src);
+        _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+    }
+    for (; i < n; ++i) dst[i] = blendPixel(dst[i], b);
+}
+
+__attribute__((target("avx2"))) void fillAvx2(std::uint32_t* dst, std::size_t n, std::uint32_t pixel) {
+    const __m256i v = _mm256_set1_epi32(static_cast<int>(pixel));
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    for (; i < n; ++i) dst[i] = pixel;
+}
+
+__attribute__((target("avx2"))) __m256i blendHalfAvx2(__m256i d, __m256i inv, __m256i src) {
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, inv), src);
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// unpack and pack both work within 128-bit lanes, so pixel order survives.
+// Tails stay in this function: calling into non-VEX SSE code with the upper
+// halves dirty costs a state transition per span.
+__attribute__((target("avx2"))) void blendAvx2(std::uint32_t* dst, std::size_t n, const Blend& b) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i inv = _mm256_set1_epi16(static_cast<short>(b.inv));
+    const __m256i src = _mm256_set1_epi64x(srcPattern(b));
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto* p = reinterpret_cast<__m256i*>(dst + i);
+        __m256i d = _mm256_loadu_si256(p);
+        __m256i lo = blendHalfAvx2(_mm256_unpacklo_epi8(d, zero), inv, src);
+        __m256i hi = blendHalfAvx2(_mm256_unpackhi_epi8(d, zero), inv, src);
+        _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+    }
+    for (; i < n; ++i) dst[i] = blendPixel(dst[i], b);
+}
+
+#endif
+
+Kernels kernelsFor(PaintKernel kernel) {
+    switch (kernel) {
+#ifdef OPENPERF_PAINT_X86
+        case PaintKernel::Avx2:
+            return {fillAvx2, blendAvx2};
+        case PaintKernel::Sse2:
+            return {fillSse2, blendSse2};
+#endif
+        default:
+            return {fillScalar, blendScalar};
+    }
+}
+
+// Bins items by tile: count, prefix-sum, fill.
+void binItems(DisplayList& list) {
+    const std::int32_t t = list.tileSize;
+    list.tileOffsets.assign(list.tileCount() + 1, 0);
+    auto forTiles = [&](const DisplayItem& item, auto&& fn) {
+        for (std::int32_t ty = item.y0 / t; ty <= (item.y1 - 1) / t; ++ty)
+            for (std::int32_t tx = item.x0 / t; tx <= (item.x1 - 1) / t; ++tx)
+                fn(static_cast<std::size_t>(ty * list.tilesX + tx));
+    };
+    for (const auto& item : list.items) forTiles(item, [&](std::size_t tile) { ++list.tileOffsets[tile + 1]; });
+    for (std::size_t i = 1; i < list.tileOffsets.size(); ++i) list.tileOffsets[i] += list.tileOffsets[i - 1];
+    list.tileItems.resize(list.tileOffsets.back());
+    std::vector<std::uint32_t> cursor(list.tileOffsets.begin(), list.tileOffsets.end() - 1);
+    for (std::uint32_t k = 0; k < list.items.size(); ++k) {
+        forTiles(list.items[k], [&](std::size_t tile) { list.tileItems[cursor[tile]++] = k; });
+    }
+}
+
+// The region of the page a display list covers, in page px.
+struct Region {
+    std::int32_t x, y, width, height;
+};
+
+// Records `nodes`, in document order (all nodes when null), into a list
+// covering `region`, in region-relative coordinates.
+DisplayList recordNodes(const Painter::Options& options, const FlatDocument& doc, const BoxArray& boxes,
+                        const std::vector<NodeIndex>* nodes, Region region, std::uint32_t clearColor) {
+    DisplayList list;
+    list.width = std::max(0, region.width);
+    list.height = std::max(0, region.height);
+    list.tileSize = options.tileSize;
+    list.tilesX = (list.width + list.tileSize - 1) / list.tileSize;
+    list.tilesY = (list.height + list.tileSize - 1) / list.tileSize;
+    list.clearColor = clearColor;
+
+    const float originX = static_cast<float>(region.x), originY = static_cast<float>(region.y);
+    const float viewW = static_cast<float>(list.width), viewH = static_cast<float>(list.height);
+    auto push = [&](float x, float y, float w, float h, std::uint32_t color) {
+        if ((color & 0xff) == 0 || w <= 0 || h <= 0) return;
+        auto x0 = static_cast<std::int32_t>(std::lround(std::clamp(x, 0.0f, viewW)));
+        auto y0 = static_cast<std::int32_t>(std::lround(std::clamp(y, 0.0f, viewH)));
+        auto x1 = static_cast<std::int32_t>(std::lround(std::clamp(x + w, 0.0f, viewW)));
+        auto y1 = static_cast<std::int32_t>(std::lround(std::clamp(y + h, 0.0f, viewH)));
+        if (x0 < x1 && y0 < y1) list.items.push_back({x0, y0, x1, y1, color});
+    };
+
+    const auto count = nodes ? nodes->size() : boxes.size();
+    for (std::size_t k = 0; k < count; ++k) {
+        const NodeIndex i = nodes ? (*nodes)[k] : static_cast<NodeIndex>(k);
+        const float x = boxes.x[i] - originX, y = boxes.y[i] - originY, w = boxes.width[i], h = boxes.height[i];
+        if (w <= 0 || h <= 0 || x >= viewW || y >= viewH || x + w <= 0 || y + h <= 0) continue;
+        const Style s = LayoutEngine::clampStyle(doc.style(i));
+
+        push(x, y, w, h, s.background);
+
+        if (s.borderWidth > 0) {
+            const float b = std::min({s.borderWidth, w / 2, h / 2});
+            push(x, y, w, b, s.borderColor);
+            push(x, y + h - b, w, b, s.borderColor);
+            push(x, y + b, b, h - 2 * b, s.borderColor);
+            push(x + w - b, y + b, b, h - 2 * b, s.borderColor);
+        }
+
+        // one bar per line of text, as laid out; only lines in the region
+        const float textWidth = static_cast<float>(doc.text(i).size()) * options.charWidth;
+        if (textWidth > 0) {
+            const float top = y + s.padding;
+            const float available = std::max(w - 2 * s.padding, options.charWidth);
+            // in float until clamped to the line count, so no cast overflows
+            const float lines = std::ceil(textWidth / available);
+            const auto first = static_cast<std::int64_t>(std::clamp(-top / options.lineHeight, 0.0f, lines));
+            const auto last =
+                static_cast<std::int64_t>(std::clamp((viewH - top) / options.lineHeight + 1, 0.0f, lines));
+            for (auto line = first; line < last; ++line) {
+                const float lineWidth = std::min(available, textWidth - static_cast<float>(line) * available);
+                const float lineTop = top + static_cast<float>(line) * options.lineHeight;
+                push(x + s.padding, lineTop + 0.2f * options.lineHeight, lineWidth, 0.6f * options.lineHeight,
+                     options.textColor);
+            }
+        }
+    }
+
+    binItems(list);
+    return list;
+}
+
+}
+
+bool paintKernelSupported(PaintKernel kernel) {
+    switch (kernel) {
+        case PaintKernel::Auto:
+        case PaintKernel::Scalar:
+            return true;
+#ifdef OPENPERF_PAINT_X86
+        case PaintKernel::Sse2:
+            return true; // baseline on x86-64
+        case PaintKernel::Avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* paintKernelName(PaintKernel kernel) {
+    switch (kernel) {
+        case PaintKernel::Auto:
+            return "auto";
+        case PaintKernel::Scalar:
+            return "scalar";
+        case PaintKernel::Sse2:
+            return "sse2";
+        case PaintKernel::Avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+PaintKernel resolvePaintKernel(PaintKernel kernel) {
+    if (kernel != PaintKernel::Auto) return paintKernelSupported(kernel) ? kernel : PaintKernel::Scalar;
+    for (auto k : {PaintKernel::Avx2, PaintKernel::Sse2})
+        if (paintKernelSupported(k)) return k;
+    return PaintKernel::Scalar;
+}
+
+std::uint32_t Raster::pixel(std::int32_t x, std::int32_t y) const {
+    const std::int32_t tile = (y / tileSize) * tilesX + x / tileSize;
+    const std::size_t offset = static_cast<std::size_t>(tile) * static_cast<std::size_t>(tileSize * tileSize) +
+                               static_cast<std::size_t>((y % tileSize) * tileSize + x % tileSize);
+    return pixels[offset];
+}
+
+Painter::Painter() : Painter(nullptr, Options{}) {}
+
+Painter::Painter(TaskScheduler* scheduler) : Painter(scheduler, Options{}) {}
+
+Painter::Painter(TaskScheduler* scheduler, Options options)
+    : scheduler_(scheduler), options_(options), kernel_(resolvePaintKernel(options.kernel)) {
+    options_.tileSize = std::max(8, options_.tileSize);
+}
+
+DisplayList Painter::record(const FlatDocument& doc, const BoxArray& boxes) const {
+    return recordNodes(options_, doc, boxes, nullptr, {0, 0, options_.viewportWidth, options_.viewportHeight},
+                       options_.clearColor);
+}
+
+std::vector<Layer> Painter::paintLayers(const FlatDocument& doc, const BoxArray& boxes) const {
+    const std::int32_t viewW = std::max(0, options_.viewportWidth), viewH = std::max(0, options_.viewportHeight);
+
+    const std::size_t maxLayers = std::max<std::size_t>(1, options_.maxLayers);
+
+    // layer 0 is the root; each displayed absolute node in the viewport
+    // starts a new one until maxLayers, after which absolute nodes are
+    // painted into their parent's layer. One pass buckets every node.
+    std::vector<Region> regions{{0, 0, viewW, viewH}};
+    std::vector<std::vector<NodeIndex>> members(1);
+    std::vector<std::uint32_t> layerOf(boxes.size(), 0);
+    for (NodeIndex i = 0; i < boxes.size(); ++i) {
+        const NodeIndex parent = doc.parent(i);
+        layerOf[i] = parent == kInvalidNode ? 0 : layerOf[parent];
+        if (regions.size() < maxLayers && doc.style(i).position == Style::Position::Absolute &&
+            boxes.width[i] > 0 && boxes.height[i] > 0) {
+            auto snap = [](float v, std::int32_t limit) {
+                return static_cast<std::int32_t>(std::clamp(v, 0.0f, static_cast<float>(limit)));
+            };
+            const std::int32_t x0 = snap(std::floor(boxes.x[i]), viewW), y0 = snap(std::floor(boxes.y[i]), viewH);
+            const std::int32_t x1 = snap(std::ceil(boxes.x[i] + boxes.width[i]), viewW);
+            const std::int32_t y1 = snap(std::ceil(boxes.y[i] + boxes.height[i]), viewH);
+            if (x0 < x1 && y0 < y1) {
+                layerOf[i] = static_cast<std::uint32_t>(regions.size());
+                regions.push_back({x0, y0, x1 - x0, y1 - y0});
+                members.emplace_back();
+            }
+        }
+        members[layerOf[i]].push_back(i);
+    }
+
+    std::vector<Layer> layers(regions.size());
+    for (std::uint32_t l = 0; l < layers.size(); ++l) {
+        // only the root layer is opaque underneath
+        auto list = std::make_shared<const DisplayList>(
+            recordNodes(options_, doc, boxes, &members[l], regions[l], l == 0 ? options_.clearColor : 0));
+        layers[l].x = regions[l].x;
+        layers[l].y = regions[l].y;
+        layers[l].raster = std::make_shared<const Raster>(rasterize(*list));
+        layers[l].list = std::move(list);
+    }
+    return layers;
+}
+
+Raster Painter::rasterize(const DisplayList& list) const {
+    Raster raster;
+    raster.width = list.width;
+    raster.height = list.height;
+    raster.tileSize = list.tileSize;
+    raster.tilesX = list.tilesX;
+    raster.tilesY = list.tilesY;
+
+    const std::size_t tiles = list.tileCount();
+    const auto t = static_cast<std::size_t>(list.tileSize);
+    raster.pixels.resize(tiles * t * t);
+    raster.tileMs.resize(tiles);
+
+    const Kernels kernels = kernelsFor(kernel_);
+    const std::uint32_t clear = toPixel(list.clearColor);
+
+    auto paintTile = [&](std::size_t tile) {
+        auto start = std::chrono::steady_clock::now();
+        std::uint32_t* out = raster.pixels.data() + tile * t * t;
+        const auto originX = static_cast<std::int32_t>((tile % static_cast<std::size_t>(list.tilesX)) * t);
+        const auto originY = static_cast<std::int32_t>((tile / static_cast<std::size_t>(list.tilesX)) * t);
+        const auto size = static_cast<std::int32_t>(t);
+
+        kernels.fill(out, t * t, clear);
+        for (std::uint32_t k = list.tileOffsets[tile]; k < list.tileOffsets[tile + 1]; ++k) {
+            const DisplayItem& item = list.items[list.tileItems[k]];
+            const std::int32_t x0 = std::max(item.x0 - originX, 0), x1 = std::min(item.x1 - originX, size);
+            const std::int32_t y0 = std::max(item.y0 - originY, 0), y1 = std::min(item.y1 - originY, size);
+            const auto span = static_cast<std::size_t>(x1 - x0);
+
+            if ((item.color & 0xff) == 0xff) {
+                const std::uint32_t pixel = toPixel(item.color);
+                for (std::int32_t y = y0; y < y1; ++y) kernels.fill(out + y * size + x0, span, pixel);
+            } else {
+                const Blend blend = makeBlend(item.color);
+                for (std::int32_t y = y0; y < y1; ++y) kernels.blend(out + y * size + x0, span, blend);
+            }
+        }
+        raster.tileMs[tile] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    if (scheduler_ && tiles > 1) {
+        scheduler_->parallelFor(0, tiles, 1, [&](std::size_t lo, std::size_t hi) {
+            for (std::size_t tile = lo; tile < hi; ++tile) paintTile(tile);
+        });
+    } else {
+        for (std::size_t tile = 0; tile < tiles; ++tile) paintTile(tile);
+    }
+    return raster;
+}
+
+}
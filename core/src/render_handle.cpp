@@ -0,0 +1,91 @@
+#include "openperf/render_handle.hpp"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace openperf {
+
+struct RenderHandle::State {
+    explicit State(std::string id) : pageId(std::move(id)) {}
+
+    const std::string pageId;
+    mutable std::mutex mutex;
+    mutable std::condition_variable readyCv;
+    bool ready = false;
+    RenderResult result;             // written once, before ready is set
+    std::function<bool()> canceller; // guarded by mutex
+};
+
+const std::string& RenderHandle::pageId() const {
+    static const std::string kNone;
+    return state_ ? state_->pageId : kNone;
+}
+
+bool RenderHandle::ready() const {
+    if (!state_) return false;
+    std::lock_guard<std::mutex> lock{state_->mutex};
+    return state_->ready;
+}
+
+const RenderResult& RenderHandle::wait() const {
+    if (!state_) {
+        static const RenderResult kNone = [] {
+            RenderResult result;
+            result.status = RenderStatus::Cancelled;
+            return result;
+        }();
+        return kNone;
+    }
+    std::unique_lock<std::mutex> lock{state_->mutex};
+    state_->readyCv.wait(lock, [&] { return state_->ready; });
+    return state_->result;
+}
+
+bool RenderHandle::waitFor(std::chrono::steady_clock::duration timeout) const {
+    if (!state_) return false;
+    std::unique_lock<std::mutex> lock{state_->mutex};
+    return state_->readyCv.wait_for(lock, timeout, [&] { return state_->ready; });
+}
+
+bool RenderHandle::cancel() {
+    if (!state_) return false;
+    std::function<bool()> canceller;
+    {
+        std::lock_guard<std::mutex> lock{state_->mutex};
+        if (state_->ready) return false;
+        canceller = state_->canceller;
+    }
+    // outside the lock: a render dropped from the admission queue completes
+    // the handle on this thread
+    return canceller && canceller();
+}
+
+RenderPromise::RenderPromise(std::string pageId) : state_(std::make_shared<RenderHandle::State>(std::move(pageId))) {}
+
+void RenderPromise::setCanceller(std::function<bool()> cancel) {
+    std::lock_guard<std::mutex> lock{state_->mutex};
+    if (!state_->ready) state_->canceller = std::move(cancel);
+}
+
+void RenderPromise::complete(RenderResult result) const {
+    {
+        std::lock_guard<std::mutex> lock{state_->mutex};
+        if (state_->ready) return;
+        state_->result = std::move(result);
+        state_->ready = true;
+        state_->canceller = nullptr; // may hold the engine's job
+    }
+    state_->readyCv.notify_all();
+}
+
+RenderCallback RenderPromise::callback() const {
+    return [promise = *this](RenderResult result) { promise.complete(std::move(result)); };
+}
+
+void waitAll(const std::vector<RenderHandle>& handles) {
+    for (const auto& handle : handles) {
+        if (handle.valid()) handle.wait();
+    }
+}
+
+}
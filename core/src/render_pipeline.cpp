@@ -0,0 +1,286 @@
+#include "openperf/render_pipeline.hpp"
+#include "openperf/trace.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace openperf {
+
+struct RenderPipeline::JobState {
+    std::shared_ptr<RenderJob> job;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> pending; // unmet deps per stage
+    std::atomic<std::size_t> remaining{0};                 // stages not yet finished
+};
+
+// Keeps an upstream stage slot occupied while its output waits in a full
+// downstream queue. Destroying the last reference frees the slot.
+struct RenderPipeline::SlotHold {
+    SlotHold(RenderPipeline* p, StageId s) : pipeline(p), stage(s) {}
+    ~SlotHold() {
+        if (!pipeline->destroying_.load(std::memory_order_acquire)) pipeline->releaseSlot(stage);
+    }
+
+    RenderPipeline* pipeline;
+    StageId stage;
+};
+
+RenderPipeline::RenderPipeline(TaskScheduler& scheduler)
+    : scheduler_(scheduler) {}
+
+RenderPipeline::~RenderPipeline() {
+    destroying_.store(true, std::memory_order_release);
+}
+
+RenderPipeline::StageId RenderPipeline::addStage(std::string name, StageFn fn,
+                                                 StageOptions options,
+                                                 std::vector<StageId> dependsOn) {
+    StageId id = stages_.size();
+    auto stage = std::make_unique<Stage>();
+    stage->name = std::move(name);
+    stage->traceName = Tracer::global().intern(stage->name);
+    stage->fn = std::move(fn);
+    stage->options = options;
+    stage->predecessorCount = static_cast<std::uint32_t>(dependsOn.size());
+
+    bool bounded = options.maxConcurrency != 0 && options.queueCapacity != 0;
+    for (StageId dep : dependsOn) {
+        if (dep >= id) throw std::invalid_argument("stage dependency must be added first");
+        stages_[dep]->successors.push_back(id);
+        stages_[dep]->successorMayBlock |= bounded;
+    }
+
+    if (dependsOn.empty()) roots_.push_back(id);
+    stages_.push_back(std::move(stage));
+    return id;
+}
+
+bool RenderPipeline::submit(std::shared_ptr<RenderJob> job) {
+    const auto& limits = admission_;
+    if (limits.maxInFlight == 0) {
+        inFlightJobs_.fetch_add(1, std::memory_order_acq_rel);
+        start(std::move(job));
+        return true;
+    }
+
+    const auto lane = static_cast<std::size_t>(job->options.priority);
+    std::shared_ptr<RenderJob> shed;
+    {
+        std::unique_lock<std::mutex> lock{admissionMutex_};
+        for (;;) {
+            // a free slot goes to the queue first, so admission stays FIFO
+            if (waitingCount_ == 0 && inFlightJobs_.load(std::memory_order_relaxed) < limits.maxInFlight) {
+                inFlightJobs_.fetch_add(1, std::memory_order_acq_rel);
+                lock.unlock();
+                start(std::move(job));
+                return true;
+            }
+            if (waitingCount_ < limits.queueCapacity) break;
+
+            if (limits.policy == AdmissionPolicy::Reject) return false;
+            if (limits.policy == AdmissionPolicy::ShedOldest) {
+                // the oldest of the least urgent jobs, never one more urgent than this
+                std::size_t victim = kTaskPriorities;
+                while (victim > lane && waiting_[victim - 1].empty()) --victim;
+                if (victim == lane) return false; // nothing to shed
+                auto& from = waiting_[victim - 1];
+                shed = std::move(from.front());
+                from.pop_front();
+                --waitingCount_;
+                // reported as shed, so a later cancel() finds it started
+                shed->phase.store(RenderJob::Phase::Running, std::memory_order_release);
+                break;
+            }
+            // Block; a worker waiting here could be the one the queue needs,
+            // and queueing past the capacity would leave it unbounded
+            if (scheduler_.currentWorkerIndex() >= 0) return false;
+            roomCv_.wait(lock);
+        }
+        waiting_[lane].push_back(std::move(job));
+        queuedJobs_.store(++waitingCount_, std::memory_order_relaxed);
+    }
+
+    if (shed && onShed_) onShed_(*shed);
+    return true;
+}
+
+RenderPipeline::CancelResult RenderPipeline::cancel(const std::shared_ptr<RenderJob>& job) {
+    if (admission_.maxInFlight != 0) {
+        std::unique_lock<std::mutex> lock{admissionMutex_};
+        auto& queue = waiting_[static_cast<std::size_t>(job->options.priority)];
+        if (auto it = std::find(queue.begin(), queue.end(), job); it != queue.end()) {
+            queue.erase(it);
+            queuedJobs_.store(--waitingCount_, std::memory_order_relaxed);
+            job->phase.store(RenderJob::Phase::Cancelled, std::memory_order_release);
+            lock.unlock();
+            if (admission_.policy == AdmissionPolicy::Block) roomCv_.notify_one();
+            return CancelResult::Dequeued;
+        }
+    }
+
+    // admitted, or about to be: whichever of this and the first stage's
+    // start comes first decides
+    auto pending = RenderJob::Phase::Pending;
+    if (job->phase.compare_exchange_strong(pending, RenderJob::Phase::Cancelled, std::memory_order_acq_rel)) {
+        return CancelResult::Skipped;
+    }
+    return CancelResult::Started;
+}
+
+void RenderPipeline::start(std::shared_ptr<RenderJob> job) {
+    auto state = std::make_shared<JobState>();
+    state->job = std::move(job);
+    state->job->stages.assign(stages_.size(), StageTiming{});
+    state->pending = std::make_unique<std::atomic<std::uint32_t>[]>(stages_.size());
+    for (StageId i = 0; i < stages_.size(); ++i) {
+        state->pending[i].store(stages_[i]->predecessorCount, std::memory_order_relaxed);
+    }
+    state->remaining.store(stages_.size(), std::memory_order_release);
+
+    if (stages_.empty()) {
+        if (onComplete_) onComplete_(*state->job);
+        finished();
+        return;
+    }
+
+    for (StageId root : roots_) deliver(root, state, nullptr);
+}
+
+void RenderPipeline::finished() {
+    if (admission_.maxInFlight == 0) {
+        inFlightJobs_.fetch_sub(1, std::memory_order_acq_rel);
+        return;
+    }
+
+    // the slot passes straight to the longest-waiting job of the lane whose turn it is
+    std::shared_ptr<RenderJob> next;
+    {
+        std::lock_guard<std::mutex> lock{admissionMutex_};
+        if (waitingCount_ != 0) {
+            const auto first = static_cast<std::size_t>(firstLaneForTurn(admissionTurn_++));
+            for (std::size_t i = 0; i < kTaskPriorities; ++i) {
+                auto& queue = waiting_[(first + i) % kTaskPriorities];
+                if (queue.empty()) continue;
+                next = std::move(queue.front());
+                queue.pop_front();
+                break;
+            }
+            queuedJobs_.store(--waitingCount_, std::memory_order_relaxed);
+        } else {
+            inFlightJobs_.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+    if (admission_.policy == AdmissionPolicy::Block) roomCv_.notify_one();
+    if (next) start(std::move(next));
+}
+
+void RenderPipeline::deliver(StageId id, std::shared_ptr<JobState> job,
+                             const std::shared_ptr<SlotHold>& hold) {
+    Stage& stage = *stages_[id];
+    std::unique_lock<std::mutex> lock{stage.mutex};
+
+    const auto& opts = stage.options;
+    if (opts.maxConcurrency == 0 || stage.running < opts.maxConcurrency) {
+        ++stage.running;
+        lock.unlock();
+        schedule(id, std::move(job));
+        return;
+    }
+
+    // roots are bounded by maxInFlight rather than by their queue
+    if (opts.queueCapacity == 0 || stage.queue.size() < opts.queueCapacity || !hold) {
+        stage.queue.push_back(std::move(job));
+        return;
+    }
+
+    stage.blocked.push_back(Blocked{std::move(job), hold});
+}
+
+void RenderPipeline::schedule(StageId id, std::shared_ptr<JobState> job) {
+    // the deadline is checked by the first stage, which reports the job
+    // expired; a stage task dropped by a stopping scheduler still has to
+    // finish the job, cancelled
+    TaskOptions options;
+    options.priority = job->job->options.priority;
+    options.node = job->job->options.node;
+    scheduler_.enqueue([this, id, job] { run(id, job); }, options, [this, id, job] { run(id, job, true); });
+}
+
+void RenderPipeline::run(StageId id, const std::shared_ptr<JobState>& job, bool dropped) {
+    Stage& stage = *stages_[id];
+    auto& timing = job->job->stages[id];
+
+    timing.start = std::chrono::steady_clock::now();
+    auto phase = RenderJob::Phase::Pending;
+    if (dropped) {
+        // an expired job stays expired
+        using Phase = RenderJob::Phase;
+        phase = job->job->phase.load(std::memory_order_acquire);
+        while (phase != Phase::Expired && phase != Phase::Cancelled &&
+               !job->job->phase.compare_exchange_weak(phase, Phase::Cancelled, std::memory_order_acq_rel)) {
+        }
+        if (phase != Phase::Expired) phase = Phase::Cancelled;
+    } else {
+        const auto next =
+            timing.start > job->job->options.deadline ? RenderJob::Phase::Expired : RenderJob::Phase::Running;
+        if (job->job->phase.compare_exchange_strong(phase, next, std::memory_order_acq_rel)) phase = next;
+    }
+
+    if (phase == RenderJob::Phase::Running) stage.fn(*job->job);
+    timing.end = std::chrono::steady_clock::now();
+    if (OPENPERF_TRACING_ON()) {
+        Tracer::global().complete("render", stage.traceName, Tracer::toNs(timing.start), Tracer::toNs(timing.end));
+    }
+
+    std::shared_ptr<SlotHold> hold;
+    if (stage.successorMayBlock) hold = std::make_shared<SlotHold>(this, id);
+
+    for (StageId next : stage.successors) {
+        if (job->pending[next].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            deliver(next, job, hold);
+        }
+    }
+
+    bool last = job->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+
+    if (hold) {
+        hold.reset(); // frees the slot unless a blocked successor still holds it
+    } else {
+        releaseSlot(id);
+    }
+
+    if (last) {
+        if (onComplete_) onComplete_(*job->job);
+        finished();
+    }
+}
+
+void RenderPipeline::releaseSlot(StageId id) {
+    Stage& stage = *stages_[id];
+    std::shared_ptr<JobState> next;
+    std::shared_ptr<SlotHold> freed;
+
+    {
+        std::lock_guard<std::mutex> lock{stage.mutex};
+        if (!stage.queue.empty()) {
+            // slot passes straight to the next queued job
+            next = std::move(stage.queue.front());
+            stage.queue.pop_front();
+            if (!stage.blocked.empty()) {
+                stage.queue.push_back(std::move(stage.blocked.front().job));
+                freed = std::move(stage.blocked.front().hold);
+                stage.blocked.pop_front();
+            }
+        } else if (!stage.blocked.empty()) {
+            next = std::move(stage.blocked.front().job);
+            freed = std::move(stage.blocked.front().hold);
+            stage.blocked.pop_front();
+        } else {
+            --stage.running;
+        }
+    }
+
+    freed.reset(); // may free an upstream slot; done outside our lock
+    if (next) schedule(id, std::move(next));
+}
+
+}
@@ -0,0 +1,161 @@
+#include "openperf/result_cache.hpp"
+
+#include "openperf/flat_document.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace openperf {
+
+namespace {
+
+// SipHash-2-4 over 64-bit words, keyed per process. Content hashes only
+// ever meet other hashes from the same process, and pages come from
+// clients: with an unkeyed hash one client could craft a page that
+// collides with another's and be served its cached results.
+class SipHasher {
+public:
+    SipHasher() {
+        const auto& k = key();
+        v0_ = k[0] ^ 0x736f6d6570736575ull;
+        v1_ = k[1] ^ 0x646f72616e646f6dull;
+        v2_ = k[0] ^ 0x6c7967656e657261ull;
+        v3_ = k[1] ^ 0x7465646279746573ull;
+    }
+
+    void add(std::uint64_t m) {
+        v3_ ^= m;
+        round();
+        round();
+        v0_ ^= m;
+        ++words_;
+    }
+
+    // length first, so adjacent fields can't trade bytes
+    void add(std::string_view s) {
+        add(s.size());
+        std::size_t i = 0;
+        for (; i + 8 <= s.size(); i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, s.data() + i, 8);
+            add(word);
+        }
+        if (i < s.size()) {
+            std::uint64_t word = 0;
+            std::memcpy(&word, s.data() + i, s.size() - i);
+            add(word);
+        }
+    }
+
+    void add(const Style& s) {
+        add(static_cast<std::uint64_t>(s.display) | static_cast<std::uint64_t>(s.position) << 8 |
+            static_cast<std::uint64_t>(s.flexDirection) << 16);
+        add(std::uint64_t{std::bit_cast<std::uint32_t>(s.width)} << 32 | std::bit_cast<std::uint32_t>(s.height));
+        add(std::uint64_t{std::bit_cast<std::uint32_t>(s.left)} << 32 | std::bit_cast<std::uint32_t>(s.top));
+        add(std::uint64_t{std::bit_cast<std::uint32_t>(s.margin)} << 32 | std::bit_cast<std::uint32_t>(s.padding));
+        add(std::uint64_t{std::bit_cast<std::uint32_t>(s.flexGrow)} << 32 |
+            std::bit_cast<std::uint32_t>(s.borderWidth));
+        add(std::uint64_t{s.background} << 32 | s.borderColor);
+    }
+
+    std::uint64_t finish() {
+        const std::uint64_t b = (words_ * 8) << 56;
+        v3_ ^= b;
+        round();
+        round();
+        v0_ ^= b;
+        v2_ ^= 0xff;
+        for (int i = 0; i < 4; ++i) round();
+        return v0_ ^ v1_ ^ v2_ ^ v3_;
+    }
+
+private:
+    static const std::array<std::uint64_t, 2>& key() {
+        static const std::array<std::uint64_t, 2> k = [] {
+            std::random_device random;
+            std::array<std::uint64_t, 2> bits{};
+            for (auto& word : bits) word = std::uint64_t{random()} << 32 | random();
+            return bits;
+        }();
+        return k;
+    }
+
+    void round() {
+        v0_ += v1_;
+        v1_ = std::rotl(v1_, 13) ^ v0_;
+        v0_ = std::rotl(v0_, 32);
+        v2_ += v3_;
+        v3_ = std::rotl(v3_, 16) ^ v2_;
+        v0_ += v3_;
+        v3_ = std::rotl(v3_, 21) ^ v0_;
+        v2_ += v1_;
+        v1_ = std::rotl(v1_, 17) ^ v2_;
+        v2_ = std::rotl(v2_, 32);
+    }
+
+    std::uint64_t v0_, v1_, v2_, v3_;
+    std::uint64_t words_ = 0;
+};
+
+}
+
+ContentHash hashTree(const Node& root) {
+    // pre-order with child counts determines the shape
+    ContentHash result;
+    SipHasher h;
+    std::vector<const Node*> stack{&root};
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+        ++result.nodes;
+
+        h.add(n->tag);
+        h.add(n->id);
+        h.add(n->text);
+        h.add(n->role);
+        h.add(n->ariaLabel);
+        h.add(n->style);
+
+        std::uint64_t children = 0;
+        for (auto it = n->children.rbegin(); it != n->children.rend(); ++it) {
+            if (!*it) continue;
+            stack.push_back(it->get());
+            ++children;
+        }
+        h.add((children << 1) | (n->isInteractive ? 1 : 0));
+    }
+
+    result.value = h.finish();
+    return result;
+}
+
+ContentHash hashDocument(const FlatDocument& doc) {
+    ContentHash result;
+    if (doc.empty()) return result;
+    SipHasher h;
+    // document order is the pre-order hashTree walks in
+    for (NodeIndex i = 0; i < doc.subtreeEnd(doc.root()); ++i) {
+        ++result.nodes;
+
+        h.add(doc.tagName(i));
+        h.add(doc.id(i));
+        h.add(doc.text(i));
+        h.add(doc.roleName(i));
+        h.add(doc.ariaLabel(i));
+        h.add(doc.style(i));
+
+        std::uint64_t children = 0;
+        for (NodeIndex c = doc.firstChild(i); c != kInvalidNode; c = doc.nextSibling(c)) ++children;
+        h.add((children << 1) | (doc.isInteractive(i) ? 1 : 0));
+    }
+
+    result.value = h.finish();
+    return result;
+}
+
+}
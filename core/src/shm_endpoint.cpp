@@ -0,0 +1,418 @@
+#include "openperf/shm_endpoint.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace openperf {
+
+namespace detail {
+
+struct ShmRing {
+    alignas(64) std::atomic<std::uint64_t> head{0}; // bytes published by the producer
+    alignas(64) std::atomic<std::uint64_t> tail{0}; // bytes released by the consumer
+
+    // futex words, bumped on every publish/release; waiters counts tell the
+    // other side whether a wake syscall is needed
+    alignas(64) std::atomic<std::uint32_t> dataSeq{0};
+    std::atomic<std::uint32_t> dataWaiters{0};
+    alignas(64) std::atomic<std::uint32_t> spaceSeq{0};
+    std::atomic<std::uint32_t> spaceWaiters{0};
+};
+
+// Lives at the start of the mapping, followed by the two rings' data. The
+// peer can write any of it, so each side keeps its own copy of ringBytes.
+struct ShmRegion {
+    std::atomic<std::uint32_t> magic{0}; // set last by the server
+    std::uint32_t version = 0;
+    std::uint64_t ringBytes = 0; // power of two
+    std::atomic<std::uint32_t> closed{0};
+    // Set by the client that holds the attach lock, see clientDied().
+    std::atomic<std::uint32_t> clientAttached{0};
+    ShmRing requests;
+    ShmRing replies;
+
+    char* requestData() { return reinterpret_cast<char*>(this + 1); }
+    char* replyData(std::size_t ringBytes) { return requestData() + ringBytes; }
+};
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+}
+
+namespace {
+
+using detail::ShmRegion;
+using detail::ShmRing;
+
+constexpr std::uint32_t kMagic = 0x4f50534d; // "OPSM"
+constexpr std::uint32_t kVersion = 3;
+
+// Busy-wait iterations before sleeping on the futex. A round trip on an
+// idle link typically completes within the spin. On a single core the peer
+// cannot make progress while we spin, so we only yield there.
+constexpr int kSpinIterations = 4096;
+constexpr int kYieldRounds = 16;
+
+int spinIterations() {
+    static const int spins = std::thread::hardware_concurrency() > 1 ? kSpinIterations : 0;
+    return spins;
+}
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Process-shared (non-private) futex ops on a word inside the mapping.
+void futexWait(std::atomic<std::uint32_t>& word, std::uint32_t expected) {
+    timespec timeout{0, 100'000'000}; // bounded so a vanished peer is noticed
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<std::uint32_t>& word) {
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void signal(std::atomic<std::uint32_t>& seq, std::atomic<std::uint32_t>& waiters) {
+    seq.fetch_add(1, std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_seq_cst) != 0) futexWakeAll(seq);
+}
+
+// The attached client holds an open-file-description write lock on the
+// region's first byte for as long as it keeps the region open, and the
+// server one on the second byte for as long as it serves it. The kernel
+// drops them when their process exits, however it exits.
+constexpr off_t kClientLockByte = 0;
+constexpr off_t kServerLockByte = 1;
+
+struct flock regionLock(off_t byte) {
+    struct flock lock{};
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = byte;
+    lock.l_len = 1;
+    return lock;
+}
+
+// True if no other open file description holds the lock on `byte`.
+bool lockReleased(int fd, off_t byte) {
+    struct flock lock = regionLock(byte);
+    return ::fcntl(fd, F_OFD_GETLK, &lock) == 0 && lock.l_type == F_UNLCK;
+}
+
+// True if a client attached and its attach lock has since been dropped.
+bool clientDied(const ShmRegion& region, int fd) {
+    return region.clientAttached.load(std::memory_order_acquire) != 0 && lockReleased(fd, kClientLockByte);
+}
+
+// True if the server process is gone without having closed the region.
+bool serverDied(int fd) {
+    return lockReleased(fd, kServerLockByte);
+}
+
+// Spins, then sleeps on `seq` until ready() holds. False once the region is
+// closed or peerGone() reports the other side dead.
+template <class Ready, class PeerGone>
+bool waitUntil(const ShmRegion& region, std::atomic<std::uint32_t>& seq,
+               std::atomic<std::uint32_t>& waiters, Ready ready, PeerGone peerGone) {
+    for (int i = 0, spins = spinIterations(); i < spins; ++i) {
+        if (ready()) return true;
+        cpuRelax();
+    }
+    for (int i = 0; i < kYieldRounds; ++i) {
+        if (ready()) return true;
+        std::this_thread::yield();
+    }
+
+    while (true) {
+        auto seen = seq.load(std::memory_order_acquire);
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        bool isReady = ready();
+        bool isClosed = region.closed.load(std::memory_order_acquire) != 0;
+        if (!isReady && !isClosed) futexWait(seq, seen);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+
+        if (isReady || ready()) return true;
+        if (isClosed) return false;
+        if (peerGone()) return false;
+    }
+}
+
+void copyIn(char* ring, std::uint64_t mask, std::uint64_t pos, const char* src, std::size_t n) {
+    auto offset = static_cast<std::size_t>(pos & mask);
+    auto first = std::min<std::size_t>(n, mask + 1 - offset);
+    std::memcpy(ring + offset, src, first);
+    std::memcpy(ring, src + first, n - first);
+}
+
+void copyOut(const char* ring, std::uint64_t mask, std::uint64_t pos, char* dst, std::size_t n) {
+    auto offset = static_cast<std::size_t>(pos & mask);
+    auto first = std::min<std::size_t>(n, mask + 1 - offset);
+    std::memcpy(dst, ring + offset, first);
+    std::memcpy(dst + first, ring, n - first);
+}
+
+// Publishes one whole frame; false if the region was closed, or the peer
+// gone, first. `capacity` is this side's ring size, never the region's.
+template <class PeerGone>
+bool writeFrame(ShmRegion& region, ShmRing& ring, char* data, std::size_t capacity, const std::string& frame,
+                PeerGone peerGone) {
+    if (frame.size() > capacity) throw wire::WireError("frame larger than the shared-memory ring");
+
+    auto head = ring.head.load(std::memory_order_relaxed); // only this side writes it
+    bool ok = waitUntil(
+        region, ring.spaceSeq, ring.spaceWaiters,
+        [&] {
+            auto used = head - ring.tail.load(std::memory_order_acquire);
+            if (used > capacity) throw wire::WireError("corrupt shared-memory ring");
+            return capacity - used >= frame.size();
+        },
+        peerGone);
+    if (!ok) return false;
+
+    copyIn(data, capacity - 1, head, frame.data(), frame.size());
+    ring.head.store(head + frame.size(), std::memory_order_release);
+    signal(ring.dataSeq, ring.dataWaiters);
+    return true;
+}
+
+// Consumes one frame; false if the region was closed, or the peer gone,
+// first. The producer's head and header are checked against this side's
+// `capacity` before anything is copied out.
+template <class PeerGone>
+bool readFrame(ShmRegion& region, ShmRing& ring, const char* data, std::size_t capacity,
+               wire::FrameHeader& header, std::string& payload, PeerGone peerGone) {
+    auto tail = ring.tail.load(std::memory_order_relaxed); // only this side writes it
+    std::uint64_t head = 0;
+    bool ok = waitUntil(
+        region, ring.dataSeq, ring.dataWaiters,
+        [&] {
+            head = ring.head.load(std::memory_order_acquire);
+            return head != tail;
+        },
+        peerGone);
+    if (!ok) return false;
+
+    // the producer publishes whole frames, never more than the ring holds
+    const auto available = head - tail;
+    if (available > capacity || available < wire::kHeaderSize) throw wire::WireError("corrupt shared-memory ring");
+    char raw[wire::kHeaderSize];
+    copyOut(data, capacity - 1, tail, raw, sizeof(raw));
+    header = wire::decodeHeader(raw);
+    if (header.length > capacity - wire::kHeaderSize || available < wire::kHeaderSize + header.length) {
+        throw wire::WireError("corrupt shared-memory ring");
+    }
+
+    payload.resize(header.length);
+    copyOut(data, capacity - 1, tail + wire::kHeaderSize, payload.data(), header.length);
+    ring.tail.store(tail + wire::kHeaderSize + header.length, std::memory_order_release);
+    signal(ring.spaceSeq, ring.spaceWaiters);
+    return true;
+}
+
+[[noreturn]] void throwErrno(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace
+
+// ShmEndpointServer
+
+ShmEndpointServer::ShmEndpointServer(IEngineEndpoint& endpoint, std::string name, std::size_t ringBytes,
+                                     TreeLimits limits)
+    : endpoint_(endpoint),
+      name_(std::move(name)),
+      ringBytes_(std::bit_ceil(std::max<std::size_t>(ringBytes, 4096))),
+      limits_(limits) {}
+
+ShmEndpointServer::~ShmEndpointServer() {
+    stop();
+}
+
+void ShmEndpointServer::start() {
+    if (running_) return;
+
+    ::shm_unlink(name_.c_str()); // stale region from a previous run
+    int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) throwErrno("shm_open " + name_);
+
+    mappedBytes_ = sizeof(ShmRegion) + 2 * ringBytes_;
+    if (::ftruncate(fd, static_cast<off_t>(mappedBytes_)) < 0) {
+        int err = errno;
+        ::close(fd);
+        ::shm_unlink(name_.c_str());
+        throw std::system_error(err, std::generic_category(), "ftruncate " + name_);
+    }
+    void* addr = ::mmap(nullptr, mappedBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        ::shm_unlink(name_.c_str());
+        throw std::system_error(err, std::generic_category(), "mmap " + name_);
+    }
+    struct flock lock = regionLock(kServerLockByte);
+    if (::fcntl(fd, F_OFD_SETLK, &lock) != 0) {
+        int err = errno;
+        ::munmap(addr, mappedBytes_);
+        ::close(fd);
+        ::shm_unlink(name_.c_str());
+        throw std::system_error(err, std::generic_category(), "lock " + name_);
+    }
+    fd_ = fd; // holds the server lock and looks for the client's
+
+    region_ = new (addr) ShmRegion();
+    region_->version = kVersion;
+    region_->ringBytes = ringBytes_;
+    region_->magic.store(kMagic, std::memory_order_release);
+
+    running_ = true;
+    thread_ = std::thread([this] { serveLoop(); });
+}
+
+void ShmEndpointServer::stop() {
+    if (!running_.exchange(false)) return;
+
+    region_->closed.store(1, std::memory_order_seq_cst);
+    for (auto* ring : {&region_->requests, &region_->replies}) {
+        ring->dataSeq.fetch_add(1, std::memory_order_seq_cst);
+        ring->spaceSeq.fetch_add(1, std::memory_order_seq_cst);
+        futexWakeAll(ring->dataSeq);
+        futexWakeAll(ring->spaceSeq);
+    }
+    if (thread_.joinable()) thread_.join();
+    ::close(fd_); // releases the server lock
+    fd_ = -1;
+
+    // a client still mapping the region keeps it alive until it unmaps
+    ::munmap(region_, mappedBytes_);
+    region_ = nullptr;
+    ::shm_unlink(name_.c_str());
+}
+
+void ShmEndpointServer::serveLoop() {
+    wire::FrameHeader header;
+    std::string payload;
+    wire::Writer reply;
+
+    const auto gone = [this] { return clientDied(*region_, fd_); };
+    try {
+        while (true) {
+            bool ok = readFrame(*region_, region_->requests, region_->requestData(), ringBytes_, header, payload,
+                                gone);
+            if (ok) {
+                wire::Reader in(payload.data(), payload.size());
+                reply.reset();
+                auto type = wire::handleRequest(endpoint_, header.type, in, reply, limits_);
+                ok = writeFrame(*region_, region_->replies, region_->replyData(ringBytes_), ringBytes_,
+                                reply.finish(type, header.requestId), gone);
+            }
+            if (ok) continue;
+            if (region_->closed.load(std::memory_order_acquire) != 0) break;
+
+            // the client died: drop its frames and let the next one attach
+            for (auto* ring : {&region_->requests, &region_->replies}) {
+                ring->head.store(0, std::memory_order_relaxed);
+                ring->tail.store(0, std::memory_order_relaxed);
+            }
+            region_->clientAttached.store(0, std::memory_order_release);
+        }
+    } catch (const std::exception&) {
+        // corrupt ring; close it so the client fails instead of hanging
+        region_->closed.store(1, std::memory_order_seq_cst);
+        futexWakeAll(region_->replies.dataSeq);
+    }
+}
+
+// ShmEndpointClient
+
+ShmEndpointClient::ShmEndpointClient(const std::string& name) {
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) throwErrno("shm_open " + name);
+
+    struct stat st{};
+    if (::fstat(fd, &st) < 0) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "fstat " + name);
+    }
+    mappedBytes_ = static_cast<std::size_t>(st.st_size);
+    if (mappedBytes_ < sizeof(ShmRegion)) {
+        ::close(fd);
+        throw wire::WireError(name + " is not an OpenPerf endpoint");
+    }
+
+    void* addr = ::mmap(nullptr, mappedBytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "mmap " + name);
+    }
+
+    // The lock comes first so the server never sees an attached client
+    // without one. clientAttached stays set after a client dies until the
+    // server has dropped its frames.
+    auto* region = static_cast<ShmRegion*>(addr);
+    struct flock lock = regionLock(kClientLockByte);
+    std::uint32_t expected = 0;
+    const char* problem = nullptr;
+    if (region->magic.load(std::memory_order_acquire) != kMagic || region->version != kVersion ||
+        mappedBytes_ != sizeof(ShmRegion) + 2 * region->ringBytes) {
+        problem = " is not an OpenPerf endpoint";
+    } else if (region->closed.load(std::memory_order_acquire) != 0 || serverDied(fd)) {
+        problem = " has no server";
+    } else if (::fcntl(fd, F_OFD_SETLK, &lock) != 0 ||
+               !region->clientAttached.compare_exchange_strong(expected, 1)) {
+        problem = " already has a client";
+    }
+    if (problem) {
+        ::munmap(addr, mappedBytes_);
+        ::close(fd);
+        throw wire::WireError(name + problem);
+    }
+    region_ = region;
+    fd_ = fd;
+    ringBytes_ = (mappedBytes_ - sizeof(ShmRegion)) / 2;
+}
+
+ShmEndpointClient::~ShmEndpointClient() {
+    if (!region_) return;
+    region_->clientAttached.store(0, std::memory_order_release);
+    ::munmap(region_, mappedBytes_);
+    ::close(fd_); // releases the attach lock
+}
+
+wire::FrameHeader ShmEndpointClient::roundTrip(const std::string& frame, std::string& replyPayload) const {
+    const auto gone = [this] { return serverDied(fd_); };
+    const auto failed = [this] {
+        return wire::WireError(region_->closed.load(std::memory_order_acquire) != 0
+                                   ? "shared-memory endpoint closed"
+                                   : "shared-memory endpoint's server died");
+    };
+    if (!writeFrame(*region_, region_->requests, region_->requestData(), ringBytes_, frame, gone)) throw failed();
+
+    wire::FrameHeader header;
+    if (!readFrame(*region_, region_->replies, region_->replyData(ringBytes_), ringBytes_, header, replyPayload,
+                   gone)) {
+        throw failed();
+    }
+    return header;
+}
+
+}
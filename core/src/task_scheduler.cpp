@@ -1,60 +1,481 @@
 #include "openperf/task_scheduler.hpp"
+#include "openperf/trace.hpp"
+
+#include <algorithm>
 
 namespace openperf {
 
-TaskScheduler::TaskScheduler(std::size_t workerCount) {
-    workers_.reserve(std::max(std::size_t{1}, workerCount));
+namespace {
+
+// Rounds of yield-and-retry an idle worker does before parking. Keeps
+// latency low for bursty submissions without burning a core forever.
+constexpr std::size_t kSpinRounds = 64;
+
+// Idle rounds before a worker takes work queued on or aimed at another
+// node; until then it leaves it to that node's workers.
+constexpr std::size_t kRemoteRounds = 16;
+
+// With metrics attached, 1 in this many tasks per thread and lane has its
+// queue wait recorded; timing every task would cost two clock reads each.
+constexpr std::uint32_t kWaitSampleInterval = 8;
+
+thread_local const TaskScheduler* tlsScheduler = nullptr;
+thread_local std::size_t tlsWorkerIndex = 0;
+thread_local TaskPriority tlsPriority = TaskPriority::Normal; // of the task running on this worker
+thread_local std::array<std::uint32_t, kTaskPriorities> tlsWaitSample{};
+
+constexpr auto kNoDeadline = std::chrono::steady_clock::time_point::max();
+
+std::uint64_t nextRandom(std::uint64_t& state) {
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+// Wraps `task` so its run is traced with the time it spent queued, linked by
+// a flow arrow to the enqueue span it is called from.
+Task traced(Task task) {
+    auto& tracer = Tracer::global();
+    const auto id = tracer.nextId();
+    const auto enqueuedNs = Tracer::now();
+    tracer.flowStart("scheduler", "task", id);
+    return [task = std::move(task), id, enqueuedNs] {
+        auto& tracer = Tracer::global();
+        const auto startNs = Tracer::now();
+        tracer.flowEnd("scheduler", "task", id);
+        task();
+        tracer.complete("scheduler", "run", startNs, Tracer::now(), "wait_ns", startNs - enqueuedNs);
+    };
+}
+
+} // namespace
+
+const char* toString(TaskPriority priority) {
+    switch (priority) {
+    case TaskPriority::Interactive:
+        return "interactive";
+    case TaskPriority::Normal:
+        return "normal";
+    case TaskPriority::Batch:
+        return "batch";
+    }
+    return "unknown";
+}
+
+bool parsePriority(std::string_view name, TaskPriority* out) {
+    for (std::size_t lane = 0; lane < kTaskPriorities; ++lane) {
+        if (name == toString(static_cast<TaskPriority>(lane))) {
+            *out = static_cast<TaskPriority>(lane);
+            return true;
+        }
+    }
+    return false;
+}
+
+TaskPriority firstLaneForTurn(std::uint64_t turn) {
+    if (turn % 16 == 15) return TaskPriority::Batch;
+    if (turn % 4 == 3) return TaskPriority::Normal;
+    return TaskPriority::Interactive;
+}
+
+const char* toString(WorkerAffinity affinity) {
+    switch (affinity) {
+    case WorkerAffinity::None:
+        return "none";
+    case WorkerAffinity::Node:
+        return "node";
+    case WorkerAffinity::Cpu:
+        return "cpu";
+    }
+    return "unknown";
+}
+
+bool parseAffinity(std::string_view name, WorkerAffinity* out) {
+    for (auto affinity : {WorkerAffinity::None, WorkerAffinity::Node, WorkerAffinity::Cpu}) {
+        if (name == toString(affinity)) {
+            *out = affinity;
+            return true;
+        }
+    }
+    return false;
+}
+
+TaskScheduler::TaskScheduler() : TaskScheduler(Options{}) {}
+
+TaskScheduler::TaskScheduler(std::size_t workerCount) : TaskScheduler([workerCount] {
+    Options options;
+    options.workers = std::max(std::size_t{1}, workerCount);
+    return options;
+}()) {}
+
+TaskScheduler::TaskScheduler(Options options)
+    : topology_(options.topology.empty() ? CpuTopology::detect() : std::move(options.topology)) {
+    if (auto rest = topology_.without(options.reservedCpus); !rest.empty()) topology_ = std::move(rest);
+    workerCount_ = options.workers > 0 ? options.workers : topology_.cpus().size();
+
+    // unpinned workers float over the whole topology as one group; they are
+    // only kept off reserved CPUs
+    const bool grouped = options.affinity != WorkerAffinity::None;
+    const auto placement = topology_.placementOrder();
+    nodeWorkers_.resize(grouped ? topology_.nodeCount() : 1);
+
+    workers_.reserve(workerCount_);
+    for (std::size_t i = 0; i < workerCount_; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->rngState = 0x9E3779B97F4A7C15ULL * (i + 1);
+        const CpuInfo& cpu = placement[i % placement.size()];
+        if (grouped) worker->node = cpu.node;
+        if (options.affinity == WorkerAffinity::Cpu) {
+            worker->cpus = {cpu.id};
+        } else if (options.affinity == WorkerAffinity::Node) {
+            worker->cpus = topology_.cpuIds(cpu.node);
+        } else if (!options.reservedCpus.empty()) {
+            worker->cpus = topology_.cpuIds();
+        }
+        nodeWorkers_[worker->node].push_back(i);
+        workers_.push_back(std::move(worker));
+    }
+
+    // a node can be left without workers when there are fewer workers than
+    // nodes; it then keeps only the shared queue
+    const std::size_t queues = nodeCount() > 1 ? nodeCount() + 1 : 1;
+    for (std::size_t i = 0; i < queues; ++i) injected_.push_back(std::make_unique<InjectionQueue>());
 }
 
 TaskScheduler::~TaskScheduler() {
     stop();
 }
 
+void TaskScheduler::attachMetrics(Metrics& metrics) {
+    metrics_ = &metrics;
+    for (std::size_t lane = 0; lane < kTaskPriorities; ++lane) {
+        const std::string name = toString(static_cast<TaskPriority>(lane));
+        waitMetrics_[lane] = metrics.registerMetric("task_wait_" + name + "_ms");
+        droppedMetrics_[lane] = metrics.registerMetric("task_dropped_" + name, MetricKind::Counter);
+    }
+}
+
 void TaskScheduler::start() {
-    running_ = true;
-    for (std::size_t i = 0; i < workers_.capacity(); ++i) {
-        workers_.emplace_back(&TaskScheduler::workerLoop, this);
+    if (running_.exchange(true)) return;
+    for (std::size_t i = 0; i < workerCount_; ++i) {
+        workers_[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
     }
 }
 
 void TaskScheduler::stop() {
     running_ = false;
-    cv_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock{parkMutex_};
+    }
+    parkCv_.notify_all();
     for (auto& w : workers_)
-        if (w.joinable())
-            w.join();
+        if (w->thread.joinable())
+            w->thread.join();
+
+    // anything submitted after the workers drained is dropped, but its
+    // owner still hears of it; the callbacks may queue more, taken the
+    // same way, and run outside the queue locks for that reason
+    std::vector<Entry*> dropped;
+    do {
+        dropped.clear();
+        for (auto& queue : injected_) {
+            std::lock_guard<std::mutex> lock{queue->mutex};
+            for (std::size_t lane = 0; lane < kTaskPriorities; ++lane) {
+                dropped.insert(dropped.end(), queue->lanes[lane].begin(), queue->lanes[lane].end());
+                queueDepth_.fetch_sub(queue->lanes[lane].size(), std::memory_order_relaxed);
+                queue->lanes[lane].clear();
+                queue->count[lane].store(0, std::memory_order_relaxed);
+            }
+        }
+        for (Entry* entry : dropped) {
+            std::unique_ptr<Entry> owned{entry};
+            if (owned->onExpired) owned->onExpired();
+        }
+    } while (!dropped.empty());
 }
 
 void TaskScheduler::enqueue(Task task) {
-    {
-        std::lock_guard<std::mutex> lock{mutex_};
-        queue_.emplace(std::move(task));
-        queueDepth_.store(queue_.size(), std::memory_order_relaxed);
+    TaskOptions options;
+    if (tlsScheduler == this) options.priority = tlsPriority;
+    enqueue(std::move(task), options);
+}
+
+void TaskScheduler::enqueue(Task task, TaskOptions options, Task onExpired) {
+    if (!task) return;
+    OPENPERF_TRACE_SPAN_ARG("scheduler", "enqueue", "depth", queueDepth_.load(std::memory_order_relaxed));
+    if (OPENPERF_TRACING_ON()) task = traced(std::move(task));
+    auto* entry = new Entry{std::move(task), std::move(onExpired), options.deadline, {}, options.priority};
+    const auto lane = static_cast<std::size_t>(options.priority);
+    if (metrics_ && tlsWaitSample[lane]++ % kWaitSampleInterval == 0) {
+        entry->enqueued = std::chrono::steady_clock::now();
+    }
+
+    // publish the depth before the task so it can never read as negative
+    queueDepth_.fetch_add(1, std::memory_order_seq_cst);
+
+    // a worker keeps the task unless it is aimed at another node; a node
+    // without workers is no target
+    int node = options.node;
+    if (node < 0 || static_cast<std::size_t>(node) >= nodeCount() || nodeWorkers_[node].empty()) node = -1;
+    if (tlsScheduler == this && (node < 0 || workers_[tlsWorkerIndex]->node == static_cast<std::size_t>(node))) {
+        workers_[tlsWorkerIndex]->deques[lane].push(entry);
+    } else {
+        auto& queue = injectionQueue(node);
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        queue.lanes[lane].push_back(entry);
+        queue.count[lane].fetch_add(1, std::memory_order_release);
     }
-    cv_.notify_one();
+
+    wakeOne();
+}
+
+bool TaskScheduler::tryEnqueue(Task task, std::size_t maxDepth) {
+    if (queueDepth_.load(std::memory_order_relaxed) >= maxDepth) return false;
+    enqueue(std::move(task));
+    return true;
+}
+
+bool TaskScheduler::tryEnqueue(Task task, std::size_t maxDepth, TaskOptions options, Task onExpired) {
+    if (queueDepth_.load(std::memory_order_relaxed) >= maxDepth) return false;
+    enqueue(std::move(task), options, std::move(onExpired));
+    return true;
 }
 
 std::size_t TaskScheduler::getQueueDepth() const {
     return queueDepth_.load(std::memory_order_relaxed);
 }
 
-void TaskScheduler::workerLoop() {
+int TaskScheduler::currentWorkerIndex() const {
+    return tlsScheduler == this ? static_cast<int>(tlsWorkerIndex) : -1;
+}
+
+int TaskScheduler::currentNode() const {
+    return tlsScheduler == this ? static_cast<int>(workers_[tlsWorkerIndex]->node) : -1;
+}
+
+void TaskScheduler::parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+                                const std::function<void(std::size_t, std::size_t)>& fn) {
+    if (begin >= end) return;
+    grain = std::max(std::size_t{1}, grain);
+    const std::size_t chunks = (end - begin + grain - 1) / grain;
+    if (chunks == 1 || !running_.load(std::memory_order_acquire)) {
+        fn(begin, end);
+        return;
+    }
+
+    // Helpers may start after the loop is over, so they share ownership of
+    // the state and only touch fn after claiming a chunk.
+    struct State {
+        std::atomic<std::size_t> next{0};
+        std::atomic<std::size_t> finished{0};
+        std::size_t chunks = 0;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+        std::size_t grain = 0;
+        const std::function<void(std::size_t, std::size_t)>* fn = nullptr;
+
+        // Claims and runs chunks until none are left.
+        void drain() {
+            for (std::size_t c; (c = next.fetch_add(1, std::memory_order_relaxed)) < chunks;) {
+                std::size_t lo = begin + c * grain;
+                (*fn)(lo, std::min(end, lo + grain));
+                if (finished.fetch_add(1, std::memory_order_acq_rel) + 1 == chunks) {
+                    finished.notify_all();
+                }
+            }
+        }
+    };
+
+    auto state = std::make_shared<State>();
+    state->chunks = chunks;
+    state->begin = begin;
+    state->end = end;
+    state->grain = grain;
+    state->fn = &fn;
+
+    std::size_t helpers = std::min(chunks - 1, workerCount_);
+    for (std::size_t i = 0; i < helpers; ++i) {
+        enqueue([state] { state->drain(); });
+    }
+    state->drain();
+
+    // only chunks already running elsewhere are left
+    for (auto done = state->finished.load(std::memory_order_acquire); done < chunks;
+         done = state->finished.load(std::memory_order_acquire)) {
+        state->finished.wait(done, std::memory_order_acquire);
+    }
+}
+
+void TaskScheduler::workerLoop(std::size_t index) {
+    tlsScheduler = this;
+    tlsWorkerIndex = index;
+    Tracer::global().setThreadName("worker " + std::to_string(index));
+    // pinned before the first task, so everything it allocates is first
+    // touched on its node
+    const auto& cpus = workers_[index]->cpus;
+    if (!cpus.empty() && pinCurrentThread(cpus)) pinnedWorkers_.fetch_add(1, std::memory_order_relaxed);
+
+    std::size_t idleRounds = 0;
     while (true) {
-        Task task;
+        // once stopping, every node's work is fair game: that node's own
+        // workers may have exited already
+        const bool stopping = !running_.load(std::memory_order_acquire);
+        if (Entry* entry = findTask(index, stopping || idleRounds >= kRemoteRounds)) {
+            std::unique_ptr<Entry> owned{entry};
+            run(*owned);
+            idleRounds = 0;
+            continue;
+        }
 
-        {
-            std::unique_lock<std::mutex> lock{mutex_};
-            cv_.wait(lock, [&]{ return !running_ || !queue_.empty(); });
+        if (stopping) break;
 
-            if (!running_ && queue_.empty()) return;
+        if (++idleRounds < kSpinRounds) {
+            std::this_thread::yield();
+            continue;
+        }
+        idleRounds = 0;
+        park();
+    }
 
-            task = std::move(queue_.front());
-            queue_.pop();
-            queueDepth_.store(queue_.size(), std::memory_order_relaxed);
+    tlsScheduler = nullptr;
+}
+
+void TaskScheduler::run(Entry& entry) {
+    const auto lane = static_cast<std::size_t>(entry.priority);
+    const bool sampled = entry.enqueued != std::chrono::steady_clock::time_point{};
+    if (sampled || entry.deadline != kNoDeadline) {
+        using ms = std::chrono::duration<double, std::milli>;
+        const auto now = std::chrono::steady_clock::now();
+        if (now > entry.deadline) {
+            if (metrics_) metrics_->record(droppedMetrics_[lane], 1);
+            OPENPERF_TRACE_INSTANT("scheduler", "expired", "lane", lane);
+            if (entry.onExpired) entry.onExpired();
+            return;
         }
+        if (sampled) metrics_->record(waitMetrics_[lane], ms(now - entry.enqueued).count());
+    }
 
-        if (task) task();
+    tlsPriority = entry.priority;
+    entry.task();
+}
+
+TaskScheduler::Entry* TaskScheduler::findTask(std::size_t index, bool remote) {
+    Worker& worker = *workers_[index];
+    const auto first = static_cast<std::size_t>(firstLaneForTurn(worker.turn));
+
+    Entry* entry = nullptr;
+    // own deque, injection queue, stolen on the node, stolen from another
+    // node, another node's injection queue
+    int source = 0;
+    for (std::size_t i = 0; i < kTaskPriorities && !entry; ++i) {
+        entry = findInLane(index, (first + i) % kTaskPriorities, remote, source);
     }
+
+    if (entry) {
+        ++worker.turn;
+        queueDepth_.fetch_sub(1, std::memory_order_relaxed);
+        OPENPERF_TRACE_INSTANT("scheduler", "dequeue", "source", source);
+    }
+    return entry;
 }
 
-}
\ No newline at end of file
+TaskScheduler::Entry* TaskScheduler::findInLane(std::size_t index, std::size_t lane, bool remote, int& source) {
+    Worker& worker = *workers_[index];
+    if (auto local = worker.deques[lane].pop()) {
+        source = 0;
+        return *local;
+    }
+    const bool numa = nodeCount() > 1;
+    if (Entry* entry = popInjected(injectionQueue(static_cast<int>(worker.node)), lane)) {
+        source = 1;
+        return entry;
+    }
+    if (numa) {
+        if (Entry* entry = popInjected(injectionQueue(-1), lane)) {
+            source = 1;
+            return entry;
+        }
+    }
+    if (Entry* entry = stealFrom(index, lane, false)) {
+        source = 2;
+        return entry;
+    }
+    if (!numa || !remote) return nullptr;
+
+    if (Entry* entry = stealFrom(index, lane, true)) {
+        source = 3;
+        return entry;
+    }
+    for (std::size_t node = 0; node < nodeCount(); ++node) {
+        if (node == worker.node) continue;
+        if (Entry* entry = popInjected(*injected_[node], lane)) {
+            source = 4;
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+TaskScheduler::Entry* TaskScheduler::popInjected(InjectionQueue& queue, std::size_t lane) {
+    if (queue.count[lane].load(std::memory_order_acquire) == 0) return nullptr;
+
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    if (queue.lanes[lane].empty()) return nullptr;
+    Entry* entry = queue.lanes[lane].front();
+    queue.lanes[lane].pop_front();
+    queue.count[lane].fetch_sub(1, std::memory_order_relaxed);
+    return entry;
+}
+
+TaskScheduler::Entry* TaskScheduler::stealFrom(std::size_t thief, std::size_t lane, bool remote) {
+    // victims on the thief's node, or with `remote` on every other node
+    const std::size_t home = workers_[thief]->node;
+    if (!remote) {
+        const auto& peers = nodeWorkers_[home];
+        if (peers.size() < 2) return nullptr;
+        auto start = static_cast<std::size_t>(nextRandom(workers_[thief]->rngState) % peers.size());
+        for (std::size_t i = 0; i < peers.size(); ++i) {
+            std::size_t victim = peers[(start + i) % peers.size()];
+            if (victim == thief) continue;
+            if (auto stolen = workers_[victim]->deques[lane].steal()) return *stolen;
+        }
+        return nullptr;
+    }
+
+    auto start = static_cast<std::size_t>(nextRandom(workers_[thief]->rngState) % workerCount_);
+    for (std::size_t i = 0; i < workerCount_; ++i) {
+        std::size_t victim = (start + i) % workerCount_;
+        if (workers_[victim]->node == home) continue;
+        if (auto stolen = workers_[victim]->deques[lane].steal()) return *stolen;
+    }
+    return nullptr;
+}
+
+TaskScheduler::InjectionQueue& TaskScheduler::injectionQueue(int node) {
+    return node >= 0 && nodeCount() > 1 ? *injected_[static_cast<std::size_t>(node)] : *injected_.back();
+}
+
+void TaskScheduler::park() {
+    std::unique_lock<std::mutex> lock{parkMutex_};
+    // Dekker-style handshake with wakeOne(): we announce ourselves before
+    // re-checking the depth, enqueue bumps the depth before checking for
+    // sleepers, so at least one side sees the other.
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    parkCv_.wait(lock, [&] {
+        return !running_.load(std::memory_order_acquire) ||
+               queueDepth_.load(std::memory_order_seq_cst) > 0;
+    });
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void TaskScheduler::wakeOne() {
+    if (sleepers_.load(std::memory_order_seq_cst) == 0) return;
+    {
+        std::lock_guard<std::mutex> lock{parkMutex_};
+    }
+    parkCv_.notify_one();
+}
+
+}
@@ -0,0 +1,276 @@
+#include "openperf/trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#include <unistd.h>
+
+namespace openperf {
+
+namespace {
+
+// The calling thread's buffer in the global tracer, once it has recorded,
+// handed back to the tracer when the thread exits.
+struct TlsBuffer {
+    void* buffer = nullptr;
+    void (*retire)(void* buffer) = nullptr;
+    ~TlsBuffer() {
+        if (buffer) retire(buffer);
+    }
+};
+thread_local TlsBuffer tlsBuffer;
+// The thread's name, kept until it records so unused threads cost no buffer.
+thread_local std::string tlsThreadName;
+
+void writeString(std::ostream& out, const char* s) {
+    out << '"';
+    for (; s && *s; ++s) {
+        const char c = *s;
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Trace-event timestamps are microseconds; keep nanosecond precision.
+void writeMicros(std::ostream& out, std::int64_t ns) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%lld.%03lld", static_cast<long long>(ns / 1000),
+                  static_cast<long long>(ns % 1000));
+    out << buffer;
+}
+
+}
+
+Tracer& Tracer::global() {
+    // never destroyed, so threads still running at exit can keep recording
+    static Tracer* tracer = new Tracer;
+    return *tracer;
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock{buffersMutex_};
+    // nothing writes to an exited thread's buffer any more
+    std::erase_if(buffers_, [](const auto& buffer) { return buffer->retired; });
+    retired_.clear();
+    for (auto& buffer : buffers_) {
+        for (std::size_t i = 0; i < kEventsPerThread; ++i) buffer->slots[i].seq.store(0, std::memory_order_relaxed);
+        buffer->head.store(0, std::memory_order_release);
+    }
+}
+
+const char* Tracer::intern(std::string_view name) {
+    std::lock_guard<std::mutex> lock{internMutex_};
+    return interned_.emplace(name).first->c_str();
+}
+
+void Tracer::setThreadName(std::string name) {
+    tlsThreadName = std::move(name);
+    if (!tlsBuffer.buffer) return;
+    std::lock_guard<std::mutex> lock{buffersMutex_};
+    static_cast<ThreadBuffer*>(tlsBuffer.buffer)->name = tlsThreadName;
+}
+
+std::int64_t Tracer::now() {
+    return toNs(std::chrono::steady_clock::now());
+}
+
+std::int64_t Tracer::toNs(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+Tracer::ThreadBuffer& Tracer::localBuffer() {
+    if (tlsBuffer.buffer) return *static_cast<ThreadBuffer*>(tlsBuffer.buffer);
+
+    // first event from this thread: slow path, once per thread
+    ThreadBuffer* raw = nullptr;
+    {
+        std::lock_guard<std::mutex> lock{buffersMutex_};
+        if (retired_.size() >= kMaxRetiredBuffers) {
+            // the oldest exited thread's events go, as in a wrapped ring
+            raw = retired_.front();
+            retired_.erase(retired_.begin());
+            for (std::size_t i = 0; i < kEventsPerThread; ++i) raw->slots[i].seq.store(0, std::memory_order_relaxed);
+            raw->head.store(0, std::memory_order_release);
+            raw->retired = false;
+        } else {
+            buffers_.push_back(std::make_unique<ThreadBuffer>());
+            raw = buffers_.back().get();
+        }
+        raw->tid = nextTid_++;
+        raw->name = tlsThreadName;
+    }
+    tlsBuffer.buffer = raw;
+    tlsBuffer.retire = &Tracer::retireBuffer;
+    return *raw;
+}
+
+void Tracer::retireBuffer(void* buffer) {
+    // the global tracer is never destroyed, so this is safe at exit
+    Tracer& tracer = global();
+    std::lock_guard<std::mutex> lock{tracer.buffersMutex_};
+    auto* raw = static_cast<ThreadBuffer*>(buffer);
+    raw->retired = true;
+    tracer.retired_.push_back(raw);
+}
+
+void Tracer::record(Phase phase, const char* category, const char* name, std::int64_t startNs,
+                    std::int64_t durationNs, const char* argName, std::int64_t arg, std::uint64_t id) {
+    ThreadBuffer& buffer = localBuffer();
+
+    // single writer; seqlock-style so an export can detect torn slots
+    auto head = buffer.head.load(std::memory_order_relaxed);
+    Slot& slot = buffer.slots[head % kEventsPerThread];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.category.store(category, std::memory_order_relaxed);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.argName.store(argName, std::memory_order_relaxed);
+    slot.startNs.store(startNs, std::memory_order_relaxed);
+    slot.durationNs.store(durationNs, std::memory_order_relaxed);
+    slot.arg.store(arg, std::memory_order_relaxed);
+    slot.id.store(id, std::memory_order_relaxed);
+    slot.phase.store(phase, std::memory_order_relaxed);
+    slot.seq.store(head + 1, std::memory_order_release);
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::complete(const char* category, const char* name, std::int64_t startNs, std::int64_t endNs,
+                      const char* argName, std::int64_t arg) {
+    if (!enabled()) return;
+    record(Phase::Complete, category, name, startNs, endNs - startNs, argName, arg, 0);
+}
+
+void Tracer::instant(const char* category, const char* name, const char* argName, std::int64_t arg) {
+    if (!enabled()) return;
+    record(Phase::Instant, category, name, now(), 0, argName, arg, 0);
+}
+
+void Tracer::flowStart(const char* category, const char* name, std::uint64_t id) {
+    if (!enabled()) return;
+    record(Phase::FlowStart, category, name, now(), 0, nullptr, 0, id);
+}
+
+void Tracer::flowEnd(const char* category, const char* name, std::uint64_t id) {
+    if (!enabled()) return;
+    record(Phase::FlowEnd, category, name, now(), 0, nullptr, 0, id);
+}
+
+void Tracer::async(const char* category, const char* name, std::uint64_t id, std::int64_t startNs,
+                   std::int64_t endNs) {
+    if (!enabled()) return;
+    record(Phase::Async, category, name, startNs, endNs - startNs, nullptr, 0, id);
+}
+
+void Tracer::writeChromeJson(std::ostream& out) const {
+    struct Event {
+        Phase phase;
+        const char* category;
+        const char* name;
+        const char* argName;
+        std::int64_t startNs;
+        std::int64_t durationNs;
+        std::int64_t arg;
+        std::uint64_t id;
+        std::uint32_t tid;
+    };
+    std::vector<Event> events;
+    std::vector<std::pair<std::uint32_t, std::string>> threadNames;
+
+    {
+        std::lock_guard<std::mutex> lock{buffersMutex_};
+        for (const auto& buffer : buffers_) {
+            if (!buffer->name.empty()) threadNames.emplace_back(buffer->tid, buffer->name);
+            const auto head = buffer->head.load(std::memory_order_acquire);
+            const auto first = head > kEventsPerThread ? head - kEventsPerThread : 0;
+            for (auto i = first; i < head; ++i) {
+                const Slot& slot = buffer->slots[i % kEventsPerThread];
+                if (slot.seq.load(std::memory_order_acquire) != i + 1) continue;
+                Event e{slot.phase.load(std::memory_order_relaxed),
+                        slot.category.load(std::memory_order_relaxed),
+                        slot.name.load(std::memory_order_relaxed),
+                        slot.argName.load(std::memory_order_relaxed),
+                        slot.startNs.load(std::memory_order_relaxed),
+                        slot.durationNs.load(std::memory_order_relaxed),
+                        slot.arg.load(std::memory_order_relaxed),
+                        slot.id.load(std::memory_order_relaxed),
+                        buffer->tid};
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq.load(std::memory_order_relaxed) != i + 1) continue; // overwritten meanwhile
+                events.push_back(e);
+            }
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.startNs < b.startNs; });
+
+    const long pid = static_cast<long>(::getpid());
+    bool first = true;
+    auto begin = [&](const char* phase, const Event& e, std::int64_t ts) {
+        out << (first ? "\n" : ",\n") << "{\"ph\":\"" << phase << "\",\"cat\":";
+        first = false;
+        writeString(out, e.category);
+        out << ",\"name\":";
+        writeString(out, e.name);
+        out << ",\"pid\":" << pid << ",\"tid\":" << e.tid << ",\"ts\":";
+        writeMicros(out, ts);
+    };
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (const auto& [tid, name] : threadNames) {
+        out << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << tid
+            << ",\"args\":{\"name\":";
+        first = false;
+        writeString(out, name.c_str());
+        out << "}}";
+    }
+    for (const auto& e : events) {
+        switch (e.phase) {
+        case Phase::Complete:
+            begin("X", e, e.startNs);
+            out << ",\"dur\":";
+            writeMicros(out, e.durationNs);
+            break;
+        case Phase::Instant:
+            begin("i", e, e.startNs);
+            out << ",\"s\":\"t\"";
+            break;
+        case Phase::FlowStart:
+            begin("s", e, e.startNs);
+            out << ",\"id\":" << e.id;
+            break;
+        case Phase::FlowEnd:
+            begin("f", e, e.startNs);
+            out << ",\"bp\":\"e\",\"id\":" << e.id;
+            break;
+        case Phase::Async:
+            begin("b", e, e.startNs);
+            out << ",\"id\":" << e.id << "}";
+            begin("e", e, e.startNs + e.durationNs);
+            out << ",\"id\":" << e.id;
+            break;
+        }
+        if (e.argName) {
+            out << ",\"args\":{";
+            writeString(out, e.argName);
+            out << ":" << e.arg << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+}
+
+std::string Tracer::chromeJson() const {
+    std::ostringstream out;
+    writeChromeJson(out);
+    return out.str();
+}
+
+}
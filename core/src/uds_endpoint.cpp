@@ -0,0 +1,201 @@
+#include "openperf/uds_endpoint.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace openperf {
+
+namespace {
+
+[[noreturn]] void throwErrno(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+sockaddr_un makeAddress(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::system_error(ENAMETOOLONG, std::generic_category(), "socket path too long");
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+// false on orderly shutdown by the peer before any byte was read
+bool readFull(int fd, char* buf, std::size_t n) {
+    std::size_t done = 0;
+    while (done < n) {
+        auto r = ::recv(fd, buf + done, n - done, 0);
+        if (r > 0) {
+            done += static_cast<std::size_t>(r);
+        } else if (r == 0) {
+            if (done == 0) return false;
+            throw wire::WireError("connection closed mid-frame");
+        } else if (errno != EINTR) {
+            throwErrno("recv");
+        }
+    }
+    return true;
+}
+
+void writeFull(int fd, const char* buf, std::size_t n) {
+    std::size_t done = 0;
+    while (done < n) {
+        auto r = ::send(fd, buf + done, n - done, MSG_NOSIGNAL);
+        if (r >= 0) {
+            done += static_cast<std::size_t>(r);
+        } else if (errno != EINTR) {
+            throwErrno("send");
+        }
+    }
+}
+
+// false if the peer closed the connection between frames
+bool readFrame(int fd, wire::FrameHeader& header, std::string& payload) {
+    char raw[wire::kHeaderSize];
+    if (!readFull(fd, raw, sizeof(raw))) return false;
+    header = wire::decodeHeader(raw);
+    payload.resize(header.length);
+    if (header.length != 0 && !readFull(fd, payload.data(), header.length)) {
+        throw wire::WireError("connection closed mid-frame");
+    }
+    return true;
+}
+
+} // namespace
+
+// UdsEndpointServer
+
+UdsEndpointServer::UdsEndpointServer(IEngineEndpoint& endpoint, std::string path, TreeLimits limits)
+    : endpoint_(endpoint), path_(std::move(path)), limits_(limits) {}
+
+UdsEndpointServer::~UdsEndpointServer() {
+    stop();
+}
+
+void UdsEndpointServer::start() {
+    if (running_) return;
+
+    auto addr = makeAddress(path_);
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) throwErrno("socket");
+
+    ::unlink(path_.c_str());
+    if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listenFd_, SOMAXCONN) < 0) {
+        int err = errno;
+        ::close(listenFd_);
+        listenFd_ = -1;
+        throw std::system_error(err, std::generic_category(), "bind/listen " + path_);
+    }
+
+    running_ = true;
+    acceptThread_ = std::thread([this] { acceptLoop(); });
+}
+
+void UdsEndpointServer::stop() {
+    if (!running_.exchange(false)) return;
+
+    // unblocks accept()
+    ::shutdown(listenFd_, SHUT_RDWR);
+    if (acceptThread_.joinable()) acceptThread_.join();
+    ::close(listenFd_);
+    listenFd_ = -1;
+    ::unlink(path_.c_str());
+
+    std::lock_guard<std::mutex> lock{connectionsMutex_};
+    for (auto& c : connections_) ::shutdown(c->fd, SHUT_RDWR);
+    for (auto& c : connections_) {
+        if (c->thread.joinable()) c->thread.join();
+        ::close(c->fd);
+    }
+    connections_.clear();
+}
+
+void UdsEndpointServer::acceptLoop() {
+    while (running_) {
+        int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break; // listening socket shut down
+        }
+
+        reapFinished();
+
+        std::lock_guard<std::mutex> lock{connectionsMutex_};
+        if (!running_) {
+            ::close(fd);
+            break;
+        }
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        auto* raw = connection.get();
+        connections_.push_back(std::move(connection));
+        raw->thread = std::thread([this, raw] { serve(*raw); });
+    }
+}
+
+void UdsEndpointServer::serve(Connection& connection) {
+    wire::FrameHeader header;
+    std::string payload;
+    wire::Writer reply;
+
+    try {
+        while (readFrame(connection.fd, header, payload)) {
+            wire::Reader in(payload.data(), payload.size());
+            reply.reset();
+            auto type = wire::handleRequest(endpoint_, header.type, in, reply, limits_);
+            const auto& frame = reply.finish(type, header.requestId);
+            writeFull(connection.fd, frame.data(), frame.size());
+        }
+    } catch (const std::exception&) {
+        // broken or malformed connection; drop it
+    }
+    connection.finished = true;
+}
+
+void UdsEndpointServer::reapFinished() {
+    std::lock_guard<std::mutex> lock{connectionsMutex_};
+    for (auto it = connections_.begin(); it != connections_.end();) {
+        auto& c = **it;
+        if (!c.finished) {
+            ++it;
+            continue;
+        }
+        c.thread.join();
+        ::close(c.fd);
+        it = connections_.erase(it);
+    }
+}
+
+// UdsEndpointClient
+
+UdsEndpointClient::UdsEndpointClient(const std::string& path) {
+    auto addr = makeAddress(path);
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) throwErrno("socket");
+    if (::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        int err = errno;
+        ::close(fd_);
+        throw std::system_error(err, std::generic_category(), "connect " + path);
+    }
+}
+
+UdsEndpointClient::~UdsEndpointClient() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+wire::FrameHeader UdsEndpointClient::roundTrip(const std::string& frame, std::string& replyPayload) const {
+    writeFull(fd_, frame.data(), frame.size());
+
+    wire::FrameHeader header;
+    if (!readFrame(fd_, header, replyPayload)) throw wire::WireError("server closed the connection");
+    return header;
+}
+
+}
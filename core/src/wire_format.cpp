@@ -0,0 +1,653 @@
+#include "openperf/wire_format.hpp"
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <utility>
+
+namespace openperf::wire {
+
+namespace {
+
+// smallest possible encoding of a node: five empty strings, flags and a child count
+constexpr std::size_t kMinNodeBytes = 5 * sizeof(std::uint32_t) + 1 + sizeof(std::uint32_t);
+
+// node flag bits
+constexpr std::uint8_t kInteractive = 1;
+constexpr std::uint8_t kHasStyle = 2;
+
+using SteadyClock = std::chrono::steady_clock;
+
+// steady_clock is system-wide, so both ends of a same-host link agree on it
+std::int64_t toNs(SteadyClock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+SteadyClock::time_point fromNs(std::int64_t ns) {
+    return SteadyClock::time_point(std::chrono::duration_cast<SteadyClock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+// Guards reserve() calls against counts taken from untrusted input.
+std::uint32_t count(Reader& r, std::size_t minElementBytes) {
+    auto n = r.u32();
+    if (n > r.remaining() / minElementBytes) throw WireError("element count exceeds frame");
+    return n;
+}
+
+void encode(Writer& w, const HistogramStats& s) {
+    w.u64(s.count);
+    w.f64(s.sum);
+    w.f64(s.min);
+    w.f64(s.max);
+    w.f64(s.p50);
+    w.f64(s.p90);
+    w.f64(s.p99);
+}
+
+HistogramStats decodeStats(Reader& r) {
+    HistogramStats s;
+    s.count = r.u64();
+    s.sum = r.f64();
+    s.min = r.f64();
+    s.max = r.f64();
+    s.p50 = r.f64();
+    s.p90 = r.f64();
+    s.p99 = r.f64();
+    return s;
+}
+
+void encodeNode(Writer& w, const Node& node, std::uint32_t children) {
+    w.str(node.tag);
+    w.str(node.id);
+    w.str(node.text);
+    w.str(node.role);
+    w.str(node.ariaLabel);
+
+    // most nodes keep the default style, so it is only written when set
+    const bool styled = !(node.style == Style{});
+    w.u8((node.isInteractive ? kInteractive : 0) | (styled ? kHasStyle : 0));
+    if (styled) {
+        const Style& s = node.style;
+        w.u8(static_cast<std::uint8_t>(s.display));
+        w.u8(static_cast<std::uint8_t>(s.position));
+        w.u8(static_cast<std::uint8_t>(s.flexDirection));
+        for (float f : {s.width, s.height, s.left, s.top, s.margin, s.padding, s.flexGrow, s.borderWidth}) w.f32(f);
+        w.u32(s.background);
+        w.u32(s.borderColor);
+    }
+    w.u32(children);
+}
+
+Style decodeStyle(Reader& r) {
+    Style s;
+    auto display = r.u8(), position = r.u8(), direction = r.u8();
+    if (display > static_cast<std::uint8_t>(Style::Display::None) ||
+        position > static_cast<std::uint8_t>(Style::Position::Absolute) ||
+        direction > static_cast<std::uint8_t>(Style::FlexDirection::Column)) {
+        throw WireError("bad style");
+    }
+    s.display = static_cast<Style::Display>(display);
+    s.position = static_cast<Style::Position>(position);
+    s.flexDirection = static_cast<Style::FlexDirection>(direction);
+    for (float* f : {&s.width, &s.height, &s.left, &s.top, &s.margin, &s.padding, &s.flexGrow, &s.borderWidth}) {
+        *f = r.f32();
+    }
+    s.background = r.u32();
+    s.borderColor = r.u32();
+    return s;
+}
+
+} // namespace
+
+void encodeHeader(const FrameHeader& header, char* out) {
+    auto type = static_cast<std::uint16_t>(header.type);
+    std::memcpy(out, &header.length, 4);
+    std::memcpy(out + 4, &type, 2);
+    std::memcpy(out + 6, &header.flags, 2);
+    std::memcpy(out + 8, &header.requestId, 4);
+}
+
+FrameHeader decodeHeader(const char* in) {
+    FrameHeader header;
+    std::uint16_t type = 0;
+    std::memcpy(&header.length, in, 4);
+    std::memcpy(&type, in + 4, 2);
+    std::memcpy(&header.flags, in + 6, 2);
+    std::memcpy(&header.requestId, in + 8, 4);
+    header.type = static_cast<MessageType>(type);
+    if (header.length > kMaxPayloadBytes) throw WireError("frame too large");
+    return header;
+}
+
+const std::string& Writer::finish(MessageType type, std::uint32_t requestId) {
+    if (payloadSize() > kMaxPayloadBytes) throw WireError("frame too large");
+    FrameHeader header;
+    header.length = static_cast<std::uint32_t>(payloadSize());
+    header.type = type;
+    header.requestId = requestId;
+    encodeHeader(header, buffer_.data());
+    return buffer_;
+}
+
+// Page
+
+namespace {
+
+// pre-order; null children are dropped, so counts are taken up front
+void encodeTree(Writer& w, const Node& root) {
+    std::vector<const Node*> stack{&root};
+    while (!stack.empty()) {
+        const Node* n = stack.back();
+        stack.pop_back();
+
+        std::uint32_t children = 0;
+        for (const auto& child : n->children)
+            if (child) ++children;
+        encodeNode(w, *n, children);
+
+        for (auto it = n->children.rbegin(); it != n->children.rend(); ++it)
+            if (*it) stack.push_back(it->get());
+    }
+}
+
+// `nodes` carries the count of the request's earlier trees, so they share
+// limits.maxNodes.
+std::shared_ptr<Node> decodeTree(Reader& r, const TreeLimits& limits, std::size_t& nodes) {
+    struct Open {
+        Node* node;
+        std::uint32_t remaining;
+    };
+    std::vector<Open> stack;
+
+    auto readNode = [&r](Node& node) {
+        node.tag = r.str();
+        node.id = r.str();
+        node.text = r.str();
+        node.role = r.str();
+        node.ariaLabel = r.str();
+        auto flags = r.u8();
+        node.isInteractive = (flags & kInteractive) != 0;
+        if (flags & kHasStyle) node.style = decodeStyle(r);
+        return count(r, kMinNodeBytes);
+    };
+
+    auto admit = [&] {
+        if (++nodes > limits.maxNodes) {
+            throw WireError("tree has more than " + std::to_string(limits.maxNodes) + " nodes");
+        }
+        if (stack.size() >= limits.maxDepth) {
+            throw WireError("tree is deeper than " + std::to_string(limits.maxDepth) + " levels");
+        }
+    };
+
+    admit();
+    auto root = std::make_shared<Node>();
+    stack.push_back({root.get(), readNode(*root)});
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        if (top.remaining == 0) {
+            stack.pop_back();
+            continue;
+        }
+        --top.remaining;
+
+        admit();
+        auto child = std::make_shared<Node>();
+        Node* raw = child.get();
+        top.node->children.push_back(std::move(child));
+        auto children = readNode(*raw);
+        raw->children.reserve(children);
+        stack.push_back({raw, children});
+    }
+    return root;
+}
+
+Page decodePage(Reader& r, const TreeLimits& limits, std::size_t& nodes) {
+    Page page;
+    page.id = r.str();
+    page.url = r.str();
+    if (r.u8() != 0) page.root = decodeTree(r, limits, nodes);
+    return page;
+}
+
+} // namespace
+
+void encode(Writer& w, const Page& page) {
+    w.str(page.id);
+    w.str(page.url);
+    w.u8(page.root ? 1 : 0);
+    if (page.root) encodeTree(w, *page.root);
+}
+
+Page decodePage(Reader& r, const TreeLimits& limits) {
+    std::size_t nodes = 0;
+    return decodePage(r, limits, nodes);
+}
+
+void encode(Writer& w, const std::vector<Page>& pages) {
+    w.u32(static_cast<std::uint32_t>(pages.size()));
+    for (const auto& page : pages) encode(w, page);
+}
+
+std::vector<Page> decodePages(Reader& r, const TreeLimits& limits) {
+    auto n = count(r, 2 * sizeof(std::uint32_t) + 1);
+    std::vector<Page> pages;
+    pages.reserve(n);
+    std::size_t nodes = 0;
+    for (std::uint32_t i = 0; i < n; ++i) pages.push_back(decodePage(r, limits, nodes));
+    return pages;
+}
+
+void encode(Writer& w, const std::vector<std::string>& ids) {
+    w.u32(static_cast<std::uint32_t>(ids.size()));
+    for (const auto& id : ids) w.str(id);
+}
+
+std::vector<std::string> decodeIds(Reader& r) {
+    auto n = count(r, sizeof(std::uint32_t));
+    std::vector<std::string> ids;
+    ids.reserve(n);
+    for (std::uint32_t i = 0; i < n; ++i) ids.push_back(r.str());
+    return ids;
+}
+
+// PatchPage
+
+void encode(Writer& w, const std::vector<NodeMutation>& mutations) {
+    w.u32(static_cast<std::uint32_t>(mutations.size()));
+    for (const auto& m : mutations) {
+        w.u8(static_cast<std::uint8_t>(m.kind));
+        w.str(m.nodeId);
+        w.u64(m.position);
+        w.u8(m.node ? 1 : 0);
+        if (m.node) encodeTree(w, *m.node);
+    }
+}
+
+std::vector<NodeMutation> decodeMutations(Reader& r, const TreeLimits& limits) {
+    auto n = count(r, 1 + sizeof(std::uint32_t) + sizeof(std::uint64_t) + 1);
+    std::vector<NodeMutation> mutations;
+    mutations.reserve(n);
+    std::size_t nodes = 0;
+    for (std::uint32_t i = 0; i < n; ++i) {
+        NodeMutation m;
+        auto kind = r.u8();
+        if (kind > static_cast<std::uint8_t>(NodeMutation::Kind::Update)) throw WireError("bad mutation kind");
+        m.kind = static_cast<NodeMutation::Kind>(kind);
+        m.nodeId = r.str();
+        m.position = static_cast<std::size_t>(r.u64());
+        if (r.u8() != 0) m.node = decodeTree(r, limits, nodes);
+        mutations.push_back(std::move(m));
+    }
+    return mutations;
+}
+
+void encode(Writer& w, const PatchResult& result) {
+    w.u8(static_cast<std::uint8_t>(result.status));
+    w.u64(result.changedNodes);
+    w.str(result.error);
+}
+
+PatchResult decodePatchResult(Reader& r) {
+    PatchResult result;
+    auto status = r.u8();
+    if (status > static_cast<std::uint8_t>(PatchStatus::InvalidMutation)) throw WireError("bad patch status");
+    result.status = static_cast<PatchStatus>(status);
+    result.changedNodes = static_cast<std::size_t>(r.u64());
+    result.error = r.str();
+    return result;
+}
+
+// RenderResult
+
+void encode(Writer& w, const RenderResult& result) {
+    w.str(result.pageId);
+    w.u8(static_cast<std::uint8_t>(result.status));
+    w.i64(toNs(result.submitted));
+    w.i64(toNs(result.completed));
+    w.u32(static_cast<std::uint32_t>(result.stages.size()));
+    for (std::size_t i = 0; i < result.stages.size(); ++i) {
+        w.str(i < result.stageNames.size() ? std::string_view{result.stageNames[i]} : std::string_view{});
+        w.i64(toNs(result.stages[i].start));
+        w.i64(toNs(result.stages[i].end));
+    }
+}
+
+RenderResult decodeRenderResult(Reader& r) {
+    RenderResult result;
+    result.pageId = r.str();
+    auto status = r.u8();
+    if (status > static_cast<std::uint8_t>(RenderStatus::Expired)) throw WireError("bad render status");
+    result.status = static_cast<RenderStatus>(status);
+    result.submitted = fromNs(r.i64());
+    result.completed = fromNs(r.i64());
+    auto stages = count(r, sizeof(std::uint32_t) + 2 * sizeof(std::int64_t));
+    result.stageNames.reserve(stages);
+    result.stages.reserve(stages);
+    for (std::uint32_t i = 0; i < stages; ++i) {
+        result.stageNames.push_back(r.str());
+        StageTiming timing;
+        timing.start = fromNs(r.i64());
+        timing.end = fromNs(r.i64());
+        result.stages.push_back(timing);
+    }
+    return result;
+}
+
+void encode(Writer& w, const std::vector<RenderResult>& results) {
+    w.u32(static_cast<std::uint32_t>(results.size()));
+    for (const auto& result : results) encode(w, result);
+}
+
+std::vector<RenderResult> decodeRenderResults(Reader& r) {
+    auto n = count(r, sizeof(std::uint32_t) + 1 + 2 * sizeof(std::int64_t) + sizeof(std::uint32_t));
+    std::vector<RenderResult> results;
+    results.reserve(n);
+    for (std::uint32_t i = 0; i < n; ++i) results.push_back(decodeRenderResult(r));
+    return results;
+}
+
+// AccessibilityIssue
+
+void encode(Writer& w, const std::vector<AccessibilityIssue>& issues) {
+    w.u32(static_cast<std::uint32_t>(issues.size()));
+    for (const auto& issue : issues) {
+        w.str(issue.code);
+        w.str(issue.message);
+        w.u8(static_cast<std::uint8_t>(issue.severity));
+        w.str(issue.nodeId);
+    }
+}
+
+std::vector<AccessibilityIssue> decodeIssues(Reader& r) {
+    auto n = count(r, 3 * sizeof(std::uint32_t) + 1);
+    std::vector<AccessibilityIssue> issues;
+    issues.reserve(n);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        AccessibilityIssue issue;
+        issue.code = r.str();
+        issue.message = r.str();
+        auto severity = r.u8();
+        if (severity > static_cast<std::uint8_t>(Severity::Error)) throw WireError("bad severity");
+        issue.severity = static_cast<Severity>(severity);
+        issue.nodeId = r.str();
+        issues.push_back(std::move(issue));
+    }
+    return issues;
+}
+
+void encode(Writer& w, const std::vector<AccessibilityReport>& reports) {
+    w.u32(static_cast<std::uint32_t>(reports.size()));
+    for (const auto& report : reports) {
+        w.u8(report.found ? 1 : 0);
+        encode(w, report.issues);
+    }
+}
+
+std::vector<AccessibilityReport> decodeReports(Reader& r) {
+    auto n = count(r, 1 + sizeof(std::uint32_t));
+    std::vector<AccessibilityReport> reports(n);
+    for (auto& report : reports) {
+        report.found = r.u8() != 0;
+        report.issues = decodeIssues(r);
+    }
+    return reports;
+}
+
+// Metrics
+
+void encode(Writer& w, const std::vector<Metric>& samples) {
+    w.u32(static_cast<std::uint32_t>(samples.size()));
+    for (const auto& s : samples) {
+        w.str(s.name);
+        w.f64(s.value);
+        w.i64(toNs(s.timestamp));
+        w.u64(s.sequence);
+    }
+}
+
+std::vector<Metric> decodeMetrics(Reader& r) {
+    auto n = count(r, sizeof(std::uint32_t) + 3 * 8);
+    std::vector<Metric> samples;
+    samples.reserve(n);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        Metric m;
+        m.name = r.str();
+        m.value = r.f64();
+        m.timestamp = fromNs(r.i64());
+        m.sequence = r.u64();
+        samples.push_back(std::move(m));
+    }
+    return samples;
+}
+
+void encode(Writer& w, const MetricsDelta& delta) {
+    w.u64(delta.cursor);
+    w.u64(delta.missed);
+    encode(w, delta.samples);
+}
+
+MetricsDelta decodeMetricsDelta(Reader& r) {
+    MetricsDelta delta;
+    delta.cursor = r.u64();
+    delta.missed = r.u64();
+    delta.samples = decodeMetrics(r);
+    return delta;
+}
+
+void encode(Writer& w, const std::vector<MetricSummary>& summaries) {
+    w.u32(static_cast<std::uint32_t>(summaries.size()));
+    for (const auto& s : summaries) {
+        w.str(s.name);
+        w.u8(static_cast<std::uint8_t>(s.kind));
+        encode(w, s.total);
+        encode(w, s.window);
+    }
+}
+
+std::vector<MetricSummary> decodeSummaries(Reader& r) {
+    auto n = count(r, sizeof(std::uint32_t) + 1 + 2 * 7 * 8);
+    std::vector<MetricSummary> summaries;
+    summaries.reserve(n);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        MetricSummary s;
+        s.name = r.str();
+        auto kind = r.u8();
+        if (kind > static_cast<std::uint8_t>(MetricKind::Counter)) throw WireError("bad metric kind");
+        s.kind = static_cast<MetricKind>(kind);
+        s.total = decodeStats(r);
+        s.window = decodeStats(r);
+        summaries.push_back(std::move(s));
+    }
+    return summaries;
+}
+
+// Server side
+
+MessageType handleRequest(IEngineEndpoint& endpoint, MessageType type, Reader& in, Writer& out,
+                          const TreeLimits& limits) {
+    try {
+        switch (type) {
+            case MessageType::SubmitPage:
+                out.str(endpoint.submitPage(decodePage(in, limits)));
+                return type;
+
+            case MessageType::RunRender: {
+                auto pageId = in.str();
+                if (in.u8() == 0) {
+                    endpoint.runRenderPipeline(pageId);
+                    return type;
+                }
+                // the transport serves one request per connection at a time,
+                // so waiting here mirrors the blocked client
+                encode(out, endpoint.render(pageId).wait());
+                return type;
+            }
+
+            case MessageType::SubmitPages:
+                encode(out, endpoint.submitPages(decodePages(in, limits)));
+                return type;
+
+            case MessageType::RunRenderBatch: {
+                auto pageIds = decodeIds(in);
+                if (in.u8() == 0) {
+                    endpoint.runRenderBatch(pageIds, nullptr);
+                    return type;
+                }
+                std::promise<std::vector<RenderResult>> done;
+                auto results = done.get_future();
+                endpoint.runRenderBatch(pageIds,
+                                        [&done](std::vector<RenderResult> r) { done.set_value(std::move(r)); });
+                encode(out, results.get());
+                return type;
+            }
+
+            case MessageType::AnalyzeAccessibility:
+                encode(out, endpoint.analyzeAccessibility(in.str()));
+                return type;
+
+            case MessageType::AnalyzeAccessibilityBatch:
+                encode(out, endpoint.analyzeAccessibilityBatch(decodeIds(in)));
+                return type;
+
+            case MessageType::PatchPage: {
+                auto pageId = in.str();
+                encode(out, endpoint.patchPage(pageId, decodeMutations(in, limits)));
+                return type;
+            }
+
+            case MessageType::GetMetrics:
+                encode(out, endpoint.getMetrics());
+                return type;
+
+            case MessageType::GetMetricsSince:
+                encode(out, endpoint.getMetricsSince(in.u64()));
+                return type;
+
+            case MessageType::GetMetricSummaries:
+                encode(out, endpoint.getMetricSummaries());
+                return type;
+
+            case MessageType::Error:
+                break;
+        }
+        out.reset();
+        out.str("unknown message type");
+    } catch (const std::exception& e) {
+        out.reset();
+        out.str(e.what());
+    }
+    return MessageType::Error;
+}
+
+// Client side
+
+std::string ClientEndpoint::call(Writer& request, MessageType type) const {
+    std::string payload;
+    FrameHeader reply;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto requestId = nextRequestId_++;
+        reply = roundTrip(request.finish(type, requestId), payload);
+        if (reply.requestId != requestId) throw WireError("reply does not match request");
+    }
+
+    if (reply.type == MessageType::Error) {
+        Reader r(payload.data(), payload.size());
+        throw WireError(r.str());
+    }
+    if (reply.type != type) throw WireError("unexpected reply type");
+    return payload;
+}
+
+std::string ClientEndpoint::submitPage(Page page) {
+    Writer w;
+    encode(w, page);
+    auto payload = call(w, MessageType::SubmitPage);
+    Reader r(payload.data(), payload.size());
+    return r.str();
+}
+
+std::vector<std::string> ClientEndpoint::submitPages(std::vector<Page> pages) {
+    Writer w;
+    encode(w, pages);
+    auto payload = call(w, MessageType::SubmitPages);
+    Reader r(payload.data(), payload.size());
+    return decodeIds(r);
+}
+
+void ClientEndpoint::runRenderPipeline(const std::string& pageId) {
+    Writer w;
+    w.str(pageId);
+    w.u8(0);
+    call(w, MessageType::RunRender);
+}
+
+void ClientEndpoint::runRenderPipeline(const std::string& pageId, RenderCallback done) {
+    Writer w;
+    w.str(pageId);
+    w.u8(1);
+    auto payload = call(w, MessageType::RunRender);
+    Reader r(payload.data(), payload.size());
+    auto result = decodeRenderResult(r);
+    if (done) done(std::move(result));
+}
+
+void ClientEndpoint::runRenderBatch(const std::vector<std::string>& pageIds, RenderBatchCallback done) {
+    Writer w;
+    encode(w, pageIds);
+    w.u8(done ? 1 : 0);
+    auto payload = call(w, MessageType::RunRenderBatch);
+    if (!done) return;
+    Reader r(payload.data(), payload.size());
+    done(decodeRenderResults(r));
+}
+
+std::vector<AccessibilityIssue> ClientEndpoint::analyzeAccessibility(const std::string& pageId) {
+    Writer w;
+    w.str(pageId);
+    auto payload = call(w, MessageType::AnalyzeAccessibility);
+    Reader r(payload.data(), payload.size());
+    return decodeIssues(r);
+}
+
+std::vector<AccessibilityReport> ClientEndpoint::analyzeAccessibilityBatch(const std::vector<std::string>& pageIds) {
+    Writer w;
+    encode(w, pageIds);
+    auto payload = call(w, MessageType::AnalyzeAccessibilityBatch);
+    Reader r(payload.data(), payload.size());
+    return decodeReports(r);
+}
+
+PatchResult ClientEndpoint::patchPage(const std::string& pageId, const std::vector<NodeMutation>& mutations) {
+    Writer w;
+    w.str(pageId);
+    encode(w, mutations);
+    auto payload = call(w, MessageType::PatchPage);
+    Reader r(payload.data(), payload.size());
+    return decodePatchResult(r);
+}
+
+std::vector<Metric> ClientEndpoint::getMetrics() const {
+    Writer w;
+    auto payload = call(w, MessageType::GetMetrics);
+    Reader r(payload.data(), payload.size());
+    return decodeMetrics(r);
+}
+
+MetricsDelta ClientEndpoint::getMetricsSince(std::uint64_t cursor) const {
+    Writer w;
+    w.u64(cursor);
+    auto payload = call(w, MessageType::GetMetricsSince);
+    Reader r(payload.data(), payload.size());
+    return decodeMetricsDelta(r);
+}
+
+std::vector<MetricSummary> ClientEndpoint::getMetricSummaries() const {
+    Writer w;
+    auto payload = call(w, MessageType::GetMetricSummaries);
+    Reader r(payload.data(), payload.size());
+    return decodeSummaries(r);
+}
+
+}
@@ -0,0 +1,275 @@
+// Items per second against batch size: the batch calls (SubmitPages,
+// RunRenderBatch waiting for completion, AnalyzeAccessibilityBatch) with
+// 1 to 1024 items per call, next to the single-item calls they replace,
+// over gRPC on loopback TCP and over a Unix domain socket. One client and
+// one Engine in one process, so the gain is the per-call cost (round trip,
+// framing, page-store locking) spread over the batch.
+//
+// The pages share a few contents, so renders and a11y reports come from the
+// engine's caches and those two rows measure the calls rather than the
+// pipeline.
+//
+// usage: openperf_batch_bench [millis_per_point]
+#include "openperf/engine.hpp"
+#include "openperf/engine_endpoint_adapter.hpp"
+#include "openperf/uds_endpoint.hpp"
+#include "proto_convert.hpp"
+#include "service_impl.hpp"
+#include "openperf.grpc.pb.h"
+
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace openperf;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A batch of calls as one client issues them. A batch of one goes through
+// the single-item call, which is what a client without batching does.
+class Client {
+public:
+    virtual ~Client() = default;
+    virtual void submit(const std::vector<Page>& pages) = 0;
+    virtual void render(const std::vector<std::string>& pageIds) = 0;
+    virtual void analyze(const std::vector<std::string>& pageIds) = 0;
+};
+
+class EndpointClient : public Client {
+public:
+    explicit EndpointClient(std::unique_ptr<IEngineEndpoint> endpoint) : endpoint_(std::move(endpoint)) {}
+
+    void submit(const std::vector<Page>& pages) override {
+        if (pages.size() == 1) {
+            endpoint_->submitPage(pages[0]);
+        } else {
+            endpoint_->submitPages(pages);
+        }
+    }
+    void render(const std::vector<std::string>& pageIds) override {
+        // the wire clients call back once the remote renders are done
+        if (pageIds.size() == 1) {
+            endpoint_->runRenderPipeline(pageIds[0], [](RenderResult) {});
+        } else {
+            endpoint_->runRenderBatch(pageIds, [](std::vector<RenderResult>) {});
+        }
+    }
+    void analyze(const std::vector<std::string>& pageIds) override {
+        if (pageIds.size() == 1) {
+            endpoint_->analyzeAccessibility(pageIds[0]);
+        } else {
+            endpoint_->analyzeAccessibilityBatch(pageIds);
+        }
+    }
+
+private:
+    std::unique_ptr<IEngineEndpoint> endpoint_;
+};
+
+class GrpcClient : public Client {
+public:
+    explicit GrpcClient(const std::shared_ptr<grpc::Channel>& channel)
+        : stub_(openperf_rpc::OpenPerfService::NewStub(channel)) {}
+
+    void submit(const std::vector<Page>& pages) override {
+        grpc::ClientContext context;
+        if (pages.size() == 1) {
+            openperf_rpc::SubmitPageRequest request;
+            toProto(pages[0], request.mutable_page());
+            openperf_rpc::SubmitPageResponse response;
+            check(stub_->SubmitPage(&context, request, &response));
+            return;
+        }
+        openperf_rpc::SubmitPagesRequest request;
+        for (const auto& page : pages) toProto(page, request.add_pages());
+        openperf_rpc::SubmitPagesResponse response;
+        check(stub_->SubmitPages(&context, request, &response));
+        for (const auto& result : response.results()) check(result.status());
+    }
+
+    void render(const std::vector<std::string>& pageIds) override {
+        grpc::ClientContext context;
+        if (pageIds.size() == 1) {
+            openperf_rpc::RunRenderRequest request;
+            request.set_page_id(pageIds[0]);
+            request.set_wait_for_completion(true);
+            openperf_rpc::RunRenderResponse response;
+            check(stub_->RunRenderPipeline(&context, request, &response));
+            return;
+        }
+        openperf_rpc::RunRenderBatchRequest request;
+        for (const auto& id : pageIds) request.add_page_ids(id);
+        request.set_wait_for_completion(true);
+        openperf_rpc::RunRenderBatchResponse response;
+        check(stub_->RunRenderBatch(&context, request, &response));
+        for (const auto& result : response.results()) check(result.status());
+    }
+
+    void analyze(const std::vector<std::string>& pageIds) override {
+        grpc::ClientContext context;
+        if (pageIds.size() == 1) {
+            openperf_rpc::AnalyzeAccessibilityRequest request;
+            request.set_page_id(pageIds[0]);
+            openperf_rpc::AnalyzeAccessibilityResponse response;
+            check(stub_->AnalyzeAccessibility(&context, request, &response));
+            return;
+        }
+        openperf_rpc::AnalyzeAccessibilityBatchRequest request;
+        for (const auto& id : pageIds) request.add_page_ids(id);
+        openperf_rpc::AnalyzeAccessibilityBatchResponse response;
+        check(stub_->AnalyzeAccessibilityBatch(&context, request, &response));
+        for (const auto& result : response.results()) check(result.status());
+    }
+
+private:
+    static void check(const grpc::Status& status) {
+        if (!status.ok()) {
+            std::fprintf(stderr, "rpc failed: %s\n", status.error_message().c_str());
+            std::exit(1);
+        }
+    }
+    static void check(const openperf_rpc::ItemStatus& status) {
+        if (status.code() != grpc::StatusCode::OK) {
+            std::fprintf(stderr, "item failed: %s\n", status.message().c_str());
+            std::exit(1);
+        }
+    }
+
+    std::unique_ptr<openperf_rpc::OpenPerfService::Stub> stub_;
+};
+
+// A small page: a few sections of mixed elements, some unlabeled images.
+Page makePage(std::size_t nodes, std::size_t seed) {
+    static const char* kTags[] = {"div", "p", "img", "button", "a", "h2", "span", "li"};
+
+    Page page;
+    page.url = "https://example.com/bench/" + std::to_string(seed);
+    page.root = std::make_shared<Node>();
+    page.root->tag = "body";
+    Node* section = nullptr;
+    for (std::size_t i = 1; i < nodes; ++i) {
+        auto node = std::make_shared<Node>();
+        if (i % 20 == 1) {
+            node->tag = "section";
+            section = node.get();
+            page.root->children.push_back(std::move(node));
+            continue;
+        }
+        node->tag = kTags[(i + seed) % std::size(kTags)];
+        node->id = "n" + std::to_string(i);
+        if (i % 3 == 0) node->text = "content " + std::to_string(i + seed);
+        node->isInteractive = node->tag == "button" || node->tag == "a";
+        section->children.push_back(std::move(node));
+    }
+    return page;
+}
+
+// Items per second over at least `millis`, best of 3.
+double itemsPerSecond(std::size_t batch, int millis, const std::function<void()>& fn) {
+    fn(); // warm up
+    double best = 0;
+    for (int rep = 0; rep < 3; ++rep) {
+        std::size_t calls = 0;
+        auto start = Clock::now();
+        double elapsed = 0;
+        do {
+            fn();
+            ++calls;
+            elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        } while (elapsed < millis);
+        best = std::max(best, static_cast<double>(calls * batch) / (elapsed / 1e3));
+    }
+    return best;
+}
+
+}
+
+int main(int argc, char** argv) {
+    const int millis = argc > 1 ? std::atoi(argv[1]) : 300;
+    constexpr std::size_t kMaxBatch = 1024;
+
+    Engine engine;
+    engine.start();
+    EngineEndpointAdapter adapter(engine);
+
+    OpenPerfServiceImpl service(engine);
+    int port = 0;
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &port);
+    builder.RegisterService(&service);
+    builder.SetMaxReceiveMessageSize(kMaxRequestBytes);
+    auto grpcServer = builder.BuildAndStart();
+    grpc::ChannelArguments channelArgs;
+    channelArgs.SetMaxReceiveMessageSize(kMaxRequestBytes);
+    auto channel = grpc::CreateCustomChannel("127.0.0.1:" + std::to_string(port),
+                                             grpc::InsecureChannelCredentials(), channelArgs);
+
+    UdsEndpointServer udsServer(adapter, "/tmp/openperf-batch-bench-" + std::to_string(::getpid()) + ".sock");
+    udsServer.start();
+
+    struct Transport {
+        const char* name;
+        std::unique_ptr<Client> client;
+    };
+    std::vector<Transport> transports;
+    transports.push_back({"grpc", std::make_unique<GrpcClient>(channel)});
+    transports.push_back({"uds", std::make_unique<EndpointClient>(std::make_unique<UdsEndpointClient>(udsServer.path()))});
+
+    // kMaxBatch pages over a few distinct contents: every id is its own page
+    // in the store, while renders and reports stay cached
+    std::vector<Page> pages;
+    for (std::size_t i = 0; i < kMaxBatch; ++i) pages.push_back(makePage(50, i % 4));
+    const std::vector<std::string> ids = engine.submitPages(pages);
+
+    std::printf("%d ms per point, best of 3; items/s\n", millis);
+    std::printf("%-6s %-5s", "op", "via");
+    for (std::size_t batch = 1; batch <= kMaxBatch; batch *= 4) std::printf(" %10zu", batch);
+    std::printf(" %8s\n", "gain");
+    for (const char* op : {"submit", "render", "a11y"}) {
+        for (auto& transport : transports) {
+            std::vector<double> rates;
+            for (std::size_t batch = 1; batch <= kMaxBatch; batch *= 4) {
+                // every batch size cycles through the same kMaxBatch items
+                std::vector<std::vector<Page>> pageBatches;
+                std::vector<std::vector<std::string>> idBatches;
+                for (std::size_t at = 0; at < kMaxBatch; at += batch) {
+                    pageBatches.emplace_back(pages.begin() + at, pages.begin() + at + batch);
+                    idBatches.emplace_back(ids.begin() + at, ids.begin() + at + batch);
+                }
+                Client& client = *transport.client;
+                std::size_t next = 0;
+                rates.push_back(itemsPerSecond(batch, millis, [&] {
+                    const std::size_t i = next++ % idBatches.size();
+                    if (op[0] == 's') {
+                        client.submit(pageBatches[i]);
+                    } else if (op[0] == 'r') {
+                        client.render(idBatches[i]);
+                    } else {
+                        client.analyze(idBatches[i]);
+                    }
+                }));
+            }
+            // printed afterwards, as the engine logs every submitted page
+            std::printf("%-6s %-5s", op, transport.name);
+            for (double rate : rates) std::printf(" %10.0f", rate);
+            std::printf(" %7.1fx\n", rates.back() / rates.front());
+            std::fflush(stdout);
+        }
+    }
+
+    udsServer.stop();
+    grpcServer->Shutdown();
+    engine.stop();
+    return 0;
+}
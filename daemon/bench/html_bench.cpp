@@ -0,0 +1,250 @@
+// Throughput of the two ways a page reaches the engine: raw HTML through
+// SubmitHtml, parsed straight into a FlatDocument (whole, and in 16 KiB
+// chunks as it streams in), against SubmitPage, where the client builds
+// and encodes a protobuf Node tree that the daemon decodes, converts and
+// flattens. Both paths are measured on the same content: the proto tree
+// is the parsed HTML's own tree. MB/s is HTML bytes per second for both.
+//
+// Without arguments the corpus is generated: pages shaped like common
+// real-world ones (article, product listing, documentation table, app
+// shell with inline data). Pass .html files to measure those instead.
+//
+// usage: openperf_html_bench [page.html...]
+#include "openperf/flat_document.hpp"
+#include "openperf/html_parser.hpp"
+#include "proto_convert.hpp"
+#include "openperf.pb.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace openperf;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t kChunk = 16 * 1024;
+
+struct Corpus {
+    std::string name;
+    std::string html;
+};
+
+// Deterministic filler text with the odd entity, as CMS output has.
+class Words {
+public:
+    std::string sentence(std::size_t words) {
+        static const char* kWords[] = {"the", "performance", "of", "browser", "engines", "depends", "on",
+                                       "layout", "and", "paint", "&amp;", "while", "users", "scroll",
+                                       "pages", "&mdash;", "with", "images", "tables", "links", "&nbsp;",
+                                       "quickly", "rendering", "&ldquo;quoted&rdquo;", "text"};
+        std::string out;
+        for (std::size_t i = 0; i < words; ++i) {
+            if (i) out += ' ';
+            out += kWords[next() % std::size(kWords)];
+        }
+        out += '.';
+        return out;
+    }
+    std::size_t next() {
+        state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<std::size_t>(state_ >> 33);
+    }
+
+private:
+    std::uint64_t state_ = 7;
+};
+
+std::string head(const std::string& title, std::size_t scripts) {
+    std::string out = "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n  <meta charset=\"utf-8\">\n"
+                      "  <meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">\n"
+                      "  <title>" + title + "</title>\n"
+                      "  <link rel=\"stylesheet\" href=\"/static/css/main.3f9a1c.css\">\n"
+                      "  <style>body{margin:0;font-family:system-ui} .card>a:hover{color:#06c}</style>\n";
+    for (std::size_t i = 0; i < scripts; ++i) {
+        out += "  <script>window.dataLayer=window.dataLayer||[];function gtag(){dataLayer.push(arguments)}"
+               "if(a<b&&c>d){gtag('js',new Date())}</script>\n";
+    }
+    return out + "</head>\n";
+}
+
+std::string navigation(Words& words) {
+    std::string out = "  <header class=\"site-header\">\n    <nav class=\"nav nav--primary\" aria-label=\"Main\">\n"
+                      "      <ul class=\"nav__list\">\n";
+    for (int i = 0; i < 8; ++i) {
+        out += "        <li class=\"nav__item\"><a class=\"nav__link\" href=\"/section/" + std::to_string(i) +
+               "\">" + words.sentence(2) + "</a></li>\n";
+    }
+    return out + "      </ul>\n    </nav>\n  </header>\n";
+}
+
+std::string article(Words& words, std::size_t paragraphs) {
+    std::string out = head("News &ndash; Article", 3) + "<body class=\"article-page\">\n" + navigation(words);
+    out += "  <main id=\"content\">\n    <article class=\"story\">\n      <h1 class=\"story__title\">" +
+           words.sentence(8) + "</h1>\n";
+    for (std::size_t i = 0; i < paragraphs; ++i) {
+        out += "      <p class=\"story__para\">" + words.sentence(25) + " <a href=\"https://example.com/ref/" +
+               std::to_string(i) + "?utm_source=feed&amp;utm_medium=web\">" + words.sentence(3) + "</a> " +
+               words.sentence(18) + " <em>" + words.sentence(2) + "</em> " + words.sentence(12) + "</p>\n";
+        if (i % 6 == 5) {
+            out += "      <!-- ad slot " + std::to_string(i) + " -->\n      <figure class=\"story__figure\">"
+                   "<img src=\"/img/" + std::to_string(i) + ".jpg\" alt=\"" + words.sentence(4) +
+                   "\" width=\"800\" height=\"450\" loading=\"lazy\"><figcaption>" + words.sentence(6) +
+                   "</figcaption></figure>\n";
+        }
+    }
+    out += "    </article>\n  </main>\n  <footer class=\"site-footer\"><p>&copy; 2024 Example</p></footer>\n"
+           "</body>\n</html>\n";
+    return out;
+}
+
+std::string listing(Words& words, std::size_t products) {
+    std::string out = head("Shop", 2) + "<body>\n" + navigation(words) +
+                      "  <main>\n    <div class=\"grid\" style=\"display: flex; padding: 8px\">\n";
+    for (std::size_t i = 0; i < products; ++i) {
+        const std::string n = std::to_string(i);
+        out += "      <div class=\"card card--product\" data-sku=\"SKU-" + n + "\" data-price=\"" +
+               std::to_string(10 + i % 90) + ".99\" style=\"width: 240px; margin: 8px; border: 1px solid #ddd\">\n"
+               "        <a href=\"/p/" + n + "\" class=\"card__link\"><img class=\"card__img\" src=\"/thumb/" + n +
+               ".webp\" alt=\"" + words.sentence(3) + "\"></a>\n"
+               "        <h3 class=\"card__title\">" + words.sentence(5) + "</h3>\n"
+               "        <span class=\"price\">&euro;" + std::to_string(10 + i % 90) + ".99</span>\n"
+               "        <button type=\"button\" class=\"btn btn--primary\" onclick=\"addToCart('SKU-" + n +
+               "')\">Add to cart</button>\n      </div>\n";
+    }
+    return out + "    </div>\n  </main>\n</body>\n</html>\n";
+}
+
+std::string docsTable(Words& words, std::size_t rows) {
+    std::string out = head("API reference", 1) + "<body>\n" + navigation(words) +
+                      "  <main class=\"docs\">\n    <h1>Reference</h1>\n    <table class=\"api\">\n"
+                      "      <tr><th>Name<th>Type<th>Description\n";
+    // optional end tags omitted, as hand-written docs often do
+    for (std::size_t i = 0; i < rows; ++i) {
+        out += "      <tr><td><code>field_" + std::to_string(i) + "</code><td>uint32<td>" + words.sentence(14) +
+               "\n";
+    }
+    return out + "    </table>\n  </main>\n</body>\n</html>\n";
+}
+
+std::string appShell(Words& words, std::size_t items) {
+    std::string out = head("Dashboard", 4) + "<body>\n  <div id=\"root\">\n";
+    // framework output: deep wrappers with long class lists
+    for (std::size_t i = 0; i < items; ++i) {
+        out += "    <div class=\"css-1dbjc4n r-1awozwy r-18u37iz r-1wtj0ep\"><div class=\"css-1dbjc4n r-13awgt0\">"
+               "<div class=\"css-901oao r-1fmj7o5 r-37j5jr\" role=\"listitem\" tabindex=\"0\"><span class=\"css-16my406\">" +
+               words.sentence(6) + "</span><svg viewBox=\"0 0 24 24\" aria-hidden=\"true\"><g><path d=\"M12 2C6.48 2 "
+               "2 6.48 2 12s4.48 10 10 10 10-4.48 10-10S17.52 2 12 2z\"></path></g></svg></div></div></div>\n";
+    }
+    out += "  </div>\n  <script id=\"__DATA__\" type=\"application/json\">{\"props\":{\"items\":[";
+    for (std::size_t i = 0; i < items; ++i) out += "{\"id\":" + std::to_string(i) + ",\"title\":\"<b>item</b>\"},";
+    return out + "{}]}}</script>\n</body>\n</html>\n";
+}
+
+std::vector<Corpus> generatedCorpus() {
+    Words words;
+    return {{"article", article(words, 120)},
+            {"listing", listing(words, 400)},
+            {"docs-table", docsTable(words, 1500)},
+            {"app-shell", appShell(words, 800)}};
+}
+
+template <typename F>
+double msPerOp(F&& fn) {
+    // at least 200ms per measurement, best of 3
+    double best = 1e300;
+    for (int rep = 0; rep < 3; ++rep) {
+        std::size_t iters = 0;
+        auto start = Clock::now();
+        double elapsed = 0;
+        do {
+            fn();
+            ++iters;
+            elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        } while (elapsed < 200);
+        best = std::min(best, elapsed / static_cast<double>(iters));
+    }
+    return best;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::vector<Corpus> corpus;
+    for (int i = 1; i < argc; ++i) {
+        std::ifstream in(argv[i], std::ios::binary);
+        if (!in) {
+            std::fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+        std::ostringstream data;
+        data << in.rdbuf();
+        corpus.push_back({argv[i], data.str()});
+    }
+    if (corpus.empty()) corpus = generatedCorpus();
+
+    std::printf("%-12s %8s %7s | %9s %9s %9s | %9s %9s %9s %9s | %7s\n", "page", "html KB", "nodes", "parse ms",
+                "chunk ms", "MB/s", "proto KB", "encode ms", "decode ms", "MB/s", "speedup");
+
+    double totalBytes = 0, totalHtmlMs = 0, totalProtoMs = 0;
+    for (const auto& page : corpus) {
+        const std::string& html = page.html;
+        const double mb = static_cast<double>(html.size()) / 1e6;
+
+        std::size_t nodes = 0;
+        const double parseMs = msPerOp([&] {
+            auto doc = parseHtml(html);
+            nodes = doc.size();
+        });
+        const double chunkMs = msPerOp([&] {
+            HtmlParser parser;
+            for (std::size_t at = 0; at < html.size(); at += kChunk) {
+                parser.feed(std::string_view(html).substr(at, kChunk));
+            }
+            auto doc = parser.finish();
+            if (doc.size() != nodes) std::abort();
+        });
+
+        // the same content as a SubmitPage request
+        auto tree = parseHtml(html).toTree();
+        std::string encoded;
+        const double encodeMs = msPerOp([&] {
+            openperf_rpc::SubmitPageRequest request;
+            Page p;
+            p.url = page.name;
+            p.root = tree;
+            toProto(p, request.mutable_page());
+            encoded.clear();
+            request.SerializeToString(&encoded);
+        });
+        const double decodeMs = msPerOp([&] {
+            openperf_rpc::SubmitPageRequest request;
+            request.ParseFromString(encoded);
+            Page p = fromProto(request.page());
+            auto doc = FlatDocument::fromTree(*p.root);
+            if (doc.size() != nodes) std::abort();
+        });
+
+        // the client side is part of the cost of the proto path
+        const double protoMs = encodeMs + decodeMs;
+        std::printf("%-12s %8.1f %7zu | %9.3f %9.3f %9.1f | %9.1f %9.3f %9.3f %9.1f | %6.1fx\n",
+                    page.name.substr(0, 12).c_str(), static_cast<double>(html.size()) / 1024, nodes, parseMs,
+                    chunkMs, mb / (chunkMs / 1e3), static_cast<double>(encoded.size()) / 1024, encodeMs, decodeMs,
+                    mb / (protoMs / 1e3), protoMs / chunkMs);
+
+        totalBytes += static_cast<double>(html.size());
+        totalHtmlMs += chunkMs;
+        totalProtoMs += protoMs;
+    }
+    std::printf("corpus: %.1f MB/s as streamed HTML, %.1f MB/s as proto trees\n", totalBytes / 1e6 / (totalHtmlMs / 1e3),
+                totalBytes / 1e6 / (totalProtoMs / 1e3));
+    return 0;
+}
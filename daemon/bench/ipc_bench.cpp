@@ -0,0 +1,249 @@
+// Round-trip latency and throughput of the same-host transports: gRPC over
+// loopback TCP (the sync service), a Unix domain socket and shared memory,
+// for submit, render (waiting for completion) and a11y calls. Everything runs
+// in one process against one Engine, so only the transport differs.
+//
+// usage: openperf_ipc_bench [threads] [millis_per_point]
+#include "openperf/engine.hpp"
+#include "openperf/engine_endpoint_adapter.hpp"
+#include "openperf/shm_endpoint.hpp"
+#include "openperf/uds_endpoint.hpp"
+#include "proto_convert.hpp"
+#include "service_impl.hpp"
+#include "openperf.grpc.pb.h"
+
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace openperf;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The calls being compared, as seen by a client of one transport.
+class Client {
+public:
+    virtual ~Client() = default;
+    virtual std::string submit(const Page& page) = 0;
+    virtual void render(const std::string& pageId) = 0;
+    virtual void analyze(const std::string& pageId) = 0;
+};
+
+class EndpointClient : public Client {
+public:
+    explicit EndpointClient(std::unique_ptr<IEngineEndpoint> endpoint) : endpoint_(std::move(endpoint)) {}
+
+    std::string submit(const Page& page) override { return endpoint_->submitPage(page); }
+    void render(const std::string& pageId) override {
+        // the wire clients call back once the remote render is done
+        endpoint_->runRenderPipeline(pageId, [](RenderResult) {});
+    }
+    void analyze(const std::string& pageId) override { endpoint_->analyzeAccessibility(pageId); }
+
+private:
+    std::unique_ptr<IEngineEndpoint> endpoint_;
+};
+
+class GrpcClient : public Client {
+public:
+    explicit GrpcClient(const std::shared_ptr<grpc::Channel>& channel)
+        : stub_(openperf_rpc::OpenPerfService::NewStub(channel)) {}
+
+    std::string submit(const Page& page) override {
+        grpc::ClientContext context;
+        openperf_rpc::SubmitPageRequest request;
+        toProto(page, request.mutable_page());
+        openperf_rpc::SubmitPageResponse response;
+        check(stub_->SubmitPage(&context, request, &response));
+        return response.page_id();
+    }
+
+    void render(const std::string& pageId) override {
+        grpc::ClientContext context;
+        openperf_rpc::RunRenderRequest request;
+        request.set_page_id(pageId);
+        request.set_wait_for_completion(true);
+        openperf_rpc::RunRenderResponse response;
+        check(stub_->RunRenderPipeline(&context, request, &response));
+    }
+
+    void analyze(const std::string& pageId) override {
+        grpc::ClientContext context;
+        openperf_rpc::AnalyzeAccessibilityRequest request;
+        request.set_page_id(pageId);
+        openperf_rpc::AnalyzeAccessibilityResponse response;
+        check(stub_->AnalyzeAccessibility(&context, request, &response));
+    }
+
+private:
+    static void check(const grpc::Status& status) {
+        if (!status.ok()) {
+            std::fprintf(stderr, "rpc failed: %s\n", status.error_message().c_str());
+            std::exit(1);
+        }
+    }
+
+    std::unique_ptr<openperf_rpc::OpenPerfService::Stub> stub_;
+};
+
+// A page of `nodes` elements in a few sections, with some unlabeled images.
+Page makePage(std::size_t nodes) {
+    static const char* kTags[] = {"div", "p", "img", "button", "a", "h2", "span", "li"};
+
+    Page page;
+    page.url = "https://example.com/bench";
+    page.root = std::make_shared<Node>();
+    page.root->tag = "body";
+    Node* section = nullptr;
+    for (std::size_t i = 1; i < nodes; ++i) {
+        auto node = std::make_shared<Node>();
+        if (i % 20 == 1) {
+            node->tag = "section";
+            section = node.get();
+            page.root->children.push_back(std::move(node));
+            continue;
+        }
+        node->tag = kTags[i % std::size(kTags)];
+        node->id = "n" + std::to_string(i);
+        if (i % 3 == 0) node->text = "content " + std::to_string(i);
+        node->isInteractive = node->tag == "button" || node->tag == "a";
+        section->children.push_back(std::move(node));
+    }
+    return page;
+}
+
+struct Op {
+    const char* name;
+    std::function<void(Client&, std::size_t)> run; // second arg: call index
+};
+
+struct Latency {
+    double p50 = 0;
+    double p99 = 0;
+};
+
+Latency measureLatency(Client& client, const Op& op, int millis) {
+    for (std::size_t i = 0; i < 20; ++i) op.run(client, i); // warm up
+
+    std::vector<double> us;
+    auto end = Clock::now() + std::chrono::milliseconds(millis);
+    for (std::size_t i = 0; Clock::now() < end; ++i) {
+        auto t0 = Clock::now();
+        op.run(client, i);
+        us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0).count());
+    }
+    std::sort(us.begin(), us.end());
+    return {us[us.size() / 2], us[std::min(us.size() - 1, us.size() * 99 / 100)]};
+}
+
+double measureThroughput(std::vector<std::unique_ptr<Client>>& clients, const Op& op, int millis) {
+    std::atomic<bool> go{false}, done{false};
+    std::atomic<std::size_t> ops{0};
+    std::vector<std::thread> threads;
+
+    for (auto& client : clients) {
+        threads.emplace_back([&, c = client.get()] {
+            std::size_t local = 0;
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            while (!done.load(std::memory_order_relaxed)) op.run(*c, local++);
+            ops.fetch_add(local);
+        });
+    }
+
+    auto t0 = Clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+    done.store(true);
+    for (auto& t : threads) t.join();
+    return static_cast<double>(ops.load()) / std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                   : std::max(1u, std::thread::hardware_concurrency());
+    int millis = argc > 2 ? std::atoi(argv[2]) : 500;
+
+    Engine engine;
+    engine.start();
+    EngineEndpointAdapter adapter(engine);
+
+    // gRPC, sync service on an ephemeral loopback port
+    OpenPerfServiceImpl service(engine);
+    int port = 0;
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &port);
+    builder.RegisterService(&service);
+    auto grpcServer = builder.BuildAndStart();
+    auto channel = grpc::CreateChannel("127.0.0.1:" + std::to_string(port), grpc::InsecureChannelCredentials());
+
+    auto tag = std::to_string(::getpid());
+    UdsEndpointServer udsServer(adapter, "/tmp/openperf-bench-" + tag + ".sock");
+    udsServer.start();
+
+    // shm regions are single-client, so each client gets its own server
+    std::vector<std::unique_ptr<ShmEndpointServer>> shmServers;
+    auto shmClient = [&](std::size_t index) {
+        auto name = "/openperf-bench-" + tag + "-" + std::to_string(index);
+        if (index >= shmServers.size()) {
+            shmServers.push_back(std::make_unique<ShmEndpointServer>(adapter, name));
+            shmServers.back()->start();
+        }
+        return std::make_unique<EndpointClient>(std::make_unique<ShmEndpointClient>(name));
+    };
+
+    struct Transport {
+        const char* name;
+        std::function<std::unique_ptr<Client>(std::size_t)> connect;
+    };
+    std::vector<Transport> transports = {
+        {"grpc", [&](std::size_t) { return std::make_unique<GrpcClient>(channel); }},
+        {"uds", [&](std::size_t) {
+             return std::make_unique<EndpointClient>(std::make_unique<UdsEndpointClient>(udsServer.path()));
+         }},
+        {"shm", shmClient},
+    };
+
+    const Page submitPage = makePage(50);
+    std::vector<std::string> analyzeIds;
+    for (int i = 0; i < 16; ++i) analyzeIds.push_back(engine.submitPage(makePage(200)));
+
+    std::vector<Op> ops = {
+        {"submit", [&](Client& c, std::size_t) { c.submit(submitPage); }},
+        {"render", [&](Client& c, std::size_t i) { c.render(analyzeIds[i % analyzeIds.size()]); }},
+        {"a11y", [&](Client& c, std::size_t i) { c.analyze(analyzeIds[i % analyzeIds.size()]); }},
+    };
+
+    std::printf("latency: 1 client; throughput: %zu clients, %d ms per point\n", threads, millis);
+    std::printf("%-6s %-9s %12s %12s %16s\n", "op", "transport", "p50_us", "p99_us", "ops/s");
+    for (const auto& op : ops) {
+        for (const auto& transport : transports) {
+            std::vector<std::unique_ptr<Client>> clients;
+            for (std::size_t i = 0; i < threads; ++i) clients.push_back(transport.connect(i));
+
+            auto latency = measureLatency(*clients[0], op, millis);
+            auto throughput = measureThroughput(clients, op, millis);
+            std::printf("%-6s %-9s %12.1f %12.1f %16.0f\n", op.name, transport.name, latency.p50, latency.p99, throughput);
+        }
+    }
+
+    for (auto& s : shmServers) s->stop();
+    udsServer.stop();
+    grpcServer->Shutdown();
+    engine.stop();
+    return 0;
+}
@@ -0,0 +1,365 @@
+// Closed-loop load generator for the OpenPerf daemon.
+//
+// Each client thread issues one RPC at a time for a fixed duration and
+// records its latency; the totals give throughput and tail latency. Run it
+// once against `openperf_daemon --mode sync` and once against
+// `--mode async` with the same flags to compare the two servers.
+//
+// With --overload F it first measures capacity that way, then offers F times
+// that rate open loop: calls go out on a fixed schedule whether or not
+// earlier ones have returned, each with a deadline, and latency counts from
+// the scheduled send time. Goodput is the rate of calls that succeeded
+// within their deadline; rejected calls (RESOURCE_EXHAUSTED) and timeouts
+// are reported apart, so admission policies can be compared at 2x load.
+
+#include "openperf.grpc.pb.h"
+
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string address = "localhost:50051";
+    std::string rpc = "render-wait"; // render-wait | render | a11y | metrics
+    std::size_t threads = 32;
+    std::size_t channels = 8; // separate connections, shared round-robin by threads
+    double seconds = 10;
+    std::size_t pages = 16;
+    std::size_t nodesPerPage = 200;
+    double overload = 0;     // open-loop rate as a multiple of capacity, 0 = closed loop only
+    double deadlineMs = 1000; // per call, open loop only
+};
+
+void usage(const char* argv0) {
+    std::fprintf(stderr,
+                 "usage: %s [--address host:port] [--rpc render-wait|render|a11y|metrics]\n"
+                 "          [--threads N] [--channels N] [--seconds S] [--pages N] [--nodes N]\n"
+                 "          [--overload F] [--deadline-ms D]\n",
+                 argv0);
+}
+
+bool parseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        if (arg == "--address") options.address = value;
+        else if (arg == "--rpc") options.rpc = value;
+        else if (arg == "--threads") options.threads = std::strtoul(value, nullptr, 10);
+        else if (arg == "--channels") options.channels = std::strtoul(value, nullptr, 10);
+        else if (arg == "--seconds") options.seconds = std::strtod(value, nullptr);
+        else if (arg == "--pages") options.pages = std::strtoul(value, nullptr, 10);
+        else if (arg == "--nodes") options.nodesPerPage = std::strtoul(value, nullptr, 10);
+        else if (arg == "--overload") options.overload = std::strtod(value, nullptr);
+        else if (arg == "--deadline-ms") options.deadlineMs = std::strtod(value, nullptr);
+        else return false;
+    }
+    return options.threads > 0 && options.channels > 0 && options.pages > 0 && options.overload >= 0 &&
+           options.deadlineMs > 0 &&
+           (options.rpc == "render-wait" || options.rpc == "render" ||
+            options.rpc == "a11y" || options.rpc == "metrics");
+}
+
+// A flat-ish page with a mix of elements the accessibility rules look at.
+openperf_rpc::Page makePage(std::size_t nodes) {
+    static const char* const tags[] = {"div", "p", "img", "button", "a", "h2", "span", "input"};
+
+    openperf_rpc::Page page;
+    page.set_url("https://example.com/load");
+    auto* root = page.mutable_root();
+    root->set_tag("body");
+    root->set_id("root");
+
+    openperf_rpc::Node* section = nullptr;
+    for (std::size_t i = 1; i < nodes; ++i) {
+        if (i % 16 == 1) {
+            section = root->add_children();
+            section->set_tag("section");
+            section->set_id("s" + std::to_string(i));
+            continue;
+        }
+        auto* node = section->add_children();
+        node->set_tag(tags[i % (sizeof(tags) / sizeof(tags[0]))]);
+        node->set_id("n" + std::to_string(i));
+        if (i % 3 == 0) node->set_text("content " + std::to_string(i));
+        node->set_is_interactive(node->tag() == "button" || node->tag() == "a" || node->tag() == "input");
+    }
+    return page;
+}
+
+std::shared_ptr<grpc::Channel> makeChannel(const std::string& address, std::size_t index) {
+    // distinct args keep channels from sharing one subchannel (connection)
+    grpc::ChannelArguments args;
+    args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+    args.SetInt("openperf.loadgen.channel", static_cast<int>(index));
+    return grpc::CreateCustomChannel(address, grpc::InsecureChannelCredentials(), args);
+}
+
+struct ThreadResult {
+    std::vector<double> latenciesMs;
+    std::size_t errors = 0;
+    std::size_t rejected = 0; // RESOURCE_EXHAUSTED, part of errors
+};
+
+// Everything a run measured, latencies of successful calls sorted.
+struct Summary {
+    std::vector<double> latenciesMs;
+    std::size_t errors = 0;
+    std::size_t rejected = 0;
+    std::size_t timeouts = 0; // DEADLINE_EXCEEDED, part of errors
+    double seconds = 0;
+
+    double rps() const { return static_cast<double>(latenciesMs.size()) / seconds; }
+};
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    auto rank = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+Summary runClosedLoop(const Options& options, const std::vector<std::shared_ptr<grpc::Channel>>& channels,
+                      const std::vector<std::string>& pageIds) {
+    std::atomic<bool> stop{false};
+    std::vector<ThreadResult> results(options.threads);
+    std::vector<std::thread> threads;
+
+    for (std::size_t t = 0; t < options.threads; ++t) {
+        threads.emplace_back([&, t] {
+            auto stub = openperf_rpc::OpenPerfService::NewStub(channels[t % channels.size()]);
+            auto& result = results[t];
+            result.latenciesMs.reserve(1 << 16);
+            std::size_t next = t;
+
+            while (!stop.load(std::memory_order_relaxed)) {
+                const auto& pageId = pageIds[next++ % pageIds.size()];
+                grpc::ClientContext context;
+                grpc::Status status;
+
+                auto start = Clock::now();
+                if (options.rpc == "render-wait" || options.rpc == "render") {
+                    openperf_rpc::RunRenderRequest request;
+                    request.set_page_id(pageId);
+                    request.set_wait_for_completion(options.rpc == "render-wait");
+                    openperf_rpc::RunRenderResponse response;
+                    status = stub->RunRenderPipeline(&context, request, &response);
+                } else if (options.rpc == "a11y") {
+                    openperf_rpc::AnalyzeAccessibilityRequest request;
+                    request.set_page_id(pageId);
+                    openperf_rpc::AnalyzeAccessibilityResponse response;
+                    status = stub->AnalyzeAccessibility(&context, request, &response);
+                } else {
+                    openperf_rpc::GetMetricsRequest request;
+                    request.set_omit_summaries(true);
+                    openperf_rpc::GetMetricsResponse response;
+                    status = stub->GetMetrics(&context, request, &response);
+                }
+                auto end = Clock::now();
+
+                if (status.ok()) {
+                    result.latenciesMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+                } else {
+                    ++result.errors;
+                    if (status.error_code() == grpc::StatusCode::RESOURCE_EXHAUSTED) ++result.rejected;
+                }
+            }
+        });
+    }
+
+    auto begin = Clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& t : threads) t.join();
+
+    Summary summary;
+    summary.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    for (auto& r : results) {
+        summary.latenciesMs.insert(summary.latenciesMs.end(), r.latenciesMs.begin(), r.latenciesMs.end());
+        summary.errors += r.errors;
+        summary.rejected += r.rejected;
+    }
+    std::sort(summary.latenciesMs.begin(), summary.latenciesMs.end());
+    return summary;
+}
+
+// One open-loop call in flight; the completion queue hands it back as its tag.
+struct OpenLoopCall {
+    virtual ~OpenLoopCall() = default;
+    grpc::ClientContext context;
+    grpc::Status status;
+    Clock::time_point scheduled;
+};
+
+template <class Response>
+struct TypedCall final : OpenLoopCall {
+    Response response;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<Response>> reader;
+};
+
+template <class Response, class Prepare>
+void startCall(Clock::time_point scheduled, double deadlineMs, Prepare&& prepare) {
+    auto* call = new TypedCall<Response>;
+    call->scheduled = scheduled;
+    call->context.set_deadline(std::chrono::system_clock::now() +
+                               std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                                   std::chrono::duration<double, std::milli>(deadlineMs)));
+    call->reader = prepare(&call->context);
+    call->reader->StartCall();
+    call->reader->Finish(&call->response, &call->status, call);
+}
+
+// Offers `rate` calls per second for options.seconds, spread over the channels.
+Summary runOpenLoop(const Options& options, const std::vector<std::shared_ptr<grpc::Channel>>& channels,
+                    const std::vector<std::string>& pageIds, double rate) {
+    std::vector<std::unique_ptr<openperf_rpc::OpenPerfService::Stub>> stubs;
+    for (const auto& channel : channels) stubs.push_back(openperf_rpc::OpenPerfService::NewStub(channel));
+    grpc::CompletionQueue cq;
+
+    // completions are drained by a few threads, so receiving never falls behind sending
+    const std::size_t receivers = std::min<std::size_t>(4, options.threads);
+    std::vector<ThreadResult> results(receivers);
+    std::vector<std::size_t> timeouts(receivers);
+    std::vector<std::thread> threads;
+    for (std::size_t r = 0; r < receivers; ++r) {
+        threads.emplace_back([&, r] {
+            void* tag = nullptr;
+            bool ok = false;
+            while (cq.Next(&tag, &ok)) {
+                std::unique_ptr<OpenLoopCall> call(static_cast<OpenLoopCall*>(tag));
+                if (call->status.ok()) {
+                    results[r].latenciesMs.push_back(
+                        std::chrono::duration<double, std::milli>(Clock::now() - call->scheduled).count());
+                    continue;
+                }
+                ++results[r].errors;
+                if (call->status.error_code() == grpc::StatusCode::RESOURCE_EXHAUSTED) ++results[r].rejected;
+                if (call->status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED) ++timeouts[r];
+            }
+        });
+    }
+
+    const auto interval = std::chrono::duration<double>(1.0 / rate);
+    const auto begin = Clock::now();
+    const auto end = begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.seconds));
+    std::size_t sent = 0;
+    for (;; ++sent) {
+        // a late sender catches up at once instead of stretching the schedule
+        const auto scheduled = begin + std::chrono::duration_cast<Clock::duration>(interval * static_cast<double>(sent));
+        if (scheduled >= end) break;
+        std::this_thread::sleep_until(scheduled);
+
+        auto& stub = *stubs[sent % stubs.size()];
+        const auto& pageId = pageIds[sent % pageIds.size()];
+        if (options.rpc == "render-wait" || options.rpc == "render") {
+            openperf_rpc::RunRenderRequest request;
+            request.set_page_id(pageId);
+            request.set_wait_for_completion(options.rpc == "render-wait");
+            startCall<openperf_rpc::RunRenderResponse>(scheduled, options.deadlineMs, [&](grpc::ClientContext* context) {
+                return stub.PrepareAsyncRunRenderPipeline(context, request, &cq);
+            });
+        } else if (options.rpc == "a11y") {
+            openperf_rpc::AnalyzeAccessibilityRequest request;
+            request.set_page_id(pageId);
+            startCall<openperf_rpc::AnalyzeAccessibilityResponse>(
+                scheduled, options.deadlineMs,
+                [&](grpc::ClientContext* context) { return stub.PrepareAsyncAnalyzeAccessibility(context, request, &cq); });
+        } else {
+            openperf_rpc::GetMetricsRequest request;
+            request.set_omit_summaries(true);
+            startCall<openperf_rpc::GetMetricsResponse>(scheduled, options.deadlineMs, [&](grpc::ClientContext* context) {
+                return stub.PrepareAsyncGetMetrics(context, request, &cq);
+            });
+        }
+    }
+
+    // calls still out end by their deadline at the latest
+    cq.Shutdown();
+    for (auto& t : threads) t.join();
+
+    Summary summary;
+    summary.seconds = std::chrono::duration<double>(end - begin).count();
+    for (std::size_t r = 0; r < receivers; ++r) {
+        summary.latenciesMs.insert(summary.latenciesMs.end(), results[r].latenciesMs.begin(),
+                                   results[r].latenciesMs.end());
+        summary.errors += results[r].errors;
+        summary.rejected += results[r].rejected;
+        summary.timeouts += timeouts[r];
+    }
+    std::sort(summary.latenciesMs.begin(), summary.latenciesMs.end());
+    return summary;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<std::shared_ptr<grpc::Channel>> channels;
+    for (std::size_t i = 0; i < options.channels; ++i) {
+        channels.push_back(makeChannel(options.address, i));
+    }
+
+    // seed pages
+    std::vector<std::string> pageIds;
+    {
+        auto stub = openperf_rpc::OpenPerfService::NewStub(channels[0]);
+        for (std::size_t i = 0; i < options.pages; ++i) {
+            grpc::ClientContext context;
+            openperf_rpc::SubmitPageRequest request;
+            *request.mutable_page() = makePage(options.nodesPerPage);
+            openperf_rpc::SubmitPageResponse response;
+            auto status = stub->SubmitPage(&context, request, &response);
+            if (!status.ok()) {
+                std::fprintf(stderr, "SubmitPage failed: %s\n", status.error_message().c_str());
+                return 1;
+            }
+            pageIds.push_back(response.page_id());
+        }
+    }
+
+    auto closed = runClosedLoop(options, channels, pageIds);
+    const auto& all = closed.latenciesMs;
+
+    std::printf("rpc=%s threads=%zu channels=%zu seconds=%.1f\n",
+                options.rpc.c_str(), options.threads, options.channels, closed.seconds);
+    std::printf("%-10s %-8s %-10s %-9s %-9s %-9s %-9s %-9s\n",
+                "ok", "errors", "rps", "p50_ms", "p90_ms", "p99_ms", "p999_ms", "max_ms");
+    std::printf("%-10zu %-8zu %-10.0f %-9.3f %-9.3f %-9.3f %-9.3f %-9.3f\n",
+                all.size(), closed.errors, closed.rps(),
+                percentile(all, 0.50), percentile(all, 0.90), percentile(all, 0.99),
+                percentile(all, 0.999), all.empty() ? 0.0 : all.back());
+    if (options.overload == 0) return 0;
+    if (all.empty()) {
+        std::fprintf(stderr, "no call succeeded, so there is no capacity to overload\n");
+        return 1;
+    }
+
+    const double offered = options.overload * closed.rps();
+    auto open = runOpenLoop(options, channels, pageIds, offered);
+    const auto& ok = open.latenciesMs;
+    std::printf("\nopen loop at %.1fx capacity: %.0f rps offered, deadline %.0f ms\n", options.overload, offered,
+                options.deadlineMs);
+    std::printf("%-10s %-10s %-10s %-10s %-8s %-9s %-9s %-9s\n",
+                "goodput", "rejected/s", "timeouts/s", "errors", "ok_pct", "p50_ms", "p99_ms", "p999_ms");
+    std::printf("%-10.0f %-10.0f %-10.0f %-10zu %-8.1f %-9.3f %-9.3f %-9.3f\n", open.rps(),
+                static_cast<double>(open.rejected) / open.seconds, static_cast<double>(open.timeouts) / open.seconds,
+                open.errors - open.rejected - open.timeouts,
+                100.0 * static_cast<double>(ok.size()) / static_cast<double>(ok.size() + open.errors),
+                percentile(ok, 0.50), percentile(ok, 0.99), percentile(ok, 0.999));
+    return 0;
+}
@@ -0,0 +1,132 @@
+// SubmitPage request handling by tree size: decoding the request and
+// converting it to a core Page, the daemon's work before the engine sees
+// the page. The current converter (iterative, limits checked first,
+// strings moved out of the request) runs next to the recursive one it
+// replaced, which is kept here as the baseline and copies every string.
+//
+// Trees are balanced with the given fanout, so they stay well inside
+// protobuf's decoding depth limit at every size.
+//
+// usage: openperf_submit_bench [fanout]
+#include "proto_convert.hpp"
+#include "openperf.pb.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The previous conversion, for comparison.
+std::shared_ptr<openperf::Node> recursiveFromProto(const openperf_rpc::Node& protoNode) {
+    auto node = std::make_shared<openperf::Node>();
+    node->id = protoNode.id();
+    node->tag = protoNode.tag();
+    node->text = protoNode.text();
+    node->role = protoNode.role();
+    node->ariaLabel = protoNode.aria_label();
+    node->isInteractive = protoNode.is_interactive();
+    if (protoNode.has_style()) {
+        // the style fields this bench sets; both converters read them the same way
+        const auto& style = protoNode.style();
+        node->style.width = style.width();
+        node->style.height = style.height();
+        node->style.background = style.background();
+    }
+    node->children.reserve(protoNode.children_size());
+    for (const auto& child : protoNode.children()) node->children.push_back(recursiveFromProto(child));
+    return node;
+}
+
+// `count` nodes in breadth-first order, each parent with up to `fanout`
+// children. Text is long enough not to fit a small-string buffer.
+std::string encodedPage(std::size_t count, std::size_t fanout) {
+    openperf_rpc::SubmitPageRequest request;
+    request.mutable_page()->set_url("https://example.com/bench");
+    std::deque<openperf_rpc::Node*> parents;
+    auto fill = [](openperf_rpc::Node* node, std::size_t i) {
+        node->set_id("node-" + std::to_string(i));
+        node->set_tag(i % 3 ? "div" : "p");
+        node->set_text("generated text content for node number " + std::to_string(i));
+        if (i % 5 == 0) node->set_role("listitem");
+        if (i % 7 == 0) node->set_aria_label("label for node " + std::to_string(i));
+        node->set_is_interactive(i % 11 == 0);
+        node->mutable_style()->set_height(20);
+    };
+    auto* root = request.mutable_page()->mutable_root();
+    fill(root, 0);
+    parents.push_back(root);
+    for (std::size_t i = 1; i < count; ++i) {
+        auto* parent = parents.front();
+        auto* child = parent->add_children();
+        fill(child, i);
+        parents.push_back(child);
+        if (static_cast<std::size_t>(parent->children_size()) == fanout) parents.pop_front();
+    }
+    std::string encoded;
+    request.SerializeToString(&encoded);
+    return encoded;
+}
+
+template <typename F>
+double msPerOp(F&& fn) {
+    // at least 200ms per measurement, best of 3
+    double best = 1e300;
+    for (int rep = 0; rep < 3; ++rep) {
+        std::size_t iters = 0;
+        auto start = Clock::now();
+        double elapsed = 0;
+        do {
+            fn();
+            ++iters;
+            elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        } while (elapsed < 200);
+        best = std::min(best, elapsed / static_cast<double>(iters));
+    }
+    return best;
+}
+
+}
+
+int main(int argc, char** argv) {
+    const std::size_t fanout = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+    if (fanout < 2) {
+        std::fprintf(stderr, "fanout must be at least 2\n");
+        return 1;
+    }
+
+    std::printf("fanout %zu\n", fanout);
+    std::printf("%8s %9s | %9s %11s %11s | %9s %11s %11s | %7s\n", "nodes", "proto KB", "old ms", "old nodes/s",
+                "old pages/s", "new ms", "new nodes/s", "new pages/s", "speedup");
+    for (std::size_t count : {100, 1'000, 10'000, 100'000}) {
+        const std::string encoded = encodedPage(count, fanout);
+
+        const double oldMs = msPerOp([&] {
+            openperf_rpc::SubmitPageRequest request;
+            request.ParseFromString(encoded);
+            openperf::Page page;
+            page.id = request.page().id();
+            page.url = request.page().url();
+            page.root = recursiveFromProto(request.page().root());
+            if (!page.root) std::abort();
+        });
+        const double newMs = msPerOp([&] {
+            openperf_rpc::SubmitPageRequest request;
+            request.ParseFromString(encoded);
+            openperf::Page page;
+            if (!fromProto(std::move(*request.mutable_page()), TreeLimits{}, &page).ok()) std::abort();
+        });
+
+        const auto nodes = static_cast<double>(count);
+        std::printf("%8zu %9.1f | %9.3f %11.3g %11.0f | %9.3f %11.3g %11.0f | %6.2fx\n", count,
+                    static_cast<double>(encoded.size()) / 1024, oldMs, nodes / (oldMs / 1e3), 1e3 / oldMs, newMs,
+                    nodes / (newMs / 1e3), 1e3 / newMs, oldMs / newMs);
+    }
+    return 0;
+}
@@ -0,0 +1,583 @@
+#include "async_server.hpp"
+#include "proto_convert.hpp"
+#include "openperf/cpu_topology.hpp"
+#include "openperf/html_parser.hpp"
+#include "openperf/trace.hpp"
+
+#include <grpcpp/alarm.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using openperf_rpc::HtmlChunk;
+using openperf_rpc::MetricsUpdate;
+using openperf_rpc::SubmitHtmlResponse;
+using openperf_rpc::WatchMetricsRequest;
+
+namespace {
+
+// calls still open this long after shutdown() are cancelled
+constexpr auto kShutdownGrace = std::chrono::seconds(2);
+
+void pinToCore(std::thread& thread, int core) {
+    if (!openperf::pinThread(thread, {core})) {
+        std::cerr << "[daemon] could not pin CQ thread to core " << core << "\n";
+    }
+}
+
+} // namespace
+
+// Everything handed to a completion queue as a tag.
+struct AsyncOpenPerfServer::Tag {
+    virtual ~Tag() = default;
+    virtual void proceed(bool ok) = 0;
+};
+
+// A call object; counted so shutdown() knows when the queues are idle.
+class AsyncOpenPerfServer::Call : public Tag {
+public:
+    explicit Call(AsyncOpenPerfServer& server) : server_(server) {
+        server_.liveCalls_.fetch_add(1, std::memory_order_relaxed);
+    }
+    ~Call() override { server_.callDestroyed(); }
+
+protected:
+    AsyncOpenPerfServer& server_;
+};
+
+template <class Request, class Response>
+class AsyncOpenPerfServer::UnaryCall final : public Call {
+public:
+    using Service = openperf_rpc::OpenPerfService::AsyncService;
+    using RequestFn = void (Service::*)(::grpc::ServerContext*, Request*,
+                                        ::grpc::ServerAsyncResponseWriter<Response>*,
+                                        ::grpc::CompletionQueue*, ::grpc::ServerCompletionQueue*, void*);
+    using Handler = void (AsyncOpenPerfServer::*)(UnaryCall&);
+
+    UnaryCall(AsyncOpenPerfServer& server, ::grpc::ServerCompletionQueue* cq, RequestFn request, Handler handler)
+        : Call(server), cq_(cq), request_(request), handler_(handler), responder_(&context_) {
+        (server_.service_.*request_)(&context_, &requestMsg_, &responder_, cq_, cq_, this);
+    }
+
+    const ::grpc::ServerContext& context() const { return context_; }
+    const Request& request() const { return requestMsg_; }
+    Request& mutableRequest() { return requestMsg_; } // for handlers that move out of it
+    Response& response() { return responseMsg_; }
+
+    // Safe from any thread, exactly once.
+    void finish(const ::grpc::Status& status) {
+        finishing_ = true;
+        responder_.Finish(responseMsg_, status, this);
+    }
+
+    void proceed(bool ok) override {
+        // ok == false before finishing means the server shut down unmatched
+        if (finishing_ || !ok) {
+            delete this;
+            return;
+        }
+
+        // keep one request armed for the next caller of this method
+        if (!server_.shuttingDown_.load(std::memory_order_acquire)) {
+            new UnaryCall(server_, cq_, request_, handler_);
+        }
+        auto status = server_.admit(
+            context_, requestCost(requestMsg_), [this] { (server_.*handler_)(*this); },
+            [this] { finish(::grpc::Status(::grpc::StatusCode::DEADLINE_EXCEEDED, "deadline passed while queued")); });
+        if (!status.ok()) finish(status);
+    }
+
+private:
+    ::grpc::ServerCompletionQueue* cq_;
+    RequestFn request_;
+    Handler handler_;
+
+    ::grpc::ServerContext context_;
+    Request requestMsg_;
+    Response responseMsg_;
+    ::grpc::ServerAsyncResponseWriter<Response> responder_;
+    bool finishing_ = false;
+};
+
+/**
+ * Server-streaming WatchMetrics. An alarm on the call's queue paces the
+ * updates; building an update runs on the scheduler. The stream only ends
+ * when the client cancels or the server shuts down, which the done tag
+ * reports, so the call is deleted once that has been seen and no operation
+ * of its own is still pending.
+ */
+class AsyncOpenPerfServer::WatchMetricsCall final : public Call {
+public:
+    WatchMetricsCall(AsyncOpenPerfServer& server, ::grpc::ServerCompletionQueue* cq)
+        : Call(server), cq_(cq), writer_(&context_), doneTag_(this) {
+        context_.AsyncNotifyWhenDone(&doneTag_);
+        server_.service_.RequestWatchMetrics(&context_, &request_, &writer_, cq_, cq_, this);
+    }
+
+    void proceed(bool ok) override {
+        std::unique_lock<std::mutex> lock{mutex_};
+        switch (state_) {
+            case State::Requested:
+                if (!ok) {
+                    // never matched, so the done tag will not be delivered either
+                    lock.unlock();
+                    delete this;
+                    return;
+                }
+                if (!server_.shuttingDown_.load(std::memory_order_acquire)) {
+                    new WatchMetricsCall(server_, cq_);
+                }
+                if (auto status = server_.limiter_.admit(context_, 1); !status.ok()) {
+                    state_ = State::Finishing;
+                    writer_.Finish(status, this);
+                    return;
+                }
+                cursor_ = request_.since();
+                interval_ = watchInterval(request_);
+                maxBatch_ = request_.max_batch_samples() ? request_.max_batch_samples() : 1000;
+                if (!done_) {
+                    arm();
+                    return;
+                }
+                break;
+
+            case State::Waiting: // alarm fired or was cancelled
+                if (ok && !done_) {
+                    state_ = State::Polling;
+                    server_.dispatch([this] { poll(); });
+                    return;
+                }
+                break;
+
+            case State::Writing:
+                if (ok && !done_) {
+                    arm();
+                    return;
+                }
+                break;
+
+            case State::Polling:
+            case State::Finishing:
+            case State::Stopped:
+                break;
+        }
+
+        state_ = State::Stopped;
+        bool destroy = done_;
+        lock.unlock();
+        if (destroy) delete this;
+    }
+
+private:
+    enum class State { Requested, Waiting, Polling, Writing, Finishing, Stopped };
+
+    struct DoneTag final : Tag {
+        explicit DoneTag(WatchMetricsCall* call) : call(call) {}
+        void proceed(bool) override { call->onDone(); }
+        WatchMetricsCall* call;
+    };
+
+    // Runs on the scheduler.
+    void poll() {
+        auto delta = server_.engine_.getMetricsSince(cursor_);
+
+        std::unique_lock<std::mutex> lock{mutex_};
+        if (done_) {
+            state_ = State::Stopped;
+            lock.unlock();
+            delete this;
+            return;
+        }
+        if (delta.samples.empty() && delta.missed == 0) {
+            arm();
+            return;
+        }
+
+        // the next poll starts from here; a failed write ends the stream anyway
+        cursor_ = delta.cursor;
+        update_.Clear();
+        toProto(delta, maxBatch_, &update_);
+        state_ = State::Writing;
+        writer_.Write(update_, this);
+    }
+
+    void onDone() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        done_ = true;
+        if (state_ == State::Waiting) alarm_.Cancel();
+        bool destroy = state_ == State::Stopped;
+        lock.unlock();
+        if (destroy) delete this;
+    }
+
+    // mutex_ held
+    void arm() {
+        state_ = State::Waiting;
+        alarm_.Set(cq_, std::chrono::system_clock::now() + interval_, this);
+    }
+
+    ::grpc::ServerCompletionQueue* cq_;
+    ::grpc::ServerContext context_;
+    WatchMetricsRequest request_;
+    ::grpc::ServerAsyncWriter<MetricsUpdate> writer_;
+    DoneTag doneTag_;
+    ::grpc::Alarm alarm_;
+
+    std::mutex mutex_;
+    State state_ = State::Requested;
+    bool done_ = false; // client cancelled or server shut down
+    std::uint64_t cursor_ = 0;
+    std::chrono::milliseconds interval_{500};
+    std::size_t maxBatch_ = 1000;
+    MetricsUpdate update_; // must outlive the pending Write
+};
+
+/**
+ * Client-streaming SubmitHtml. Each chunk is parsed on the scheduler, and
+ * the next read is only started once it has been, so chunks are parsed in
+ * order and at most one is buffered. The call has a single operation in
+ * flight at any time, which is what orders its state changes.
+ */
+class AsyncOpenPerfServer::SubmitHtmlCall final : public Call {
+public:
+    SubmitHtmlCall(AsyncOpenPerfServer& server, ::grpc::ServerCompletionQueue* cq)
+        : Call(server), cq_(cq), reader_(&context_), parser_(parserOptions(server.options_.treeLimits)) {
+        server_.service_.RequestSubmitHtml(&context_, &reader_, cq_, cq_, this);
+    }
+
+    void proceed(bool ok) override {
+        switch (state_) {
+            case State::Requested:
+                if (!ok) break;
+                if (!server_.shuttingDown_.load(std::memory_order_acquire)) {
+                    new SubmitHtmlCall(server_, cq_);
+                }
+                if (auto status = server_.limiter_.admit(context_, 1); !status.ok()) {
+                    state_ = State::Finishing;
+                    reader_.FinishWithError(status, this);
+                    return;
+                }
+                read();
+                return;
+
+            case State::Reading: // a chunk, or the end of the stream
+                server_.dispatch([this, ok] { ok ? parse() : submit(); });
+                return;
+
+            case State::Finishing:
+                break;
+        }
+        delete this;
+    }
+
+private:
+    enum class State { Requested, Reading, Finishing };
+
+    void read() {
+        state_ = State::Reading;
+        reader_.Read(&chunk_, this);
+    }
+
+    // Runs on the scheduler.
+    void parse() {
+        if (first_) {
+            page_.id = chunk_.page_id();
+            page_.url = chunk_.url();
+            first_ = false;
+        }
+        if (auto status = checkHtml(parser_, chunk_.data().size(), server_.options_.treeLimits); !status.ok()) {
+            state_ = State::Finishing;
+            reader_.FinishWithError(status, this);
+            return;
+        }
+        parser_.feed(chunk_.data());
+        complete_ = chunk_.last();
+        read();
+    }
+
+    // Runs on the scheduler.
+    void submit() {
+        state_ = State::Finishing;
+        if (auto status = checkHtml(parser_, 0, server_.options_.treeLimits); !status.ok()) {
+            reader_.FinishWithError(status, this);
+            return;
+        }
+        if (!complete_) {
+            reader_.FinishWithError(
+                ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "html stream ended before its last chunk"), this);
+            return;
+        }
+
+        response_.set_bytes(parser_.bytesFed());
+        auto dom = std::make_shared<const openperf::FlatDocument>(parser_.finish());
+        if (dom->empty()) {
+            reader_.FinishWithError(::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "html has no elements"), this);
+            return;
+        }
+        response_.set_nodes(dom->size());
+        page_.dom = std::move(dom);
+
+        response_.set_page_id(server_.engine_.submitPage(std::move(page_)));
+        reader_.Finish(response_, ::grpc::Status::OK, this);
+    }
+
+    ::grpc::ServerCompletionQueue* cq_;
+    ::grpc::ServerContext context_;
+    ::grpc::ServerAsyncReader<SubmitHtmlResponse, HtmlChunk> reader_;
+    State state_ = State::Requested;
+
+    HtmlChunk chunk_;
+    openperf::HtmlParser parser_;
+    openperf::Page page_;
+    bool first_ = true;
+    bool complete_ = false;
+    SubmitHtmlResponse response_;
+};
+
+AsyncOpenPerfServer::AsyncOpenPerfServer(openperf::Engine& engine, Options options)
+    : engine_(engine), options_(std::move(options)), limiter_(options_.rateLimit) {
+    if (options_.cqThreads == 0) options_.cqThreads = 1;
+}
+
+AsyncOpenPerfServer::~AsyncOpenPerfServer() {
+    shutdown();
+}
+
+bool AsyncOpenPerfServer::start() {
+    ::grpc::ServerBuilder builder;
+    builder.AddListeningPort(options_.address, ::grpc::InsecureServerCredentials());
+    builder.RegisterService(&service_);
+    builder.SetMaxReceiveMessageSize(kMaxRequestBytes);
+    for (std::size_t i = 0; i < options_.cqThreads; ++i) {
+        cqs_.push_back(builder.AddCompletionQueue());
+    }
+
+    server_ = builder.BuildAndStart();
+    if (!server_) return false;
+
+    for (auto& cq : cqs_) requestCalls(cq.get());
+
+    const std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t i = 0; i < cqs_.size(); ++i) {
+        threads_.emplace_back([this, i] { serve(i); });
+        if (!options_.pinThreads) continue;
+        pinToCore(threads_.back(), options_.cpus.empty() ? static_cast<int>(i % cores)
+                                                         : options_.cpus[i % options_.cpus.size()]);
+    }
+    return true;
+}
+
+void AsyncOpenPerfServer::wait() {
+    if (server_) server_->Wait();
+}
+
+void AsyncOpenPerfServer::shutdown() {
+    if (!server_ || shuttingDown_.exchange(true, std::memory_order_acq_rel)) return;
+
+    server_->Shutdown(std::chrono::system_clock::now() + kShutdownGrace);
+
+    // pending requests fail, open calls are cancelled and renders still in
+    // the pipeline finish their calls; only then may the queues close
+    {
+        std::unique_lock<std::mutex> lock{callsMutex_};
+        callsCv_.wait(lock, [this] { return liveCalls_.load(std::memory_order_acquire) == 0; });
+    }
+
+    for (auto& cq : cqs_) cq->Shutdown();
+    for (auto& t : threads_) t.join();
+    threads_.clear();
+}
+
+void AsyncOpenPerfServer::requestCalls(::grpc::ServerCompletionQueue* cq) {
+    using Service = openperf_rpc::OpenPerfService::AsyncService;
+    new SubmitPageCall(*this, cq, &Service::RequestSubmitPage, &AsyncOpenPerfServer::handleSubmitPage);
+    new PatchPageCall(*this, cq, &Service::RequestPatchPage, &AsyncOpenPerfServer::handlePatchPage);
+    new RunRenderCall(*this, cq, &Service::RequestRunRenderPipeline, &AsyncOpenPerfServer::handleRunRender);
+    new AnalyzeCall(*this, cq, &Service::RequestAnalyzeAccessibility, &AsyncOpenPerfServer::handleAnalyze);
+    new GetMetricsCall(*this, cq, &Service::RequestGetMetrics, &AsyncOpenPerfServer::handleGetMetrics);
+    new SubmitPagesCall(*this, cq, &Service::RequestSubmitPages, &AsyncOpenPerfServer::handleSubmitPages);
+    new RunRenderBatchCall(*this, cq, &Service::RequestRunRenderBatch, &AsyncOpenPerfServer::handleRunRenderBatch);
+    new AnalyzeBatchCall(*this, cq, &Service::RequestAnalyzeAccessibilityBatch,
+                         &AsyncOpenPerfServer::handleAnalyzeBatch);
+    new WatchMetricsCall(*this, cq);
+    new SubmitHtmlCall(*this, cq);
+}
+
+void AsyncOpenPerfServer::serve(std::size_t index) {
+    auto& cq = *cqs_[index];
+    void* tag = nullptr;
+    bool ok = false;
+    while (cq.Next(&tag, &ok)) {
+        static_cast<Tag*>(tag)->proceed(ok);
+    }
+}
+
+void AsyncOpenPerfServer::dispatch(openperf::Task task) {
+    engine_.scheduler().enqueue(std::move(task));
+}
+
+::grpc::Status AsyncOpenPerfServer::admit(const ::grpc::ServerContext& context, std::size_t cost,
+                                           openperf::Task task, openperf::Task onExpired) {
+    if (auto status = limiter_.admit(context, cost); !status.ok()) return status;
+    auto& scheduler = engine_.scheduler();
+    const auto options = callOptions(context, limiter_.fromTrustedGateway(context));
+    if (options_.maxQueuedCalls == 0) {
+        scheduler.enqueue(std::move(task), options, std::move(onExpired));
+    } else if (!scheduler.tryEnqueue(std::move(task), options_.maxQueuedCalls, options, std::move(onExpired))) {
+        return ::grpc::Status(::grpc::StatusCode::RESOURCE_EXHAUSTED, "server is overloaded");
+    }
+    return ::grpc::Status::OK;
+}
+
+void AsyncOpenPerfServer::callDestroyed() {
+    if (liveCalls_.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+        shuttingDown_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock{callsMutex_};
+        callsCv_.notify_all();
+    }
+}
+
+void AsyncOpenPerfServer::handleSubmitPage(SubmitPageCall& call) {
+    OPENPERF_TRACE_SPAN("rpc", "SubmitPage");
+    if (!call.request().has_page()) {
+        call.finish(::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "page is required"));
+        return;
+    }
+
+    openperf::Page page;
+    auto status = fromProto(std::move(*call.mutableRequest().mutable_page()), options_.treeLimits, &page);
+    if (!status.ok()) {
+        call.finish(status);
+        return;
+    }
+    call.response().set_page_id(engine_.submitPage(std::move(page)));
+    call.finish(::grpc::Status::OK);
+}
+
+void AsyncOpenPerfServer::handlePatchPage(PatchPageCall& call) {
+    OPENPERF_TRACE_SPAN("rpc", "PatchPage");
+    auto& request = call.mutableRequest();
+    if (request.page_id().empty()) {
+        call.finish(::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "page_id is required"));
+        return;
+    }
+
+    std::vector<openperf::NodeMutation> mutations;
+    if (auto status = fromProto(std::move(*request.mutable_mutations()), options_.treeLimits, &mutations); !status.ok()) {
+        call.finish(status);
+        return;
+    }
+
+    auto result = engine_.patchPage(request.page_id(), mutations);
+    call.response().set_changed_nodes(result.changedNodes);
+    call.finish(toStatus(result));
+}
+
+void AsyncOpenPerfServer::handleRunRender(RunRenderCall& call) {
+    OPENPERF_TRACE_SPAN("rpc", "RunRenderPipeline");
+    const auto& pageId = call.request().page_id();
+    if (pageId.empty()) {
+        call.finish(::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "page_id is required"));
+        return;
+    }
+
+    const auto options = callOptions(call.context(), limiter_.fromTrustedGateway(call.context()));
+    if (!call.request().wait_for_completion()) {
+        // the call ends here, so its deadline does not bind the render
+        engine_.runRenderPipeline(pageId, nullptr, {options.priority});
+        call.finish(::grpc::Status::OK);
+        return;
+    }
+
+    engine_.runRenderPipeline(pageId, [&call](openperf::RenderResult result) {
+        toProto(result, &call.response());
+        call.finish(toStatus(result));
+    }, options);
+}
+
+void AsyncOpenPerfServer::handleAnalyze(AnalyzeCall& call) {
+    OPENPERF_TRACE_SPAN("rpc", "AnalyzeAccessibility");
+    const auto& pageId = call.request().page_id();
+    if (pageId.empty()) {
+        call.finish(::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "page_id is required"));
+        return;
+    }
+
+    for (const auto& issue : engine_.analyzeAccessibility(pageId)) {
+        toProto(issue, call.response().add_issues());
+    }
+    call.finish(::grpc::Status::OK);
+}
+
+void AsyncOpenPerfServer::handleSubmitPages(SubmitPagesCall& call) {
+    OPENPERF_TRACE_SPAN("rpc", "SubmitPages");
+    // pages that fail conversion get their status, the rest are stored together
+    auto* pagesIn = call.mutableRequest().mutable_pages();
+    auto& response = call.response();
+    std::vector<openperf::Page> pages;
+    std::vector<int> slots;
+    pages.reserve(pagesIn->size());
+    slots.reserve(pagesIn->size());
+    response.mutable_results()->Reserve(pagesIn->size());
+    for (int i = 0; i < pagesIn->size(); ++i) {
+        auto* item = response.add_results();
+        openperf::Page page;
+        auto status = fromProto(std::move(*pagesIn->Mutable(i)), options_.treeLimits, &page);
+        if (!status.ok()) {
+            toProto(status, item->mutable_status());
+            continue;
+        }
+        pages.push_back(std::move(page));
+        slots.push_back(i);
+    }
+
+    auto ids = engine_.submitPages(std::move(pages));
+    for (std::size_t i = 0; i < ids.size(); ++i) response.mutable_results(slots[i])->set_page_id(std::move(ids[i]));
+    call.finish(::grpc::Status::OK);
+}
+
+void AsyncOpenPerfServer::handleRunRenderBatch(RunRenderBatchCall& call) {
+    OPENPERF_TRACE_SPAN("rpc", "RunRenderBatch");
+    const auto& request = call.request();
+    std::vector<std::string> pageIds(request.page_ids().begin(), request.page_ids().end());
+    const auto options = callOptions(call.context(), limiter_.fromTrustedGateway(call.context()));
+    if (!request.wait_for_completion()) {
+        engine_.runRenderBatch(pageIds, nullptr, {options.priority});
+        call.finish(::grpc::Status::OK);
+        return;
+    }
+
+    engine_.runRenderBatch(pageIds, [&call](std::vector<openperf::RenderResult> results) {
+        toProto(results, &call.response());
+        call.finish(::grpc::Status::OK);
+    }, options);
+}
+
+void AsyncOpenPerfServer::handleAnalyzeBatch(AnalyzeBatchCall& call) {
+    OPENPERF_TRACE_SPAN("rpc", "AnalyzeAccessibilityBatch");
+    const auto& request = call.request();
+    std::vector<std::string> pageIds(request.page_ids().begin(), request.page_ids().end());
+    toProto(engine_.analyzeAccessibilityBatch(pageIds), request.page_ids(), &call.response());
+    call.finish(::grpc::Status::OK);
+}
+
+void AsyncOpenPerfServer::handleGetMetrics(GetMetricsCall& call) {
+    OPENPERF_TRACE_SPAN("rpc", "GetMetrics");
+    auto delta = engine_.getMetricsSince(call.request().since());
+    auto& response = call.response();
+    for (const auto& s : delta.samples) {
+        toProto(s, response.add_samples());
+    }
+    response.set_next_cursor(delta.cursor);
+    response.set_missed(delta.missed);
+
+    if (!call.request().omit_summaries()) {
+        for (const auto& summary : engine_.getMetricSummaries()) {
+            toProto(summary, response.add_summaries());
+        }
+    }
+    call.finish(::grpc::Status::OK);
+}
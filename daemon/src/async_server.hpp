@@ -0,0 +1,119 @@
+#pragma once
+
+#include "openperf/engine.hpp"
+#include "proto_convert.hpp"
+#include "rate_limiter.hpp"
+#include "openperf.grpc.pb.h"
+
+#include <grpcpp/grpcpp.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Completion-queue (async API) implementation of the OpenPerf service.
+ *
+ * Each CQ thread owns one completion queue and is optionally pinned to a
+ * core. CQ threads only move calls between states; handlers run on the
+ * engine's TaskScheduler. RunRenderPipeline with wait_for_completion is
+ * finished from the pipeline's completion callback, so an in-progress render
+ * holds no thread, unlike OpenPerfServiceImpl where it holds a gRPC thread;
+ * the same goes for RunRenderBatch.
+ *
+ * New calls are turned away with RESOURCE_EXHAUSTED on the CQ thread, before
+ * reaching the scheduler, when the client is over its rate limit or
+ * maxQueuedCalls tasks are already waiting for a worker. Admitted calls
+ * wait in the scheduler lane their x-priority metadata names, and fail
+ * with DEADLINE_EXCEEDED instead of running once their deadline has passed.
+ */
+class AsyncOpenPerfServer {
+public:
+    struct Options {
+        std::string address = "0.0.0.0:50051";
+        std::size_t cqThreads = 2;
+        bool pinThreads = true; // CQ thread i runs on cpus[i], or core i without cpus (mod count)
+        std::vector<int> cpus;
+        TreeLimits treeLimits;  // for trees in SubmitPage, PatchPage and SubmitHtml
+        RateLimiter::Options rateLimit;
+        std::size_t maxQueuedCalls = 0; // scheduler backlog new calls may join, 0 = unlimited
+    };
+
+    AsyncOpenPerfServer(openperf::Engine& engine, Options options);
+    ~AsyncOpenPerfServer();
+
+    AsyncOpenPerfServer(const AsyncOpenPerfServer&) = delete;
+    AsyncOpenPerfServer& operator=(const AsyncOpenPerfServer&) = delete;
+
+    // Returns false if the server could not bind its address.
+    bool start();
+
+    // Blocks until shutdown() is called from another thread.
+    void wait();
+
+    // Cancels calls still open after a short grace period, then stops the
+    // CQ threads. Idempotent.
+    void shutdown();
+
+private:
+    struct Tag;
+    class Call;
+    template <class Request, class Response>
+    class UnaryCall;
+    class WatchMetricsCall;
+    class SubmitHtmlCall;
+
+    using SubmitPageCall = UnaryCall<openperf_rpc::SubmitPageRequest, openperf_rpc::SubmitPageResponse>;
+    using PatchPageCall = UnaryCall<openperf_rpc::PatchPageRequest, openperf_rpc::PatchPageResponse>;
+    using RunRenderCall = UnaryCall<openperf_rpc::RunRenderRequest, openperf_rpc::RunRenderResponse>;
+    using AnalyzeCall = UnaryCall<openperf_rpc::AnalyzeAccessibilityRequest, openperf_rpc::AnalyzeAccessibilityResponse>;
+    using GetMetricsCall = UnaryCall<openperf_rpc::GetMetricsRequest, openperf_rpc::GetMetricsResponse>;
+    using SubmitPagesCall = UnaryCall<openperf_rpc::SubmitPagesRequest, openperf_rpc::SubmitPagesResponse>;
+    using RunRenderBatchCall = UnaryCall<openperf_rpc::RunRenderBatchRequest, openperf_rpc::RunRenderBatchResponse>;
+    using AnalyzeBatchCall =
+        UnaryCall<openperf_rpc::AnalyzeAccessibilityBatchRequest, openperf_rpc::AnalyzeAccessibilityBatchResponse>;
+
+    // Arms one pending request per RPC method on the given queue.
+    void requestCalls(::grpc::ServerCompletionQueue* cq);
+    void serve(std::size_t index);
+    void dispatch(openperf::Task task);
+    // Checks a new call's rate limit, then dispatches it in its priority
+    // lane unless the scheduler's backlog is full. Returns why it did not.
+    // `onExpired` runs instead of `task` if the call's deadline passes while
+    // it is queued.
+    ::grpc::Status admit(const ::grpc::ServerContext& context, std::size_t cost, openperf::Task task,
+                         openperf::Task onExpired);
+    void callDestroyed();
+
+    // handlers, run on the scheduler; each finishes its call exactly once
+    void handleSubmitPage(SubmitPageCall& call);
+    void handlePatchPage(PatchPageCall& call);
+    void handleRunRender(RunRenderCall& call);
+    void handleAnalyze(AnalyzeCall& call);
+    void handleGetMetrics(GetMetricsCall& call);
+    void handleSubmitPages(SubmitPagesCall& call);
+    void handleRunRenderBatch(RunRenderBatchCall& call);
+    void handleAnalyzeBatch(AnalyzeBatchCall& call);
+
+    openperf::Engine& engine_;
+    Options options_;
+    RateLimiter limiter_;
+
+    openperf_rpc::OpenPerfService::AsyncService service_;
+    std::unique_ptr<::grpc::Server> server_;
+    std::vector<std::unique_ptr<::grpc::ServerCompletionQueue>> cqs_;
+    std::vector<std::thread> threads_;
+
+    std::atomic<bool> shuttingDown_{false};
+
+    // calls alive, including ones only waiting to be matched; the queues
+    // may only be shut down once this drops to zero
+    std::atomic<std::size_t> liveCalls_{0};
+    std::mutex callsMutex_;
+    std::condition_variable callsCv_;
+};
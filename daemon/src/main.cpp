@@ -1,31 +1,182 @@
 // daemon/src/main.cpp
 #include <grpcpp/grpcpp.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
 
 #include "openperf/engine.hpp"
+#include "openperf/trace.hpp"
+#include "async_server.hpp"
 #include "service_impl.hpp"
 
-int main(int argc, char** argv) {
-    std::string address("0.0.0.0:50051");
-    if (argc > 1)
-        address = argv[1]; // allow overriding listen address
+namespace {
 
-    openperf::Engine engine;
-    engine.start();
+void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0
+              << " [address] [--mode sync|async] [--cq-threads N] [--no-pin] [--max-tree-depth N]"
+                 " [--max-tree-nodes N] [--max-html-bytes N]\n"
+                 "       [--max-in-flight N] [--render-queue N] [--admission block|reject|shed-oldest]\n"
+                 "       [--rate-limit R] [--rate-burst B] [--trusted-gateway ADDR]... [--max-queued-calls N]\n"
+                 "       [--workers N] [--pin-workers none|node|cpu] [--reserved-cpus LIST]\n"
+                 "       [--trace FILE] [--trace-seconds N]\n";
+}
+
+bool parsePolicy(const std::string& name, openperf::AdmissionPolicy& policy) {
+    if (name == "block") policy = openperf::AdmissionPolicy::Block;
+    else if (name == "reject") policy = openperf::AdmissionPolicy::Reject;
+    else if (name == "shed-oldest") policy = openperf::AdmissionPolicy::ShedOldest;
+    else return false;
+    return true;
+}
+
+// Records a trace for the first `seconds` after startup and writes it to
+// `path` as Chrome trace JSON, on a thread of its own.
+void captureTrace(std::string path, int seconds) {
+    openperf::Tracer::global().start();
+    std::thread([path = std::move(path), seconds] {
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        auto& tracer = openperf::Tracer::global();
+        tracer.stop();
+        std::ofstream out(path);
+        tracer.writeChromeJson(out);
+        tracer.clear(); // recording is over; free the buffers of exited threads
+        if (out) {
+            std::cout << "trace written to " << path << std::endl;
+        } else {
+            std::cerr << "failed to write trace to " << path << std::endl;
+        }
+    }).detach();
+}
 
-    OpenPerfServiceImpl service(engine);
+int runSync(openperf::Engine& engine, const std::string& address, TreeLimits limits,
+            RateLimiter::Options rateLimit) {
+    OpenPerfServiceImpl service(engine, limits, rateLimit);
 
     grpc::ServerBuilder builder;
     builder.AddListeningPort(address, grpc::InsecureServerCredentials());
     builder.RegisterService(&service);
+    builder.SetMaxReceiveMessageSize(kMaxRequestBytes);
 
     std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
-    std::cout << "OpenPerf daemon listening on " << address << std::endl;
+    if (!server) {
+        std::cerr << "failed to listen on " << address << std::endl;
+        return 1;
+    }
+    std::cout << "OpenPerf daemon (sync) listening on " << address << std::endl;
 
     server->Wait(); // block
+    return 0;
+}
 
-    engine.stop();
+int runAsync(openperf::Engine& engine, AsyncOpenPerfServer::Options options) {
+    AsyncOpenPerfServer server(engine, options);
+    if (!server.start()) {
+        std::cerr << "failed to listen on " << options.address << std::endl;
+        return 1;
+    }
+    std::cout << "OpenPerf daemon (async, " << options.cqThreads << " CQ threads) listening on "
+              << options.address << std::endl;
+
+    server.wait(); // block
     return 0;
-}
\ No newline at end of file
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string address("0.0.0.0:50051");
+    std::string mode("sync");
+    std::string tracePath;
+    int traceSeconds = 10;
+    AsyncOpenPerfServer::Options asyncOptions;
+    // renders beyond a few per worker only add latency
+    openperf::Engine::Options engineOptions;
+    engineOptions.admission.maxInFlight = 4 * std::max(1u, std::thread::hardware_concurrency());
+    engineOptions.admission.queueCapacity = 256;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--mode" && i + 1 < argc) {
+            mode = argv[++i];
+        } else if (arg == "--cq-threads" && i + 1 < argc) {
+            asyncOptions.cqThreads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--no-pin") {
+            asyncOptions.pinThreads = false;
+        } else if (arg == "--max-tree-depth" && i + 1 < argc) {
+            asyncOptions.treeLimits.maxDepth = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--max-tree-nodes" && i + 1 < argc) {
+            asyncOptions.treeLimits.maxNodes = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--max-html-bytes" && i + 1 < argc) {
+            asyncOptions.treeLimits.maxHtmlBytes = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--max-in-flight" && i + 1 < argc) {
+            engineOptions.admission.maxInFlight = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--render-queue" && i + 1 < argc) {
+            engineOptions.admission.queueCapacity = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--admission" && i + 1 < argc) {
+            if (!parsePolicy(argv[++i], engineOptions.admission.policy)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (arg == "--rate-limit" && i + 1 < argc) {
+            asyncOptions.rateLimit.rate = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--rate-burst" && i + 1 < argc) {
+            asyncOptions.rateLimit.burst = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--trusted-gateway" && i + 1 < argc) {
+            asyncOptions.rateLimit.trustedGateways.emplace_back(argv[++i]);
+        } else if (arg == "--max-queued-calls" && i + 1 < argc) {
+            asyncOptions.maxQueuedCalls = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--workers" && i + 1 < argc) {
+            engineOptions.scheduler.workers = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--pin-workers" && i + 1 < argc) {
+            if (!openperf::parseAffinity(argv[++i], &engineOptions.scheduler.affinity)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (arg == "--reserved-cpus" && i + 1 < argc) {
+            if (!openperf::parseCpuList(argv[++i], &engineOptions.scheduler.reservedCpus)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--trace-seconds" && i + 1 < argc) {
+            traceSeconds = std::atoi(argv[++i]);
+        } else if (arg.rfind("--", 0) != 0) {
+            address = arg; // allow overriding listen address
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (mode != "sync" && mode != "async") {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // CQ threads get the cores kept free of workers
+    asyncOptions.cpus = engineOptions.scheduler.reservedCpus;
+
+    openperf::Engine engine(engineOptions);
+    engine.start();
+    const auto& scheduler = engine.scheduler();
+    std::cout << "[daemon] " << scheduler.workerCount() << " workers, pinned by "
+              << openperf::toString(engineOptions.scheduler.affinity) << ", on "
+              << scheduler.topology().describe() << std::endl;
+    if (!tracePath.empty()) captureTrace(tracePath, traceSeconds);
+
+    int rc = 0;
+    if (mode == "async") {
+        asyncOptions.address = address;
+        rc = runAsync(engine, asyncOptions);
+    } else {
+        rc = runSync(engine, address, asyncOptions.treeLimits, asyncOptions.rateLimit);
+    }
+
+    engine.stop();
+    return rc;
+}
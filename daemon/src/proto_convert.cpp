@@ -0,0 +1,447 @@
+#include "proto_convert.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <string_view>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+openperf::Style fromProto(const openperf_rpc::Style& protoStyle) {
+    using openperf::Style;
+    Style style;
+    switch (protoStyle.display()) {
+        case openperf_rpc::DISPLAY_BLOCK:
+            style.display = Style::Display::Block;
+            break;
+        case openperf_rpc::DISPLAY_INLINE:
+            style.display = Style::Display::Inline;
+            break;
+        case openperf_rpc::DISPLAY_FLEX:
+            style.display = Style::Display::Flex;
+            break;
+        case openperf_rpc::DISPLAY_NONE:
+            style.display = Style::Display::None;
+            break;
+        default:
+            break;
+    }
+    if (protoStyle.position() == openperf_rpc::POSITION_ABSOLUTE) style.position = Style::Position::Absolute;
+    if (protoStyle.flex_direction() == openperf_rpc::FLEX_COLUMN) style.flexDirection = Style::FlexDirection::Column;
+    if (protoStyle.has_width()) style.width = protoStyle.width();
+    if (protoStyle.has_height()) style.height = protoStyle.height();
+    style.left = protoStyle.left();
+    style.top = protoStyle.top();
+    style.margin = protoStyle.margin();
+    style.padding = protoStyle.padding();
+    style.flexGrow = protoStyle.flex_grow();
+    style.background = protoStyle.background();
+    style.borderColor = protoStyle.border_color();
+    style.borderWidth = protoStyle.border_width();
+    return style;
+}
+
+void toProto(const openperf::Style& in, openperf_rpc::Style* out) {
+    using openperf::Style;
+    switch (in.display) {
+        case Style::Display::Block:
+            out->set_display(openperf_rpc::DISPLAY_BLOCK);
+            break;
+        case Style::Display::Inline:
+            out->set_display(openperf_rpc::DISPLAY_INLINE);
+            break;
+        case Style::Display::Flex:
+            out->set_display(openperf_rpc::DISPLAY_FLEX);
+            break;
+        case Style::Display::None:
+            out->set_display(openperf_rpc::DISPLAY_NONE);
+            break;
+        case Style::Display::Auto:
+            out->set_display(openperf_rpc::DISPLAY_AUTO);
+            break;
+    }
+    out->set_position(in.position == Style::Position::Absolute ? openperf_rpc::POSITION_ABSOLUTE
+                                                               : openperf_rpc::POSITION_STATIC);
+    out->set_flex_direction(in.flexDirection == Style::FlexDirection::Column ? openperf_rpc::FLEX_COLUMN
+                                                                             : openperf_rpc::FLEX_ROW);
+    if (in.width >= 0) out->set_width(in.width);
+    if (in.height >= 0) out->set_height(in.height);
+    out->set_left(in.left);
+    out->set_top(in.top);
+    out->set_margin(in.margin);
+    out->set_padding(in.padding);
+    out->set_flex_grow(in.flexGrow);
+    out->set_background(in.background);
+    out->set_border_color(in.borderColor);
+    out->set_border_width(in.borderWidth);
+}
+
+constexpr TreeLimits kNoLimits{std::numeric_limits<std::size_t>::max(), std::numeric_limits<std::size_t>::max(),
+                               std::numeric_limits<std::size_t>::max()};
+
+// False, with `error` set, if the tree under `root` exceeds `limits`. Its
+// nodes are added to `count`, so several trees can share one budget.
+bool withinLimits(const openperf_rpc::Node& root, const TreeLimits& limits, std::size_t& count, std::string* error) {
+    std::vector<std::pair<const openperf_rpc::Node*, std::size_t>> stack{{&root, 1}};
+    while (!stack.empty()) {
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+        if (++count > limits.maxNodes) {
+            *error = "tree has more than " + std::to_string(limits.maxNodes) + " nodes";
+            return false;
+        }
+        if (depth > limits.maxDepth) {
+            *error = "tree is deeper than " + std::to_string(limits.maxDepth) + " levels";
+            return false;
+        }
+        for (const auto& child : node->children()) stack.emplace_back(&child, depth + 1);
+    }
+    return true;
+}
+
+// Converts the tree under `root`, moving strings out of a non-const `root`
+// and copying them from a const one.
+template <class ProtoNode>
+std::shared_ptr<openperf::Node> buildTree(ProtoNode& root) {
+    constexpr bool kMove = !std::is_const_v<ProtoNode>;
+    auto tree = std::make_shared<openperf::Node>();
+    std::vector<std::pair<ProtoNode*, openperf::Node*>> stack{{&root, tree.get()}};
+    while (!stack.empty()) {
+        auto [proto, node] = stack.back();
+        stack.pop_back();
+        if constexpr (kMove) {
+            // mutable_*() allocates for an unset field, so empty ones are skipped
+            if (!proto->id().empty()) node->id = std::move(*proto->mutable_id());
+            if (!proto->tag().empty()) node->tag = std::move(*proto->mutable_tag());
+            if (!proto->text().empty()) node->text = std::move(*proto->mutable_text());
+            if (!proto->role().empty()) node->role = std::move(*proto->mutable_role());
+            if (!proto->aria_label().empty()) node->ariaLabel = std::move(*proto->mutable_aria_label());
+        } else {
+            node->id = proto->id();
+            node->tag = proto->tag();
+            node->text = proto->text();
+            node->role = proto->role();
+            node->ariaLabel = proto->aria_label();
+        }
+        node->isInteractive = proto->is_interactive();
+        if (proto->has_style()) node->style = fromProto(proto->style());
+
+        node->children.reserve(proto->children_size());
+        auto& children = [proto]() -> auto& {
+            if constexpr (kMove) return *proto->mutable_children();
+            else return proto->children();
+        }();
+        for (auto& child : children) {
+            node->children.push_back(std::make_shared<openperf::Node>());
+            stack.emplace_back(&child, node->children.back().get());
+        }
+    }
+    return tree;
+}
+
+template <class ProtoNode>
+::grpc::Status convertTree(ProtoNode& root, const TreeLimits& limits, std::shared_ptr<openperf::Node>* out) {
+    std::string error;
+    std::size_t count = 0;
+    if (!withinLimits(root, limits, count, &error)) {
+        return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, error);
+    }
+    *out = buildTree(root);
+    return ::grpc::Status::OK;
+}
+
+template <class ProtoMutation>
+::grpc::Status convertMutation(ProtoMutation& protoMutation, const TreeLimits& limits, openperf::NodeMutation* out) {
+    switch (protoMutation.kind()) {
+        case openperf_rpc::MUTATION_REMOVE:
+            out->kind = openperf::NodeMutation::Kind::Remove;
+            break;
+        case openperf_rpc::MUTATION_UPDATE:
+            out->kind = openperf::NodeMutation::Kind::Update;
+            break;
+        default:
+            out->kind = openperf::NodeMutation::Kind::Insert;
+            break;
+    }
+    out->nodeId = protoMutation.node_id();
+    if (protoMutation.position() >= 0) out->position = static_cast<std::size_t>(protoMutation.position());
+    if (!protoMutation.has_node()) return ::grpc::Status::OK;
+    if constexpr (std::is_const_v<ProtoMutation>) {
+        return convertTree(protoMutation.node(), limits, &out->node);
+    } else {
+        return convertTree(*protoMutation.mutable_node(), limits, &out->node);
+    }
+}
+
+template <class ProtoPage>
+::grpc::Status convertPage(ProtoPage& protoPage, const TreeLimits& limits, openperf::Page* out) {
+    if constexpr (std::is_const_v<ProtoPage>) {
+        out->id = protoPage.id();
+        out->url = protoPage.url();
+        if (!protoPage.has_root()) return ::grpc::Status::OK;
+        return convertTree(protoPage.root(), limits, &out->root);
+    } else {
+        out->id = std::move(*protoPage.mutable_id());
+        out->url = std::move(*protoPage.mutable_url());
+        if (!protoPage.has_root()) return ::grpc::Status::OK;
+        return convertTree(*protoPage.mutable_root(), limits, &out->root);
+    }
+}
+
+// The trees are checked together first, then converted without a second
+// check.
+template <class Mutations>
+::grpc::Status convertMutations(Mutations& mutations, const TreeLimits& limits,
+                                std::vector<openperf::NodeMutation>* out) {
+    std::string error;
+    std::size_t count = 0;
+    for (const auto& mutation : mutations) {
+        if (mutation.has_node() && !withinLimits(mutation.node(), limits, count, &error)) {
+            return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, error);
+        }
+    }
+    out->clear();
+    out->reserve(static_cast<std::size_t>(mutations.size()));
+    for (auto& mutation : mutations) convertMutation(mutation, kNoLimits, &out->emplace_back());
+    return ::grpc::Status::OK;
+}
+
+}
+
+openperf::Page fromProto(const openperf_rpc::Page& protoPage) {
+    openperf::Page page;
+    page.id = protoPage.id();
+    page.url = protoPage.url();
+    if (protoPage.has_root()) {
+        page.root = fromProto(protoPage.root());
+    }
+    return page;
+}
+
+std::shared_ptr<openperf::Node> fromProto(const openperf_rpc::Node& protoNode) {
+    std::shared_ptr<openperf::Node> node;
+    convertTree(protoNode, kNoLimits, &node);
+    return node;
+}
+
+openperf::NodeMutation fromProto(const openperf_rpc::NodeMutation& protoMutation) {
+    openperf::NodeMutation mutation;
+    convertMutation(protoMutation, kNoLimits, &mutation);
+    return mutation;
+}
+
+::grpc::Status fromProto(const openperf_rpc::Page& protoPage, const TreeLimits& limits, openperf::Page* out) {
+    return convertPage(protoPage, limits, out);
+}
+
+::grpc::Status fromProto(openperf_rpc::Page&& protoPage, const TreeLimits& limits, openperf::Page* out) {
+    return convertPage(protoPage, limits, out);
+}
+
+::grpc::Status fromProto(const ProtoMutations& mutations, const TreeLimits& limits,
+                         std::vector<openperf::NodeMutation>* out) {
+    return convertMutations(mutations, limits, out);
+}
+
+::grpc::Status fromProto(ProtoMutations&& mutations, const TreeLimits& limits, std::vector<openperf::NodeMutation>* out) {
+    return convertMutations(mutations, limits, out);
+}
+
+openperf::HtmlParser::Options parserOptions(const TreeLimits& limits) {
+    openperf::HtmlParser::Options options;
+    options.maxDepth = limits.maxDepth;
+    options.maxNodes = limits.maxNodes;
+    return options;
+}
+
+::grpc::Status checkHtml(const openperf::HtmlParser& parser, std::size_t nextChunkBytes, const TreeLimits& limits) {
+    if (parser.truncated()) {
+        return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT,
+                              "html has more than " + std::to_string(limits.maxNodes) + " elements");
+    }
+    if (nextChunkBytes > limits.maxHtmlBytes - std::min(parser.bytesFed(), limits.maxHtmlBytes)) {
+        return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT,
+                              "html is larger than " + std::to_string(limits.maxHtmlBytes) + " bytes");
+    }
+    return ::grpc::Status::OK;
+}
+
+void toProto(const openperf::Page& in, openperf_rpc::Page* out) {
+    out->set_id(in.id);
+    out->set_url(in.url);
+    if (in.root) toProto(*in.root, out->mutable_root());
+}
+
+void toProto(const openperf::Node& in, openperf_rpc::Node* out) {
+    out->set_id(in.id);
+    out->set_tag(in.tag);
+    out->set_text(in.text);
+    out->set_role(in.role);
+    out->set_aria_label(in.ariaLabel);
+    out->set_is_interactive(in.isInteractive);
+    if (!(in.style == openperf::Style{})) toProto(in.style, out->mutable_style());
+    for (const auto& child : in.children) {
+        if (child) toProto(*child, out->add_children());
+    }
+}
+
+void toProto(const openperf::AccessibilityIssue& in, openperf_rpc::AccessibilityIssue* out) {
+    out->set_code(in.code);
+    out->set_message(in.message);
+    out->set_node_id(in.nodeId);
+
+    switch (in.severity) {
+        case openperf::Severity::Info:
+            out->set_severity(openperf_rpc::SEVERITY_INFO);
+            break;
+        case openperf::Severity::Warning:
+            out->set_severity(openperf_rpc::SEVERITY_WARNING);
+            break;
+        case openperf::Severity::Error:
+            out->set_severity(openperf_rpc::SEVERITY_ERROR);
+            break;
+    }
+}
+
+void toProto(const openperf::Metric& in, openperf_rpc::MetricSample* out) {
+    out->set_name(in.name);
+    out->set_value(in.value);
+    out->set_sequence(in.sequence);
+
+    auto ms = std::chrono::time_point_cast<std::chrono::milliseconds>(in.timestamp)
+                  .time_since_epoch()
+                  .count();
+    out->set_timestamp_unix_ms(ms);
+}
+
+void toProto(const openperf::HistogramStats& in, openperf_rpc::HistogramStats* out) {
+    out->set_count(in.count);
+    out->set_sum(in.sum);
+    out->set_min(in.min);
+    out->set_max(in.max);
+    out->set_p50(in.p50);
+    out->set_p90(in.p90);
+    out->set_p99(in.p99);
+}
+
+void toProto(const openperf::MetricSummary& in, openperf_rpc::MetricSummary* out) {
+    out->set_name(in.name);
+    toProto(in.total, out->mutable_total());
+    toProto(in.window, out->mutable_window());
+}
+
+void toProto(const openperf::RenderResult& in, openperf_rpc::RunRenderResponse* out) {
+    using ms = std::chrono::duration<double, std::milli>;
+
+    for (std::size_t i = 0; i < in.stages.size(); ++i) {
+        const auto& timing = in.stages[i];
+        auto* stage = out->add_stages();
+        if (i < in.stageNames.size()) stage->set_name(in.stageNames[i]);
+        stage->set_start_ms(ms(timing.start - in.submitted).count());
+        stage->set_duration_ms(ms(timing.end - timing.start).count());
+    }
+    out->set_total_ms(ms(in.completed - in.submitted).count());
+    out->set_queue_wait_ms(ms(in.queueWait()).count());
+}
+
+void toProto(const ::grpc::Status& in, openperf_rpc::ItemStatus* out) {
+    out->set_code(static_cast<std::int32_t>(in.error_code()));
+    out->set_message(in.error_message());
+}
+
+void toProto(const std::vector<openperf::RenderResult>& in, openperf_rpc::RunRenderBatchResponse* out) {
+    out->mutable_results()->Reserve(static_cast<int>(in.size()));
+    for (const auto& result : in) {
+        auto* item = out->add_results();
+        toProto(toStatus(result), item->mutable_status());
+        if (result.status == openperf::RenderStatus::Completed) toProto(result, item->mutable_render());
+    }
+}
+
+void toProto(const std::vector<openperf::AccessibilityReport>& in,
+             const google::protobuf::RepeatedPtrField<std::string>& pageIds,
+             openperf_rpc::AnalyzeAccessibilityBatchResponse* out) {
+    out->mutable_results()->Reserve(static_cast<int>(in.size()));
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        auto* item = out->add_results();
+        if (!in[i].found) {
+            const auto& pageId = pageIds[static_cast<int>(i)];
+            toProto(::grpc::Status(::grpc::StatusCode::NOT_FOUND, "unknown page_id " + pageId), item->mutable_status());
+            continue;
+        }
+        for (const auto& issue : in[i].issues) toProto(issue, item->add_issues());
+    }
+}
+
+void toProto(const openperf::MetricsDelta& in, std::size_t maxBatch, openperf_rpc::MetricsUpdate* out) {
+    out->set_next_cursor(in.cursor);
+    out->set_missed(in.missed);
+    if (in.samples.size() <= maxBatch) {
+        for (const auto& s : in.samples) toProto(s, out->add_samples());
+    } else {
+        out->set_is_coalesced(true);
+        for (const auto& summary : openperf::summarizeSamples(in.samples)) {
+            toProto(summary, out->add_coalesced());
+        }
+    }
+}
+
+openperf::TaskOptions callOptions(const ::grpc::ServerContext& context, bool trustedCaller) {
+    openperf::TaskOptions options;
+    const auto& metadata = context.client_metadata();
+    if (auto it = metadata.find("x-priority"); it != metadata.end()) {
+        openperf::parsePriority(std::string_view(it->second.data(), it->second.size()), &options.priority);
+    }
+    if (options.priority == openperf::TaskPriority::Interactive && !trustedCaller) {
+        options.priority = openperf::TaskPriority::Normal;
+    }
+
+    // gRPC deadlines are system-clock; the scheduler runs on the steady clock
+    const auto deadline = context.deadline();
+    if (deadline != std::chrono::system_clock::time_point::max()) {
+        options.deadline = std::chrono::steady_clock::now() +
+                           std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               deadline - std::chrono::system_clock::now());
+    }
+    return options;
+}
+
+std::chrono::milliseconds watchInterval(const openperf_rpc::WatchMetricsRequest& request) {
+    if (request.interval_ms() == 0) return std::chrono::milliseconds(500);
+    return std::chrono::milliseconds(std::max(request.interval_ms(), kMinWatchIntervalMs));
+}
+
+::grpc::Status toStatus(const openperf::RenderResult& result) {
+    switch (result.status) {
+        case openperf::RenderStatus::Completed:
+            return ::grpc::Status::OK;
+        case openperf::RenderStatus::PageNotFound:
+            return ::grpc::Status(::grpc::StatusCode::NOT_FOUND, "unknown page_id " + result.pageId);
+        case openperf::RenderStatus::Rejected:
+            return ::grpc::Status(::grpc::StatusCode::RESOURCE_EXHAUSTED, "render queue is full");
+        case openperf::RenderStatus::Shed:
+            return ::grpc::Status(::grpc::StatusCode::RESOURCE_EXHAUSTED, "render was shed from a full queue");
+        case openperf::RenderStatus::Cancelled:
+            return ::grpc::Status(::grpc::StatusCode::CANCELLED, "render was cancelled");
+        case openperf::RenderStatus::Expired:
+            return ::grpc::Status(::grpc::StatusCode::DEADLINE_EXCEEDED, "deadline passed before the render started");
+    }
+    return ::grpc::Status(::grpc::StatusCode::INTERNAL, "unknown render status");
+}
+
+::grpc::Status toStatus(const openperf::PatchResult& result) {
+    switch (result.status) {
+        case openperf::PatchStatus::Applied:
+            return ::grpc::Status::OK;
+        case openperf::PatchStatus::PageNotFound:
+        case openperf::PatchStatus::NodeNotFound:
+            return ::grpc::Status(::grpc::StatusCode::NOT_FOUND, result.error);
+        case openperf::PatchStatus::InvalidMutation:
+            return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, result.error);
+    }
+    return ::grpc::Status(::grpc::StatusCode::INTERNAL, "unknown patch status");
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "openperf/accessibility.hpp"
+#include "openperf/html_parser.hpp"
+#include "openperf/metrics.hpp"
+#include "openperf/page_editor.hpp"
+#include "openperf/page.hpp"
+#include "openperf/render_pipeline.hpp"
+#include "openperf.pb.h"
+
+#include <grpcpp/grpcpp.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Conversions between core types and their protobuf messages, shared by the
+// sync and async service implementations.
+
+// Bounds on trees taken from requests, checked in one pass over the decoded
+// message before any node is converted. SubmitHtml streams are held to the
+// same node and depth bounds while they are parsed.
+//
+// Protobuf's decoder rejects messages nested deeper than its recursion
+// limit of 100, which leaves at most 98 or 99 tree levels under a request
+// message. The default depth stays below that, so it is the bound that
+// actually applies and its error is the one callers see.
+using TreeLimits = openperf::TreeLimits;
+
+// Largest request either server accepts. gRPC's 4 MiB default is too small
+// for batches; this matches the wire format's kMaxPayloadBytes.
+constexpr int kMaxRequestBytes = 64 << 20;
+
+// SubmitHtml: a parser that keeps to `limits` (elements nested deeper
+// become siblings, ones past maxNodes are dropped), and INVALID_ARGUMENT
+// once a stream about to feed `nextChunkBytes` more is past them.
+openperf::HtmlParser::Options parserOptions(const TreeLimits& limits);
+::grpc::Status checkHtml(const openperf::HtmlParser& parser, std::size_t nextChunkBytes, const TreeLimits& limits);
+
+// Trees are converted without recursion, so depth is bounded only by
+// protobuf's decoder and TreeLimits, not by the stack.
+openperf::Page fromProto(const openperf_rpc::Page& protoPage);
+std::shared_ptr<openperf::Node> fromProto(const openperf_rpc::Node& protoNode);
+openperf::NodeMutation fromProto(const openperf_rpc::NodeMutation& protoMutation);
+
+// The same for request handlers: a tree beyond `limits` fails with
+// INVALID_ARGUMENT. Strings are moved out of a message the handler owns
+// (the async server's) and copied from a const one (the sync server's).
+::grpc::Status fromProto(const openperf_rpc::Page& protoPage, const TreeLimits& limits, openperf::Page* out);
+::grpc::Status fromProto(openperf_rpc::Page&& protoPage, const TreeLimits& limits, openperf::Page* out);
+// A PatchPage request's mutations; maxNodes bounds all their trees together.
+using ProtoMutations = google::protobuf::RepeatedPtrField<openperf_rpc::NodeMutation>;
+::grpc::Status fromProto(const ProtoMutations& mutations, const TreeLimits& limits,
+                         std::vector<openperf::NodeMutation>* out);
+::grpc::Status fromProto(ProtoMutations&& mutations, const TreeLimits& limits, std::vector<openperf::NodeMutation>* out);
+
+void toProto(const openperf::Page& in, openperf_rpc::Page* out);
+void toProto(const openperf::Node& in, openperf_rpc::Node* out);
+
+void toProto(const openperf::AccessibilityIssue& in, openperf_rpc::AccessibilityIssue* out);
+void toProto(const openperf::Metric& in, openperf_rpc::MetricSample* out);
+void toProto(const openperf::HistogramStats& in, openperf_rpc::HistogramStats* out);
+void toProto(const openperf::MetricSummary& in, openperf_rpc::MetricSummary* out);
+void toProto(const openperf::RenderResult& in, openperf_rpc::RunRenderResponse* out);
+void toProto(const ::grpc::Status& in, openperf_rpc::ItemStatus* out);
+
+// Batch results, one item per request entry; statuses as toStatus() gives them.
+void toProto(const std::vector<openperf::RenderResult>& in, openperf_rpc::RunRenderBatchResponse* out);
+void toProto(const std::vector<openperf::AccessibilityReport>& in,
+             const google::protobuf::RepeatedPtrField<std::string>& pageIds,
+             openperf_rpc::AnalyzeAccessibilityBatchResponse* out);
+
+// Raw samples, or per-metric aggregates when there are more than maxBatch.
+void toProto(const openperf::MetricsDelta& in, std::size_t maxBatch, openperf_rpc::MetricsUpdate* out);
+
+// A WatchMetrics stream's push interval: 500 ms unless the request asks,
+// and never below kMinWatchIntervalMs, so a stream cannot poll the metrics
+// store in a tight loop.
+constexpr std::uint32_t kMinWatchIntervalMs = 50;
+std::chrono::milliseconds watchInterval(const openperf_rpc::WatchMetricsRequest& request);
+
+// How a call's work is scheduled: in the lane its x-priority metadata names
+// ("interactive", "normal" or "batch"; Normal otherwise), by its deadline.
+// Only a trusted caller (a --trusted-gateway, which sets the lane per
+// route) gets Interactive; anyone else asking for it gets Normal.
+openperf::TaskOptions callOptions(const ::grpc::ServerContext& context, bool trustedCaller);
+
+// OK for a completed render, otherwise the matching error status.
+::grpc::Status toStatus(const openperf::RenderResult& result);
+::grpc::Status toStatus(const openperf::PatchResult& result);
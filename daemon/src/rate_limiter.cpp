@@ -0,0 +1,80 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <functional>
+
+RateLimiter::RateLimiter() : RateLimiter(Options{}) {}
+
+RateLimiter::RateLimiter(Options options)
+    : options_(options), shards_(std::make_unique<Shard[]>(kShards)) {
+    if (options_.burst <= 0) options_.burst = std::max(1.0, options_.rate);
+}
+
+bool RateLimiter::tryAcquire(std::string_view client, double cost) {
+    if (!enabled()) return true;
+    cost = std::min(cost, options_.burst);
+
+    auto& shard = shards_[std::hash<std::string_view>{}(client) % kShards];
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock{shard.mutex};
+
+    auto it = shard.buckets.find(std::string(client));
+    if (it == shard.buckets.end()) {
+        if (shard.buckets.size() >= options_.maxClients / kShards + 1) prune(shard, now);
+        it = shard.buckets.emplace(std::string(client), Bucket{options_.burst, now}).first;
+    } else {
+        auto& bucket = it->second;
+        const double earned = std::chrono::duration<double>(now - bucket.updated).count() * options_.rate;
+        bucket.tokens = std::min(options_.burst, bucket.tokens + earned);
+        bucket.updated = now;
+    }
+
+    auto& bucket = it->second;
+    if (bucket.tokens < cost) return false;
+    bucket.tokens -= cost;
+    return true;
+}
+
+::grpc::Status RateLimiter::admit(const ::grpc::ServerContext& context, std::size_t cost) {
+    if (!enabled()) return ::grpc::Status::OK;
+    auto client = clientId(context);
+    if (tryAcquire(client, static_cast<double>(cost))) return ::grpc::Status::OK;
+    return ::grpc::Status(::grpc::StatusCode::RESOURCE_EXHAUSTED, "rate limit exceeded for client " + client);
+}
+
+void RateLimiter::prune(Shard& shard, Clock::time_point now) {
+    // a bucket that would be full by now is the same as a new one
+    const auto refill = std::chrono::duration<double>(options_.burst / options_.rate);
+    std::erase_if(shard.buckets, [&](const auto& entry) {
+        const auto& bucket = entry.second;
+        return now - bucket.updated >= refill - std::chrono::duration<double>(bucket.tokens / options_.rate);
+    });
+}
+
+bool RateLimiter::fromTrustedGateway(const ::grpc::ServerContext& context) const {
+    if (options_.trustedGateways.empty()) return false;
+    const std::string peer = peerAddress(context);
+    // "ipv4:10.0.0.5" also matches "10.0.0.5", "ipv6:[::1]" also "[::1]"
+    const auto colon = peer.find(':');
+    const std::string_view host =
+        peer.rfind("unix:", 0) == 0 || colon == std::string::npos ? std::string_view(peer)
+                                                                  : std::string_view(peer).substr(colon + 1);
+    return std::any_of(options_.trustedGateways.begin(), options_.trustedGateways.end(),
+                       [&](const std::string& gateway) { return gateway == peer || gateway == host; });
+}
+
+std::string RateLimiter::clientId(const ::grpc::ServerContext& context) const {
+    const auto& metadata = context.client_metadata();
+    if (auto it = metadata.find("x-client-id"); it != metadata.end() && it->second.size() != 0) {
+        if (fromTrustedGateway(context)) return std::string(it->second.data(), it->second.size());
+    }
+    return peerAddress(context);
+}
+
+std::string peerAddress(const ::grpc::ServerContext& context) {
+    // "ipv4:127.0.0.1:51234" or "ipv6:[::1]:51234"; unix peers have no port
+    auto peer = context.peer();
+    if (peer.rfind("unix:", 0) == 0) return peer;
+    if (auto colon = peer.rfind(':'); colon != std::string::npos && colon > peer.find(':')) peer.resize(colon);
+    return peer;
+}
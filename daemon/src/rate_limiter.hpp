@@ -0,0 +1,98 @@
+#pragma once
+
+#include "openperf.pb.h"
+
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Per-client token buckets, shared by the sync and async servers.
+ *
+ * A client earns `rate` tokens per second up to `burst`, and a call costs
+ * one token per page or page id it carries (see requestCost()). A call the
+ * bucket cannot pay for fails with RESOURCE_EXHAUSTED and costs nothing.
+ *
+ * Clients are told apart by peer address without the port. A caller can't
+ * choose its own bucket: x-client-id metadata is honoured only from the
+ * trustedGateways, which speak for many users and forward an id for each.
+ * Buckets live in shards keyed by client; a shard tracking
+ * more than its share of maxClients drops the buckets that have refilled,
+ * which lose nothing by being recreated.
+ */
+class RateLimiter {
+public:
+    struct Options {
+        double rate = 0;  // tokens per second per client, 0 = unlimited
+        double burst = 0; // bucket size, 0 = one second's worth
+        std::size_t maxClients = 65536;
+        // peers whose x-client-id is used (and whose calls may ask for the
+        // Interactive lane, see callOptions()), as "10.0.0.5",
+        // "ipv4:10.0.0.5", "[::1]" or "unix:/path"
+        std::vector<std::string> trustedGateways;
+    };
+
+    RateLimiter();
+    explicit RateLimiter(Options options);
+
+    bool enabled() const { return options_.rate > 0; }
+
+    // Takes `cost` tokens from the client's bucket if it has them. A cost
+    // above the bucket size is charged as a full bucket.
+    bool tryAcquire(std::string_view client, double cost = 1);
+
+    // tryAcquire() for the caller of `context`, as a gRPC status.
+    ::grpc::Status admit(const ::grpc::ServerContext& context, std::size_t cost);
+
+    // Whether the call comes from one of the trustedGateways.
+    bool fromTrustedGateway(const ::grpc::ServerContext& context) const;
+    // The x-client-id metadata of a trusted gateway's call if set, else the
+    // peer address.
+    std::string clientId(const ::grpc::ServerContext& context) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Bucket {
+        double tokens = 0;
+        Clock::time_point updated;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Bucket> buckets;
+    };
+
+    static constexpr std::size_t kShards = 16;
+
+    void prune(Shard& shard, Clock::time_point now);
+
+    Options options_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
+// The caller's address without its port, e.g. "ipv4:127.0.0.1".
+std::string peerAddress(const ::grpc::ServerContext& context);
+
+// Tokens a call costs: one, or one per page or page id for batches.
+template <class Request>
+std::size_t requestCost(const Request&) {
+    return 1;
+}
+inline std::size_t requestCost(const openperf_rpc::SubmitPagesRequest& request) {
+    return std::max(1, request.pages_size());
+}
+inline std::size_t requestCost(const openperf_rpc::RunRenderBatchRequest& request) {
+    return std::max(1, request.page_ids_size());
+}
+inline std::size_t requestCost(const openperf_rpc::AnalyzeAccessibilityBatchRequest& request) {
+    return std::max(1, request.page_ids_size());
+}
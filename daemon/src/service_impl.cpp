@@ -1,66 +1,187 @@
 #include "service_impl.hpp"
+#include "proto_convert.hpp"
+#include "openperf/html_parser.hpp"
 #include "openperf/page.hpp"
+#include "openperf/trace.hpp"
 #include "openperf.pb.h"
 
-#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
 // Core engine
 using openperf::Engine;
-using openperf::Metric;
 
+using openperf_rpc::AnalyzeAccessibilityBatchRequest;
+using openperf_rpc::AnalyzeAccessibilityBatchResponse;
 using openperf_rpc::AnalyzeAccessibilityRequest;
 using openperf_rpc::AnalyzeAccessibilityResponse;
 using openperf_rpc::GetMetricsRequest;
 using openperf_rpc::GetMetricsResponse;
+using openperf_rpc::HtmlChunk;
+using openperf_rpc::PatchPageRequest;
+using openperf_rpc::PatchPageResponse;
+using openperf_rpc::RunRenderBatchRequest;
+using openperf_rpc::RunRenderBatchResponse;
 using openperf_rpc::RunRenderRequest;
 using openperf_rpc::RunRenderResponse;
 using openperf_rpc::SubmitPageRequest;
+using openperf_rpc::SubmitPagesRequest;
+using openperf_rpc::SubmitPagesResponse;
+using openperf_rpc::SubmitHtmlResponse;
 using openperf_rpc::SubmitPageResponse;
-using openperf_rpc::MetricSample;
+using openperf_rpc::MetricsUpdate;
+using openperf_rpc::WatchMetricsRequest;
+
+namespace {
+
+// How often a handler waiting on renders checks whether its call is over.
+constexpr auto kCancelPoll = std::chrono::milliseconds(20);
+
+// Waits for every handle unless the call is cancelled first (the client
+// went away or its deadline passed); renders not yet started are then
+// cancelled and false is returned.
+bool awaitRenders(const ::grpc::ServerContext& context, std::vector<openperf::RenderHandle>& handles) {
+    for (auto& handle : handles) {
+        while (!handle.waitFor(kCancelPoll)) {
+            if (!context.IsCancelled()) continue;
+            for (auto& pending : handles) pending.cancel();
+            return false;
+        }
+    }
+    return true;
+}
+
+::grpc::Status callCancelled() {
+    return ::grpc::Status(::grpc::StatusCode::CANCELLED, "call cancelled before its renders finished");
+}
+
+}
 
 OpenPerfServiceImpl::OpenPerfServiceImpl(Engine& engine)
-    : engine_(engine) {}
+    : OpenPerfServiceImpl(engine, TreeLimits{}) {}
+
+OpenPerfServiceImpl::OpenPerfServiceImpl(Engine& engine, TreeLimits limits)
+    : OpenPerfServiceImpl(engine, limits, RateLimiter::Options{}) {}
+
+OpenPerfServiceImpl::OpenPerfServiceImpl(Engine& engine, TreeLimits limits, RateLimiter::Options rateLimit)
+    : engine_(engine), limits_(limits), limiter_(rateLimit) {}
 
-::grpc::Status OpenPerfServiceImpl::SubmitPage(::grpc::ServerContext*,
+::grpc::Status OpenPerfServiceImpl::SubmitPage(::grpc::ServerContext* context,
                                                const SubmitPageRequest* request,
                                                SubmitPageResponse* response) {
+    OPENPERF_TRACE_SPAN("rpc", "SubmitPage");
+    if (auto status = limiter_.admit(*context, requestCost(*request)); !status.ok()) return status;
+
     if (!request->has_page()) {
         return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "page is required");
     }
 
-    // convert proto page to core page
-    openperf::Page corePage = fromProto(request->page());
-    std::cout << "[daemon] SubmitPage: incoming page.id='" << corePage.id
-                << "', url='" << corePage.url << "'\n";
-
-    // generate ID here
-    auto pageId = ensurePageId(corePage);
-    std::cout << "[daemon] SubmitPage: after ensurePageId, id='" << pageId << "'\n";
-
-    // engine just stores it, we don't rely on its return value anymore
-    engine_.submitPage(std::move(corePage));
+    // convert proto page to core page; the engine assigns an id if it has none.
+    // The request belongs to gRPC, so its strings are copied.
+    openperf::Page page;
+    auto status = fromProto(request->page(), limits_, &page);
+    if (!status.ok()) return status;
+    auto pageId = engine_.submitPage(std::move(page));
     std::cout << "[daemon] SubmitPage: stored page, id='" << pageId << "'\n";
 
     response->set_page_id(pageId);
     return ::grpc::Status::OK;
 }
 
-::grpc::Status OpenPerfServiceImpl::RunRenderPipeline(::grpc::ServerContext*,
+::grpc::Status OpenPerfServiceImpl::SubmitHtml(::grpc::ServerContext* context,
+                                               ::grpc::ServerReader<HtmlChunk>* reader,
+                                               SubmitHtmlResponse* response) {
+    OPENPERF_TRACE_SPAN("rpc", "SubmitHtml");
+    if (auto status = limiter_.admit(*context, 1); !status.ok()) return status;
+
+    // only the chunk being read is buffered; the DOM grows as they arrive
+    openperf::HtmlParser parser(parserOptions(limits_));
+    openperf::Page page;
+    HtmlChunk chunk;
+    bool first = true;
+    bool complete = false;
+    while (reader->Read(&chunk)) {
+        if (first) {
+            page.id = chunk.page_id();
+            page.url = chunk.url();
+            first = false;
+        }
+        if (auto status = checkHtml(parser, chunk.data().size(), limits_); !status.ok()) return status;
+        parser.feed(chunk.data());
+        complete = chunk.last();
+    }
+    if (auto status = checkHtml(parser, 0, limits_); !status.ok()) return status;
+    if (!complete) {
+        return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "html stream ended before its last chunk");
+    }
+
+    response->set_bytes(parser.bytesFed());
+    auto dom = std::make_shared<const openperf::FlatDocument>(parser.finish());
+    if (dom->empty()) {
+        return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "html has no elements");
+    }
+    response->set_nodes(dom->size());
+    page.dom = std::move(dom);
+
+    response->set_page_id(engine_.submitPage(std::move(page)));
+    return ::grpc::Status::OK;
+}
+
+::grpc::Status OpenPerfServiceImpl::PatchPage(::grpc::ServerContext* context,
+                                              const PatchPageRequest* request,
+                                              PatchPageResponse* response) {
+    OPENPERF_TRACE_SPAN("rpc", "PatchPage");
+    if (auto status = limiter_.admit(*context, requestCost(*request)); !status.ok()) return status;
+
+    if (request->page_id().empty()) {
+        return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "page_id is required");
+    }
+
+    std::vector<openperf::NodeMutation> mutations;
+    if (auto status = fromProto(request->mutations(), limits_, &mutations); !status.ok()) return status;
+
+    auto result = engine_.patchPage(request->page_id(), mutations);
+    response->set_changed_nodes(result.changedNodes);
+    return toStatus(result);
+}
+
+::grpc::Status OpenPerfServiceImpl::RunRenderPipeline(::grpc::ServerContext* context,
                                                       const RunRenderRequest* request,
-                                                      RunRenderResponse*) {
+                                                      RunRenderResponse* response) {
+    OPENPERF_TRACE_SPAN("rpc", "RunRenderPipeline");
+    if (auto status = limiter_.admit(*context, requestCost(*request)); !status.ok()) return status;
+
     const auto& pageId = request->page_id();
     if (pageId.empty()) {
         return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "page_id is required");
     }
 
-    engine_.runRenderPipeline(pageId);
-    return ::grpc::Status::OK;
+    const auto options = callOptions(*context, limiter_.fromTrustedGateway(*context));
+    if (!request->wait_for_completion()) {
+        // the call ends here, so its deadline does not bind the render
+        engine_.runRenderPipeline(pageId, nullptr, {options.priority});
+        return ::grpc::Status::OK;
+    }
+
+    // holds this gRPC thread until the pipeline is done or the call is
+    // cancelled; the async server finishes the call from the completion
+    // callback instead
+    std::vector<openperf::RenderHandle> handles{engine_.render(pageId, options)};
+    if (!awaitRenders(*context, handles)) return callCancelled();
+    const auto& rendered = handles.front().wait();
+    toProto(rendered, response);
+    return toStatus(rendered);
 }
 
-::grpc::Status OpenPerfServiceImpl::AnalyzeAccessibility(::grpc::ServerContext*,
+::grpc::Status OpenPerfServiceImpl::AnalyzeAccessibility(::grpc::ServerContext* context,
                                                          const AnalyzeAccessibilityRequest* request,
                                                          AnalyzeAccessibilityResponse* response) {
+    OPENPERF_TRACE_SPAN("rpc", "AnalyzeAccessibility");
+    if (auto status = limiter_.admit(*context, requestCost(*request)); !status.ok()) return status;
+
     const auto& pageId = request->page_id();
     if (pageId.empty()) {
         return ::grpc::Status(::grpc::StatusCode::INVALID_ARGUMENT, "page_id is required");
@@ -68,80 +189,123 @@ OpenPerfServiceImpl::OpenPerfServiceImpl(Engine& engine)
 
     auto issues = engine_.analyzeAccessibility(pageId);
     for (const auto& issue : issues) {
-        auto* out = response->add_issues();
-        out->set_code(issue.code);
-        out->set_message(issue.message);
-        out->set_node_id(issue.nodeId);
-
-        switch (issue.severity) {
-            case openperf::Severity::Info:
-                out->set_severity(openperf_rpc::SEVERITY_INFO);
-                break;
-            case openperf::Severity::Warning:
-                out->set_severity(openperf_rpc::SEVERITY_WARNING);
-                break;
-            case openperf::Severity::Error:
-                out->set_severity(openperf_rpc::SEVERITY_ERROR);
-                break;
-        }
+        toProto(issue, response->add_issues());
     }
 
     return ::grpc::Status::OK;
 }
 
-::grpc::Status OpenPerfServiceImpl::GetMetrics(::grpc::ServerContext*,
-                                               const GetMetricsRequest*,
-                                               GetMetricsResponse* response) {
-    auto samples = engine_.getMetrics();
-    for (const auto& s : samples) {
-        auto* out = response->add_samples();
-        out->set_name(s.name);
-        out->set_value(s.value);
-
-        auto ms = std::chrono::time_point_cast<std::chrono::milliseconds>(s.timestamp)
-                      .time_since_epoch()
-                      .count();
-        out->set_timestamp_unix_ms(ms);
+::grpc::Status OpenPerfServiceImpl::SubmitPages(::grpc::ServerContext* context,
+                                                const SubmitPagesRequest* request,
+                                                SubmitPagesResponse* response) {
+    OPENPERF_TRACE_SPAN("rpc", "SubmitPages");
+    if (auto status = limiter_.admit(*context, requestCost(*request)); !status.ok()) return status;
+
+    // pages that fail conversion get their status, the rest are stored together
+    const auto& pagesIn = request->pages();
+    std::vector<openperf::Page> pages;
+    std::vector<int> slots;
+    pages.reserve(pagesIn.size());
+    slots.reserve(pagesIn.size());
+    response->mutable_results()->Reserve(pagesIn.size());
+    for (int i = 0; i < pagesIn.size(); ++i) {
+        auto* item = response->add_results();
+        openperf::Page page;
+        auto status = fromProto(pagesIn.Get(i), limits_, &page);
+        if (!status.ok()) {
+            toProto(status, item->mutable_status());
+            continue;
+        }
+        pages.push_back(std::move(page));
+        slots.push_back(i);
     }
 
+    auto ids = engine_.submitPages(std::move(pages));
+    for (std::size_t i = 0; i < ids.size(); ++i) response->mutable_results(slots[i])->set_page_id(std::move(ids[i]));
     return ::grpc::Status::OK;
 }
 
-//conversion helpers
+::grpc::Status OpenPerfServiceImpl::RunRenderBatch(::grpc::ServerContext* context,
+                                                   const RunRenderBatchRequest* request,
+                                                   RunRenderBatchResponse* response) {
+    OPENPERF_TRACE_SPAN("rpc", "RunRenderBatch");
+    if (auto status = limiter_.admit(*context, requestCost(*request)); !status.ok()) return status;
 
-openperf::Page OpenPerfServiceImpl::fromProto(const openperf_rpc::Page& protoPage) {
-    openperf::Page page;
-    page.id = protoPage.id();
-    page.url = protoPage.url();
-    if (protoPage.has_root()) {
-        page.root = fromProto(protoPage.root());
+    std::vector<std::string> pageIds(request->page_ids().begin(), request->page_ids().end());
+    const auto options = callOptions(*context, limiter_.fromTrustedGateway(*context));
+    if (!request->wait_for_completion()) {
+        engine_.runRenderBatch(pageIds, nullptr, {options.priority});
+        return ::grpc::Status::OK;
     }
-    return page;
+
+    auto handles = engine_.renderBatch(pageIds, options);
+    if (!awaitRenders(*context, handles)) return callCancelled();
+    std::vector<openperf::RenderResult> results;
+    results.reserve(handles.size());
+    for (const auto& handle : handles) results.push_back(handle.wait());
+    toProto(results, response);
+    return ::grpc::Status::OK;
 }
 
-std::shared_ptr<openperf::Node> OpenPerfServiceImpl::fromProto(const openperf_rpc::Node& protoNode) {
-    auto node = std::make_shared<openperf::Node>();
-    node->id = protoNode.id();
-    node->tag = protoNode.tag();
-    node->text = protoNode.text();
-    node->role = protoNode.role();
-    node->ariaLabel = protoNode.aria_label();
-    node->isInteractive = protoNode.is_interactive();
-    node->children.reserve(protoNode.children_size());
-    for (const auto& childProto : protoNode.children()) {
-        node->children.push_back(fromProto(childProto));
-    }
-    return node;
+::grpc::Status OpenPerfServiceImpl::AnalyzeAccessibilityBatch(::grpc::ServerContext* context,
+                                                              const AnalyzeAccessibilityBatchRequest* request,
+                                                              AnalyzeAccessibilityBatchResponse* response) {
+    OPENPERF_TRACE_SPAN("rpc", "AnalyzeAccessibilityBatch");
+    if (auto status = limiter_.admit(*context, requestCost(*request)); !status.ok()) return status;
+
+    std::vector<std::string> pageIds(request->page_ids().begin(), request->page_ids().end());
+    toProto(engine_.analyzeAccessibilityBatch(pageIds), request->page_ids(), response);
+    return ::grpc::Status::OK;
 }
 
-namespace {
-    std::atomic<std::uint64_t> g_pageCounter{0};
+::grpc::Status OpenPerfServiceImpl::GetMetrics(::grpc::ServerContext* context,
+                                               const GetMetricsRequest* request,
+                                               GetMetricsResponse* response) {
+    OPENPERF_TRACE_SPAN("rpc", "GetMetrics");
+    if (auto status = limiter_.admit(*context, requestCost(*request)); !status.ok()) return status;
+
+    auto delta = engine_.getMetricsSince(request->since());
+    for (const auto& s : delta.samples) {
+        toProto(s, response->add_samples());
+    }
+    response->set_next_cursor(delta.cursor);
+    response->set_missed(delta.missed);
+
+    if (!request->omit_summaries()) {
+        for (const auto& summary : engine_.getMetricSummaries()) {
+            toProto(summary, response->add_summaries());
+        }
+    }
+
+    return ::grpc::Status::OK;
 }
 
-std::string OpenPerfServiceImpl::ensurePageId(openperf::Page& page) {
-    if (page.id.empty()) {
-        auto idNum = g_pageCounter.fetch_add(1, std::memory_order_relaxed);
-        page.id = "page-" + std::to_string(idNum);
+::grpc::Status OpenPerfServiceImpl::WatchMetrics(::grpc::ServerContext* context,
+                                                 const WatchMetricsRequest* request,
+                                                 ::grpc::ServerWriter<MetricsUpdate>* writer) {
+    OPENPERF_TRACE_SPAN("rpc", "WatchMetrics");
+    if (auto status = limiter_.admit(*context, 1); !status.ok()) return status;
+
+    const auto interval = watchInterval(*request);
+    const std::size_t maxBatch = request->max_batch_samples() ? request->max_batch_samples() : 1000;
+    std::uint64_t cursor = request->since();
+
+    // Write() blocks while a slow client's window is full. Meanwhile new
+    // samples only accumulate in the engine's bounded rings, and the next
+    // update picks up everything since the cursor in one (coalesced) batch,
+    // so nothing is queued per client.
+    while (!context->IsCancelled()) {
+        std::this_thread::sleep_for(interval);
+
+        auto delta = engine_.getMetricsSince(cursor);
+        if (delta.samples.empty() && delta.missed == 0) continue;
+
+        MetricsUpdate update;
+        toProto(delta, maxBatch, &update);
+
+        if (!writer->Write(update)) break; // client went away
+        cursor = delta.cursor;
     }
-    return page.id;
-}
\ No newline at end of file
+
+    return ::grpc::Status::OK;
+}
@@ -2,29 +2,43 @@
 
 #include "openperf/engine.hpp"
 #include "openperf/page.hpp"
+#include "proto_convert.hpp"
+#include "rate_limiter.hpp"
 #include "openperf.grpc.pb.h"
 
 #include <grpcpp/grpcpp.h>
 
 /**
- * gRPC implementation of the OpenPerf service.
- * 
+ * gRPC implementation of the OpenPerf service (synchronous API).
+ *
+ * Every call occupies a gRPC thread for its whole duration. See
+ * AsyncOpenPerfServer for the completion-queue based alternative.
+ *
  * This is one concrete implementation of the IPC layer. The core Engine is
- * transport-agnostic, allowing alternative implementations such as:
- * - Unix domain sockets (for lower latency on same-machine IPC)
- * - Shared memory transport (for high-throughput scenarios)
- * - Named pipes (for Windows compatibility)
+ * transport-agnostic; core also provides Unix domain socket and shared-memory
+ * endpoints for lower-latency same-machine IPC.
  * 
  * See core/include/openperf/ipc_endpoint.hpp for the abstract interface.
  */
 class OpenPerfServiceImpl final : public openperf_rpc::OpenPerfService::Service {
 public:
     explicit OpenPerfServiceImpl(openperf::Engine& engine);
+    OpenPerfServiceImpl(openperf::Engine& engine, TreeLimits limits);
+    OpenPerfServiceImpl(openperf::Engine& engine, TreeLimits limits, RateLimiter::Options rateLimit);
 
     ::grpc::Status SubmitPage(::grpc::ServerContext* context,
                               const openperf_rpc::SubmitPageRequest* request,
                               openperf_rpc::SubmitPageResponse* response) override;
 
+    // Parses the HTML chunk by chunk as it arrives and stores the page.
+    ::grpc::Status SubmitHtml(::grpc::ServerContext* context,
+                              ::grpc::ServerReader<openperf_rpc::HtmlChunk>* reader,
+                              openperf_rpc::SubmitHtmlResponse* response) override;
+
+    ::grpc::Status PatchPage(::grpc::ServerContext* context,
+                             const openperf_rpc::PatchPageRequest* request,
+                             openperf_rpc::PatchPageResponse* response) override;
+
     ::grpc::Status RunRenderPipeline(::grpc::ServerContext* context,
                                      const openperf_rpc::RunRenderRequest* request,
                                      openperf_rpc::RunRenderResponse* response) override;
@@ -33,16 +47,33 @@ public:
                                         const openperf_rpc::AnalyzeAccessibilityRequest* request,
                                         openperf_rpc::AnalyzeAccessibilityResponse* response) override;
 
+    // Batch variants: the pages are looked up and stored together and
+    // processed in parallel on the engine's scheduler. Each item carries
+    // its own status; the call itself only fails for a malformed request.
+    ::grpc::Status SubmitPages(::grpc::ServerContext* context,
+                               const openperf_rpc::SubmitPagesRequest* request,
+                               openperf_rpc::SubmitPagesResponse* response) override;
+
+    ::grpc::Status RunRenderBatch(::grpc::ServerContext* context,
+                                  const openperf_rpc::RunRenderBatchRequest* request,
+                                  openperf_rpc::RunRenderBatchResponse* response) override;
+
+    ::grpc::Status AnalyzeAccessibilityBatch(::grpc::ServerContext* context,
+                                             const openperf_rpc::AnalyzeAccessibilityBatchRequest* request,
+                                             openperf_rpc::AnalyzeAccessibilityBatchResponse* response) override;
+
     ::grpc::Status GetMetrics(::grpc::ServerContext* context,
                               const openperf_rpc::GetMetricsRequest* request,
                               openperf_rpc::GetMetricsResponse* response) override;
 
+    // Pushes new samples every interval; coalesces into per-metric aggregates
+    // when a batch exceeds the client's limit.
+    ::grpc::Status WatchMetrics(::grpc::ServerContext* context,
+                                const openperf_rpc::WatchMetricsRequest* request,
+                                ::grpc::ServerWriter<openperf_rpc::MetricsUpdate>* writer) override;
+
 private:
     openperf::Engine& engine_; // core engine stays in openperf namespace
-
-    // helpers to convert between proto and core types
-    openperf::Page fromProto(const openperf_rpc::Page& protoPage);
-    std::shared_ptr<openperf::Node> fromProto(const openperf_rpc::Node& protoNode);
-
-    std::string ensurePageId(openperf::Page& page);
+    TreeLimits limits_;        // for trees in SubmitPage, PatchPage and SubmitHtml
+    RateLimiter limiter_;      // checked before any other work of a call
 };
\ No newline at end of file
@@ -8,6 +8,9 @@ type MetricSample = {
   timestamp_unix_ms: string; // comes back as a string from gateway
 };
 
+// samples kept client-side for charting
+const MAX_SAMPLES = 2000;
+
 type A11yIssue = {
   code: string;
   message: string;
@@ -22,13 +25,19 @@ function App() {
   const [loadingIssues, setLoadingIssues] = useState(false);
   const [submittingPage, setSubmittingPage] = useState(false);
 
-  // Poll /metrics every 3s
+  // Poll /metrics every 3s, fetching only samples newer than the last cursor
   useEffect(() => {
+    let cursor = '0';
+
     async function fetchMetrics() {
       try {
-        const res = await fetch('http://localhost:3000/metrics');
+        const res = await fetch(`http://localhost:3000/metrics?since=${cursor}`);
         const json = await res.json();
-        setMetrics(json.samples ?? []);
+        cursor = json.nextCursor ?? cursor;
+        const fresh: MetricSample[] = json.samples ?? [];
+        if (fresh.length > 0) {
+          setMetrics((prev) => [...prev, ...fresh].slice(-MAX_SAMPLES));
+        }
       } catch (e) {
         console.error('Failed to fetch metrics', e);
       }
@@ -44,6 +53,7 @@ function App() {
     if (!pageId) return;
     setLoadingIssues(true);
     try {
+      // the gateway runs this route in the daemon's interactive lane
       const res = await fetch(`http://localhost:3000/pages/${pageId}/a11y`);
       const json = await res.json();
       setIssues(json.issues ?? []);
@@ -25,6 +25,22 @@ const protoDescriptor = grpc.loadPackageDefinition(
 const OpenPerfService = protoDescriptor.openperf_rpc.OpenPerfService;
 
 // Types for our JSON API
+export interface StylePayload {
+  display?: "auto" | "block" | "inline" | "flex" | "none";
+  position?: "static" | "absolute";
+  flexDirection?: "row" | "column";
+  width?: number;  // px; omitted is auto
+  height?: number;
+  left?: number;
+  top?: number;
+  margin?: number;
+  padding?: number;
+  flexGrow?: number;
+  background?: string;   // "#rrggbb" or "#rrggbbaa"
+  borderColor?: string;
+  borderWidth?: number;
+}
+
 export interface NodePayload {
   id?: string;
   tag: string;
@@ -32,6 +48,7 @@ export interface NodePayload {
   role?: string;
   ariaLabel?: string;
   isInteractive?: boolean;
+  style?: StylePayload;
   children?: NodePayload[];
 }
 
@@ -41,6 +58,17 @@ export interface PagePayload {
   root: NodePayload;
 }
 
+export interface MutationPayload {
+  kind: "insert" | "remove" | "update";
+  nodeId: string;      // the parent for insert, otherwise the node itself
+  position?: number;   // insert: child index; appends when omitted
+  node?: NodePayload;  // insert: the new subtree; update: the new attributes
+}
+
+export interface PatchPayload {
+  mutations: MutationPayload[];
+}
+
 // dreate a client instance
 export function createOpenPerfClient(
   address: string = "localhost:50051"
@@ -1,15 +1,89 @@
 import express from "express";
 import * as grpc from "@grpc/grpc-js";
-import { createOpenPerfClient, PagePayload } from "./client";
+import { createOpenPerfClient, PagePayload, PatchPayload } from "./client";
 
 const PORT = process.env.PORT || 3000;
 const GRPC_ADDRESS = process.env.OPENPERF_GRPC_ADDRESS || "localhost:50051";
 
 const app = express();
-app.use(express.json());
+// Express's "trust proxy" value (e.g. "loopback" or a hop count) when the
+// gateway sits behind a proxy, so req.ip is the caller's address
+if (process.env.OPENPERF_TRUST_PROXY) app.set("trust proxy", process.env.OPENPERF_TRUST_PROXY);
+app.use(express.json({ limit: "64mb" })); // batches of pages; the daemon accepts up to 64 MiB
 
 const client = createOpenPerfClient(GRPC_ADDRESS);
 
+// The daemon rate-limits per client, and every request arrives from this
+// gateway, so pass on who is calling: their address, which the caller
+// cannot pick the way it could a header. The daemon only honours the id
+// when this gateway is one of its --trusted-gateway addresses.
+//
+// Each route picks the daemon queue its calls wait in: "normal", or
+// "interactive" for the dashboard's own requests. A caller may step down to
+// "batch" with the x-priority header or ?priority=, never up.
+type Lane = "interactive" | "normal";
+
+function callerMetadata(req: express.Request, lane: Lane = "normal"): grpc.Metadata {
+  const metadata = new grpc.Metadata();
+  metadata.set("x-client-id", req.ip ?? req.socket.remoteAddress ?? "gateway");
+  const asked = req.get("x-priority") ?? req.query.priority;
+  metadata.set("x-priority", asked === "batch" ? "batch" : lane);
+  return metadata;
+}
+
+// Every call but the metrics stream carries a gRPC deadline, so the daemon
+// drops work whose HTTP request has timed out instead of running it.
+const REQUEST_TIMEOUT_MS = Number(process.env.OPENPERF_REQUEST_TIMEOUT_MS) || 30000;
+
+function callOptions(): grpc.CallOptions {
+  return { deadline: new Date(Date.now() + REQUEST_TIMEOUT_MS) };
+}
+
+// gRPC error -> HTTP status; RESOURCE_EXHAUSTED is the daemon shedding load
+function httpStatus(err: grpc.ServiceError): number {
+  switch (err.code) {
+    case grpc.status.INVALID_ARGUMENT:
+      return 400;
+    case grpc.status.NOT_FOUND:
+      return 404;
+    case grpc.status.RESOURCE_EXHAUSTED:
+      return 429;
+    case grpc.status.DEADLINE_EXCEEDED:
+      return 504;
+    default:
+      return 500;
+  }
+}
+
+// "#rgb", "#rrggbb" or "#rrggbbaa" -> 0xRRGGBBAA; anything else is transparent
+function parseColor(color: any): number {
+  if (typeof color !== "string" || !color.startsWith("#")) return 0;
+  let hex = color.slice(1);
+  if (hex.length === 3) hex = hex.split("").map((c) => c + c).join("");
+  if (hex.length === 6) hex += "ff";
+  const value = parseInt(hex, 16);
+  return hex.length === 8 && !Number.isNaN(value) ? value >>> 0 : 0;
+}
+
+// convert JSON StylePayload into proto shape; unset width/height stay auto
+function toProtoStyle(style: any): any {
+  return {
+    display: "DISPLAY_" + String(style.display ?? "auto").toUpperCase(),
+    position: "POSITION_" + String(style.position ?? "static").toUpperCase(),
+    flex_direction: "FLEX_" + String(style.flexDirection ?? "row").toUpperCase(),
+    width: style.width,
+    height: style.height,
+    left: style.left ?? 0,
+    top: style.top ?? 0,
+    margin: style.margin ?? 0,
+    padding: style.padding ?? 0,
+    flex_grow: style.flexGrow ?? 0,
+    background: parseColor(style.background),
+    border_color: parseColor(style.borderColor),
+    border_width: style.borderWidth ?? 0,
+  };
+}
+
 // convert JSON NodePayload into proto shape
 function toProtoNode(node: any): any {
   return {
@@ -19,6 +93,7 @@ function toProtoNode(node: any): any {
     role: node.role ?? "",
     aria_label: node.ariaLabel ?? "",
     is_interactive: node.isInteractive ?? false,
+    style: node.style ? toProtoStyle(node.style) : undefined,
     children: (node.children ?? []).map(toProtoNode),
   };
 }
@@ -39,10 +114,12 @@ app.post("/pages", (req, res) => {
 
   client.SubmitPage(
     { page: pageMessage },
+    callerMetadata(req),
+    callOptions(),
     (err: grpc.ServiceError | null, response: any) => {
       if (err) {
         console.error("SubmitPage error:", err);
-        return res.status(500).json({ error: err.message });
+        return res.status(httpStatus(err)).json({ error: err.message });
       }
       if (!response) {
         console.error("SubmitPage: received null/undefined response");
@@ -61,45 +138,243 @@ app.post("/pages", (req, res) => {
   );
 });
 
-// POST /pages/:id/render -> RunRenderPipeline
+// POST /pages/html[?id=...&url=...] -> SubmitHtml
+// The body is the raw HTML (any content type but JSON). It is streamed to the
+// daemon as it arrives, which parses it chunk by chunk, so neither side
+// buffers the whole page.
+app.post("/pages/html", (req, res) => {
+  if (req.is("application/json")) {
+    return res.status(400).json({ error: "Send the page as raw HTML, not JSON" });
+  }
+
+  const call = client.SubmitHtml(callerMetadata(req), callOptions(), (err: grpc.ServiceError | null, response: any) => {
+    if (err) {
+      console.error("SubmitHtml error:", err);
+      return res.status(httpStatus(err)).json({ error: err.message });
+    }
+    return res.json({ pageId: response.page_id, nodes: Number(response.nodes), bytes: Number(response.bytes) });
+  });
+
+  // page id and url go with the first chunk only
+  let header: any = { page_id: String(req.query.id ?? ""), url: String(req.query.url ?? "") };
+  const send = (chunk: any) => {
+    const ok = call.write({ ...header, ...chunk });
+    header = {};
+    return ok;
+  };
+
+  req.on("data", (data: Buffer) => {
+    if (!send({ data })) {
+      req.pause();
+      call.once("drain", () => req.resume());
+    }
+  });
+  req.on("end", () => {
+    send({ data: Buffer.alloc(0), last: true });
+    call.end();
+  });
+  req.on("aborted", () => call.cancel());
+});
+
+const MUTATION_KINDS: Record<string, string> = {
+  insert: "MUTATION_INSERT",
+  remove: "MUTATION_REMOVE",
+  update: "MUTATION_UPDATE",
+};
+
+// PATCH /pages/:id -> PatchPage
+// Body: { mutations: [{ kind, nodeId, position?, node? }] }, applied in order, all or nothing.
+app.patch("/pages/:id", (req, res) => {
+  const body: PatchPayload = req.body;
+  if (!body || !Array.isArray(body.mutations)) {
+    return res.status(400).json({ error: "Missing mutations in body" });
+  }
+  if (body.mutations.some((m) => !MUTATION_KINDS[m.kind])) {
+    return res.status(400).json({ error: "Mutation kind must be insert, remove or update" });
+  }
+
+  const mutations = body.mutations.map((m) => ({
+    kind: MUTATION_KINDS[m.kind],
+    node_id: m.nodeId ?? "",
+    position: m.position ?? -1,
+    node: m.node ? toProtoNode(m.node) : undefined,
+  }));
+
+  client.PatchPage(
+    { page_id: req.params.id, mutations },
+    callerMetadata(req),
+    callOptions(),
+    (err: grpc.ServiceError | null, response: any) => {
+      if (err) {
+        console.error("PatchPage error:", err);
+        return res.status(httpStatus(err)).json({ error: err.message });
+      }
+      return res.json({ changedNodes: Number(response.changed_nodes) });
+    }
+  );
+});
+
+// POST /pages/:id/render[?wait=1] -> RunRenderPipeline
+// With wait=1 the response is sent once the render has finished and carries its stage timings.
 app.post("/pages/:id/render", (req, res) => {
   const pageId = req.params.id;
+  const wait = req.query.wait === "1" || req.query.wait === "true";
   client.RunRenderPipeline(
-    { page_id: pageId },
+    { page_id: pageId, wait_for_completion: wait },
+    callerMetadata(req),
+    callOptions(),
     (err: grpc.ServiceError | null, response: any) => {
       if (err) {
         console.error("RunRenderPipeline error:", err);
-        return res.status(500).json({ error: err.message });
+        return res.status(httpStatus(err)).json({ error: err.message });
       }
-      return res.json({ status: "ok" });
+      if (!wait) return res.json({ status: "ok" });
+      return res.json({ status: "ok", stages: response.stages, totalMs: response.total_ms });
     }
   );
 });
 
 // GET /pages/:id/a11y -> AnalyzeAccessibility
+// The dashboard shows the result to someone waiting, so it goes ahead of bulk work.
 app.get("/pages/:id/a11y", (req, res) => {
   const pageId = req.params.id;
   client.AnalyzeAccessibility(
     { page_id: pageId },
+    callerMetadata(req, "interactive"),
+    callOptions(),
     (err: grpc.ServiceError | null, response: any) => {
       if (err) {
         console.error("AnalyzeAccessibility error:", err);
-        return res.status(500).json({ error: err.message });
+        return res.status(httpStatus(err)).json({ error: err.message });
       }
       return res.json({ issues: response.issues });
     }
   );
 });
 
-// GET /metrics -> GetMetrics
-app.get("/metrics", (_req, res) => {
-  client.GetMetrics({}, (err: grpc.ServiceError | null, response: any) => {
+// per-item status of a batch response -> { error } or nothing
+function itemError(status: any): { error?: string } {
+  return status && status.code ? { error: status.message } : {};
+}
+
+function pageIdList(body: any): string[] | null {
+  const ids = body?.pageIds;
+  return Array.isArray(ids) && ids.every((id: any) => typeof id === "string") ? ids : null;
+}
+
+// POST /batch/pages -> SubmitPages
+// Body: { pages: [PagePayload] }. Results are in request order; a page that
+// fails carries its own error instead of failing the batch.
+app.post("/batch/pages", (req, res) => {
+  const pages: PagePayload[] = req.body?.pages;
+  if (!Array.isArray(pages) || pages.some((p) => !p || !p.url || !p.root)) {
+    return res.status(400).json({ error: "Body must be { pages: [{ url, root }] }" });
+  }
+
+  const request = {
+    pages: pages.map((p) => ({ id: p.id ?? "", url: p.url, root: toProtoNode(p.root) })),
+  };
+  client.SubmitPages(request, callerMetadata(req), callOptions(), (err: grpc.ServiceError | null, response: any) => {
+    if (err) {
+      console.error("SubmitPages error:", err);
+      return res.status(httpStatus(err)).json({ error: err.message });
+    }
+    return res.json({
+      results: response.results.map((r: any) => ({ pageId: r.page_id || undefined, ...itemError(r.status) })),
+    });
+  });
+});
+
+// POST /batch/render[?wait=1] -> RunRenderBatch
+// Body: { pageIds: [...] }. With wait=1 the response is sent once every render has finished.
+app.post("/batch/render", (req, res) => {
+  const pageIds = pageIdList(req.body);
+  if (!pageIds) return res.status(400).json({ error: "Body must be { pageIds: [string] }" });
+  const wait = req.query.wait === "1" || req.query.wait === "true";
+
+  client.RunRenderBatch(
+    { page_ids: pageIds, wait_for_completion: wait },
+    callerMetadata(req),
+    callOptions(),
+    (err: grpc.ServiceError | null, response: any) => {
+      if (err) {
+        console.error("RunRenderBatch error:", err);
+        return res.status(httpStatus(err)).json({ error: err.message });
+      }
+      if (!wait) return res.json({ status: "ok" });
+      return res.json({
+        results: response.results.map((r: any, i: number) => ({
+          pageId: pageIds[i],
+          ...itemError(r.status),
+          ...(r.render ? { stages: r.render.stages, totalMs: r.render.total_ms } : {}),
+        })),
+      });
+    }
+  );
+});
+
+// POST /batch/a11y -> AnalyzeAccessibilityBatch
+// Body: { pageIds: [...] }
+app.post("/batch/a11y", (req, res) => {
+  const pageIds = pageIdList(req.body);
+  if (!pageIds) return res.status(400).json({ error: "Body must be { pageIds: [string] }" });
+
+  client.AnalyzeAccessibilityBatch(
+    { page_ids: pageIds },
+    callerMetadata(req),
+    callOptions(),
+    (err: grpc.ServiceError | null, response: any) => {
+      if (err) {
+        console.error("AnalyzeAccessibilityBatch error:", err);
+        return res.status(httpStatus(err)).json({ error: err.message });
+      }
+      return res.json({
+        results: response.results.map((r: any, i: number) => ({
+          pageId: pageIds[i],
+          ...itemError(r.status),
+          issues: r.issues,
+        })),
+      });
+    }
+  );
+});
+
+// GET /metrics?since=<cursor> -> GetMetrics
+// Pass back `nextCursor` from the previous response to receive only newer samples.
+app.get("/metrics", (req, res) => {
+  const since = typeof req.query.since === "string" ? req.query.since : "0";
+  client.GetMetrics({ since }, callerMetadata(req), callOptions(), (err: grpc.ServiceError | null, response: any) => {
     if (err) {
       console.error("GetMetrics error:", err);
-      return res.status(500).json({ error: err.message });
+      return res.status(httpStatus(err)).json({ error: err.message });
     }
-    return res.json({ samples: response.samples });
+    return res.json({
+      samples: response.samples,
+      summaries: response.summaries,
+      nextCursor: response.next_cursor,
+      missed: response.missed,
+    });
+  });
+});
+
+// GET /metrics/stream?since=<cursor> -> WatchMetrics, as server-sent events
+app.get("/metrics/stream", (req, res) => {
+  const since = typeof req.query.since === "string" ? req.query.since : "0";
+  res.setHeader("Content-Type", "text/event-stream");
+  res.setHeader("Cache-Control", "no-cache");
+  res.setHeader("Connection", "keep-alive");
+  res.flushHeaders();
+
+  const call = client.WatchMetrics({ since, interval_ms: 1000, max_batch_samples: 500 }, callerMetadata(req));
+  call.on("data", (update: any) => {
+    res.write(`data: ${JSON.stringify(update)}\n\n`);
+  });
+  call.on("error", (err: grpc.ServiceError) => {
+    if (err.code !== grpc.status.CANCELLED) console.error("WatchMetrics error:", err);
+    res.end();
   });
+  call.on("end", () => res.end());
+  req.on("close", () => call.cancel());
 });
 
 app.listen(PORT, () => {
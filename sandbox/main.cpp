@@ -26,7 +26,7 @@ int main() {
     auto pageId = engine.submitPage(std::move(page));
 
     // kick off render pipeline
-    engine.runRenderPipeline(pageId);
+    auto render = engine.render(pageId);
 
     // run accessibility analysis
     auto issues = engine.analyzeAccessibility(pageId);
@@ -37,7 +37,13 @@ int main() {
 
     }
 
-    // fetch some metrics. (later: wait or poll)
+    // the render's metrics are recorded by the time it reports
+    const auto& rendered = render.wait();
+    std::println("Render of {}: queued {} us, ran {} us", rendered.pageId,
+                 std::chrono::duration_cast<std::chrono::microseconds>(rendered.queueWait()).count(),
+                 std::chrono::duration_cast<std::chrono::microseconds>(rendered.runTime()).count());
+
+    // fetch some metrics
     auto samples = engine.getMetrics();
     std::println("Metrics collected:");
     for (const auto& s : samples) {